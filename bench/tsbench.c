@@ -0,0 +1,1385 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: tsbench.c
+ * funx: micro benchmark of tstools libraries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h> /* for uint?_t, etc */
+#include <string.h> /* for strcmp, etc */
+#include <sys/time.h> /* for gettimeofday */
+#include <unistd.h> /* for close, unlink, rmdir */
+#include <pthread.h> /* for pthread_create, pthread_join */
+
+#include "tstool_config.h"
+#include "common.h"
+#include "buddy.h"
+#include "ts.h"
+#include "tsgen.h"
+
+#define BUF_SIZE (4096 + 64)
+#define MP_ORDER (24) /* memory pool for ts_obj: 16MB */
+#define BATCH_NUM (256) /* packet number of each ts_parse_batch() */
+#define THREAD_MAX (4) /* max thread number of buddy case */
+#define LIVE_NUM (64) /* live block number of each thread in buddy case */
+#define TRACE_MIN (4096) /* initial op number of trace case */
+
+/* one op of malloc trace, slot is the index of live block */
+struct trace_op
+{
+        uint32_t slot;
+        uint32_t size; /* 0 means free */
+};
+
+/* trace of buddy_malloc() and buddy_free() during parse */
+struct trace
+{
+        void **ptr; /* ptr of each op, map to slot later */
+        struct trace_op *op;
+        size_t cnt;
+        size_t size; /* malloced op number */
+};
+
+/* whole PES packets of one PID, one after another */
+struct pes_out
+{
+        uint8_t *buf;
+        size_t len; /* bytes of complete PES */
+        size_t size;
+        size_t pes_len; /* for regroup: bytes of PES in collecting, after len */
+        int is_sync; /* for regroup: collecting a PES from its head */
+};
+
+/* for pes_rec(), PES of one ts_parse_batch() call */
+struct pes_batch
+{
+        struct pes_out *out; /* out[0x2000] */
+        struct {
+                const struct ts_pes *pes;
+                const uint8_t *buf;
+                int len;
+        } rec[BATCH_NUM];
+        size_t cnt;
+        size_t total; /* PES number of all call */
+};
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+static int loops = 20000; /* call number of each case */
+static char *file_i = NULL;
+static char *bin_dir = "."; /* build dir of the tools, for pipe case */
+static struct tsgen_cfg gen; /* synthetic stream, if no file */
+static int gen_num = 100000; /* packet number of synthetic stream */
+static volatile uint32_t sink; /* keep the loops */
+
+static int deal_with_parameter(int argc, char *argv[]);
+static int get_int(int argc, char *argv[], int *i, int min, int *dat);
+static void show_help();
+static void show_version();
+static double now_us(void);
+static int bench_crc(void);
+static int bench_gen(void);
+static int bench_parse(void);
+static void alloc_cnt(void *arg, void *ptr, size_t size);
+static int bench_pipe(void);
+static int save_tmp(char *name, const uint8_t *buf, size_t num);
+static int bench_pes(void);
+static int pes_check(const char *name, const uint8_t *buf, size_t num);
+static int pes_regroup(const uint8_t *buf, size_t num, struct pes_out *out);
+static int pes_whole(const uint8_t *buf, size_t num, struct pes_out *out, size_t *total);
+static void pes_rec(void *arg, const struct ts_pes *pes);
+static int pes_tsana(const uint8_t *buf, size_t num, const struct pes_out *out);
+static int pes_add(struct pes_out *o, const uint8_t *buf, size_t len);
+static int bench_stc(void);
+static int bench_buddy(void);
+static void *buddy_thread(void *arg);
+static int bench_trace(void);
+static void trace_rec(void *arg, void *ptr, size_t size);
+static size_t trace_slot(struct trace *t);
+static uint8_t *load_file(size_t *num);
+static uint64_t rand64(void);
+static uint32_t crc_bit(void *buf, size_t size, int mode);
+
+int main(int argc, char *argv[])
+{
+        tsgen_default(&gen);
+        if(0 != deal_with_parameter(argc, argv)) {
+                return -1;
+        }
+
+        if(0 == strcmp(argv[1], "crc")) {
+                return bench_crc();
+        }
+        if(0 == strcmp(argv[1], "gen")) {
+                return bench_gen();
+        }
+        if(0 == strcmp(argv[1], "parse")) {
+                return bench_parse();
+        }
+        if(0 == strcmp(argv[1], "pipe")) {
+                return bench_pipe();
+        }
+        if(0 == strcmp(argv[1], "pes")) {
+                return bench_pes();
+        }
+        if(0 == strcmp(argv[1], "stc")) {
+                return bench_stc();
+        }
+        if(0 == strcmp(argv[1], "buddy")) {
+                return bench_buddy();
+        }
+        if(0 == strcmp(argv[1], "trace")) {
+                return bench_trace();
+        }
+
+        RPTERR("unknown case: %s", argv[1]);
+        return -1;
+}
+
+static int deal_with_parameter(int argc, char *argv[])
+{
+        int i;
+        int dat;
+
+        if(1 == argc) {
+                /* no parameter */
+                show_help();
+                return -1;
+        }
+
+        for(i = 1; i < argc; i++) {
+                if('-' == argv[i][0]) {
+                        if(0 == strcmp(argv[i], "-n")) {
+                                i++;
+                                if(i >= argc) {
+                                        RPTERR("no parameter for 'n'");
+                                        return -1;
+                                }
+                                dat = atoi(argv[i]);
+                                if(dat <= 0) {
+                                        RPTERR("bad loop number: %s", argv[i]);
+                                        return -1;
+                                }
+                                loops = dat;
+                        }
+                        else if(0 == strcmp(argv[i], "-prog")) {
+                                if(0 != get_int(argc, argv, &i, 1, &(gen.prog_cnt))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-es")) {
+                                if(0 != get_int(argc, argv, &i, 1, &(gen.es_cnt))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-rate")) {
+                                if(0 != get_int(argc, argv, &i, 1, &(gen.rate))) {
+                                        return -1;
+                                }
+                                gen.rate *= 1000; /* kbit/s -> bit/s */
+                        }
+                        else if(0 == strcmp(argv[i], "-pcr")) {
+                                if(0 != get_int(argc, argv, &i, 1, &(gen.pcr_ms))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-pes")) {
+                                if(0 != get_int(argc, argv, &i, 1, &(gen.pes_size))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-sect")) {
+                                if(0 != get_int(argc, argv, &i, 0, &(gen.sect_size))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-ccerr")) {
+                                if(0 != get_int(argc, argv, &i, 0, &(gen.cc_err))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-pcrerr")) {
+                                if(0 != get_int(argc, argv, &i, 0, &(gen.pcr_err))) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-seed")) {
+                                if(0 != get_int(argc, argv, &i, 0, &dat)) {
+                                        return -1;
+                                }
+                                gen.seed = (uint32_t)dat;
+                        }
+                        else if(0 == strcmp(argv[i], "-num")) {
+                                if(0 != get_int(argc, argv, &i, 1, &gen_num)) {
+                                        return -1;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-bin")) {
+                                i++;
+                                if(i >= argc) {
+                                        RPTERR("no parameter for 'bin'");
+                                        return -1;
+                                }
+                                bin_dir = argv[i];
+                        }
+                        else if(0 == strcmp(argv[i], "-h") ||
+                                0 == strcmp(argv[i], "--help")) {
+                                show_help();
+                                return -1;
+                        }
+                        else if(0 == strcmp(argv[i], "-v") ||
+                                0 == strcmp(argv[i], "--version")) {
+                                show_version();
+                                return -1;
+                        }
+                        else {
+                                RPTERR("wrong parameter: %s", argv[i]);
+                                return -1;
+                        }
+                }
+                else if(1 == i) {
+                        /* case */
+                }
+                else if(NULL == file_i) {
+                        file_i = argv[i];
+                }
+                else {
+                        RPTERR("wrong parameter: %s", argv[i]);
+                        return -1;
+                }
+        }
+
+        if('-' == argv[1][0]) {
+                RPTERR("no case, see \"tsbench -h\"");
+                return -1;
+        }
+        return 0;
+}
+
+/* the number after argv[*i] */
+static int get_int(int argc, char *argv[], int *i, int min, int *dat)
+{
+        char *end;
+        long n;
+
+        if(*i + 1 >= argc) {
+                RPTERR("no parameter for '%s'", argv[*i] + 1);
+                return -1;
+        }
+        (*i)++;
+        n = strtol(argv[*i], &end, 0);
+        if('\0' != *end || n < min || n > INT32_MAX) {
+                RPTERR("bad parameter for '%s': %s", argv[*i - 1] + 1, argv[*i]);
+                return -1;
+        }
+        *dat = (int)n;
+        return 0;
+}
+
+static void show_help()
+{
+        fprintf(stdout,
+                "'tsbench' time the hot functions of tstools libraries.\n"
+                "\n"
+                "Usage: tsbench CASE [OPTION] [file]\n"
+                "\n"
+                "Without file, parse, trace, pipe and pes use the synthetic stream of tsgen.\n"
+                "\n"
+                "Cases:\n"
+                "\n"
+                " crc              ts_crc() vs. the old bit loop, check result first\n"
+                " gen              write the synthetic stream to file\n"
+                " parse            ts_parse_batch() with some ts_cfg, pkt/s, ns/pkt and alloc/pkt\n"
+                " pipe             run catts, tsana and tobin once on the stream, pkt/s and ns/pkt\n"
+                "                  of each pipeline, check the round trip of catts|tsana|tobin\n"
+                " pes              check whole PES of ts_parse_batch() and \"tsana -demux -pes\"\n"
+                "                  with the PES fragments of each packet, on bounded, unbounded\n"
+                "                  and CC lost PES of tsgen, or on TS file without sync lost\n"
+                " stc              ts_slope_mul() vs. the old long double STC calc\n"
+                " buddy            buddy_malloc()/buddy_free() by 1-%d threads on one pool\n"
+                " trace            replay malloc/free trace of ts_parse_batch() on TS file,\n"
+                "                  buddy vs. libc\n"
+                "\n"
+                "Options:\n"
+                "\n"
+                " -n <n>           call number of each case, default: 20000\n"
+                " -bin <dir>       build dir of catts, tsana and tobin, default: .\n"
+                "\n"
+                "Synthetic stream:\n"
+                "\n"
+                " -num <n>         packet number, default: 100000\n"
+                " -prog <n>        program number, 1-%d, default: 4\n"
+                " -es <n>          ES number of each program, 1-%d, default: 3\n"
+                " -rate <kbps>     mux bitrate for packet time, default: 40000\n"
+                " -pcr <ms>        PCR interval, default: 30\n"
+                " -pes <n>         PES payload size, default: 8000\n"
+                " -sect <n>        min SDT section size, up to 1021, default: 400\n"
+                " -ccerr <n>       skip one CC every n packets, default: 0(none)\n"
+                " -pcrerr <n>      PCR jumps 1ms every n PCR, default: 0(none)\n"
+                " -seed <n>        seed of ES payload, default: 1\n"
+                "\n"
+                " -h, --help       print this information only\n"
+                " -v, --version    print my version only\n"
+                "\n"
+                "Examples:\n"
+                "  tsbench crc -n 100000\n"
+                "  tsbench parse xxx.ts\n"
+                "  tsbench parse -prog 32 -pcr 20\n"
+                "  tsbench trace xxx.ts -n 100\n"
+                "  tsbench gen -ccerr 10000 -pcrerr 50 err.ts\n"
+                "  tsbench pipe -num 500000\n"
+                "  tsbench pes -bin .\n"
+                "\n"
+                "Report bugs to <zhoucheng@tsinghua.org.cn>.\n",
+                THREAD_MAX, TSGEN_PROG_MAX, TSGEN_ES_MAX);
+        return;
+}
+
+static void show_version()
+{
+        fprintf(stdout,
+                "tsbench of tstools v%s (%s)\n"
+                "Build time: %s %s\n"
+                "\n"
+                "Copyright (C) 2009,2010,2011,2012 ZHOU Cheng.\n"
+                "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>\n"
+                "This is free software; contact author for additional information.\n"
+                "There is NO warranty; not even for MERCHANTABILITY or FITNESS FOR\n"
+                "A PARTICULAR PURPOSE.\n"
+                "\n"
+                "Written by ZHOU Cheng.\n",
+                VERSION_STR, REVISION, __DATE__, __TIME__);
+        return;
+}
+
+static double now_us(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (double)tv.tv_sec * 1e6 + (double)tv.tv_usec;
+}
+
+static int bench_crc(void)
+{
+        static uint8_t buf[BUF_SIZE];
+        static const int mode[] = {8, 16, 32};
+        static const size_t size[] = {16, 188, 1024, 4096}; /* short, TS, PSI, private */
+        size_t i;
+        size_t m;
+        size_t s;
+        int n;
+        int bit_loops;
+        uint32_t sum;
+        double t0;
+        double t_bit;
+        double t_tab;
+
+        srand(1);
+        for(i = 0; i < BUF_SIZE; i++) {
+                buf[i] = (uint8_t)rand();
+        }
+
+        /* check: every length and offset, against the bit loop */
+        for(m = 0; m < sizeof(mode) / sizeof(mode[0]); m++) {
+                for(i = 0; i <= 4096; i += ((i < 300) ? 1 : 37)) {
+                        uint8_t *p = buf + (i & 0x0F);
+
+                        if(crc_bit(p, i, mode[m]) != ts_crc(p, i, mode[m])) {
+                                RPTERR("CRC-%d mismatch, size %zu", mode[m], i);
+                                return -1;
+                        }
+                }
+        }
+        fprintf(stdout, "check: OK\n");
+
+        fprintf(stdout, "mode,  size,  bit(MB/s),  ts_crc(MB/s),  speedup\n");
+        sum = 0;
+        for(m = 0; m < sizeof(mode) / sizeof(mode[0]); m++) {
+                for(s = 0; s < sizeof(size) / sizeof(size[0]); s++) {
+                        bit_loops = loops / 20 + 1; /* bit loop is too slow */
+
+                        t0 = now_us();
+                        for(n = 0; n < bit_loops; n++) {
+                                sum += crc_bit(buf + (n & 0x0F), size[s], mode[m]);
+                        }
+                        t_bit = (now_us() - t0) / bit_loops;
+
+                        t0 = now_us();
+                        for(n = 0; n < loops; n++) {
+                                sum += ts_crc(buf + (n & 0x0F), size[s], mode[m]);
+                        }
+                        t_tab = (now_us() - t0) / loops;
+
+                        fprintf(stdout, "%4d, %5zu, %10.1f, %13.1f, %7.1f\n",
+                                mode[m], size[s],
+                                size[s] / t_bit, size[s] / t_tab, t_bit / t_tab);
+                }
+        }
+        sink = sum;
+        return 0;
+}
+
+static int bench_gen(void)
+{
+        FILE *fd;
+        uint8_t *buf;
+        size_t num;
+
+        if(NULL == file_i) {
+                RPTERR("no output file, see \"tsbench -h\"");
+                return -1;
+        }
+        num = (size_t)gen_num;
+        buf = tsgen(&gen, num);
+        if(NULL == buf) {
+                return -1;
+        }
+        fd = fopen(file_i, "wb");
+        if(NULL == fd) {
+                RPTERR("open \"%s\" failed", file_i);
+                free(buf);
+                return -1;
+        }
+        if(1 != fwrite(buf, num * TS_PKT_SIZE, 1, fd)) {
+                RPTERR("write \"%s\" failed", file_i);
+                fclose(fd);
+                free(buf);
+                return -1;
+        }
+        fclose(fd);
+        free(buf);
+
+        fprintf(stdout, "%zu packets to %s\n", num, file_i);
+        return 0;
+}
+
+static int bench_parse(void)
+{
+        static const struct {
+                const char *name;
+                struct ts_cfg cfg;
+        } preset[] = {
+                /*       cc af tm psi si pes align stat pkt */
+                {"pkt",  {1, 1, 1, 1, 1, 1, 1, 1, 1}}, /* all with whole PES */
+                {"all",  {1, 1, 1, 1, 1, 1, 1, 1, 0}},
+                {"rate", {0, 1, 1, 1, 1, 0, 0, 1, 0}}, /* like tsana -rate */
+                {"cc",   {1, 0, 0, 1, 0, 0, 0, 0, 0}}, /* PSI for prog, then CC */
+                {"none", {0, 0, 0, 0, 0, 0, 0, 0, 0}}, /* TS head only */
+        };
+        static struct ts_evt evt[BATCH_NUM];
+        uint8_t *buf;
+        size_t num;
+        size_t i;
+        size_t p;
+        size_t n;
+        size_t acnt;
+        double t0;
+        double us;
+
+        buf = load_file(&num);
+        if(NULL == buf) {
+                return -1;
+        }
+
+        fprintf(stdout, "cfg,    pkt/s,  Mbit/s,  ns/pkt,  alloc/pkt\n");
+        for(i = 0; i < sizeof(preset) / sizeof(preset[0]); i++) {
+                void *mp;
+                struct ts_obj *ts;
+
+                mp = buddy_create(MP_ORDER, 6);
+                buddy_init(mp);
+                acnt = 0;
+                buddy_trace(mp, alloc_cnt, &acnt); /* one add for each malloc */
+                ts = ts_create(mp);
+                if(NULL == ts) {
+                        buddy_destroy(mp);
+                        free(buf);
+                        return -1;
+                }
+                ts_ioctl(ts, TS_SCFG, (void *)&(preset[i].cfg));
+
+                t0 = now_us();
+                for(p = 0; p < num; p += n) {
+                        n = ((num - p) < BATCH_NUM) ? (num - p) : BATCH_NUM;
+                        n = (size_t)ts_parse_batch(ts, buf + p * TS_PKT_SIZE, n, TS_PKT_SIZE, evt);
+                }
+                us = now_us() - t0;
+
+                fprintf(stdout, "%4s, %9.0f, %7.1f, %7.1f, %10.4f\n", preset[i].name,
+                        num / us * 1e6, num * TS_PKT_SIZE * 8 / us,
+                        us * 1e3 / num, (double)acnt / num);
+                ts_destroy(ts);
+                buddy_destroy(mp);
+        }
+        free(buf);
+        return 0;
+}
+
+/* callback of buddy_trace(), count malloc only */
+static void alloc_cnt(void *arg, void *ptr, size_t size)
+{
+        if(0 != size) {
+                (*(size_t *)arg)++;
+        }
+        return;
+}
+
+/* wall time of the tools on the stream, one run each */
+static int bench_pipe(void)
+{
+        static const struct {
+                const char *name;
+                const char *cmd; /* 1: bin_dir, 2: TS file */
+        } pipe[] = {
+                {"catts",             "%1$s/catts/catts %2$s > /dev/null"},
+                {"catts -b",          "%1$s/catts/catts -b %2$s > /dev/null"},
+                {"tsana -err",        "%1$s/tsana/tsana -err %2$s > /dev/null"},
+                {"catts|tsana",       "%1$s/catts/catts %2$s | %1$s/tsana/tsana -err > /dev/null"},
+                {"catts -b|tsana",    "%1$s/catts/catts -b %2$s | %1$s/tsana/tsana -err > /dev/null"},
+                {"catts|tsana|tobin", "%1$s/catts/catts -b %2$s | %1$s/tsana/tsana -dump | %1$s/tobin/tobin %2$s.out"},
+        };
+        char name[] = "/tmp/tsbenchXXXXXX.ts";
+        char cmd[1024];
+        char *file;
+        uint8_t *buf;
+        size_t num;
+        size_t i;
+        int rslt = 0;
+        double t0;
+        double us;
+
+        buf = load_file(&num);
+        if(NULL == buf) {
+                return -1;
+        }
+        if(NULL != file_i) {
+                file = file_i;
+        }
+        else {
+                /* the tools read file only */
+                if(0 != save_tmp(name, buf, num)) {
+                        free(buf);
+                        return -1;
+                }
+                file = name;
+        }
+        free(buf);
+
+        fprintf(stdout, "pipe             ,      sec,      pkt/s,  ns/pkt\n");
+        for(i = 0; i < sizeof(pipe) / sizeof(pipe[0]); i++) {
+                snprintf(cmd, sizeof(cmd), pipe[i].cmd, bin_dir, file);
+                t0 = now_us();
+                if(0 != system(cmd)) {
+                        RPTERR("\"%s\" failed", cmd);
+                        rslt = -1;
+                        break;
+                }
+                us = now_us() - t0;
+                fprintf(stdout, "%-17s, %8.3f, %10.0f, %7.1f\n", pipe[i].name,
+                        us / 1e6, num / us * 1e6, us * 1e3 / num);
+        }
+
+        /* check: the round trip must keep every byte */
+        if(0 == rslt) {
+                snprintf(cmd, sizeof(cmd), "cmp -s %s %s.out", file, file);
+                rslt = ((0 == system(cmd)) ? 0 : -1);
+                fprintf(stdout, "check: %s\n", (0 == rslt) ? "OK" : "FAILED");
+        }
+
+        snprintf(cmd, sizeof(cmd), "%s.out", file);
+        unlink(cmd);
+        if(file == name) {
+                unlink(name);
+        }
+        return rslt;
+}
+
+/* buf[num] into temp file of name[], e.g. "/tmp/tsbenchXXXXXX.ts" */
+static int save_tmp(char *name, const uint8_t *buf, size_t num)
+{
+        int fd = mkstemps(name, 3);
+
+        if(fd < 0) {
+                RPTERR("create temp file failed");
+                return -1;
+        }
+        if((ssize_t)(num * TS_PKT_SIZE) != write(fd, buf, num * TS_PKT_SIZE)) {
+                RPTERR("write \"%s\" failed", name);
+                close(fd);
+                unlink(name);
+                return -1;
+        }
+        close(fd);
+        return 0;
+}
+
+/* whole PES reassembly on some stream, see pes_check() */
+static int bench_pes(void)
+{
+        static const struct {
+                const char *name;
+                int pes_size;
+                int cc_err;
+        } var[] = {
+                {"bounded",   1000,  0}, /* some PES of a PID in each batch */
+                {"unbounded", 70000, 0}, /* PES_packet_length is 0 */
+                {"cc lost",   1000,  997},
+        };
+        uint8_t *buf = NULL;
+        size_t num;
+        size_t i;
+        int rslt = 0;
+
+        if(NULL != file_i) {
+                buf = load_file(&num);
+                if(NULL == buf) {
+                        return -1;
+                }
+        }
+        fprintf(stdout, "stream   ,    PES,      bytes,  check\n");
+        if(NULL != buf) {
+                rslt = pes_check("file", buf, num);
+                free(buf);
+                return rslt;
+        }
+        for(i = 0; i < sizeof(var) / sizeof(var[0]); i++) {
+                struct tsgen_cfg cfg = gen;
+
+                cfg.pes_size = var[i].pes_size;
+                cfg.cc_err = var[i].cc_err;
+                num = (size_t)gen_num;
+                buf = tsgen(&cfg, num);
+                if(NULL == buf) {
+                        RPTERR("tsgen failed");
+                        return -1;
+                }
+                rslt |= pes_check(var[i].name, buf, num);
+                free(buf);
+        }
+        return rslt;
+}
+
+/* whole PES of ts_parse_batch() and tsana must be the PES fragments regrouped */
+static int pes_check(const char *name, const uint8_t *buf, size_t num)
+{
+        struct pes_out *ref;
+        struct pes_out *out;
+        size_t total = 0;
+        size_t bytes = 0;
+        const char *bad = NULL;
+        int i;
+
+        ref = (struct pes_out *)calloc(0x2000, sizeof(struct pes_out));
+        out = (struct pes_out *)calloc(0x2000, sizeof(struct pes_out));
+        if(NULL == ref || NULL == out) {
+                RPTERR("malloc PES table failed");
+                free(ref);
+                free(out);
+                return -1;
+        }
+
+        if(0 != pes_regroup(buf, num, ref)) {
+                bad = "regroup";
+        }
+        else if(0 != pes_whole(buf, num, out, &total)) {
+                bad = "ts_evt.pes";
+        }
+        else {
+                for(i = 0; i < 0x2000; i++) {
+                        if(ref[i].len != out[i].len ||
+                           (0 != out[i].len && 0 != memcmp(ref[i].buf, out[i].buf, out[i].len))) {
+                                bad = "ts_pes_callback";
+                                break;
+                        }
+                        bytes += out[i].len;
+                }
+                if(NULL == bad && 0 != pes_tsana(buf, num, out)) {
+                        bad = "tsana -demux -pes";
+                }
+        }
+        fprintf(stdout, "%-9s, %6zu, %10zu,  %s%s\n", name, total, bytes,
+                (NULL == bad) ? "OK" : "FAILED: ", (NULL == bad) ? "" : bad);
+
+        for(i = 0; i < 0x2000; i++) {
+                free(ref[i].buf);
+                free(out[i].buf);
+        }
+        free(ref);
+        free(out);
+        return (NULL == bad) ? 0 : -1;
+}
+
+/* reference: PES fragment of each packet, grouped by PUSI and PES_packet_length,
+ * the PES with CC lost or short of PES_packet_length is dropped */
+static int pes_regroup(const uint8_t *buf, size_t num, struct pes_out *out)
+{
+        static const struct ts_cfg cfg = {1, 1, 1, 1, 1, 1, 0, 0, 0}; /* no reassembly */
+        static struct ts_evt evt[1];
+        void *mp;
+        struct ts_obj *ts;
+        size_t p;
+        int rslt = 0;
+
+        mp = buddy_create(MP_ORDER, 6);
+        buddy_init(mp);
+        ts = ts_create(mp);
+        if(NULL == ts) {
+                buddy_destroy(mp);
+                return -1;
+        }
+        ts_ioctl(ts, TS_SCFG, (void *)&cfg);
+
+        for(p = 0; p < num && 0 == rslt; p++) {
+                struct pes_out *o;
+                const uint8_t *pes;
+                size_t len;
+
+                ts_parse_batch(ts, buf + p * TS_PKT_SIZE, 1, TS_PKT_SIZE, evt);
+                o = out + ts->PID;
+                if(NULL == ts->pid || NULL == ts->pid->elem) {
+                        continue; /* not elem PID */
+                }
+                if(o->is_sync && ts->CC_lost) {
+                        o->is_sync = 0;
+                }
+                if(ts->tsh.payload_unit_start_indicator) {
+                        pes = o->buf + o->len;
+                        if(o->is_sync && o->pes_len >= 6 && 0 == ((pes[4] << 8) | pes[5])) {
+                                o->len += o->pes_len; /* unbounded, ended here */
+                        }
+                        o->is_sync = 1;
+                        o->pes_len = 0;
+                }
+                if(!(o->is_sync) || 0 == ts->PES_len) {
+                        continue;
+                }
+
+                /* PES in collecting is kept after o->len */
+                len = o->len;
+                o->len += o->pes_len;
+                rslt = pes_add(o, ts->PES, (size_t)(ts->PES_len));
+                o->pes_len = o->len - len;
+                o->len = len;
+                pes = o->buf + o->len;
+                if(o->pes_len >= 6 && 0 != ((pes[4] << 8) | pes[5])) {
+                        len = 6 + (size_t)((pes[4] << 8) | pes[5]);
+                        if(o->pes_len >= len) {
+                                o->len += len; /* bounded, the tail is stuffing */
+                                o->is_sync = 0;
+                        }
+                }
+        }
+
+        ts_destroy(ts);
+        buddy_destroy(mp);
+        return rslt;
+}
+
+/* ts_parse_batch() with need_pes_pkt, evt[i].pes should be the ones of pes_rec() */
+static int pes_whole(const uint8_t *buf, size_t num, struct pes_out *out, size_t *total)
+{
+        static const struct ts_cfg cfg = {1, 1, 1, 1, 1, 1, 0, 0, 1};
+        static struct ts_evt evt[BATCH_NUM];
+        static struct pes_batch pb;
+        void *mp;
+        struct ts_obj *ts;
+        size_t p;
+        size_t n;
+        size_t i;
+        size_t j;
+        int rslt = 0;
+
+        mp = buddy_create(MP_ORDER, 6);
+        buddy_init(mp);
+        ts = ts_create(mp);
+        if(NULL == ts) {
+                buddy_destroy(mp);
+                return -1;
+        }
+        ts_ioctl(ts, TS_SCFG, (void *)&cfg);
+        pb.out = out;
+        pb.cnt = 0;
+        pb.total = 0;
+        ts_pes_callback(ts, pes_rec, &pb);
+
+        for(p = 0; p < num && 0 == rslt; p += n) {
+                n = ((num - p) < BATCH_NUM) ? (num - p) : BATCH_NUM;
+                n = (size_t)ts_parse_batch(ts, buf + p * TS_PKT_SIZE, n, TS_PKT_SIZE, evt);
+
+                /* each PES still as the callback got it, one PES of a PID in a batch */
+                for(i = 0, j = 0; i < n; i++) {
+                        if(!(TS_EVT_PES & evt[i].flag)) {
+                                continue;
+                        }
+                        if(j >= pb.cnt ||
+                           evt[i].pes != pb.rec[j].pes ||
+                           evt[i].pes->buf != pb.rec[j].buf ||
+                           evt[i].pes->len != pb.rec[j].len) {
+                                break;
+                        }
+                        j++;
+                }
+                rslt = ((i == n && j == pb.cnt) ? 0 : -1);
+                pb.cnt = 0;
+        }
+        *total = pb.total;
+
+        ts_destroy(ts);
+        buddy_destroy(mp);
+        return rslt;
+}
+
+/* callback of ts_pes_callback() */
+static void pes_rec(void *arg, const struct ts_pes *pes)
+{
+        struct pes_batch *pb = (struct pes_batch *)arg;
+
+        if(pb->cnt < BATCH_NUM) {
+                pb->rec[pb->cnt].pes = pes;
+                pb->rec[pb->cnt].buf = pes->buf;
+                pb->rec[pb->cnt].len = pes->len;
+                pb->cnt++;
+        }
+        pb->total++;
+        pes_add(pb->out + pes->PID, pes->buf, (size_t)(pes->len));
+        return;
+}
+
+/* "tsana -demux dir -pes" on the stream, dir/0xXXXX.pes should be out[0xXXXX] */
+static int pes_tsana(const uint8_t *buf, size_t num, const struct pes_out *out)
+{
+        char name[] = "/tmp/tsbenchXXXXXX.ts";
+        char dir[] = "/tmp/tsbenchXXXXXX";
+        char cmd[1024];
+        uint8_t *got = NULL;
+        int rslt = 0;
+        int i;
+
+        if(0 != save_tmp(name, buf, num)) {
+                return -1;
+        }
+        if(NULL == mkdtemp(dir)) {
+                RPTERR("create temp dir failed");
+                unlink(name);
+                return -1;
+        }
+        snprintf(cmd, sizeof(cmd), "%s/tsana/tsana -demux %s -pes %s", bin_dir, dir, name);
+        if(0 != system(cmd)) {
+                RPTERR("\"%s\" failed", cmd);
+                rslt = -1;
+        }
+
+        for(i = 0; i < 0x2000; i++) {
+                FILE *fd;
+                long len = 0;
+
+                snprintf(cmd, sizeof(cmd), "%s/0x%04X.pes", dir, (unsigned int)i);
+                fd = fopen(cmd, "rb");
+                if(NULL != fd) {
+                        fseek(fd, 0, SEEK_END);
+                        len = ftell(fd);
+                        fseek(fd, 0, SEEK_SET);
+                        got = (uint8_t *)realloc(got, (size_t)len + 1);
+                        if(NULL == got || (len > 0 && 1 != fread(got, (size_t)len, 1, fd))) {
+                                rslt = -1;
+                        }
+                        fclose(fd);
+                        unlink(cmd);
+                }
+                if(0 == rslt && ((size_t)len != out[i].len ||
+                                 (len > 0 && 0 != memcmp(got, out[i].buf, (size_t)len)))) {
+                        rslt = -1;
+                }
+        }
+
+        free(got);
+        rmdir(dir);
+        unlink(name);
+        return rslt;
+}
+
+/* buf[len] at the end of o->buf[o->len] */
+static int pes_add(struct pes_out *o, const uint8_t *buf, size_t len)
+{
+        if(o->len + len > o->size) {
+                size_t size = ((o->size) ? o->size : 4096);
+                uint8_t *p;
+
+                while(o->len + len > size) {
+                        size <<= 1;
+                }
+                p = (uint8_t *)realloc(o->buf, size);
+                if(NULL == p) {
+                        RPTERR("realloc PES buffer failed");
+                        return -1;
+                }
+                o->buf = p;
+                o->size = size;
+        }
+        memcpy(o->buf + o->len, buf, len);
+        o->len += len;
+        return 0;
+}
+
+static int bench_stc(void)
+{
+        static int64_t dy[BATCH_NUM]; /* PCRb - PCRa */
+        static int64_t dx[BATCH_NUM]; /* ADDb - ADDa */
+        static int64_t x[BATCH_NUM]; /* ADDx - ADDb */
+        static struct ts_slope slope[BATCH_NUM];
+        int64_t max_err;
+        int64_t sum;
+        long double delta;
+        double t0;
+        double t_ld;
+        double t_fx;
+        int i;
+        int n;
+
+        /* check: random PCR interval, bitrate and position(less than 4GB), against long double */
+        srand(1);
+        max_err = 0;
+        for(n = 0; n < loops * 50; n++) {
+                int64_t a;
+                int64_t b;
+                int64_t c;
+                struct ts_slope s;
+
+                a = (int64_t)(rand64() % (uint64_t)(STC_OVF >> 1)) >> (rand() % 40);
+                a = (rand() & 1) ? -a : a; /* PCR may jump back */
+                b = (int64_t)(rand64() % ((uint64_t)1 << 30)) >> (rand() % 30);
+                b = b + 1;
+                c = (int64_t)(rand64() % ((uint64_t)b * 4 + 1)); /* PCR lost for a while */
+
+                ts_slope_set(&s, a, b);
+                delta = (long double)a;
+                delta *= c;
+                delta /= b;
+                if(llabs((int64_t)delta - ts_slope_mul(&s, c)) > max_err) {
+                        max_err = llabs((int64_t)delta - ts_slope_mul(&s, c));
+                }
+        }
+        fprintf(stdout, "check: max error %lld tick, %s\n", (long long int)max_err,
+                (max_err <= 1) ? "OK" : "FAILED");
+        if(max_err > 1) {
+                return -1;
+        }
+
+        /* time: 100 Mbit/s, PCR every 40ms */
+        for(i = 0; i < BATCH_NUM; i++) {
+                dy[i] = 40 * STC_MS + (rand() % 1000);
+                dx[i] = 500000 + (rand() % 1000) * TS_PKT_SIZE;
+                x[i] = (rand() % 2660) * TS_PKT_SIZE;
+                ts_slope_set(&slope[i], dy[i], dx[i]);
+        }
+
+        sum = 0;
+        t0 = now_us();
+        for(n = 0; n < loops; n++) {
+                for(i = 0; i < BATCH_NUM; i++) {
+                        delta = (long double)dy[i];
+                        delta *= x[i];
+                        delta /= dx[i];
+                        sum += (int64_t)delta;
+                }
+        }
+        t_ld = (now_us() - t0) / loops / BATCH_NUM;
+
+        t0 = now_us();
+        for(n = 0; n < loops; n++) {
+                for(i = 0; i < BATCH_NUM; i++) {
+                        sum += ts_slope_mul(&slope[i], x[i]);
+                }
+        }
+        t_fx = (now_us() - t0) / loops / BATCH_NUM;
+
+        fprintf(stdout, "long double(ns),  ts_slope_mul(ns),  speedup\n");
+        fprintf(stdout, "%15.2f, %17.2f, %8.1f\n", t_ld * 1e3, t_fx * 1e3, t_ld / t_fx);
+        sink = (uint32_t)sum;
+        return 0;
+}
+
+static int bench_buddy(void)
+{
+        void *mp;
+        pthread_t thread[THREAD_MAX];
+        int cnt;
+        int i;
+        double t0;
+        double us;
+
+        mp = buddy_create(MP_ORDER, 6);
+        if(NULL == mp) {
+                return -1;
+        }
+
+        fprintf(stdout, "thread, Mop/s\n");
+        for(cnt = 1; cnt <= THREAD_MAX; cnt <<= 1) {
+                buddy_init(mp);
+                t0 = now_us();
+                for(i = 0; i < cnt; i++) {
+                        if(0 != pthread_create(&(thread[i]), NULL, buddy_thread, mp)) {
+                                RPTERR("create thread failed");
+                                cnt = i;
+                                break;
+                        }
+                }
+                for(i = 0; i < cnt; i++) {
+                        pthread_join(thread[i], NULL);
+                }
+                us = now_us() - t0;
+
+                /* one op: malloc and free of one block */
+                fprintf(stdout, "%6d, %5.1f\n", cnt, (double)cnt * loops * 100 / us);
+                buddy_status(mp, 1, "");
+        }
+        buddy_destroy(mp);
+        return 0;
+}
+
+/* keep LIVE_NUM blocks of ts_sect, ts_pid and ts_pkt size, free the oldest */
+static void *buddy_thread(void *arg)
+{
+        static const size_t size[3] = {
+                sizeof(struct ts_sect),
+                sizeof(struct ts_pid),
+                sizeof(struct ts_pkt)
+        };
+        void *mp = arg;
+        void *live[LIVE_NUM];
+        int n;
+        int i;
+
+        memset(live, 0, sizeof(live));
+        for(n = 0; n < loops * 100; n++) {
+                i = n % LIVE_NUM;
+                if(live[i]) {
+                        buddy_free(mp, live[i]);
+                }
+                live[i] = buddy_malloc(mp, size[n % 3]);
+                if(NULL == live[i]) {
+                        break;
+                }
+        }
+        for(i = 0; i < LIVE_NUM; i++) {
+                if(live[i]) {
+                        buddy_free(mp, live[i]);
+                }
+        }
+        return NULL;
+}
+
+/* record the malloc/free of a full parse, then replay it on buddy and libc */
+static int bench_trace(void)
+{
+        static const struct ts_cfg all = {1, 1, 1, 1, 1, 1, 1, 1};
+        static struct ts_evt evt[BATCH_NUM];
+        struct trace t;
+        void *mp;
+        struct ts_obj *ts;
+        uint8_t *buf;
+        void **live;
+        size_t num;
+        size_t slot_cnt;
+        size_t mcnt;
+        size_t p;
+        size_t n;
+        size_t i;
+        int k;
+        double t0;
+        double t_buddy;
+        double t_libc;
+
+        buf = load_file(&num);
+        if(NULL == buf) {
+                return -1;
+        }
+
+        /* record */
+        memset(&t, 0, sizeof(t));
+        mp = buddy_create(MP_ORDER, 6);
+        buddy_init(mp);
+        buddy_trace(mp, trace_rec, &t);
+        ts = ts_create(mp);
+        if(NULL == ts) {
+                buddy_destroy(mp);
+                free(buf);
+                return -1;
+        }
+        ts_ioctl(ts, TS_SCFG, (void *)&all);
+        for(p = 0; p < num; p += n) {
+                n = ((num - p) < BATCH_NUM) ? (num - p) : BATCH_NUM;
+                n = (size_t)ts_parse_batch(ts, buf + p * TS_PKT_SIZE, n, TS_PKT_SIZE, evt);
+        }
+        ts_destroy(ts);
+        buddy_trace(mp, NULL, NULL);
+        free(buf);
+        if(NULL == t.op) {
+                RPTERR("no malloc in parse");
+                buddy_destroy(mp);
+                return -1;
+        }
+
+        slot_cnt = trace_slot(&t);
+        live = (void **)calloc(slot_cnt, sizeof(void *));
+        if(NULL == live) {
+                buddy_destroy(mp);
+                free(t.op);
+                return -1;
+        }
+        for(mcnt = 0, i = 0; i < t.cnt; i++) {
+                mcnt += (0 != t.op[i].size);
+        }
+        fprintf(stdout, "trace: %zu malloc, %zu free, %zu live at most\n", mcnt, t.cnt - mcnt, slot_cnt);
+
+        /* replay: the slots are all freed at the end of trace */
+        buddy_init(mp);
+        t0 = now_us();
+        for(k = 0; k < loops; k++) {
+                for(i = 0; i < t.cnt; i++) {
+                        struct trace_op *op = &(t.op[i]);
+
+                        if(0 != op->size) {
+                                live[op->slot] = buddy_malloc(mp, op->size);
+                        }
+                        else {
+                                buddy_free(mp, live[op->slot]);
+                        }
+                }
+        }
+        t_buddy = (now_us() - t0) / loops / t.cnt;
+        buddy_status(mp, 1, "");
+
+        t0 = now_us();
+        for(k = 0; k < loops; k++) {
+                for(i = 0; i < t.cnt; i++) {
+                        struct trace_op *op = &(t.op[i]);
+
+                        if(0 != op->size) {
+                                live[op->slot] = malloc(op->size);
+                        }
+                        else {
+                                free(live[op->slot]);
+                        }
+                }
+        }
+        t_libc = (now_us() - t0) / loops / t.cnt;
+
+        fprintf(stdout, "buddy(ns/op),  libc(ns/op)\n");
+        fprintf(stdout, "%12.2f, %12.2f\n", t_buddy * 1e3, t_libc * 1e3);
+        free(live);
+        free(t.op);
+        buddy_destroy(mp);
+        return 0;
+}
+
+/* callback of buddy_trace(), grow the op list by need */
+static void trace_rec(void *arg, void *ptr, size_t size)
+{
+        struct trace *t = (struct trace *)arg;
+
+        if(t->cnt == t->size) {
+                size_t new_size = (t->size) ? (t->size * 2) : TRACE_MIN;
+                void **new_ptr = (void **)realloc(t->ptr, new_size * sizeof(void *));
+                struct trace_op *new_op;
+
+                if(NULL == new_ptr) {
+                        return; /* lost */
+                }
+                t->ptr = new_ptr;
+                new_op = (struct trace_op *)realloc(t->op, new_size * sizeof(struct trace_op));
+                if(NULL == new_op) {
+                        return; /* lost */
+                }
+                t->op = new_op;
+                t->size = new_size;
+        }
+        t->ptr[t->cnt] = ptr;
+        t->op[t->cnt].size = (uint32_t)size;
+        t->cnt++;
+        return;
+}
+
+/* map ptr of each op to slot, reuse slot of freed block, free the live ones at the end;
+ * drop the free of block malloced before trace, return slot number */
+static size_t trace_slot(struct trace *t)
+{
+        void **hash_ptr; /* open address hash: ptr -> slot */
+        uint32_t *hash_slot;
+        uint32_t *idle; /* stack of freed slot */
+        size_t idle_cnt;
+        size_t hash_size;
+        size_t slot_cnt;
+        size_t cnt;
+        size_t h;
+        size_t i;
+
+        for(hash_size = 1024; hash_size < t->cnt * 2; hash_size <<= 1) {}
+        hash_ptr = (void **)calloc(hash_size, sizeof(void *));
+        hash_slot = (uint32_t *)calloc(hash_size, sizeof(uint32_t));
+        idle = (uint32_t *)calloc(t->cnt + 1, sizeof(uint32_t));
+        if(NULL == hash_ptr || NULL == hash_slot || NULL == idle) {
+                RPTERR("malloc hash of trace failed");
+                exit(EXIT_FAILURE);
+        }
+
+        idle_cnt = 0;
+        slot_cnt = 0;
+        for(cnt = 0, i = 0; i < t->cnt; i++) {
+                /* buddy block is aligned, drop the low bits */
+                for(h = ((size_t)(t->ptr[i]) >> 4) & (hash_size - 1);
+                    NULL != hash_ptr[h] && t->ptr[i] != hash_ptr[h];
+                    h = (h + 1) & (hash_size - 1)) {}
+
+                if(0 != t->op[i].size) {
+                        hash_ptr[h] = t->ptr[i];
+                        hash_slot[h] = (uint32_t)((idle_cnt) ? idle[--idle_cnt] : slot_cnt++);
+                        t->op[cnt].slot = hash_slot[h];
+                        t->op[cnt].size = t->op[i].size;
+                        cnt++;
+                }
+                else if(NULL != hash_ptr[h] && UINT32_MAX != hash_slot[h]) {
+                        t->op[cnt].slot = hash_slot[h];
+                        t->op[cnt].size = 0;
+                        cnt++;
+                        idle[idle_cnt++] = hash_slot[h];
+                        hash_slot[h] = UINT32_MAX; /* keep ptr in hash for probe */
+                }
+        }
+
+        /* free the blocks still live at the end */
+        for(h = 0; h < hash_size; h++) {
+                if(NULL != hash_ptr[h] && UINT32_MAX != hash_slot[h]) {
+                        t->op[cnt].slot = hash_slot[h];
+                        t->op[cnt].size = 0;
+                        cnt++;
+                }
+        }
+        t->cnt = cnt;
+
+        free(t->ptr);
+        t->ptr = NULL;
+        free(hash_ptr);
+        free(hash_slot);
+        free(idle);
+        return slot_cnt;
+}
+
+/* the whole TS file in one buffer, or the synthetic stream */
+static uint8_t *load_file(size_t *num)
+{
+        FILE *fd;
+        uint8_t *buf;
+        long len;
+
+        if(NULL == file_i) {
+                *num = (size_t)gen_num;
+                buf = tsgen(&gen, *num);
+                if(NULL != buf) {
+                        fprintf(stdout, "%zu packets from tsgen\n", *num);
+                }
+                return buf;
+        }
+        fd = fopen(file_i, "rb");
+        if(NULL == fd) {
+                RPTERR("open \"%s\" failed", file_i);
+                return NULL;
+        }
+        fseek(fd, 0, SEEK_END);
+        len = ftell(fd);
+        fseek(fd, 0, SEEK_SET);
+        *num = (len > 0) ? (size_t)len / TS_PKT_SIZE : 0;
+        buf = (uint8_t *)malloc(*num * TS_PKT_SIZE + 1);
+        if(NULL == buf || 1 != fread(buf, *num * TS_PKT_SIZE, 1, fd)) {
+                RPTERR("read \"%s\" failed", file_i);
+                fclose(fd);
+                free(buf);
+                return NULL;
+        }
+        fclose(fd);
+
+        fprintf(stdout, "%zu packets from %s\n", *num, file_i);
+        return buf;
+}
+
+static uint64_t rand64(void)
+{
+        uint64_t r = 0;
+        int i;
+
+        for(i = 0; i < 4; i++) {
+                r = (r << 16) ^ (uint64_t)(rand() & 0xFFFF);
+        }
+        return r;
+}
+
+/* the original bit-serial ts_crc(), as reference */
+static uint32_t crc_bit(void *buf, size_t size, int mode)
+{
+        int bitcount = 0;
+        int bitinbyte = 0;
+        unsigned short databit;
+        unsigned short shiftreg[32];
+        /*                      0 1 2 3 4 5 6 7 8 */
+        unsigned short g08[] = {1,1,1,0,0,0,0,0,1};
+        /*                      0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 */
+        unsigned short g16[] = {1,0,0,0,0,0,0,0,0,0,0,0,1,0,0,1,1};
+        /*                      0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 */
+        unsigned short g32[] = {1,1,1,0,1,1,0,1,1,0,1,1,1,0,0,0,1,0,0,0,0,0,1,1,0,0,1,0,0,0,0,0,1};
+
+        unsigned short *g;
+        int i,nrbits;
+        char *data;
+        int cnt;
+        uint32_t crc;
+
+        switch(mode) {
+                case  8: g = g08; cnt =  8; break;
+                case 16: g = g16; cnt = 16; break;
+                default: g = g32; cnt = 32; break;
+        }
+
+        /* Initialize shift register's to '1' */
+        for(i = 0; i < cnt; i++) {
+                shiftreg[i] = 1;
+        }
+
+        /* Calculate nr of data bits */
+        nrbits = ((int) size) * 8;
+        data = buf;
+
+        while(bitcount < nrbits) {
+                /* Fetch bit from bitstream */
+                databit = (unsigned short)(*data  & (0x80 >> bitinbyte));
+                databit = (unsigned short)(databit >> (7 - bitinbyte));
+                bitinbyte++;
+                bitcount++;
+                if(bitinbyte == 8) {
+                        bitinbyte = 0;
+                        data++;
+                }
+
+                /* Perform the shift and modula 2 addition */
+                databit ^= shiftreg[cnt - 1];
+                i = cnt - 1;
+                while (i != 0) {
+                        if (g[i]) {
+                                shiftreg[i] = shiftreg[i-1] ^ databit;
+                        }
+                        else {
+                                shiftreg[i] = shiftreg[i-1];
+                        }
+                        i--;
+                }
+                shiftreg[0] = databit;
+        }
+
+        /* make CRC an UIMSBF */
+        crc = 0;
+        for(i = 0; i < cnt; i++) {
+                crc = (crc << 1) | ((unsigned int) shiftreg[cnt - 1 - i]);
+        }
+
+        return crc;
+}
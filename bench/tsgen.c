@@ -0,0 +1,408 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: tsgen.c
+ * funx: deterministic synthetic TS multiplex, for benchmark
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h> /* for uint?_t, etc */
+#include <string.h> /* for memset, etc */
+
+#include "common.h"
+#include "ts.h"
+#include "tsgen.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define PSI_MS (100) /* PAT and PMT interval */
+#define SDT_MS (500) /* SDT interval */
+#define SECT_MAX (1024) /* PSI and SDT section */
+#define PEND_MAX (512) /* section packets waiting for send */
+#define PES_HEAD (14) /* PES head with PTS */
+
+struct es {
+        uint16_t PID;
+        uint8_t stream_id;
+        int left; /* PES payload byte left, 0 means new PES */
+};
+
+struct gen {
+        const struct tsgen_cfg *cfg;
+        uint32_t rand; /* xorshift32 */
+        uint8_t CC[0x2000];
+        struct es es[TSGEN_PROG_MAX * TSGEN_ES_MAX];
+        int es_cnt;
+        int es_idx; /* next ES */
+        int64_t next_pcr[TSGEN_PROG_MAX];
+        int64_t pcr_cnt;
+        int64_t next_psi;
+        int64_t next_sdt;
+        int64_t cnt; /* packet number */
+        uint8_t pend[PEND_MAX][188]; /* section packets first */
+        int pend_head;
+        int pend_cnt;
+};
+
+static void put_es(struct gen *g, uint8_t *ts, struct es *es, int64_t t, int has_pcr);
+static void put_sects(struct gen *g);
+static int make_pat(const struct tsgen_cfg *cfg, uint8_t *sect);
+static int make_pmt(const struct tsgen_cfg *cfg, int i, uint8_t *sect);
+static int make_sdt(const struct tsgen_cfg *cfg, uint8_t *sect);
+static int sect_end(uint8_t *sect, uint8_t *p);
+static void queue_sect(struct gen *g, uint16_t PID, const uint8_t *sect, int len);
+static uint8_t next_cc(struct gen *g, uint16_t PID);
+static uint32_t next_rand(struct gen *g);
+
+void tsgen_default(struct tsgen_cfg *cfg)
+{
+        cfg->prog_cnt = 4;
+        cfg->es_cnt = 3;
+        cfg->rate = 40000000;
+        cfg->pcr_ms = 30;
+        cfg->pes_size = 8000;
+        cfg->sect_size = 400;
+        cfg->cc_err = 0;
+        cfg->pcr_err = 0;
+        cfg->seed = 1;
+        return;
+}
+
+uint8_t *tsgen(const struct tsgen_cfg *cfg, size_t num)
+{
+        struct gen *g;
+        uint8_t *buf;
+        uint8_t *ts;
+        size_t k;
+        int i;
+        int j;
+
+        if(cfg->prog_cnt < 1 || cfg->prog_cnt > TSGEN_PROG_MAX ||
+           cfg->es_cnt < 1 || cfg->es_cnt > TSGEN_ES_MAX ||
+           cfg->rate < 100000 || cfg->pcr_ms < 1 ||
+           cfg->pes_size < 1 || cfg->sect_size > SECT_MAX - 3) {
+                RPTERR("bad cfg of tsgen");
+                return NULL;
+        }
+
+        g = (struct gen *)calloc(1, sizeof(struct gen));
+        buf = (uint8_t *)malloc(num * 188 + 1);
+        if(NULL == g || NULL == buf) {
+                RPTERR("malloc failed");
+                free(g);
+                free(buf);
+                return NULL;
+        }
+        g->cfg = cfg;
+        g->rand = ((cfg->seed) ? cfg->seed : 1);
+        for(i = 0; i < cfg->prog_cnt; i++) {
+                for(j = 0; j < cfg->es_cnt; j++) {
+                        struct es *es = g->es + g->es_cnt++;
+
+                        es->PID = (uint16_t)TSGEN_ES_PID(i, j);
+                        es->stream_id = (uint8_t)((0 == j) ? 0xE0 : (0xC0 + j - 1));
+                        es->left = 0;
+                }
+                g->next_pcr[i] = (int64_t)i * STC_MS; /* not all at the same time */
+        }
+
+        for(k = 0, ts = buf; k < num; k++, ts += 188) {
+                int64_t t = (int64_t)((double)k * 188 * 8 * STC_1S / cfg->rate); /* arrive time of this packet */
+
+                if(t >= g->next_psi) {
+                        put_sects(g);
+                        g->next_psi += PSI_MS * STC_MS;
+                }
+
+                if(g->pend_cnt) {
+                        memcpy(ts, g->pend[g->pend_head], 188);
+                        g->pend_head = (g->pend_head + 1) % PEND_MAX;
+                        g->pend_cnt--;
+                        ts[3] |= next_cc(g, (uint16_t)(((ts[1] & 0x1F) << 8) | ts[2]));
+                        continue;
+                }
+
+                for(i = 0; i < cfg->prog_cnt; i++) {
+                        if(t >= g->next_pcr[i]) {
+                                break;
+                        }
+                }
+                if(i < cfg->prog_cnt) {
+                        put_es(g, ts, g->es + i * cfg->es_cnt, t, 1);
+                        g->next_pcr[i] += cfg->pcr_ms * STC_MS;
+                        continue;
+                }
+
+                put_es(g, ts, g->es + g->es_idx, t, 0);
+                g->es_idx = (g->es_idx + 1) % g->es_cnt;
+        }
+
+        free(g);
+        return buf;
+}
+
+/* one packet of ES, with PCR and stuffing in AF if need */
+static void put_es(struct gen *g, uint8_t *ts, struct es *es, int64_t t, int has_pcr)
+{
+        const struct tsgen_cfg *cfg = g->cfg;
+        uint8_t *p;
+        int af_len = ((has_pcr) ? 8 : 0); /* with adaptation_field_length byte */
+        int head = 0; /* PES head */
+        int data;
+        int i;
+
+        if(0 == es->left) {
+                es->left = cfg->pes_size;
+                head = PES_HEAD;
+        }
+        data = 184 - af_len - head;
+        data = ((es->left < data) ? es->left : data);
+        af_len = 184 - head - data; /* stuffing */
+
+        ts[0] = 0x47;
+        ts[1] = (uint8_t)(((head) ? 0x40 : 0x00) | (es->PID >> 8));
+        ts[2] = (uint8_t)(es->PID);
+        ts[3] = (uint8_t)(((af_len) ? 0x30 : 0x10) | next_cc(g, es->PID));
+        p = ts + 4;
+
+        if(af_len) {
+                *p++ = (uint8_t)(af_len - 1);
+                if(af_len > 1) {
+                        *p++ = (uint8_t)((has_pcr) ? 0x10 : 0x00); /* PCR_flag */
+                        if(has_pcr) {
+                                int64_t pcr = t;
+                                int64_t base;
+                                int ext;
+
+                                g->pcr_cnt++;
+                                if(cfg->pcr_err && 0 == g->pcr_cnt % cfg->pcr_err) {
+                                        pcr += STC_MS; /* jump */
+                                }
+                                base = (pcr / 300) & 0x1FFFFFFFFLL;
+                                ext = (int)(pcr % 300);
+                                *p++ = (uint8_t)(base >> 25);
+                                *p++ = (uint8_t)(base >> 17);
+                                *p++ = (uint8_t)(base >> 9);
+                                *p++ = (uint8_t)(base >> 1);
+                                *p++ = (uint8_t)(((base & 1) << 7) | 0x7E | (ext >> 8));
+                                *p++ = (uint8_t)ext;
+                        }
+                        memset(p, 0xFF, (size_t)(ts + 4 + af_len - p));
+                        p = ts + 4 + af_len;
+                }
+        }
+
+        if(head) {
+                int64_t pts = (t / 300 + 9000) & 0x1FFFFFFFFLL; /* 100ms later than PCR */
+                int len = 8 + cfg->pes_size;
+
+                len = ((len > 0xFFFF) ? 0 : len); /* 0 means unbounded */
+                *p++ = 0x00;
+                *p++ = 0x00;
+                *p++ = 0x01;
+                *p++ = es->stream_id;
+                *p++ = (uint8_t)(len >> 8);
+                *p++ = (uint8_t)len;
+                *p++ = 0x80; /* '10' */
+                *p++ = 0x80; /* PTS_DTS_flags: '10' */
+                *p++ = 0x05; /* PES_header_data_length */
+                *p++ = (uint8_t)(0x21 | ((pts >> 29) & 0x0E));
+                *p++ = (uint8_t)(pts >> 22);
+                *p++ = (uint8_t)(0x01 | ((pts >> 14) & 0xFE));
+                *p++ = (uint8_t)(pts >> 7);
+                *p++ = (uint8_t)(0x01 | ((pts << 1) & 0xFE));
+        }
+
+        for(i = 0; i < data; i += 4) {
+                uint32_t r = next_rand(g);
+
+                memcpy(p + i, &r, (size_t)(((data - i) < 4) ? (data - i) : 4));
+        }
+        es->left -= data;
+        return;
+}
+
+/* PAT, PMT every PSI_MS, SDT every SDT_MS */
+static void put_sects(struct gen *g)
+{
+        const struct tsgen_cfg *cfg = g->cfg;
+        uint8_t sect[SECT_MAX];
+        int len;
+        int i;
+
+        len = make_pat(cfg, sect);
+        queue_sect(g, 0x0000, sect, len);
+        for(i = 0; i < cfg->prog_cnt; i++) {
+                len = make_pmt(cfg, i, sect);
+                queue_sect(g, (uint16_t)TSGEN_PMT_PID(i), sect, len);
+        }
+        if(g->next_psi >= g->next_sdt) {
+                len = make_sdt(cfg, sect);
+                queue_sect(g, 0x0011, sect, len);
+                g->next_sdt += SDT_MS * STC_MS;
+        }
+        return;
+}
+
+static int make_pat(const struct tsgen_cfg *cfg, uint8_t *sect)
+{
+        uint8_t *p = sect;
+        int i;
+
+        *p++ = 0x00; /* table_id */
+        p += 2; /* section_length */
+        *p++ = 0x00; /* transport_stream_id */
+        *p++ = 0x01;
+        *p++ = 0xC1; /* version_number: 0, current_next_indicator: 1 */
+        *p++ = 0x00; /* section_number */
+        *p++ = 0x00; /* last_section_number */
+        for(i = 0; i < cfg->prog_cnt; i++) {
+                *p++ = (uint8_t)((i + 1) >> 8); /* program_number */
+                *p++ = (uint8_t)(i + 1);
+                *p++ = (uint8_t)(0xE0 | (TSGEN_PMT_PID(i) >> 8));
+                *p++ = (uint8_t)TSGEN_PMT_PID(i);
+        }
+        return sect_end(sect, p);
+}
+
+static int make_pmt(const struct tsgen_cfg *cfg, int i, uint8_t *sect)
+{
+        uint8_t *p = sect;
+        int j;
+
+        *p++ = 0x02; /* table_id */
+        p += 2; /* section_length */
+        *p++ = (uint8_t)((i + 1) >> 8); /* program_number */
+        *p++ = (uint8_t)(i + 1);
+        *p++ = 0xC1;
+        *p++ = 0x00;
+        *p++ = 0x00;
+        *p++ = (uint8_t)(0xE0 | (TSGEN_ES_PID(i, 0) >> 8)); /* PCR_PID */
+        *p++ = (uint8_t)TSGEN_ES_PID(i, 0);
+        *p++ = 0xF0; /* program_info_length */
+        *p++ = 0x00;
+        for(j = 0; j < cfg->es_cnt; j++) {
+                *p++ = (uint8_t)((0 == j) ? 0x02 : 0x04); /* stream_type: MPEG-2 video or audio */
+                *p++ = (uint8_t)(0xE0 | (TSGEN_ES_PID(i, j) >> 8));
+                *p++ = (uint8_t)TSGEN_ES_PID(i, j);
+                *p++ = 0xF0; /* ES_info_length */
+                *p++ = 0x00;
+        }
+        return sect_end(sect, p);
+}
+
+/* service_descriptor of each program, then private descriptor up to sect_size */
+static int make_sdt(const struct tsgen_cfg *cfg, uint8_t *sect)
+{
+        uint8_t *p = sect;
+        uint8_t *loop = NULL;
+        int i;
+
+        *p++ = 0x42; /* table_id: actual TS */
+        p += 2; /* section_length */
+        *p++ = 0x00; /* transport_stream_id */
+        *p++ = 0x01;
+        *p++ = 0xC1;
+        *p++ = 0x00;
+        *p++ = 0x00;
+        *p++ = 0x00; /* original_network_id */
+        *p++ = 0x01;
+        *p++ = 0xFF; /* reserved_future_use */
+        for(i = 0; i < cfg->prog_cnt; i++) {
+                char name[16];
+                int len = sprintf(name, "prog%d", i + 1);
+
+                *p++ = (uint8_t)((i + 1) >> 8); /* service_id */
+                *p++ = (uint8_t)(i + 1);
+                *p++ = 0xFC; /* EIT flags: 0 */
+                loop = p;
+                p += 2; /* running_status, free_CA_mode, descriptors_loop_length */
+                *p++ = 0x48; /* service_descriptor */
+                *p++ = (uint8_t)(3 + 7 + len);
+                *p++ = 0x01; /* service_type: digital television */
+                *p++ = 7;
+                memcpy(p, "tstools", 7);
+                p += 7;
+                *p++ = (uint8_t)len;
+                memcpy(p, name, (size_t)len);
+                p += len;
+                if(i == cfg->prog_cnt - 1) {
+                        /* the last one: pad up to sect_size with private descriptor */
+                        while(p - sect + 4 < cfg->sect_size) {
+                                int pad = (int)(cfg->sect_size - (p - sect + 4) - 2);
+
+                                pad = ((pad > 255) ? 255 : ((pad < 0) ? 0 : pad));
+                                *p++ = 0x80; /* user defined */
+                                *p++ = (uint8_t)pad;
+                                memset(p, 0x55, (size_t)pad);
+                                p += pad;
+                        }
+                }
+                loop[0] = (uint8_t)(0x80 | ((p - loop - 2) >> 8)); /* running */
+                loop[1] = (uint8_t)(p - loop - 2);
+        }
+        return sect_end(sect, p);
+}
+
+/* fill section_length and CRC_32, return section size */
+static int sect_end(uint8_t *sect, uint8_t *p)
+{
+        int len = (int)(p - sect) + 4;
+        uint32_t crc;
+
+        sect[1] = (uint8_t)(0xB0 | ((len - 3) >> 8)); /* section_syntax_indicator: 1 */
+        sect[2] = (uint8_t)(len - 3);
+        crc = ts_crc(sect, (size_t)(len - 4), 32);
+        *p++ = (uint8_t)(crc >> 24);
+        *p++ = (uint8_t)(crc >> 16);
+        *p++ = (uint8_t)(crc >> 8);
+        *p++ = (uint8_t)crc;
+        return len;
+}
+
+/* split section into packets, pointer_field in the first one, CC later */
+static void queue_sect(struct gen *g, uint16_t PID, const uint8_t *sect, int len)
+{
+        int off = 0;
+
+        while(off < len && g->pend_cnt < PEND_MAX) {
+                uint8_t *ts = g->pend[(g->pend_head + g->pend_cnt++) % PEND_MAX];
+                uint8_t *p = ts + 4;
+                int n;
+
+                ts[0] = 0x47;
+                ts[1] = (uint8_t)(((0 == off) ? 0x40 : 0x00) | (PID >> 8));
+                ts[2] = (uint8_t)PID;
+                ts[3] = 0x10; /* payload only */
+                if(0 == off) {
+                        *p++ = 0x00; /* pointer_field */
+                }
+                n = (int)(ts + 188 - p);
+                n = ((len - off < n) ? (len - off) : n);
+                memcpy(p, sect + off, (size_t)n);
+                memset(p + n, 0xFF, (size_t)(ts + 188 - p - n));
+                off += n;
+        }
+        return;
+}
+
+/* CC of the next packet, skip one for cc_err */
+static uint8_t next_cc(struct gen *g, uint16_t PID)
+{
+        g->cnt++;
+        g->CC[PID] = (uint8_t)((g->CC[PID] + 1) & 0x0F);
+        if(g->cfg->cc_err && 0 == g->cnt % g->cfg->cc_err) {
+                g->CC[PID] = (uint8_t)((g->CC[PID] + 1) & 0x0F);
+        }
+        return g->CC[PID];
+}
+
+static uint32_t next_rand(struct gen *g)
+{
+        uint32_t x = g->rand;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        g->rand = x;
+        return x;
+}
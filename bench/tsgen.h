@@ -0,0 +1,44 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: tsgen.h
+ * funx: deterministic synthetic TS multiplex, for benchmark
+ */
+
+#ifndef _TSGEN_H
+#define _TSGEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* for uint?_t, etc */
+#include <stddef.h> /* for size_t */
+
+#define TSGEN_PROG_MAX (64)
+#define TSGEN_ES_MAX (8)
+
+/* PID of the stream */
+#define TSGEN_PMT_PID(i)        (0x0100 + (i)) /* PMT of program i */
+#define TSGEN_ES_PID(i, j)      (0x0200 + (i) * TSGEN_ES_MAX + (j)) /* ES j of program i, j == 0 has PCR */
+
+struct tsgen_cfg {
+        int prog_cnt; /* program number, 1-TSGEN_PROG_MAX */
+        int es_cnt; /* ES number of each program, 1-TSGEN_ES_MAX, the first one is video with PCR */
+        int rate; /* mux bitrate(unit: bit/s), for the time of each packet */
+        int pcr_ms; /* PCR interval of each program */
+        int pes_size; /* PES payload size(unit: byte) */
+        int sect_size; /* min SDT section size(unit: byte), PAT and PMT every 100ms, SDT every 500ms */
+        int cc_err; /* skip one CC every cc_err packets, 0 means none */
+        int pcr_err; /* PCR jumps 1ms every pcr_err PCR, 0 means none */
+        uint32_t seed; /* the same cfg, the same stream */
+};
+
+void tsgen_default(struct tsgen_cfg *cfg);
+
+/* num packets of the stream, malloced, NULL means bad cfg or no memory */
+uint8_t *tsgen(const struct tsgen_cfg *cfg, size_t num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TSGEN_H */
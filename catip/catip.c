@@ -13,21 +13,27 @@
 #include "if.h"
 #include "url.h"
 
+#define PKT_BATCH (64 * 7) /* packet number got from url at one time */
+
 static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 
 static struct url *fd_i = NULL;
 static char file_i[FILENAME_MAX] = "";
 static int npline = 188; /* data number per line */
 static int64_t pkt_addr = 0;
+static int is_bin = 0; /* output binary record instead of text line */
 
 static int deal_with_parameter(int argc, char *argv[]);
 static void show_help();
 static void show_version();
+static int output_pkt(const uint8_t *pkt);
 
 int main(int argc, char *argv[])
 {
         unsigned char bbuf[ 204 + 10]; /* bin data buffer */
-        char tbuf[1024 + 10]; /* txt data buffer */
+        const uint8_t *pkt[PKT_BATCH]; /* packets in the datagrams, without copy */
+        size_t cnt;
+        size_t i;
 
         if(0 != deal_with_parameter(argc, argv)) {
                 return -1;
@@ -39,19 +45,61 @@ int main(int argc, char *argv[])
                 return -1;
         }
 
+        if(is_bin) {
+                rec_binmode(stdout);
+        }
+
         pkt_addr = 0;
-        while(1 == url_read(bbuf, (size_t)npline, 1, fd_i)) {
+        if(URL_IS_UDP(fd_i)) {
+                /* all packets of some datagrams with one syscall */
+                while(0 != (cnt = url_pkts(fd_i, pkt, (size_t)npline, PKT_BATCH))) {
+                        for(i = 0; i < cnt; i++) {
+                                if(0 != output_pkt(pkt[i])) {
+                                        break;
+                                }
+                        }
+                        if(i < cnt) {
+                                break;
+                        }
+                }
+        }
+        else {
+                while(1 == url_read(bbuf, (size_t)npline, 1, fd_i)) {
+                        if(0 != output_pkt(bbuf)) {
+                                break;
+                        }
+                }
+        }
+
+        url_close(fd_i);
+
+        return 0;
+}
+
+static int output_pkt(const uint8_t *pkt)
+{
+        char tbuf[1024 + 10]; /* txt data buffer */
+
+        if(is_bin) {
+                struct rec rec;
+
+                rec.flag = (REC_TS | REC_ADDR);
+                rec.TS = (uint8_t *)pkt; /* only read by rec_write() */
+                rec.ADDR = pkt_addr;
+                if(0 != rec_write(stdout, &rec)) {
+                        RPTERR("write stdout failed");
+                        return -1;
+                }
+        }
+        else {
                 fprintf(stdout, "*ts, ");
-                b2t(tbuf, bbuf, 188);
+                b2t(tbuf, pkt, 188);
                 fprintf(stdout, "%s", tbuf);
 
                 fprintf(stdout, "*addr, %"PRIX64", \n", pkt_addr);
-
-                pkt_addr += npline;
         }
 
-        url_close(fd_i);
-
+        pkt_addr += npline;
         return 0;
 }
 
@@ -68,8 +116,12 @@ static int deal_with_parameter(int argc, char *argv[])
 
         for(i = 1; i < argc; i++) {
                 if('-' == argv[i][0]) {
-                        if(0 == strcmp(argv[i], "-h") ||
-                           0 == strcmp(argv[i], "--help")) {
+                        if(0 == strcmp(argv[i], "-b") ||
+                           0 == strcmp(argv[i], "--binary")) {
+                                is_bin = 1;
+                        }
+                        else if(0 == strcmp(argv[i], "-h") ||
+                                0 == strcmp(argv[i], "--help")) {
                                 show_help();
                                 return -1;
                         }
@@ -96,10 +148,11 @@ static void show_help()
         fprintf(stdout,
                 "'catip' read TS over IP, translate 0xXY to 'XY ' format, then send to stdout.\n"
                 "\n"
-                "Usage: catip [OPTION] udp://*@*:* [OPTION]\n"
+                "Usage: catip [OPTION] udp://*@*:*|rtp://*@*:* [OPTION]\n"
                 "\n"
                 "Options:\n"
                 "\n"
+                " -b, --binary     output binary record instead of text line\n"
                 " -h, --help       print this information only\n"
                 " -v, --version    print my version only\n"
                 "\n"
@@ -107,6 +160,8 @@ static void show_help()
                 "  catip udp://:1234\n"
                 "  catip udp://224.165.54.31:1234\n"
                 "  catip udp://192.165.54.36@224.165.54.31:1234\n"
+                "  catip rtp://224.165.54.31:1234\n"
+                "  catip -b udp://224.165.54.31:1234 | tsana -err\n"
                 "\n"
                 "Report bugs to <zhoucheng@tsinghua.org.cn>.\n");
         return;
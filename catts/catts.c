@@ -11,19 +11,16 @@
 #include "tstool_config.h"
 #include "common.h"
 #include "if.h"
+#include "url.h"
+#include "sync.h" /* for judge_type(), judge_type_mem() */
+#include "tsidx.h" /* for ts_idx_load(), etc */
 
 static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 
-enum FILE_TYPE
-{
-        FILE_MTS,
-        FILE_TSRS,
-        FILE_TS,
-        FILE_BIN,
-        FILE_UNKNOWN
-};
-
+static struct url *url_i = NULL;
 static FILE *fd_i = NULL;
+static const uint8_t *map = NULL; /* memory map of file, NULL means fread() */
+static int64_t map_size = 0;
 static char file_i[FILENAME_MAX] = "";
 static int npline = 16; /* data number per line */
 static int type = FILE_TS;
@@ -31,84 +28,103 @@ static intmax_t aim_start = 0; /* first byte */
 static intmax_t aim_stop = 0; /* last byte */
 static int64_t pkt_addr = 0;
 static int32_t pkt_mts = 0;
+static int is_bin = 0; /* output binary record instead of text line */
+static char *idx_file = NULL; /* index file, NULL means "file.idx" */
+static char *seek_pos = NULL; /* position to seek by index, NULL means no seek */
 
 static int deal_with_parameter(int argc, char *argv[]);
 static int show_help();
 static int show_version();
-static int judge_type();
+static int judge();
+static int seek_idx();
+static int seek_start();
+static int goto_pkt(int64_t addr);
 static int mts_time(int32_t *mts, uint8_t *bin);
+static int next_data(uint8_t **pdat, uint8_t *bbuf);
+static int put_rec(struct rec *rec);
 
 int main(int argc, char *argv[])
 {
         int cnt;
-        unsigned char bbuf[LINE_LENGTH_MAX / 3 + 10]; /* bin data buffer */
-        char tbuf[LINE_LENGTH_MAX + 10]; /* txt data buffer */
+        uint8_t bbuf[LINE_LENGTH_MAX / 3 + 10]; /* bin data buffer */
+        uint8_t *pdat; /* point to bbuf or map */
 
         if(0 != deal_with_parameter(argc, argv)) {
                 return -1;
         }
 
-        fd_i = fopen(file_i, "rb");
-        if(NULL == fd_i) {
+        url_i = url_open(file_i, "rb");
+        if(NULL == url_i) {
                 RPTERR("open \"%s\" failed", file_i);
                 return -1;
         }
+        if(URL_IS_UDP(url_i)) {
+                RPTERR("\"%s\" is not a file, use catip instead", file_i);
+                url_close(url_i);
+                return -1;
+        }
+        fd_i = url_i->fd;
+        map = url_map(url_i, &map_size);
+
+        if(is_bin) {
+                rec_binmode(stdout);
+        }
 
         pkt_addr = 0;
-        judge_type();
-        while(0 < (cnt = (int)fread(bbuf, 1, (size_t)npline, fd_i))) {
+        judge();
+        if(seek_pos && 0 != seek_idx()) {
+                url_close(url_i);
+                return -1;
+        }
+        if(0 != aim_start && 0 != seek_start()) {
+                url_close(url_i);
+                return -1;
+        }
+        while(0 < (cnt = next_data(&pdat, bbuf))) {
+                struct rec rec;
+
+                if(FILE_BIN != type && FILE_UNKNOWN != type && cnt < npline) {
+                        RPTWRN("pass %d-byte of the last packet", cnt);
+                        break;
+                }
+
+                if(FILE_BIN != type && FILE_UNKNOWN != type && 0x47 != pdat[(FILE_MTS == type) ? 4 : 0]) {
+                        /* lost sync, judge type again; nothing to judge means EOF, as tsana */
+                        pkt_addr -= ((pkt_addr >= (int64_t)npline) ? npline : 0);
+                        if(0 != judge()) {
+                                break;
+                        }
+                        continue;
+                }
+
+                rec.flag = REC_ADDR;
+                rec.ADDR = pkt_addr;
                 switch(type) {
                         case FILE_TS:
-                                if(0x47 != bbuf[0]) {
-                                        pkt_addr -= ((pkt_addr >= (int64_t)npline) ? npline : 0);
-                                        judge_type();
-                                        continue;
-                                }
-                                fprintf(stdout, "*ts, ");
-                                b2t(tbuf, bbuf, 188);
-                                fprintf(stdout, "%s", tbuf);
-
-                                fprintf(stdout, "*addr, %"PRIX64", \n", pkt_addr);
+                                rec.flag |= REC_TS;
+                                rec.TS = pdat;
                                 break;
                         case FILE_MTS:
-                                if(0x47 != bbuf[4]) {
-                                        pkt_addr -= ((pkt_addr >= (int64_t)npline) ? npline : 0);
-                                        judge_type();
-                                        continue;
-                                }
-                                fprintf(stdout, "*ts, ");
-                                b2t(tbuf, bbuf + 4, 188);
-                                fprintf(stdout, "%s", tbuf);
-
-                                fprintf(stdout, "*addr, %"PRIX64", ", pkt_addr);
-
-                                mts_time(&pkt_mts, bbuf);
-                                fprintf(stdout, "*mts, %"PRIX32", \n", pkt_mts);
+                                rec.flag |= (REC_TS | REC_MTS);
+                                rec.TS = pdat + 4;
+                                mts_time(&pkt_mts, pdat);
+                                rec.MTS = (uint32_t)pkt_mts;
                                 break;
                         case FILE_TSRS:
-                                if(0x47 != bbuf[0]) {
-                                        pkt_addr -= ((pkt_addr >= (int64_t)npline) ? npline : 0);
-                                        judge_type();
-                                        continue;
-                                }
-                                fprintf(stdout, "*ts, ");
-                                b2t(tbuf, bbuf, 188);
-                                fprintf(stdout, "%s", tbuf);
-
-                                fprintf(stdout, "*rs, ");
-                                b2t(tbuf, bbuf + 188, 16);
-                                fprintf(stdout, "%s", tbuf);
-
-                                fprintf(stdout, "*addr, %"PRIX64", \n", pkt_addr);
+                                rec.flag |= (REC_TS | REC_RS);
+                                rec.TS = pdat;
+                                rec.RS = pdat + 188;
                                 break;
                         default: /* FILE_BIN */
-                                fprintf(stdout, "*data, ");
-                                b2t(tbuf, bbuf, cnt);
-                                fprintf(stdout, "%s", tbuf);
-
-                                fprintf(stdout, "*addr, %"PRIX64", \n", pkt_addr);
+                                rec.flag |= REC_DATA;
+                                rec.DATA = pdat;
+                                rec.len = cnt;
                                 break;
                 }
+                if(0 != put_rec(&rec)) {
+                        RPTERR("write stdout failed");
+                        break;
+                }
                 pkt_addr += cnt;
 
                 if(0 != aim_stop && pkt_addr >= (int64_t)aim_stop) {
@@ -116,7 +132,7 @@ int main(int argc, char *argv[])
                 }
         }
 
-        fclose(fd_i);
+        url_close(url_i);
 
         return 0;
 }
@@ -180,6 +196,28 @@ static int deal_with_parameter(int argc, char *argv[])
                                         RPTERR("bad variable for 'width': %jd(0 < x < %u), use 16 instead!\n", dat, LINE_LENGTH_MAX / 3);
                                 }
                         }
+                        else if(0 == strcmp(argv[i], "-x") ||
+                                0 == strcmp(argv[i], "--idx")) {
+                                i++;
+                                if(i >= argc) {
+                                        RPTERR("no parameter for 'idx'!\n");
+                                        return -1;
+                                }
+                                idx_file = argv[i];
+                        }
+                        else if(0 == strcmp(argv[i], "-k") ||
+                                0 == strcmp(argv[i], "--seek")) {
+                                i++;
+                                if(i >= argc) {
+                                        RPTERR("no parameter for 'seek'!\n");
+                                        return -1;
+                                }
+                                seek_pos = argv[i];
+                        }
+                        else if(0 == strcmp(argv[i], "-b") ||
+                                0 == strcmp(argv[i], "--binary")) {
+                                is_bin = 1;
+                        }
                         else if(0 == strcmp(argv[i], "-l"))
                         {
                                 i++;
@@ -242,8 +280,13 @@ static int show_help()
                 "Options:\n"
                 "\n"
                 " -w, --width <n>          n-byte per line for FILE_BIN, default: 16\n"
-                " -s, --start <a>          cat from, default: 0(from first byte)\n"
+                " -s, --start <a>          cat from, default: 0(from first byte), TS file is seeked\n"
+                "                          to the packet with byte(a) directly\n"
                 " -p, --stop <b>           cat to, default: 0(to last byte)\n"
+                " -b, --binary             output binary record instead of text line\n"
+                " -k, --seek <pos>         cat from pos by index(\"tsana -mkidx\"), pos is second from\n"
+                "                          the first PCR(e.g. 12.5), \"pcr:PCR\" or \"pkt:x\"\n"
+                " -x, --idx <file>         index file for seek, default: file.idx\n"
                 "\n"
                 " -l <level>               set report level(dbg|inf|wrn|err), default: wrn\n"
                 " -h, --help               display this information\n"
@@ -251,6 +294,8 @@ static int show_help()
                 "\n"
                 "Examples:\n"
                 "  catts xxx.ts\n"
+                "  catts -b xxx.ts | tsana -rate\n"
+                "  catts -b -k 600 xxx.ts | tsana -pcr -count 10000\n"
                 "\n"
                 "Report bugs to <zhoucheng@tsinghua.org.cn>.\n");
         return 0;
@@ -273,132 +318,155 @@ static int show_version()
         return 0;
 }
 
-#define SYNC_TIME       3 /* SYNC_TIME syncs means TS sync */
-#define ASYNC_BYTE      4096 /* head ASYNC_BYTE bytes async means BIN file */
-/* for TS data: use "state machine" to determine sync position and packet size */
-static int judge_type()
+static int mts_time(int32_t *mts, uint8_t *bin)
 {
-        uint8_t dat;
-        int sync_cnt = 0;
-        int state = FILE_UNKNOWN;
-        int64_t off = 0;
-
-        RPTINF("judge type from 0x%"PRIX64" +%"PRId64, pkt_addr, off);
-        type = FILE_UNKNOWN;
-        while(FILE_UNKNOWN == type) {
-                switch(state) {
-                        case FILE_UNKNOWN:
-                                fseek(fd_i, (long)(pkt_addr + off), SEEK_SET);
-                                if(1 != fread(&dat, 1, 1, fd_i)) {
-                                        return -1;
-                                }
-                                if(0x47 == dat) {
-                                        RPTINF("first 0x47 at +%"PRId64", maybe TS", off);
-                                        sync_cnt = 1;
-                                        state = FILE_TS;
-                                }
-                                else {
-                                        off++;
-                                        if(off > ASYNC_BYTE) {
-                                                RPTINF("unlock over %d-byte, it is BIN", ASYNC_BYTE);
-                                                off = 0;
-                                                type = FILE_BIN;
-                                                state = FILE_BIN;
-                                        }
-                                }
-                                break;
-                        case FILE_TS:
-                                fseek(fd_i, +187, SEEK_CUR);
-                                if(1 != fread(&dat, 1, 1, fd_i)) {
-                                        return -1;
-                                }
-                                if(0x47 == dat) {
-                                        RPTINF("meet 0x47, maybe TS");
-                                        sync_cnt++;
-                                        if(sync_cnt >= SYNC_TIME) {
-                                                RPTINF("it is TS");
-                                                npline = 188;
-                                                type = FILE_TS;
-                                        }
-                                }
-                                else {
-                                        fseek(fd_i, (long)(pkt_addr + off + 1), SEEK_SET);
-                                        sync_cnt = 1;
-                                        state = FILE_MTS;
-                                }
-                                break;
-                        case FILE_MTS:
-                                fseek(fd_i, +191, SEEK_CUR);
-                                if(1 != fread(&dat, 1, 1, fd_i)) {
-                                        return -1;
-                                }
-                                if(0x47 == dat) {
-                                        RPTINF("meet 0x47, maybe MTS");
-                                        sync_cnt++;
-                                        if(sync_cnt >= SYNC_TIME) {
-                                                if(off < 4) {
-                                                        fseek(fd_i, (long)(pkt_addr + off + 1), SEEK_SET);
-                                                        sync_cnt = 1;
-                                                        state = FILE_TSRS;
-                                                }
-                                                else {
-                                                        RPTINF("it is MTS");
-                                                        off -= 4;
-                                                        npline = 192;
-                                                        type = FILE_MTS;
-                                                }
-                                        }
-                                }
-                                else {
-                                        fseek(fd_i, (long)(pkt_addr + off + 1), SEEK_SET);
-                                        sync_cnt = 1;
-                                        state = FILE_TSRS;
-                                }
-                                break;
-                        case FILE_TSRS:
-                                fseek(fd_i, +203, SEEK_CUR);
-                                if(1 != fread(&dat, 1, 1, fd_i)) {
-                                        return -1;
-                                }
-                                if(0x47 == dat) {
-                                        RPTINF("meet 0x47, maybe TSRS");
-                                        sync_cnt++;
-                                        if(sync_cnt >= SYNC_TIME) {
-                                                RPTINF("it is TSRS");
-                                                npline = 204;
-                                                type = FILE_TSRS;
-                                        }
-                                }
-                                else {
-                                        off++;
-                                        type = FILE_UNKNOWN;
-                                        state = FILE_UNKNOWN;
-                                        RPTINF("judge type from 0x%"PRIX64" +%"PRId64, pkt_addr, off);
-                                }
-                                break;
-                        default:
-                                RPTERR("bad state: %d", state);
-                                return -1;
+        int i;
+
+        *mts = 0;
+        for(i = 0; i < 4; i++) {
+                *mts <<= 8;
+                *mts |= *bin++;
+        }
+
+        return 0;
+}
+
+static int judge()
+{
+        if(map) {
+                type = judge_type_mem(map, map_size, &pkt_addr, &npline);
+        }
+        else {
+                type = judge_type(fd_i, &pkt_addr, &npline);
+        }
+        if(type < 0) {
+                type = FILE_UNKNOWN;
+                return -1;
+        }
+        return 0;
+}
+
+/* move pkt_addr to seek_pos by index, then sync again */
+static int seek_idx()
+{
+        struct ts_idx *idx;
+        char name[FILENAME_MAX];
+        int64_t addr;
+
+        if(FILE_TS != type && FILE_MTS != type && FILE_TSRS != type) {
+                RPTERR("\"%s\" is not TS file, can not seek", file_i);
+                return -1;
+        }
+        if(idx_file) {
+                snprintf(name, sizeof(name), "%s", idx_file);
+        }
+        else {
+                snprintf(name, sizeof(name), "%s.idx", file_i);
+        }
+        idx = ts_idx_open(name, npline, seek_pos, &addr);
+        if(NULL == idx) {
+                return -1;
+        }
+        ts_idx_destroy(idx);
+
+        if(0 != goto_pkt(addr)) {
+                RPTERR("no TS packet at 0x%" PRIX64 " of \"%s\", index is out of date?", addr, file_i);
+                return -1;
+        }
+        return 0;
+}
+
+/* move pkt_addr to aim_start directly, to the head of the packet with it */
+static int seek_start()
+{
+        int64_t addr = (int64_t)aim_start;
+
+        if(map && addr >= map_size) {
+                RPTERR("start 0x%" PRIX64 " is beyond the end of \"%s\"", addr, file_i);
+                return -1;
+        }
+        if(FILE_BIN == type || FILE_UNKNOWN == type) {
+                pkt_addr = addr;
+                if(NULL == map && 0 != fseek(fd_i, (long)addr, SEEK_SET)) {
+                        RPTERR("seek \"%s\" failed", file_i);
+                        return -1;
                 }
+                return 0;
         }
 
-        if(off != 0) {
-                RPTWRN("pass %"PRId64"-byte from 0x%"PRIX64" (%"PRId64")", off, pkt_addr, pkt_addr);
+        if(addr > pkt_addr) {
+                addr = pkt_addr + (addr - pkt_addr) / npline * npline; /* packet aligned */
+        }
+        else {
+                addr = pkt_addr;
+        }
+        if(0 != goto_pkt(addr)) {
+                RPTERR("no TS packet after 0x%" PRIX64 " of \"%s\"", addr, file_i);
+                return -1;
         }
-        pkt_addr += off;
-        fseek(fd_i, (long)pkt_addr, SEEK_SET);
         return 0;
 }
 
-static int mts_time(int32_t *mts, uint8_t *bin)
+/* move pkt_addr to the packet at addr, sync again only if it is not there */
+static int goto_pkt(int64_t addr)
 {
-        int i;
+        pkt_addr = addr;
+        type = sync_goto(fd_i, map, map_size, &pkt_addr, type, &npline);
+        if(FILE_TS != type && FILE_MTS != type && FILE_TSRS != type) {
+                type = ((type < 0) ? FILE_UNKNOWN : type);
+                return -1;
+        }
+        return 0;
+}
 
-        *mts = 0;
-        for(i = 0; i < 4; i++) {
-                *mts <<= 8;
-                *mts |= *bin++;
+/* point *pdat to the next npline-byte, in the map or read into bbuf */
+static int next_data(uint8_t **pdat, uint8_t *bbuf)
+{
+        int64_t left;
+
+        if(NULL == map) {
+                *pdat = bbuf;
+                return (int)fread(bbuf, 1, (size_t)npline, fd_i);
+        }
+
+        left = map_size - pkt_addr;
+        if(left <= 0) {
+                return 0;
+        }
+        *pdat = (uint8_t *)(map + pkt_addr); /* read only */
+        return (left < (int64_t)npline) ? (int)left : npline;
+}
+
+/* output one packet: binary record or "*tag, data, " text line */
+static int put_rec(struct rec *rec)
+{
+        char tbuf[LINE_LENGTH_MAX + 10]; /* txt data buffer */
+
+        if(is_bin) {
+                return rec_write(stdout, rec);
         }
 
+        if(rec->flag & REC_TS) {
+                fprintf(stdout, "*ts, ");
+                b2t(tbuf, rec->TS, 188);
+                fprintf(stdout, "%s", tbuf);
+        }
+        if(rec->flag & REC_RS) {
+                fprintf(stdout, "*rs, ");
+                b2t(tbuf, rec->RS, 16);
+                fprintf(stdout, "%s", tbuf);
+        }
+        if(rec->flag & REC_DATA) {
+                fprintf(stdout, "*data, ");
+                b2t(tbuf, rec->DATA, rec->len);
+                fprintf(stdout, "%s", tbuf);
+        }
+        if(rec->flag & REC_ADDR) {
+                fprintf(stdout, "*addr, %"PRIX64", ", rec->ADDR);
+        }
+        if(rec->flag & REC_MTS) {
+                fprintf(stdout, "*mts, %"PRIX32", ", (uint32_t)rec->MTS);
+        }
+        fprintf(stdout, "\n");
         return 0;
 }
@@ -1,2 +1,2 @@
-catts %1 | tsana -alles
+tsana -demux es %1
 pause
@@ -6,5 +6,5 @@
 @rem 截取COUNT个TS包
 @set COUNT=451814
 
-catts %1 | tsana -dump -start %START% -count %COUNT% | tobin %1.ts
+tsana -dump -start %START% -count %COUNT% %1 | tobin %1.ts
 pause
@@ -3,6 +3,12 @@
 #include <stdlib.h>
 #include <string.h> /* for memcpy */
 #include <stdint.h> /* for uintN_t, etc */
+#include <pthread.h> /* for pthread_mutex_xxx, pthread_key_xxx */
+
+#include "config.h" /* for SYS_* macro, generated by configure */
+#ifndef SYS_WINDOWS
+#       include <sys/mman.h> /* for mmap(), madvise(), etc */
+#endif
 
 #include "buddy.h"
 
@@ -22,27 +28,109 @@ static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
 #define IS_POWER_OF_2(x) (0 == ((x) & ((x) - 1)))
 
-#define LSUBTREE(index) (((index) << 1) + 1)
-#define RSUBTREE(index) (((index) << 1) + 2)
-#define PARENT(index)   ((((index) + 1) >> 1) - 1)
+/* bit of free block idx of the order: bits of order omin, then omin + 1, ... omax */
+#define BIT_IDX(p, order, idx) ((((size_t)1 << ((p)->omax - (p)->omin + 1)) - \
+                                 ((size_t)1 << ((p)->omax - (order) + 1))) + (idx))
+#define BIT_GET(bits, i) (((bits)[(i) >> 6] >> ((i) & 63)) & 1)
+#define BIT_SET(bits, i) ((bits)[(i) >> 6] |= ((uint64_t)1 << ((i) & 63)))
+#define BIT_CLR(bits, i) ((bits)[(i) >> 6] &= ~((uint64_t)1 << ((i) & 63)))
+
+#define BLK_ORDER_MIN (4) /* free block keeps next and prev pointer */
+
+#define CACHE_ORDER_MAX (8) /* cache block not bigger than 256-byte: ts_sect, ts_pid, ts_pkt, etc */
+#define CACHE_BATCH (8) /* block number moved between thread cache and buddy lists at one time */
+#define CACHE_MAX (2 * CACHE_BATCH) /* max block number of each order in thread cache */
+#define IS_CACHED(order) ((order) <= CACHE_ORDER_MAX && ((size_t)1 << (order)) >= sizeof(void *))
+
+#define ARENA_MAX (64) /* max arena number of one pool */
+
+struct buddy_pool;
+
+/* free lists of small blocks for one thread, malloc and free without lock */
+struct buddy_cache
+{
+        struct buddy_pool *pool;
+        struct buddy_cache *next; /* cache list of pool */
+        void *blk[CACHE_ORDER_MAX + 1]; /* free list of each order, next pointer is in block */
+        size_t cnt[CACHE_ORDER_MAX + 1]; /* block number in free list */
+        size_t malloc_cnt; /* count of malloc of this thread, for debug */
+        size_t free_cnt; /* count of free of this thread, for debug */
+};
+
+/* node of free list, in the free block */
+struct buddy_blk
+{
+        struct buddy_blk *next;
+        struct buddy_blk *prev;
+};
+
+/* buddy lists of one arena, the pool grows arena by arena:
+ * each order has a free list and a bitmap of its free blocks, so malloc
+ * is to pop the list of the smallest order in avail(by ctz), free is to
+ * check the bit of the buddy and merge, no tree walk from root */
+struct buddy_arena
+{
+        uint8_t *map; /* 1 + order of used block, for each (1 << omin) of arena */
+        uint64_t *bits; /* free block bitmap of each order, see BIT_IDX() */
+        struct buddy_blk **head; /* free list of each order */
+        size_t avail; /* bit order is set if free list of the order is not empty */
+        uint8_t *pool; /* arena buffer, the page is committed when it is touched */
+        int is_trim; /* true, if the pages of this empty arena are returned to OS */
+};
 
 struct buddy_pool
 {
         size_t omax; /* max order */
         size_t omin; /* min order */
-        uint8_t *tree; /* binary tree, the array to describe the status of pool */
-        size_t size; /* pool size: (1 << omax) */
-        uint8_t *pool; /* pool buffer */
+        size_t size; /* arena size: (1 << omax) */
+        int is_init; /* false before buddy_init(), do not grow */
+
+        /* arena[0] is always there, others are added by need and kept for lock-free search;
+         * the pages of empty arena are returned to OS, and committed again when reused */
+        struct buddy_arena arena[ARENA_MAX];
+        size_t arena_cnt; /* set with lock, read without lock, so use __atomic_xxx */
+        struct buddy_arena *spare; /* one empty arena kept with its pages, NULL means none */
+
+        /* for thread safe: the buddy lists are modified with lock only */
+        pthread_mutex_t lock;
+        pthread_key_t key; /* key of buddy_cache of each thread */
+        struct buddy_cache *cache0; /* cache list of all threads */
+
+        /* for debug */
+        size_t malloc_cnt; /* count of malloc, without thread cache or of exited thread */
+        size_t free_cnt; /* count of free, without thread cache or of exited thread */
+        size_t lock_cnt; /* count of lock */
+        size_t wait_cnt; /* count of lock meeting other thread */
+        size_t trim_cnt; /* count of arena returned to OS */
+
+        /* for benchmark */
+        buddy_trace_f trace; /* called for each malloc and free */
+        void *trace_arg;
 };
 
 static size_t smallest_order(size_t size);
+static int arena_create(struct buddy_pool *p, struct buddy_arena *a);
+static void arena_destroy(struct buddy_pool *p, struct buddy_arena *a);
+static void arena_init(struct buddy_pool *p, struct buddy_arena *a);
+static void arena_trim(struct buddy_pool *p, struct buddy_arena *a);
+static struct buddy_arena *find_arena(struct buddy_pool *p, void *ptr);
+static void list_add(struct buddy_pool *p, struct buddy_arena *a, struct buddy_blk *blk, size_t order, size_t idx);
+static void list_del(struct buddy_pool *p, struct buddy_arena *a, struct buddy_blk *blk, size_t order, size_t idx);
+static uint8_t *blk_malloc(struct buddy_pool *p, size_t order);
+static void blk_free(struct buddy_pool *p, void *ptr, size_t order);
+static int find_order(struct buddy_pool *p, void *ptr, size_t *order);
+static void *blk_realloc(struct buddy_pool *p, void *ptr, size_t size);
+static struct buddy_cache *get_cache(struct buddy_pool *p);
+static void flush_cache(struct buddy_cache *c, size_t order, size_t left);
+static size_t drop_cache(struct buddy_pool *p);
+static void exit_cache(void *arg);
+static void pool_lock(struct buddy_pool *p);
 
 /*@only@*/
 /*@null@*/
 void *buddy_create(size_t order_max, size_t order_min)
 {
         struct buddy_pool *p;
-        size_t tree_size;
 
         if(order_max > BUDDY_ORDER_MAX) {
                 RPTERR("create: bad order_max: %zd > %zd", order_max, BUDDY_ORDER_MAX);
@@ -59,111 +147,133 @@ void *buddy_create(size_t order_max, size_t order_min)
                 return NULL; /* failed */
         }
 
-        p = (struct buddy_pool *)malloc(sizeof(struct buddy_pool));
+        p = (struct buddy_pool *)calloc(1, sizeof(struct buddy_pool));
         if(NULL == p) {
                 RPTERR("create: create buddy pool object failed");
                 return NULL; /* failed */
         }
 
         p->omax = order_max;
-        p->omin = order_min;
+        p->omin = MAX(order_min, BLK_ORDER_MIN);
         p->size = ((size_t)1 << order_max);
+        if(p->omin >= p->omax) {
+                RPTERR("create: bad order_max: %zd <= %d", order_max, BLK_ORDER_MIN);
+                free(p);
+                return NULL; /* failed */
+        }
 
-        tree_size = (1 << (p->omax - p->omin + 1)) - 1;
-        p->tree = (uint8_t *)malloc(tree_size); /* FIXME: memalign? */
-        if(NULL == p->tree) {
-                RPTERR("create: malloc tree(%zd-byte) failed", tree_size);
+        if(0 != arena_create(p, &(p->arena[0]))) {
                 free(p);
                 return NULL; /* failed */
         }
-        RPTDBG("create: tree: %8zX-byte @ %p", tree_size, p->tree);
+        p->arena_cnt = 1;
+        p->spare = NULL;
 
-        p->pool = (uint8_t *)malloc(p->size); /* FIXME: memalign? */
-        if(NULL == p->pool) {
-                RPTERR("create: malloc pool(%zd-byte) failed", p->size);
-                free(p->tree);
+        if(0 != pthread_key_create(&(p->key), exit_cache)) {
+                RPTERR("create: create key of thread cache failed");
+                arena_destroy(p, &(p->arena[0]));
                 free(p);
                 return NULL; /* failed */
         }
-        RPTDBG("create: pool: %8zX-byte @ %p, min space: %zX", p->size, p->pool, (size_t)1 << order_min);
+        pthread_mutex_init(&(p->lock), NULL);
+        p->cache0 = NULL;
 
-        p->tree[0] = 0; /* to avoid use malloc() before init() */
+        p->is_init = 0;
+        p->trace = NULL;
         return p;
 }
 
 int buddy_destroy(/*@only@*/ /*@null@*/ void *id)
 {
         struct buddy_pool *p;
-        int rslt = 0;
+        size_t k;
 
         p = (struct buddy_pool *)id;
         if(!p) {
                 RPTERR("destroy: bad id");
-                rslt = -1;
-                return rslt;
+                return -1;
         }
 
-        if(p->tree) {
-                free(p->tree);
-        } else {
-                RPTERR("destroy: bad tree");
-                rslt = -2;
+        /* the blocks in thread cache are returned with pool */
+        while(NULL != p->cache0) {
+                struct buddy_cache *c = p->cache0;
+
+                p->cache0 = c->next;
+                free(c);
         }
+        pthread_key_delete(p->key); /* no exit_cache() after here */
+        pthread_mutex_destroy(&(p->lock));
 
-        if(p->pool) {
-                free(p->pool);
-        } else {
-                RPTERR("destroy: bad pool");
-                rslt = -3;
+        for(k = 0; k < p->arena_cnt; k++) {
+                arena_destroy(p, &(p->arena[k]));
         }
 
         free(p);
-        return rslt;
+        return 0;
 }
 
 int buddy_init(void *id)
 {
         struct buddy_pool *p;
-        size_t tree_size;
-        size_t order;
-        size_t i;
+        struct buddy_cache *c;
 
         p= (struct buddy_pool *)id;
         if(NULL == p) {
                 RPTERR("init: bad id");
                 return -1;
         }
-        if(NULL == p->tree) {
-                RPTERR("init: bad tree");
+        if(NULL == p->arena[0].map) {
+                RPTERR("init: bad map");
                 return -1;
         }
 
-        tree_size = (1 << (p->omax - p->omin + 1)) - 1;
-        for(order = p->omax + 1, i = 0; i < tree_size; i++) {
-                if(IS_POWER_OF_2(i + 1)) {
-                        order--;
-                }
-                p->tree[i] = order;
+        pthread_mutex_lock(&(p->lock));
+
+        /* back to one arena */
+        while(p->arena_cnt > 1) {
+                p->arena_cnt--;
+                arena_destroy(p, &(p->arena[p->arena_cnt]));
         }
+        arena_init(p, &(p->arena[0]));
+        p->spare = NULL;
+        p->is_init = 1;
+
+        /* all blocks are free now, clear thread cache */
+        for(c = p->cache0; c; c = c->next) {
+                memset(c->blk, 0, sizeof(c->blk));
+                memset(c->cnt, 0, sizeof(c->cnt));
+                c->malloc_cnt = 0;
+                c->free_cnt = 0;
+        }
+        p->malloc_cnt = 0;
+        p->free_cnt = 0;
+        p->lock_cnt = 0;
+        p->wait_cnt = 0;
+        p->trim_cnt = 0;
+        pthread_mutex_unlock(&(p->lock));
         return 0;
 }
 
 int buddy_status(void *id, int enable, const char *hint)
 {
         struct buddy_pool *p;
+        struct buddy_cache *c;
         size_t order;
-        size_t tree_size;
-        size_t cnt;
+        size_t cnt[BUDDY_ORDER_MAX + 1];
         size_t acc;
         size_t i;
+        size_t k;
+        size_t cached;
+        size_t malloc_cnt;
+        size_t free_cnt;
 
         p = (struct buddy_pool *)id;
         if(NULL == p) {
                 RPTERR("status: bad id");
                 return -1;
         }
-        if(NULL == p->tree) {
-                RPTERR("status: bad tree");
+        if(NULL == p->arena[0].map) {
+                RPTERR("status: bad map");
                 return -1;
         }
         if(0 == enable) {
@@ -171,86 +281,83 @@ int buddy_status(void *id, int enable, const char *hint)
                 return 0;
         }
 
-        order = p->omax + 1;
-        tree_size = (1 << (p->omax - p->omin + 1)) - 1;
-        cnt = 0;
+        pthread_mutex_lock(&(p->lock));
+        memset(cnt, 0, sizeof(cnt));
         acc = 0;
-        fprintf(stderr,"buddy: ");
-#if 0
-        fprintf(stderr,"\n");
-#endif
-        for(i = 0; i < tree_size; i++) {
-                if(IS_POWER_OF_2(i + 1)) {
-                        order--;
-                        cnt = 0;
-                }
-                if(0 == p->tree[i]) {
-                        if(LSUBTREE(i) >= tree_size || RSUBTREE(i) >= tree_size) {
-                                /* no subtree */
-                                cnt++;
-                                acc += (1 << order);
-#if 0
-                                uint8_t *buf = (p->pool + (i + 1) * (1<<order) - (p->size));
-                                for(size_t x = 0; x <(1 << order); x++) {
-                                        fprintf(stderr, "%c", *(buf + x));
-                                }
-                                fprintf(stderr, "\n");
-                                for(size_t x = 0; x <(1 << order); x++) {
-                                        fprintf(stderr, "%02X ", *(buf + x));
-                                }
-                                fprintf(stderr, "\n");
-#endif
-                        }
-                        else {
-                                /* depend on subtree */
-                                if(0 != p->tree[LSUBTREE(i)] || 0 != p->tree[RSUBTREE(i)]) {
-                                        cnt++;
-                                        acc += (1 << order);
-#if 0
-                                        uint8_t *buf = (p->pool + (i + 1) * (1<<order) - (p->size));
-                                        for(size_t x = 0; x <(1 << order); x++) {
-                                                fprintf(stderr, "%c", *(buf + x));
-                                        }
-                                        fprintf(stderr, "\n");
-                                        for(size_t x = 0; x <(1 << order); x++) {
-                                                fprintf(stderr, "%02X ", *(buf + x));
-                                        }
-                                        fprintf(stderr, "\n");
-#endif
-                                }
+        for(k = 0; k < p->arena_cnt; k++) {
+                uint8_t *map = p->arena[k].map;
+
+                for(i = 0; i < ((size_t)1 << (p->omax - p->omin)); i++) {
+                        if(0 != map[i]) {
+                                order = (size_t)(map[i]) - 1;
+                                cnt[order]++;
+                                acc += ((size_t)1 << order);
                         }
                 }
-                if(IS_POWER_OF_2(i + 2) && (0 != cnt)) {
-                        fprintf(stderr,"%3zd x 0x%zX, ", cnt, (size_t)1 << order);
-#if 0
-                        fprintf(stderr, "\n");
-#endif
+        }
+
+        fprintf(stderr,"buddy: ");
+        for(order = p->omax; order >= p->omin; order--) {
+                if(0 != cnt[order]) {
+                        fprintf(stderr,"%3zd x 0x%zX, ", cnt[order], (size_t)1 << order);
                 }
         }
-        fprintf(stderr,"(%zu / %zu) used", acc, (size_t)1 << p->omax);
+        fprintf(stderr,"(%zu / %zu) used in %zu arena, %zu trim", acc, p->arena_cnt << p->omax,
+                p->arena_cnt, p->trim_cnt);
+
+        /* counter of other running thread maybe not exact */
+        cached = 0;
+        malloc_cnt = p->malloc_cnt;
+        free_cnt = p->free_cnt;
+        for(c = p->cache0; c; c = c->next) {
+                for(order = p->omin; order <= CACHE_ORDER_MAX; order++) {
+                        cached += (c->cnt[order] << order);
+                }
+                malloc_cnt += c->malloc_cnt;
+                free_cnt += c->free_cnt;
+        }
+        fprintf(stderr,", %zu cached, %zu malloc, %zu free, %zu lock, %zu wait",
+                cached, malloc_cnt, free_cnt, p->lock_cnt, p->wait_cnt);
+        pthread_mutex_unlock(&(p->lock));
         fprintf(stderr,": %s\n", ((hint) ? hint : ""));
         return 0;
 }
 
+int buddy_trace(void *id, buddy_trace_f f, void *arg)
+{
+        struct buddy_pool *p;
+
+        p = (struct buddy_pool *)id;
+        if(NULL == p) {
+                RPTERR("trace: bad id");
+                return -1;
+        }
+
+        pthread_mutex_lock(&(p->lock));
+        p->trace = f;
+        p->trace_arg = arg;
+        pthread_mutex_unlock(&(p->lock));
+        return 0;
+}
+
 /*@dependent@*/
 /*@null@*/
 void *buddy_malloc(void *id, size_t size)
 {
         struct buddy_pool *p = (struct buddy_pool *)id;
+        struct buddy_cache *c;
         size_t order;
-        size_t i;
-        size_t current_order;
         uint8_t *rslt;
 
         if(NULL == p) {
                 RPTERR("malloc: bad id");
                 return NULL;
         }
-        if(NULL == p->tree) {
-                RPTERR("malloc: bad tree");
+        if(NULL == p->arena[0].map) {
+                RPTERR("malloc: bad map");
                 return NULL;
         }
-        if(NULL == p->pool) {
+        if(NULL == p->arena[0].pool) {
                 RPTERR("malloc: bad pool");
                 return NULL;
         }
@@ -260,34 +367,58 @@ void *buddy_malloc(void *id, size_t size)
                 return NULL;
         }
 
-        /* determine aim order in tree */
+        /* determine aim order */
         order = MAX(smallest_order(size), p->omin);
-        if((size_t)(p->tree[0]) < order) {
-                RPTERR("malloc: not enough space in pool");
-                return NULL;
+        c = (IS_CACHED(order) ? get_cache(p) : NULL);
+        if(NULL == c) {
+                /* big block, malloc in buddy lists directly */
+                pool_lock(p);
+                rslt = blk_malloc(p, order);
+                if(NULL == rslt && 0 != drop_cache(p)) {
+                        rslt = blk_malloc(p, order); /* try again */
+                }
+                if(NULL != rslt) {
+                        p->malloc_cnt++;
+                }
+                pthread_mutex_unlock(&(p->lock));
+                if(NULL == rslt) {
+                        RPTERR("malloc: not enough space in pool");
+                }
+                else if(NULL != p->trace) {
+                        p->trace(p->trace_arg, rslt, size);
+                }
+                return rslt;
         }
 
-        /* search aim node in the tree */
-        i = 0; /* index of binary tree array */
-        for(current_order = p->omax; current_order > order; current_order--) {
-                if(p->tree[LSUBTREE(i)] >= order) {
-                        i = LSUBTREE(i);
+        if(0 == c->cnt[order]) {
+                /* refill free list of this thread with one lock */
+                pool_lock(p);
+                while(c->cnt[order] < CACHE_BATCH) {
+                        rslt = blk_malloc(p, order);
+                        if(NULL == rslt && 0 == c->cnt[order] && 0 != drop_cache(p)) {
+                                rslt = blk_malloc(p, order); /* try again */
+                        }
+                        if(NULL == rslt) {
+                                break;
+                        }
+                        *(void **)rslt = c->blk[order];
+                        c->blk[order] = rslt;
+                        c->cnt[order]++;
                 }
-                else {
-                        i = RSUBTREE(i);
+                pthread_mutex_unlock(&(p->lock));
+                if(0 == c->cnt[order]) {
+                        RPTERR("malloc: not enough space in pool");
+                        return NULL;
                 }
         }
-        p->tree[i] = 0; /* find the aim node */
-
-        rslt = (p->pool + (i + 1) * (1<<order) - (p->size));
-        RPTDBG("malloc:  @ %p %zX %zX", rslt, (size_t)1 << order, size);
 
-        /* modify parent order */
-        while(0 != i) {
-                i = PARENT(i);
-                p->tree[i] = MAX(p->tree[LSUBTREE(i)], p->tree[RSUBTREE(i)]) ;
+        rslt = (uint8_t *)(c->blk[order]);
+        c->blk[order] = *(void **)rslt;
+        c->cnt[order]--;
+        c->malloc_cnt++;
+        if(NULL != p->trace) {
+                p->trace(p->trace_arg, rslt, size);
         }
-
         return rslt;
 }
 
@@ -296,26 +427,17 @@ void *buddy_malloc(void *id, size_t size)
 void *buddy_realloc(void *id, void *ptr, size_t size) /* FIXME: need to be test */
 {
         struct buddy_pool *p = (struct buddy_pool *)id;
-        size_t offset;
-        size_t old_order;
-        size_t oi; /* index of binary tree array */
-        size_t found;
-        size_t new_order;
-        size_t ni; /* index of binary tree array */
-        size_t current_order;
-        uint8_t *rslt;
-        size_t lorder;
-        size_t rorder;
+        void *rslt;
 
         if(NULL == p) {
                 RPTERR("realloc: bad id");
                 return NULL;
         }
-        if(NULL == p->tree) {
-                RPTERR("realloc: bad tree");
+        if(NULL == p->arena[0].map) {
+                RPTERR("realloc: bad map");
                 return NULL;
         }
-        if(NULL == p->pool) {
+        if(NULL == p->arena[0].pool) {
                 RPTERR("realloc: bad pool");
                 return NULL;
         }
@@ -328,162 +450,444 @@ void *buddy_realloc(void *id, void *ptr, size_t size) /* FIXME: need to be test
                 return NULL;
         }
 
-        /* determine offset, then search old node in the tree */
-        if((uint8_t *)ptr < p->pool) {
-                RPTERR("realloc: bad ptr: %p(%p + %zd), before pool", ptr, p->pool, p->size);
-                return NULL;
+        pool_lock(p);
+        rslt = blk_realloc(p, ptr, size);
+        pthread_mutex_unlock(&(p->lock));
+        if(NULL != rslt && NULL != p->trace) {
+                p->trace(p->trace_arg, ptr, 0);
+                p->trace(p->trace_arg, rslt, size);
+        }
+        return rslt;
+}
+
+void buddy_free(/*@null@*/ void *id, /*@dependent@*/ /*@null@*/ void *ptr)
+{
+        struct buddy_pool *p = (struct buddy_pool *)id;
+        struct buddy_cache *c;
+        size_t order;
+
+        if(NULL == p) {
+                RPTERR("free: bad id");
+                return;
         }
-        offset = (size_t)((uint8_t *)ptr - p->pool); /* FIXME */
-        if(offset >= p->size) {
-                RPTERR("realloc: bad ptr: %p(%p + %zd), after pool", ptr, p->pool, p->size);
+        if(NULL == p->arena[0].map) {
+                RPTERR("free: bad map");
+                return;
+        }
+        if(NULL == p->arena[0].pool) {
+                RPTERR("free: bad pool");
+                return;
+        }
+        if(NULL == ptr) {
+                RPTERR("free: bad ptr");
+                return;
+        }
+
+        /* the node of ptr is used by this thread, so search it without lock */
+        if(0 != find_order(p, ptr, &order)) {
+                return;
+        }
+        RPTDBG("free:    @ %p %zX", ptr, (size_t)1 << order);
+        if(NULL != p->trace) {
+                p->trace(p->trace_arg, ptr, 0);
+        }
+
+        c = (IS_CACHED(order) ? get_cache(p) : NULL);
+        if(NULL == c) {
+                /* big block, free in buddy lists directly */
+                pool_lock(p);
+                blk_free(p, ptr, order);
+                p->free_cnt++;
+                pthread_mutex_unlock(&(p->lock));
+                return;
+        }
+
+        *(void **)ptr = c->blk[order];
+        c->blk[order] = ptr;
+        c->cnt[order]++;
+        c->free_cnt++;
+        if(c->cnt[order] > CACHE_MAX) {
+                /* return part of free list to buddy lists with one lock */
+                pool_lock(p);
+                flush_cache(c, order, CACHE_BATCH);
+                pthread_mutex_unlock(&(p->lock));
+        }
+        return;
+}
+
+/* pop a free block of the order, split it down to aim order, with lock */
+static uint8_t *blk_malloc(struct buddy_pool *p, size_t order)
+{
+        struct buddy_arena *a = NULL;
+        struct buddy_blk *blk;
+        size_t k;
+        size_t idx;
+        size_t free_order;
+
+        if(order > p->omax) {
                 return NULL;
         }
 
-        old_order = p->omin;
-        oi = 0;
-        found = 0;
-        while(offset % (1<<old_order) == 0) {
-                oi = (1<<(p->omax - old_order)) - 1 + offset / (1<<old_order);
-                if(0 == p->tree[oi]) {
-                        found = 1;
+        /* the first arena with enough space, so the last arenas may be empty */
+        for(k = 0; k < p->arena_cnt; k++) {
+                if(0 != (p->arena[k].avail >> order)) {
+                        a = &(p->arena[k]);
                         break;
                 }
-                old_order++;
         }
-        if(0 == found) {
-                RPTERR("realloc: bad ptr: %p, illegal node or module bug", ptr);
-                return NULL;
+        if(NULL == a) {
+                if(!(p->is_init) || p->arena_cnt >= ARENA_MAX) {
+                        return NULL;
+                }
+                a = &(p->arena[p->arena_cnt]);
+                if(0 != arena_create(p, a)) {
+                        return NULL;
+                }
+                arena_init(p, a);
+                __atomic_store_n(&(p->arena_cnt), p->arena_cnt + 1, __ATOMIC_RELEASE);
+                RPTINF("malloc: add arena %zu", p->arena_cnt);
+        }
+        a->is_trim = 0;
+        if(a == p->spare) {
+                p->spare = NULL; /* in use again */
         }
 
-        /* determine new_order in tree */
-        new_order = MAX(smallest_order(size), p->omin);
-        if((size_t)(p->tree[0]) < new_order) {
-                RPTERR("realloc: not enough space in pool");
-                return NULL;
+        /* smallest order with free block */
+        free_order = order + (size_t)__builtin_ctzll((unsigned long long)(a->avail >> order));
+        blk = a->head[free_order];
+        idx = (size_t)((uint8_t *)blk - a->pool) >> free_order;
+        list_del(p, a, blk, free_order, idx);
+
+        /* split: the right half is free */
+        while(free_order > order) {
+                free_order--;
+                idx <<= 1;
+                list_add(p, a, (struct buddy_blk *)(a->pool + ((idx + 1) << free_order)), free_order, idx + 1);
         }
 
-        /* maybe do not need to realloc */
-        if(new_order <= old_order) {
-                return ptr;
+        a->map[(idx << order) >> p->omin] = (uint8_t)(order + 1);
+        RPTDBG("malloc:  @ %p %zX", a->pool + (idx << order), (size_t)1 << order);
+        return (a->pool + (idx << order));
+}
+
+/* merge the block with its free buddy order by order, with lock */
+static void blk_free(struct buddy_pool *p, void *ptr, size_t order)
+{
+        struct buddy_arena *a;
+        size_t idx;
+
+        a = find_arena(p, ptr);
+        idx = (size_t)((uint8_t *)ptr - a->pool) >> order;
+        a->map[(idx << order) >> p->omin] = 0;
+
+        while(order < p->omax && BIT_GET(a->bits, BIT_IDX(p, order, idx ^ 1))) {
+                list_del(p, a, (struct buddy_blk *)(a->pool + ((idx ^ 1) << order)), order, idx ^ 1);
+                idx >>= 1;
+                order++;
         }
+        list_add(p, a, (struct buddy_blk *)(a->pool + (idx << order)), order, idx);
 
-        /* search new node in the tree */
-        ni = 0; /* index of binary tree array */
-        for(current_order = p->omax; current_order > new_order; current_order--) {
-                if(p->tree[LSUBTREE(ni)] >= new_order) {
-                        ni = LSUBTREE(ni);
-                }
-                else {
-                        ni = RSUBTREE(ni);
+        /* empty: keep the last one as spare, so a load about the arena border
+         * does not pay madvise() and page faults on each malloc and free */
+        if(a != &(p->arena[0]) && order == p->omax) {
+                if(NULL != p->spare && a != p->spare) {
+                        arena_trim(p, p->spare);
                 }
+                p->spare = a;
         }
+        return;
+}
 
-        rslt = (p->pool + (ni + 1) * (1<<new_order) - (p->size));
-        RPTDBG("realloc: @ %p %zX %zX", rslt, (size_t)1 << new_order, size);
+/* get the order of a used block: only the map byte of the block is read, without lock */
+static int find_order(struct buddy_pool *p, void *ptr, size_t *order)
+{
+        struct buddy_arena *a;
+        size_t offset;
+        uint8_t dat;
 
-        /* modify tree for new */
-        p->tree[ni] = 0;
-        while(0 != ni) {
-                ni = PARENT(ni);
-                p->tree[ni] = MAX(p->tree[LSUBTREE(ni)], p->tree[RSUBTREE(ni)]) ;
+        /* determine arena and offset, then get order in map */
+        a = find_arena(p, ptr);
+        if(NULL == a) {
+                RPTERR("free: bad ptr: %p, out of %zu arena", ptr, p->arena_cnt);
+                return -1;
         }
+        offset = (size_t)((uint8_t *)ptr - a->pool);
+        dat = a->map[offset >> p->omin];
+        if(0 != (offset & (((size_t)1 << p->omin) - 1)) || 0 == dat) {
+                RPTERR("free: bad ptr: %p, illegal node or module bug", ptr);
+                return -1;
+        }
+        *order = (size_t)dat - 1;
+        return 0;
+}
 
-        /* copy data */
-        memmove(rslt, ptr, ((size_t)1 << old_order)); /* FIXME: splint prohibit using memcpy here */
+/* new node, copy data, then free old node, with lock */
+static void *blk_realloc(struct buddy_pool *p, void *ptr, size_t size)
+{
+        size_t old_order;
+        size_t new_order;
+        uint8_t *rslt;
 
-        /* modify tree for old */
-        RPTDBG("realloc: @ %p %zX", ptr, (size_t)1 << old_order);
-        p->tree[oi] = old_order;
-        while(0 != oi) {
-                oi = PARENT(oi) ;
-                old_order++;
+        if(0 != find_order(p, ptr, &old_order)) {
+                return NULL;
+        }
 
-                lorder = p->tree[LSUBTREE(oi)];
-                rorder = p->tree[RSUBTREE(oi)];
-                if(lorder == (old_order - 1) &&
-                   rorder == (old_order - 1)) {
-                        p->tree[oi] = old_order;
-                }
-                else {
-                        p->tree[oi] = MAX(lorder, rorder);
-                }
+        /* maybe do not need to realloc */
+        new_order = MAX(smallest_order(size), p->omin);
+        if(new_order <= old_order) {
+                return ptr;
+        }
+
+        rslt = blk_malloc(p, new_order);
+        if(NULL == rslt) {
+                RPTERR("realloc: not enough space in pool");
+                return NULL;
         }
+        RPTDBG("realloc: @ %p %zX -> @ %p %zX", ptr, (size_t)1 << old_order, rslt, (size_t)1 << new_order);
+        p->malloc_cnt++;
+        p->free_cnt++;
 
+        memcpy(rslt, ptr, ((size_t)1 << old_order));
+        blk_free(p, ptr, old_order);
         return rslt;
 }
 
-void buddy_free(/*@null@*/ void *id, /*@dependent@*/ /*@null@*/ void *ptr)
+/* map, bits and head are malloced, pool is mapped but not committed */
+static int arena_create(struct buddy_pool *p, struct buddy_arena *a)
 {
-        struct buddy_pool *p = (struct buddy_pool *)id;
-        size_t offset;
-        size_t order;
-        size_t i; /* index of binary tree array */
-        int found;
-        size_t lorder;
-        size_t rorder;
-
-        if(NULL == p) {
-                RPTERR("free: bad id");
-                return;
+        size_t map_size = ((size_t)1 << (p->omax - p->omin));
+        size_t bits_size = (BIT_IDX(p, p->omax, 1) + 63) / 64 * sizeof(uint64_t);
+
+        a->map = (uint8_t *)malloc(map_size);
+        a->bits = (uint64_t *)malloc(bits_size);
+        a->head = (struct buddy_blk **)malloc((p->omax + 1) * sizeof(struct buddy_blk *));
+        if(NULL == a->map || NULL == a->bits || NULL == a->head) {
+                RPTERR("create: malloc map(%zd-byte) and bits(%zd-byte) failed", map_size, bits_size);
+                arena_destroy(p, a);
+                return -1;
         }
-        if(NULL == p->tree) {
-                RPTERR("free: bad tree");
-                return;
+        RPTDBG("create: map: %8zX-byte @ %p, bits: %8zX-byte @ %p", map_size, a->map, bits_size, a->bits);
+
+#ifndef SYS_WINDOWS
+        a->pool = (uint8_t *)mmap(NULL, p->size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(MAP_FAILED == (void *)(a->pool)) {
+                a->pool = NULL;
         }
-        if(NULL == p->pool) {
-                RPTERR("free: bad pool");
-                return;
+#else
+        a->pool = (uint8_t *)malloc(p->size);
+#endif
+        if(NULL == a->pool) {
+                RPTERR("create: map pool(%zd-byte) failed", p->size);
+                arena_destroy(p, a);
+                return -1;
         }
-        if(NULL == ptr) {
-                RPTERR("free: bad ptr");
-                return;
+        RPTDBG("create: pool: %8zX-byte @ %p, min space: %zX", p->size, a->pool, (size_t)1 << p->omin);
+        a->avail = 0; /* to avoid use malloc() before init() */
+        a->is_trim = 0;
+        return 0;
+}
+
+static void arena_destroy(struct buddy_pool *p, struct buddy_arena *a)
+{
+        if(a->map) {
+                free(a->map);
+                a->map = NULL;
+        }
+        if(a->bits) {
+                free(a->bits);
+                a->bits = NULL;
+        }
+        if(a->head) {
+                free(a->head);
+                a->head = NULL;
+        }
+        if(a->pool) {
+#ifndef SYS_WINDOWS
+                munmap(a->pool, p->size);
+#else
+                free(a->pool);
+#endif
+                a->pool = NULL;
         }
+        return;
+}
+
+/* the whole arena is one free block */
+static void arena_init(struct buddy_pool *p, struct buddy_arena *a)
+{
+        memset(a->map, 0, (size_t)1 << (p->omax - p->omin));
+        memset(a->bits, 0, (BIT_IDX(p, p->omax, 1) + 63) / 64 * sizeof(uint64_t));
+        memset(a->head, 0, (p->omax + 1) * sizeof(struct buddy_blk *));
+        a->avail = 0;
+        list_add(p, a, (struct buddy_blk *)(a->pool), p->omax, 0);
+        return;
+}
 
-        /* determine offset, then search aim node in the tree */
-        if((uint8_t *)ptr < p->pool) {
-                RPTERR("realloc: bad ptr: %p(%p + %zd), before pool", ptr, p->pool, p->size);
+/* the arena is kept for lock-free search, but its pages are returned to OS */
+static void arena_trim(struct buddy_pool *p, struct buddy_arena *a)
+{
+        if(a->is_trim) {
                 return;
         }
-        offset = (size_t)((uint8_t *)ptr - p->pool); /* FIXME */
-        if(offset >= p->size) {
-                RPTERR("realloc: bad ptr: %p(%p + %zd), after pool", ptr, p->pool, p->size);
+#ifndef SYS_WINDOWS
+        if(0 != madvise(a->pool, p->size, MADV_DONTNEED)) {
+                RPTINF("madvise arena failed, keep its pages");
                 return;
         }
+        arena_init(p, a); /* the free list node in the first page is lost */
+#else
+        return; /* can not return part of malloc memory */
+#endif
+        a->is_trim = 1;
+        p->trim_cnt++;
+        return;
+}
 
-        order = p->omin;
-        i = 0;
-        found = 0;
-        while(offset % (1<<order) == 0) {
-                i = (1<<(p->omax - order)) - 1 + offset / (1<<order);
-                if(0 == p->tree[i]) {
-                        found = 1;
-                        break;
+/* the arena of ptr, without lock: arena is added only, before buddy_init() */
+static struct buddy_arena *find_arena(struct buddy_pool *p, void *ptr)
+{
+        struct buddy_arena *a;
+        size_t cnt;
+        size_t k;
+
+        cnt = __atomic_load_n(&(p->arena_cnt), __ATOMIC_ACQUIRE);
+        for(k = 0; k < cnt; k++) {
+                a = &(p->arena[k]);
+                if((uint8_t *)ptr >= a->pool && (uint8_t *)ptr < a->pool + p->size) {
+                        return a;
                 }
-                order++;
         }
-        if(0 == found) {
-                RPTERR("free: bad ptr: %p, illegal node or module bug", ptr);
-                return;
+        return NULL;
+}
+
+/* push free block to the list of its order, O(1) */
+static void list_add(struct buddy_pool *p, struct buddy_arena *a, struct buddy_blk *blk, size_t order, size_t idx)
+{
+        blk->prev = NULL;
+        blk->next = a->head[order];
+        if(blk->next) {
+                blk->next->prev = blk;
+        }
+        a->head[order] = blk;
+        a->avail |= ((size_t)1 << order);
+        BIT_SET(a->bits, BIT_IDX(p, order, idx));
+        return;
+}
+
+/* remove free block from the list of its order, O(1) */
+static void list_del(struct buddy_pool *p, struct buddy_arena *a, struct buddy_blk *blk, size_t order, size_t idx)
+{
+        if(blk->prev) {
+                blk->prev->next = blk->next;
+        }
+        else {
+                a->head[order] = blk->next;
         }
+        if(blk->next) {
+                blk->next->prev = blk->prev;
+        }
+        if(NULL == a->head[order]) {
+                a->avail &= ~((size_t)1 << order);
+        }
+        BIT_CLR(a->bits, BIT_IDX(p, order, idx));
+        return;
+}
 
-        /* modify tree */
-        RPTDBG("free:    @ %p %zX", ptr, (size_t)1 << order);
-        p->tree[i] = order;
-        while(0 != i) {
-                i = PARENT(i) ;
-                order++;
+/* free lists of this thread, create it when first use */
+static struct buddy_cache *get_cache(struct buddy_pool *p)
+{
+        struct buddy_cache *c;
 
-                lorder = p->tree[LSUBTREE(i)];
-                rorder = p->tree[RSUBTREE(i)];
-                if(lorder == (order - 1) &&
-                   rorder == (order - 1)) {
-                        p->tree[i] = order;
-                }
-                else {
-                        p->tree[i] = MAX(lorder, rorder);
+        c = (struct buddy_cache *)pthread_getspecific(p->key);
+        if(NULL != c) {
+                return c;
+        }
+
+        c = (struct buddy_cache *)calloc(1, sizeof(struct buddy_cache));
+        if(NULL == c) {
+                RPTINF("malloc thread cache failed, use buddy lists directly");
+                return NULL;
+        }
+        if(0 != pthread_setspecific(p->key, c)) {
+                RPTINF("set thread cache failed, use buddy lists directly");
+                free(c);
+                return NULL;
+        }
+        c->pool = p;
+
+        pthread_mutex_lock(&(p->lock));
+        c->next = p->cache0;
+        p->cache0 = c;
+        pthread_mutex_unlock(&(p->lock));
+        return c;
+}
+
+/* return blocks of one order in cache to buddy lists until left number, with lock */
+static void flush_cache(struct buddy_cache *c, size_t order, size_t left)
+{
+        void *ptr;
+
+        while(c->cnt[order] > left) {
+                ptr = c->blk[order];
+                c->blk[order] = *(void **)ptr;
+                c->cnt[order]--;
+                blk_free(c->pool, ptr, order);
+        }
+        return;
+}
+
+/* return all blocks in cache of this thread to buddy lists, with lock */
+static size_t drop_cache(struct buddy_pool *p)
+{
+        struct buddy_cache *c;
+        size_t order;
+        size_t cnt = 0;
+
+        c = (struct buddy_cache *)pthread_getspecific(p->key);
+        if(NULL == c) {
+                return 0;
+        }
+        for(order = p->omin; order <= CACHE_ORDER_MAX; order++) {
+                cnt += c->cnt[order];
+                flush_cache(c, order, 0);
+        }
+        return cnt;
+}
+
+/* destructor of thread cache, called when thread exit */
+static void exit_cache(void *arg)
+{
+        struct buddy_cache *c = (struct buddy_cache *)arg;
+        struct buddy_pool *p = c->pool;
+        struct buddy_cache **pc;
+        size_t order;
+
+        pthread_mutex_lock(&(p->lock));
+        for(order = p->omin; order <= CACHE_ORDER_MAX; order++) {
+                flush_cache(c, order, 0);
+        }
+        p->malloc_cnt += c->malloc_cnt;
+        p->free_cnt += c->free_cnt;
+        for(pc = &(p->cache0); *pc; pc = &((*pc)->next)) {
+                if(*pc == c) {
+                        *pc = c->next;
+                        break;
                 }
         }
+        pthread_mutex_unlock(&(p->lock));
+        free(c);
+        return;
+}
 
+/* lock the buddy lists, count the contention */
+static void pool_lock(struct buddy_pool *p)
+{
+        if(0 != pthread_mutex_trylock(&(p->lock))) {
+                pthread_mutex_lock(&(p->lock));
+                p->wait_cnt++;
+        }
+        p->lock_cnt++;
         return;
 }
 
@@ -14,12 +14,30 @@ extern "C" {
 
 #define BUDDY_ORDER_MAX (8 * sizeof(size_t))
 
+/* for benchmark: called after each malloc, and before each free with size 0 */
+typedef void (*buddy_trace_f)(void *arg, void *ptr, size_t size);
+
+/* growable: the pool is made of arenas of (1 << order_max) bytes, mapped
+ * but committed when touched, an arena is added when all are full, and the
+ * pages of empty arena are returned to OS, except the last one emptied,
+ * at most 64 arenas;
+ * O(1): each order of arena has a free list and a bitmap of free blocks,
+ * malloc pops the smallest order with free block, free merges the block
+ * with its buddy by the bitmap, no walk of a binary tree from root;
+ * thread safe: small block(not bigger than 256-byte, e.g. ts_sect, ts_pid,
+ * ts_pkt) is malloced and freed in free lists of each thread without lock,
+ * the free lists are refilled from or returned to the buddy lists with lock;
+ * buddy_init() and buddy_destroy() should be called when no other thread
+ * uses the pool, the blocks in free list are returned when thread exit
+ */
+
 /*@only@*/
 /*@null@*/
 void *buddy_create(size_t order_max, size_t order_min);
 int buddy_destroy(/*@only@*/ /*@null@*/ void *id);
 int buddy_init(void *id);
-int buddy_status(void *id, int enable, const char *hint); /* for debug */
+int buddy_status(void *id, int enable, const char *hint); /* for debug: usage, malloc, lock count, etc */
+int buddy_trace(void *id, buddy_trace_f f, void *arg); /* for benchmark: record malloc and free, f is NULL to stop */
 
 /*@dependent@*/
 /*@null@*/
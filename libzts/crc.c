@@ -0,0 +1,185 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: crc.c
+ * funx: CRC-8/16/32 of MPEG-2 TS, MSB first, init all "1", no final xor
+ */
+
+#include <stdlib.h> /* for size_t */
+#include <stdint.h> /* for uint?_t, etc */
+#include <pthread.h> /* for pthread_once() */
+
+#include "config.h"
+#include "ts.h"
+
+#if defined(__GNUC__) && (defined(ARCH_X86_64) || defined(ARCH_X86))
+#define HAVE_CLMUL 1
+#include <immintrin.h> /* for _mm_clmulepi64_si128, _mm_shuffle_epi8, etc */
+#endif
+
+#define POLY08 (0x07u) /* x8 + x2 + x + 1 */
+#define POLY16 (0x9001u) /* x16 + x15 + x12 + 1, as the old bit loop */
+#define POLY32 (0x04C11DB7u) /* MPEG-2 CRC_32 */
+
+#define CLMUL_SIZE_MIN (64) /* shorter buffer: table is fast enough */
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT; /* ts_obj of some threads share the tables */
+static uint8_t tab08[256];
+static uint16_t tab16[256];
+static uint32_t tab32[8][256]; /* tab32[k][b]: CRC of b followed by k zero bytes */
+
+static uint32_t (*crc32_fx)(uint32_t crc, const uint8_t *p, size_t size);
+
+static void crc_init(void);
+static uint32_t crc32_tab(uint32_t crc, const uint8_t *p, size_t size);
+
+#ifdef HAVE_CLMUL
+static uint64_t k192; /* x^192 mod POLY32 */
+static uint64_t k128; /* x^128 mod POLY32 */
+static uint32_t xn_mod(int n);
+static uint32_t crc32_clmul(uint32_t crc, const uint8_t *p, size_t size);
+#endif
+
+uint32_t ts_crc(void *buf, size_t size, int mode)
+{
+        const uint8_t *p = buf;
+        uint32_t crc;
+
+        pthread_once(&crc_once, crc_init);
+
+        switch(mode) {
+                case 8:
+                        crc = 0xFF;
+                        while(size--) {
+                                crc = tab08[crc ^ *p++];
+                        }
+                        break;
+                case 16:
+                        crc = 0xFFFF;
+                        while(size--) {
+                                crc = ((crc << 8) ^ tab16[(crc >> 8) ^ *p++]) & 0xFFFF;
+                        }
+                        break;
+                default:
+                        crc = crc32_fx(0xFFFFFFFF, p, size);
+                        break;
+        }
+        return crc;
+}
+
+static void crc_init(void)
+{
+        int i;
+        int k;
+        uint32_t crc;
+
+        for(i = 0; i < 256; i++) {
+                crc = (uint32_t)i;
+                for(k = 0; k < 8; k++) {
+                        crc = (crc & 0x80) ? ((crc << 1) ^ POLY08) : (crc << 1);
+                }
+                tab08[i] = (uint8_t)crc;
+
+                crc = (uint32_t)i << 8;
+                for(k = 0; k < 8; k++) {
+                        crc = (crc & 0x8000) ? ((crc << 1) ^ POLY16) : (crc << 1);
+                }
+                tab16[i] = (uint16_t)crc;
+
+                crc = (uint32_t)i << 24;
+                for(k = 0; k < 8; k++) {
+                        crc = (crc & 0x80000000) ? ((crc << 1) ^ POLY32) : (crc << 1);
+                }
+                tab32[0][i] = crc;
+        }
+        for(i = 0; i < 256; i++) {
+                for(k = 1; k < 8; k++) {
+                        crc = tab32[k - 1][i];
+                        tab32[k][i] = (crc << 8) ^ tab32[0][crc >> 24];
+                }
+        }
+
+        crc32_fx = crc32_tab;
+#ifdef HAVE_CLMUL
+        k192 = xn_mod(192);
+        k128 = xn_mod(128);
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) {
+                crc32_fx = crc32_clmul;
+        }
+#endif
+        return;
+}
+
+/* slicing-by-8 */
+static uint32_t crc32_tab(uint32_t crc, const uint8_t *p, size_t size)
+{
+        uint32_t a;
+        uint32_t b;
+
+        while(size >= 8) {
+                a = crc ^ (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                           ((uint32_t)p[2] <<  8) | ((uint32_t)p[3]));
+                b = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) |
+                    ((uint32_t)p[6] <<  8) | ((uint32_t)p[7]);
+                crc = tab32[7][a >> 24] ^ tab32[6][(a >> 16) & 0xFF] ^
+                      tab32[5][(a >> 8) & 0xFF] ^ tab32[4][a & 0xFF] ^
+                      tab32[3][b >> 24] ^ tab32[2][(b >> 16) & 0xFF] ^
+                      tab32[1][(b >> 8) & 0xFF] ^ tab32[0][b & 0xFF];
+                p += 8;
+                size -= 8;
+        }
+        while(size--) {
+                crc = (crc << 8) ^ tab32[0][(crc >> 24) ^ *p++];
+        }
+        return crc;
+}
+
+#ifdef HAVE_CLMUL
+static uint32_t xn_mod(int n)
+{
+        uint32_t r = 1;
+
+        while(n--) {
+                r = (r & 0x80000000) ? ((r << 1) ^ POLY32) : (r << 1);
+        }
+        return r;
+}
+
+/* fold 16-byte block with carry-less multiply, then finish with table:
+ *      block X = H * x^64 + L, next block Y
+ *      X * x^128 + Y == H * (x^192 mod P) + L * (x^128 mod P) + Y (mod P)
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_clmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+        __m128i swap; /* first byte to bit 127..120 */
+        __m128i k;
+        __m128i x;
+        __m128i y;
+        uint8_t blk[16];
+
+        if(size < CLMUL_SIZE_MIN) {
+                return crc32_tab(crc, p, size);
+        }
+
+        swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        k = _mm_set_epi64x((int64_t)k192, (int64_t)k128);
+
+        x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), swap);
+        x = _mm_xor_si128(x, _mm_set_epi32((int)crc, 0, 0, 0));
+        p += 16;
+        size -= 16;
+
+        while(size >= 16) {
+                y = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), swap);
+                y = _mm_xor_si128(y, _mm_clmulepi64_si128(x, k, 0x11));
+                x = _mm_xor_si128(y, _mm_clmulepi64_si128(x, k, 0x00));
+                p += 16;
+                size -= 16;
+        }
+
+        /* CRC of X with init 0 is X * x^32 mod P, the register we need */
+        _mm_storeu_si128((__m128i *)blk, _mm_shuffle_epi8(x, swap));
+        crc = crc32_tab(0, blk, 16);
+        return crc32_tab(crc, p, size);
+}
+#endif
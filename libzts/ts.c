@@ -25,8 +25,11 @@
 #define BIT(n) (1<<(n))
 #define NORMAL_SECTION_LENGTH_MAX (1021)
 #define PRIVATE_SECTION_LENGTH_MAX (4093)
+#define SECT_ARENA_MIN (1024) /* first size of section arena of one PID */
+#define PES_ARENA_MIN (4096) /* first size of PES arena of one PID */
+#define PES_ARENA_MAX (1 << 23) /* drop the unbounded PES packet bigger than it */
 
-static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+static __thread int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG, 0 for TS_QUIET */
 
 struct ts_pid_table {
         uint16_t min; /* PID range */
@@ -162,12 +165,26 @@ enum {
 
 static void init(/*@out@*/ struct ts_obj *obj);
 static void tidy(struct ts_obj *obj);
+static void seek(struct ts_obj *obj);
 static int state_next_pat(struct ts_obj *obj);
 static int state_next_pmt(struct ts_obj *obj);
 static int state_next_pkt(struct ts_obj *obj);
 
+static void resolve_stage(struct ts_obj *obj);
+static int tsh_af(struct ts_obj *obj);
+static int tsh_timestamp(struct ts_obj *obj);
+static int tsh_cts(struct ts_obj *obj);
+static int tsh_statistic(struct ts_obj *obj);
+static int tsh_sect(struct ts_obj *obj);
+static int tsb_cc(struct ts_obj *obj);
+static int tsb_pcr(struct ts_obj *obj);
+static int tsb_rate(struct ts_obj *obj);
+static int tsb_pes(struct ts_obj *obj);
+static int tsb_pes_pkt(struct ts_obj *obj);
+
 static int ts_parse_af(struct ts_obj *obj); /* Adaption Fields information */
 static int ts_ts2sect(struct ts_obj *obj); /* collect PSI/SI section data */
+static int sect_append(struct ts_obj *obj, const uint8_t *buf, int len);
 static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect);
 static int ts_parse_secb_pat(struct ts_obj *obj);
 static int ts_parse_secb_cat(struct ts_obj *obj);
@@ -176,17 +193,22 @@ static int ts_parse_secb_sdt(struct ts_obj *obj);
 static int ts_parse_pesh(struct ts_obj *obj); /* PES layer information */
 static int ts_parse_pesh_switch(struct ts_obj *obj);
 static int ts_parse_pesh_detail(struct ts_obj *obj);
+static int pes_append(struct ts_obj *obj, const uint8_t *buf, int len);
+static void pes_done(struct ts_obj *obj, int len);
 
 static struct ts_pid *update_pid_list(struct ts_obj *obj, struct ts_pid *new_pid);
 static void free_pid(void *mp, struct ts_pid *pid);
+static struct ts_sect *copy_sect(void *mp, const struct ts_sect *sect);
 static void free_sect(void *mp, struct ts_sect *sect);
 static void free_tabl(void *mp, struct ts_tabl *tabl);
 static void free_prog(void *mp, struct ts_prog *prog);
 static int is_all_prog_parsed(struct ts_obj *obj);
+static uint64_t hash_tabl(uint64_t h, const struct ts_tabl *tabl, int mask);
+static uint64_t hash_mix(uint64_t h, const void *buf, size_t len);
 static int pid_type(uint16_t pid);
 static const struct table_id_table *table_type(uint8_t id);
 static const struct stream_type_table *elem_type(uint8_t stream_type);
-static int dump(uint8_t *buf, int len);
+static int dump(const uint8_t *buf, int len);
 
 /*@only@*/
 /*@null@*/
@@ -211,6 +233,10 @@ struct ts_obj *ts_create(/*@null@*/ void *mp)
         obj->pid0 = NULL; /* no pid list now */
         obj->prog0 = NULL; /* no prog list now */
         obj->tabl0 = NULL; /* no tabl list now */
+        obj->role = NULL; /* TS_ROLE_ALL for all PID */
+        obj->is_quiet = 0; /* report as rpt_lvl */
+        obj->pes_cb = NULL; /* no callback for PES packet */
+        obj->pes_arg = NULL;
         init(obj);
 
         return obj;
@@ -243,6 +269,7 @@ int ts_ioctl(struct ts_obj *obj, int cmd, void *arg)
                 case TS_SCFG:
                         if(arg) {
                                 memcpy(&(obj->cfg), (struct ts_cfg *)arg, sizeof(struct ts_cfg));
+                                resolve_stage(obj);
                         }
                         else {
                                 RPTERR("bad cfg");
@@ -251,6 +278,15 @@ int ts_ioctl(struct ts_obj *obj, int cmd, void *arg)
                 case TS_TIDY:
                         tidy(obj);
                         break;
+                case TS_SROLE:
+                        obj->role = (const uint8_t *)arg; /* NULL is OK */
+                        break;
+                case TS_SEEK:
+                        seek(obj);
+                        break;
+                case TS_QUIET:
+                        obj->is_quiet = ((arg) ? 1 : 0);
+                        break;
                 default:
                         RPTERR("bad cmd");
                         break;
@@ -258,6 +294,18 @@ int ts_ioctl(struct ts_obj *obj, int cmd, void *arg)
         return 0;
 }
 
+int ts_pes_callback(struct ts_obj *obj, /*@null@*/ ts_pes_f f, void *arg)
+{
+        if(!obj) {
+                RPTERR("bad obj");
+                return -1;
+        }
+
+        obj->pes_cb = f;
+        obj->pes_arg = arg;
+        return 0;
+}
+
 static void init(/*@out@*/ struct ts_obj *obj)
 {
         struct ts_pid *pid;
@@ -269,6 +317,7 @@ static void init(/*@out@*/ struct ts_obj *obj)
                 free_pid(obj->mp, pid);
         }
         obj->pid0 = NULL;
+        memset(obj->pid_tab, 0, sizeof(obj->pid_tab));
 
         /* clear the prog list */
         while(NULL != (prog = (struct ts_prog *)zlst_pop(&(obj->prog0)))) {
@@ -288,6 +337,9 @@ static void init(/*@out@*/ struct ts_obj *obj)
         obj->has_got_transport_stream_id = 0;
         obj->transport_stream_id = 0;
         obj->CC_lost = 0;
+        obj->RTP_lost = 0;
+        obj->RTP_jitter = 0;
+        obj->is_RTP_jitter = 0;
         obj->is_pat_pmt_parsed = 0;
         obj->is_psi_si_parsed = 0;
         obj->concerned_pid = 0x0000; /* PAT_PID */
@@ -296,11 +348,17 @@ static void init(/*@out@*/ struct ts_obj *obj)
         obj->CTS0 = (int64_t)0;
         obj->lCTS = (int64_t)0; /* for MTS file only, must init as 0L */
         obj->STC = STC_OVF;
+        obj->ipt.pTS = NULL; /* use ipt.TS[] */
+        obj->ipt.has_rtp = 0;
+        obj->ipt.has_stc = 0;
+        obj->pes = NULL;
+        obj->batch = 0;
         obj->has_scrambling = 0;
         obj->has_CAT = 0;
 
         memset(&(obj->err), 0, sizeof(struct ts_err)); /* no error */
         memset(&(obj->cfg), 0, sizeof(struct ts_cfg)); /* do nothing */
+        resolve_stage(obj);
         return;
 }
 
@@ -320,6 +378,7 @@ static void tidy(struct ts_obj *obj)
                 new_pid.elem = NULL;
                 new_pid.cnt = 0;
                 new_pid.lcnt = 0;
+                new_pid.CC = 0;
                 new_pid.is_CC_sync = 0;
                 (void)update_pid_list(obj, &new_pid);
                 RPTINF("add pat pid: 0x%04X", (unsigned int)(new_pid.PID));
@@ -334,6 +393,7 @@ static void tidy(struct ts_obj *obj)
                 prog->PCRa = STC_OVF;
                 prog->ADDb = 0;
                 prog->PCRb = STC_OVF;
+                memset(&(prog->slope), 0, sizeof(struct ts_slope));
                 prog->is_STC_sync = 0;
 
                 /* add PMT pid */
@@ -343,6 +403,7 @@ static void tidy(struct ts_obj *obj)
                 new_pid.elem = NULL;
                 new_pid.cnt = 0;
                 new_pid.lcnt = 0;
+                new_pid.CC = 0;
                 new_pid.is_CC_sync = 0;
                 (void)update_pid_list(obj, &new_pid);
                 RPTINF("add pmt pid: 0x%04X", (unsigned int)(new_pid.PID));
@@ -354,6 +415,7 @@ static void tidy(struct ts_obj *obj)
                 new_pid.elem = NULL;
                 new_pid.cnt = 0;
                 new_pid.lcnt = 0;
+                new_pid.CC = 0;
                 new_pid.is_CC_sync = 0;
                 (void)update_pid_list(obj, &new_pid);
                 RPTINF("add pcr pid: 0x%04X", (unsigned int)(new_pid.PID));
@@ -373,6 +435,7 @@ static void tidy(struct ts_obj *obj)
                         new_pid.elem = elem;
                         new_pid.cnt = 0;
                         new_pid.lcnt = 0;
+                        new_pid.CC = 0;
                         new_pid.is_CC_sync = 0;
                         (void)update_pid_list(obj, &new_pid);
                         RPTINF("add elem pid: 0x%04X", (unsigned int)(new_pid.PID));
@@ -385,9 +448,11 @@ static void tidy(struct ts_obj *obj)
                 tabl->STC = STC_OVF;
         }
 
-        /* pid list */
+        /* pid list, maybe filled by xml2list, so rebuild pid_tab here */
+        memset(obj->pid_tab, 0, sizeof(obj->pid_tab));
         for(pid = obj->pid0; pid; pid = (struct ts_pid *)(((struct znode *)pid)->next)) {
                 RPTINF("tidy pid: 0x%02X", (unsigned int)(pid->PID));
+                obj->pid_tab[pid->PID & 0x1FFF] = pid;
                 if((obj->prog0) &&
                    (pid->PID < 0x0020 || pid->PID == 0x1FFF)) {
                         pid->prog = obj->prog0;
@@ -409,19 +474,74 @@ static void tidy(struct ts_obj *obj)
         return;
 }
 
-static void free_pid(void *mp, struct ts_pid *pid)
+/* keep PSI/SI and PID list, forget the state which needs the packets in order */
+static void seek(struct ts_obj *obj)
 {
-        struct ts_pkt *pkt;
+        struct ts_pid *pid;
+        struct ts_prog *prog;
+        struct ts_tabl *tabl;
 
-        /* clear the pkt list */
-        while(NULL != (pkt = (struct ts_pkt *)zlst_pop(&(pid->pkt0)))) {
-                buddy_free(mp, pkt);
+        for(pid = obj->pid0; pid; pid = (struct ts_pid *)(((struct znode *)pid)->next)) {
+                pid->is_CC_sync = 0;
+                pid->is_sect_sync = 0;
+                pid->is_pes_sync = 0;
+        }
+        for(prog = obj->prog0; prog; prog = (struct ts_prog *)(((struct znode *)prog)->next)) {
+                prog->tabl.STC = STC_OVF;
+                prog->ADDa = 0;
+                prog->PCRa = STC_OVF;
+                prog->ADDb = 0;
+                prog->PCRb = STC_OVF;
+                memset(&(prog->slope), 0, sizeof(struct ts_slope));
+                prog->is_STC_sync = 0;
+        }
+        for(tabl = obj->tabl0; tabl; tabl = (struct ts_tabl *)(((struct znode *)tabl)->next)) {
+                tabl->STC = STC_OVF;
+        }
+        obj->STC = STC_OVF;
+        obj->CC_lost = 0;
+        obj->pes = NULL;
+        return;
+}
+
+static void free_pid(void *mp, struct ts_pid *pid)
+{
+        if(pid->sect_buf) {
+                buddy_free(mp, pid->sect_buf);
+        }
+        if(pid->pes_buf) {
+                buddy_free(mp, pid->pes_buf);
+        }
+        if(pid->pes_last) {
+                buddy_free(mp, pid->pes_last);
         }
 
         buddy_free(mp, pid);
         return;
 }
 
+static struct ts_sect *copy_sect(void *mp, const struct ts_sect *sect)
+{
+        struct ts_sect *new_sect;
+        size_t size = 3 + (size_t)(sect->section_length);
+
+        new_sect = (struct ts_sect *)buddy_malloc(mp, sizeof(struct ts_sect));
+        if(!new_sect) {
+                RPTERR("malloc section node failed");
+                return NULL;
+        }
+        memcpy(new_sect, sect, sizeof(struct ts_sect));
+
+        new_sect->section = (uint8_t *)buddy_malloc(mp, size);
+        if(!new_sect->section) {
+                RPTERR("malloc data buffer of section node failed");
+                buddy_free(mp, new_sect);
+                return NULL;
+        }
+        memcpy(new_sect->section, sect->section, size);
+        return new_sect;
+}
+
 static void free_sect(void *mp, struct ts_sect *sect)
 {
         if(sect->section) {
@@ -486,12 +606,13 @@ int ts_parse_tsh(struct ts_obj *obj)
         uint8_t dat;
         struct ts_tsh *tsh;
         struct ts_err *err;
-        struct ts_pid *pid; /* maybe NULL */
+        const ts_stage_t *stage;
 
         if(!obj) {
                 RPTERR("ts_parse_tsh: bad obj");
                 return -1;
         }
+        rpt_lvl = ((obj->is_quiet) ? 0 : WRN_LVL); /* for this thread, till next call */
         ipt = &(obj->ipt);
 
         /* TS[] */
@@ -499,7 +620,8 @@ int ts_parse_tsh(struct ts_obj *obj)
                 RPTERR("ts_parse_tsh: no ts packet");
                 return -1;
         }
-        obj->cur = ipt->TS;
+        obj->TS = (ipt->pTS) ? (ipt->pTS) : (ipt->TS);
+        obj->cur = obj->TS;
         obj->tail = obj->cur + TS_PKT_SIZE;
 
         /* packet count and ADDR */
@@ -507,7 +629,7 @@ int ts_parse_tsh(struct ts_obj *obj)
         obj->ADDR = (ipt->has_addr) ? (ipt->ADDR) : (obj->ADDR + TS_PKT_SIZE);
 #if 0
         RPTINF("packet %lld @ %lld:", obj->cnt, obj->ADDR);
-        dump(ipt->TS, TS_PKT_SIZE); /* debug only */
+        dump(obj->TS, TS_PKT_SIZE); /* debug only */
 #endif
 
         tsh = &(obj->tsh);
@@ -520,10 +642,27 @@ int ts_parse_tsh(struct ts_obj *obj)
         obj->has_pts = 0; /* no PTS */
         obj->has_dts = 0; /* no DTS */
         obj->ES_len = 0; /* no ES */
+        obj->pes = NULL; /* no PES packet complete */
         obj->is_psi_si = 0; /* not PSI/SI */
         obj->sect = NULL; /* not an end of a section */
         obj->has_rate = 0; /* not a new rate calculate peroid */
 
+        /* network: RTP of the datagram, report jitter once when it goes over the limit */
+        err->RTP_error = 0;
+        obj->RTP_lost = 0;
+        if(ipt->has_rtp) {
+                err->RTP_error |= ((ipt->RTP_lost) ? ERR_RTP_0 : 0);
+                if(!(obj->is_RTP_jitter) && ipt->RTP_jitter > TS_RTP_JITTER_MAX) {
+                        err->RTP_error |= ERR_RTP_1;
+                        obj->is_RTP_jitter = 1;
+                }
+                else if(obj->is_RTP_jitter && ipt->RTP_jitter < TS_RTP_JITTER_MAX / 2) {
+                        obj->is_RTP_jitter = 0;
+                }
+                obj->RTP_lost = ipt->RTP_lost;
+                obj->RTP_jitter = ipt->RTP_jitter;
+        }
+
         /* begin */
         dat = *(obj->cur)++;
         tsh->sync_byte = dat;
@@ -533,7 +672,7 @@ int ts_parse_tsh(struct ts_obj *obj)
                         err->TS_sync_loss++;
                 }
                 RPTERR("sync_byte(0x%02X) error!", (unsigned int)(tsh->sync_byte));
-                dump(ipt->TS, TS_PKT_SIZE);
+                dump(obj->TS, TS_PKT_SIZE);
         }
         else {
                 err->TS_sync_loss = 0;
@@ -564,19 +703,11 @@ int ts_parse_tsh(struct ts_obj *obj)
                 RPTERR("Bad adaption_field_control field(00)!");
         }
 
-        if((BIT(1) & tsh->adaption_field_control) && obj->cfg.need_af) {
-                ts_parse_af(obj);
-        }
-
-        if(BIT(0) & tsh->adaption_field_control) {
-                /* data_byte, PSI or PES */
-        }
-
         obj->PID = tsh->PID; /* record into obj struct */
 #if 0
         RPTDBG("search 0x%04X in pid_list", obj->PID);
 #endif
-        obj->pid = (struct ts_pid *)zlst_search(&(obj->pid0), (int)(obj->PID));
+        obj->pid = obj->pid_tab[obj->PID];
         if(!(obj->pid)) {
                 struct ts_pid ts_pid, *new_pid = &ts_pid;
 
@@ -593,6 +724,7 @@ int ts_parse_tsh(struct ts_obj *obj)
                 new_pid->elem = NULL;
                 new_pid->cnt = 1;
                 new_pid->lcnt = 0;
+                new_pid->CC = 0;
                 new_pid->is_CC_sync = 0;
 
                 obj->pid = update_pid_list(obj, new_pid);
@@ -601,92 +733,10 @@ int ts_parse_tsh(struct ts_obj *obj)
                 }
         }
 
-        pid = obj->pid; /* maybe NULL */
-
-        /* calc STC and CTS, should be as early as possible */
-        if(obj->cfg.need_timestamp) {
-                if(ipt->has_mts) {
-                        int64_t dCTS = ts_timestamp_diff(ipt->MTS, obj->lCTS, (int64_t)MTS_OVF);
-
-                        if(STC_OVF != obj->STC) {
-                                obj->STC = ts_timestamp_add(obj->STC, dCTS, STC_OVF);
-                        }
-                        else {
-                                obj->STC = ts_timestamp_add(0L, dCTS, STC_OVF);
-                        }
-                        obj->lCTS = ipt->MTS; /* record last CTS */
-
-                        if(ipt->has_cts) {
-                                obj->CTS = ipt->CTS;
-                        }
-                        else {
-                                obj->CTS = obj->STC;
-                        }
-                }
-                else {
-                        struct ts_prog *prog; /* may be NULL */
-
-                        /* STC: according to pid->prog */
-                        if(pid && pid->prog) {
-                                prog = pid->prog;
-                                if((prog->is_STC_sync) &&
-                                   (prog->PCRa != prog->PCRb)) {
-                                        long double delta;
-
-                                        /* STCx - PCRb   ADDx - ADDb */
-                                        /* ----------- = ----------- */
-                                        /* PCRb - PCRa   ADDb - ADDa */
-                                        delta = (long double)ts_timestamp_diff(prog->PCRb, prog->PCRa, STC_OVF);
-                                        delta *= (obj->ADDR - prog->ADDb);
-                                        delta /= (prog->ADDb - prog->ADDa);
-                                        obj->STC = ts_timestamp_add(prog->PCRb, (int64_t)delta, STC_OVF);
-                                }
-                        }
-
-                        /* CTS: according to prog0 */
-                        if(ipt->has_cts) {
-                                obj->CTS = ipt->CTS;
-                        }
-                        else {
-                                if(obj->prog0) {
-                                        prog = obj->prog0;
-                                        if((prog->is_STC_sync) &&
-                                           (prog->PCRa != prog->PCRb)) {
-                                                long double delta;
-
-                                                /* CTSx - PCRb   ADDx - ADDb */
-                                                /* ----------- = ----------- */
-                                                /* PCRb - PCRa   ADDb - ADDa */
-                                                delta = (long double)ts_timestamp_diff(prog->PCRb, prog->PCRa, STC_OVF);
-                                                delta *= (obj->ADDR - prog->ADDb);
-                                                delta /= (prog->ADDb - prog->ADDa);
-                                                obj->CTS = ts_timestamp_add(prog->PCRb, (int64_t)delta, STC_OVF);
-                                        }
-                                }
-                        }
-                }
-                obj->STC_base = obj->STC / 300;
-                obj->STC_ext = obj->STC % 300;
-                obj->CTS_base = obj->CTS / 300;
-                obj->CTS_ext = obj->CTS % 300;
-        }
-
-        /* statistic */
-        if(obj->cfg.need_statistic) {
-                pid->cnt++;
-                obj->sys_cnt++;
-                obj->nul_cnt += ((0x1FFF == tsh->PID) ? 1 : 0);
-                if((tsh->PID < 0x0020) || IS_TYPE(TS_TYPE_PMT, pid->type)) {
-                        obj->psi_cnt++;
-                        obj->is_psi_si = 1;
-                }
-        }
-
-        /* PSI/SI section collect */
-        if(obj->cfg.need_psi || obj->cfg.need_si) {
-                if((tsh->PID < 0x0020) || IS_TYPE(TS_TYPE_PMT, pid->type)) {
-                        ts_ts2sect(obj);
-                }
+        /* stages resolved from cfg, for the role of this PID */
+        stage = obj->tsh_stage[(obj->role) ? obj->role[obj->PID] : TS_ROLE_ALL];
+        for(; *stage; stage++) {
+                (*stage)(obj);
         }
 
         return 0;
@@ -698,6 +748,7 @@ int ts_parse_tsb(struct ts_obj *obj)
                 RPTERR("bad obj");
                 return -1;
         }
+        rpt_lvl = ((obj->is_quiet) ? 0 : WRN_LVL);
 
         switch(obj->state) {
                 case STATE_NEXT_PAT:
@@ -715,6 +766,231 @@ int ts_parse_tsb(struct ts_obj *obj)
         return 0;
 }
 
+int ts_parse_batch(struct ts_obj *obj, const uint8_t *pkts, size_t n, size_t stride, struct ts_evt *evt)
+{
+        struct ts_ipt *ipt;
+        struct ts_err *err;
+        const uint8_t *p;
+        size_t i;
+        int CRC_error;
+
+        if(!obj || !pkts || !evt) {
+                RPTERR("ts_parse_batch: bad parameter");
+                return -1;
+        }
+        rpt_lvl = ((obj->is_quiet) ? 0 : WRN_LVL);
+        if(TS_PKT_SIZE != stride && 192 != stride && 204 != stride) {
+                RPTERR("ts_parse_batch: bad stride(%d)", (int)stride);
+                return -1;
+        }
+        ipt = &(obj->ipt);
+        err = &(obj->err);
+
+        if(!(ipt->has_addr)) {
+                ipt->ADDR = obj->ADDR + TS_PKT_SIZE; /* as ts_parse_tsh() */
+        }
+        ipt->has_ts = 1;
+        ipt->has_rs = ((204 == stride) ? 1 : 0);
+        ipt->has_addr = 1;
+        ipt->has_mts = ((192 == stride) ? 1 : 0);
+        ipt->has_cts = 0;
+        ipt->has_stc = 0;
+        ipt->has_rtp = 0;
+        obj->batch++;
+        if(0 == obj->batch) {
+                obj->batch = 1; /* 0 is for PID without PES in any batch */
+        }
+
+        for(i = 0, p = pkts; i < n; i++, p += stride, evt++) {
+                const uint8_t *q = p + ((192 == stride) ? 4 : 0);
+                struct ts_pid *pid = obj->pid_tab[((q[1] & 0x1F) << 8) | q[2]];
+
+                /* next PES of this PID will overwrite the one in evt[] */
+                if(i > 0 && pid && obj->batch == pid->pes_batch) {
+                        break;
+                }
+
+                if(192 == stride) {
+                        ipt->MTS = ((int64_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+                        ipt->pTS = p + 4;
+                }
+                else {
+                        ipt->pTS = p;
+                        if(204 == stride) {
+                                memcpy(ipt->RS, p + TS_PKT_SIZE, 16);
+                        }
+                }
+
+                /* CRC_error is kept until user clear it, check this packet only */
+                CRC_error = err->CRC_error;
+                err->CRC_error = 0;
+
+                ts_parse_tsh(obj);
+                ts_parse_tsb(obj);
+
+                evt->ADDR = obj->ADDR;
+                evt->PID = obj->PID;
+                evt->flag = 0;
+                evt->flag |= (obj->tsh.payload_unit_start_indicator ? TS_EVT_PUSI : 0);
+                evt->flag |= (obj->has_pcr ? TS_EVT_PCR : 0);
+                evt->flag |= (obj->has_pts ? TS_EVT_PTS : 0);
+                evt->flag |= (obj->has_dts ? TS_EVT_DTS : 0);
+                evt->flag |= (obj->sect ? TS_EVT_SECT : 0);
+                evt->flag |= (obj->pes ? TS_EVT_PES : 0);
+                evt->flag |= ((obj->AF_len > 1 && obj->af.random_access_indicator) ? TS_EVT_RAI : 0);
+                evt->flag |= ((0x47 != obj->tsh.sync_byte) ? TS_EVT_SYNC_ERR : 0);
+                evt->flag |= (obj->tsh.transport_error_indicator ? TS_EVT_TEI_ERR : 0);
+                evt->flag |= ((obj->cfg.need_cc && obj->CC_lost) ? TS_EVT_CC_ERR : 0);
+                evt->flag |= (err->CRC_error ? TS_EVT_CRC_ERR : 0);
+                evt->PCR = obj->PCR;
+                evt->PTS = obj->PTS;
+                evt->DTS = obj->DTS;
+                evt->sect = obj->sect;
+                evt->pes = obj->pes;
+                evt->CC_lost = obj->CC_lost;
+                if(obj->pes) {
+                        obj->pid->pes_batch = obj->batch;
+                }
+
+                err->CRC_error |= CRC_error;
+                ipt->ADDR += stride;
+        }
+
+        ipt->pTS = NULL; /* do not keep pkts[] for next ts_parse_tsh() */
+        return (int)i;
+}
+
+#define HASH_VAR(h, v) h = hash_mix(h, &(v), sizeof(v))
+uint64_t ts_state_hash(const struct ts_obj *obj, int mask)
+{
+        uint64_t h = 0xCBF29CE484222325ULL; /* FNV-1a */
+        struct znode *znode;
+        struct znode *znode_sub;
+        int64_t key;
+
+        if(!obj) {
+                RPTERR("bad obj");
+                return 0;
+        }
+
+        /* whole stream */
+        HASH_VAR(h, obj->state);
+        HASH_VAR(h, obj->is_pat_pmt_parsed);
+        HASH_VAR(h, obj->STC);
+        HASH_VAR(h, obj->CTS);
+        HASH_VAR(h, obj->lCTS);
+        HASH_VAR(h, obj->has_scrambling);
+        HASH_VAR(h, obj->has_CAT);
+        HASH_VAR(h, obj->has_got_transport_stream_id);
+        HASH_VAR(h, obj->transport_stream_id);
+        if(mask & TS_HASH_ERR) {
+                h = hash_mix(h, &(obj->err), sizeof(struct ts_err)); /* all int */
+                if(obj->has_scrambling && !(obj->has_CAT)) {
+                        mask |= TS_HASH_RATE; /* CAT_error is checked at the end of interval */
+                }
+        }
+        if(mask & TS_HASH_RATE) {
+                HASH_VAR(h, obj->CTS0);
+                HASH_VAR(h, obj->interval);
+                HASH_VAR(h, obj->sys_cnt);
+                HASH_VAR(h, obj->psi_cnt);
+                HASH_VAR(h, obj->nul_cnt);
+                HASH_VAR(h, obj->last_interval);
+                HASH_VAR(h, obj->last_sys_cnt);
+                HASH_VAR(h, obj->last_psi_cnt);
+                HASH_VAR(h, obj->last_nul_cnt);
+        }
+
+        /* pid list: CC and section collect */
+        for(znode = (struct znode *)(obj->pid0); znode; znode = znode->next) {
+                struct ts_pid *pid = (struct ts_pid *)znode;
+
+                HASH_VAR(h, pid->PID);
+                HASH_VAR(h, pid->type);
+                key = (pid->prog) ? (int64_t)(pid->prog->program_number) : -1;
+                HASH_VAR(h, key);
+                key = (pid->elem) ? (int64_t)(pid->elem->PID) : -1;
+                HASH_VAR(h, key);
+                HASH_VAR(h, pid->is_CC_sync);
+                HASH_VAR(h, pid->CC);
+                if(mask & TS_HASH_RATE) {
+                        HASH_VAR(h, pid->cnt);
+                        HASH_VAR(h, pid->lcnt);
+                }
+                if(pid->is_sect_sync) {
+                        HASH_VAR(h, pid->payload_total);
+                        HASH_VAR(h, pid->next_sech);
+                        HASH_VAR(h, pid->has_sech3);
+                        HASH_VAR(h, pid->section_length);
+                        h = hash_mix(h, pid->sect_buf, (size_t)(pid->payload_total));
+                }
+        }
+
+        /* prog list: PCR for STC, PTS of each elem, and PMT */
+        for(znode = (struct znode *)(obj->prog0); znode; znode = znode->next) {
+                struct ts_prog *prog = (struct ts_prog *)znode;
+
+                HASH_VAR(h, prog->program_number);
+                HASH_VAR(h, prog->PMT_PID);
+                HASH_VAR(h, prog->PCR_PID);
+                HASH_VAR(h, prog->is_parsed);
+                HASH_VAR(h, prog->is_STC_sync);
+                HASH_VAR(h, prog->PCRa);
+                HASH_VAR(h, prog->ADDa);
+                HASH_VAR(h, prog->PCRb);
+                HASH_VAR(h, prog->ADDb);
+                h = hash_tabl(h, &(prog->tabl), mask);
+                for(znode_sub = (struct znode *)(prog->elem0); znode_sub; znode_sub = znode_sub->next) {
+                        struct ts_elem *elem = (struct ts_elem *)znode_sub;
+
+                        HASH_VAR(h, elem->PID);
+                        HASH_VAR(h, elem->type);
+                        HASH_VAR(h, elem->PTS);
+                        HASH_VAR(h, elem->DTS);
+                        HASH_VAR(h, elem->STC);
+                        HASH_VAR(h, elem->is_pes_align);
+                }
+        }
+
+        /* table list: for sect_interval */
+        for(znode = (struct znode *)(obj->tabl0); znode; znode = znode->next) {
+                h = hash_tabl(h, (const struct ts_tabl *)znode, mask);
+        }
+        return h;
+}
+
+static uint64_t hash_tabl(uint64_t h, const struct ts_tabl *tabl, int mask)
+{
+        struct znode *znode;
+
+        HASH_VAR(h, tabl->table_id);
+        HASH_VAR(h, tabl->version_number);
+        HASH_VAR(h, tabl->last_section_number);
+        HASH_VAR(h, tabl->STC);
+        if(mask & TS_HASH_SECT) {
+                /* the first one is reported for the same section_number */
+                for(znode = (struct znode *)(tabl->sect0); znode; znode = znode->next) {
+                        const struct ts_sect *sect = (const struct ts_sect *)znode;
+
+                        HASH_VAR(h, sect->section_number);
+                        h = hash_mix(h, sect->section, 3 + (size_t)(sect->section_length));
+                }
+        }
+        return h;
+}
+
+static uint64_t hash_mix(uint64_t h, const void *buf, size_t len)
+{
+        const uint8_t *p = (const uint8_t *)buf;
+
+        while(len--) {
+                h ^= *p++;
+                h *= 0x100000001B3ULL;
+        }
+        return h;
+}
+#undef HASH_VAR
+
 static int state_next_pat(struct ts_obj *obj)
 {
         struct ts_tsh *tsh = &(obj->tsh);
@@ -766,7 +1042,7 @@ static int state_next_pmt(struct ts_obj *obj)
         struct ts_pid *pid;
 
         RPTDBG("search 0x%04X in pid_list", (unsigned int)(tsh->PID));
-        pid = (struct ts_pid *)zlst_search(&(obj->pid0), (int)(tsh->PID));
+        pid = obj->pid_tab[tsh->PID];
         if((!pid) || !IS_TYPE(TS_TYPE_PMT, pid->type)) {
                 return -1; /* not PMT */
         }
@@ -781,53 +1057,140 @@ static int state_next_pmt(struct ts_obj *obj)
         return 0;
 }
 
-static int state_next_pkt(struct ts_obj *obj)
+/* resolve cfg into stage lists once, no cfg check for each packet */
+static void resolve_stage(struct ts_obj *obj)
 {
-        struct ts_tsh *tsh = &(obj->tsh);
-        struct ts_af *af = &(obj->af);
-        struct ts_pid *pid = obj->pid;
-        struct ts_elem *elem = pid->elem; /* may be NULL */
-        struct ts_err *err = &(obj->err);
+        struct ts_cfg *cfg = &(obj->cfg);
+        ts_stage_t *h = obj->tsh_stage[TS_ROLE_ALL];
+        ts_stage_t *b = obj->tsb_stage[TS_ROLE_ALL];
+        int role;
+
+        /* ts_parse_tsh() */
+        if(cfg->need_af) {
+                *h++ = tsh_af;
+        }
+        if(cfg->need_timestamp) {
+                *h++ = tsh_timestamp;
+        }
+        if(cfg->need_statistic) {
+                *h++ = tsh_statistic;
+        }
+        if(cfg->need_psi || cfg->need_si) {
+                *h++ = tsh_sect;
+        }
+        *h = NULL;
+
+        /* ts_parse_tsb() in STATE_NEXT_PKT */
+        if(cfg->need_cc) {
+                *b++ = tsb_cc;
+        }
+        if(cfg->need_af) {
+                *b++ = tsb_pcr;
+        }
+        if(cfg->need_statistic) {
+                *b++ = tsb_rate;
+        }
+        if(cfg->need_pes) {
+                *b++ = tsb_pes;
+                if(cfg->need_pes_pkt) {
+                        *b++ = tsb_pes_pkt;
+                }
+        }
+        *b = NULL;
 
-        /* CC */
-        if(obj->cfg.need_cc) {
-                if(pid->is_CC_sync) {
-                        uint8_t dCC;
-                        int lost;
+        /* other roles: part of TS_ROLE_ALL stages */
+        for(role = TS_ROLE_PCR; role < TS_ROLE_MAX; role++) {
+                const ts_stage_t *stage;
 
-                        if((1 == tsh->adaption_field_control) || /* 01 */
-                           (3 == tsh->adaption_field_control)) { /* 11 */
-                                dCC = 1;
+                h = obj->tsh_stage[role];
+                for(stage = obj->tsh_stage[TS_ROLE_ALL]; *stage; stage++) {
+                        if(TS_ROLE_RATE == role && tsh_timestamp == *stage) {
+                                *h++ = tsh_cts;
                         }
-                        else { /* 00 or 10 */
-                                dCC = 0;
+                        else if(tsh_timestamp == *stage ||
+                                tsh_statistic == *stage ||
+                                (TS_ROLE_PCR == role && tsh_af == *stage)) {
+                                *h++ = *stage;
                         }
+                }
+                *h = NULL;
 
-                        pid->CC += dCC;
-                        pid->CC &= 0x0F; /* 4-bit */
-                        lost  = (int)tsh->continuity_counter;
-                        lost -= (int)pid->CC;
-                        if(lost < 0) {
-                                lost += 16;
+                b = obj->tsb_stage[role];
+                for(stage = obj->tsb_stage[TS_ROLE_ALL]; *stage; stage++) {
+                        if(tsb_rate == *stage ||
+                           (TS_ROLE_PCR == role && tsb_pcr == *stage)) {
+                                *b++ = *stage;
                         }
+                }
+                *b = NULL;
+        }
+        return;
+}
+
+static int state_next_pkt(struct ts_obj *obj)
+{
+        const ts_stage_t *stage;
 
-                        obj->CC_wait = (int)(pid->CC);
-                        obj->CC_find = (int)(tsh->continuity_counter);
-                        obj->CC_lost = lost;
+        /* stages resolved from cfg, for the role of this PID */
+        stage = obj->tsb_stage[(obj->role) ? obj->role[obj->PID] : TS_ROLE_ALL];
+        for(; *stage; stage++) {
+                (*stage)(obj);
+        }
+        return 0;
+}
+
+/* stage of ts_parse_tsb(): CC */
+static int tsb_cc(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_pid *pid = obj->pid;
+        struct ts_err *err = &(obj->err);
+
+        if(pid->is_CC_sync) {
+                uint8_t dCC;
+                int lost;
+
+                if((1 == tsh->adaption_field_control) || /* 01 */
+                   (3 == tsh->adaption_field_control)) { /* 11 */
+                        dCC = 1;
+                }
+                else { /* 00 or 10 */
+                        dCC = 0;
                 }
-                else {
-                        pid->is_CC_sync = 1;
 
-                        obj->CC_wait = (int)(pid->CC);
-                        obj->CC_find = (int)(tsh->continuity_counter);
-                        obj->CC_lost = 0;
+                pid->CC += dCC;
+                pid->CC &= 0x0F; /* 4-bit */
+                lost  = (int)tsh->continuity_counter;
+                lost -= (int)pid->CC;
+                if(lost < 0) {
+                        lost += 16;
                 }
-                pid->CC = tsh->continuity_counter; /* update CC */
-                err->Continuity_count_error = (0x1FFF == tsh->PID) ? 0 : obj->CC_lost;
+
+                obj->CC_wait = (int)(pid->CC);
+                obj->CC_find = (int)(tsh->continuity_counter);
+                obj->CC_lost = lost;
         }
+        else {
+                pid->is_CC_sync = 1;
 
-        /* PCR flush */
-        if(obj->cfg.need_af && obj->has_pcr) {
+                obj->CC_wait = (int)(pid->CC);
+                obj->CC_find = (int)(tsh->continuity_counter);
+                obj->CC_lost = 0;
+        }
+        pid->CC = tsh->continuity_counter; /* update CC */
+        err->Continuity_count_error = (0x1FFF == tsh->PID) ? 0 : obj->CC_lost;
+        return 0;
+}
+
+/* stage of ts_parse_tsb(): PCR */
+static int tsb_pcr(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_af *af = &(obj->af);
+        struct ts_pid *pid = obj->pid;
+        struct ts_err *err = &(obj->err);
+
+        if(obj->has_pcr) {
                 struct znode *znode_prog;
                 struct ts_prog *prog;
 
@@ -901,6 +1264,13 @@ static int state_next_pkt(struct ts_obj *obj)
                         prog->PCRb = obj->PCR;
                         prog->ADDb = obj->ADDR;
 
+                        /* slope for STC calc of each packet, see tsh_timestamp() */
+                        if(STC_OVF != prog->PCRa) {
+                                ts_slope_set(&(prog->slope),
+                                             ts_timestamp_diff(prog->PCRb, prog->PCRa, STC_OVF),
+                                             prog->ADDb - prog->ADDa);
+                        }
+
                         /* is_STC_sync */
                         if(!prog->is_STC_sync) {
                                 int is_first_count_clear = 0;
@@ -953,9 +1323,15 @@ static int state_next_pkt(struct ts_obj *obj)
                         }
                 }
         }
+        return 0;
+}
+
+/* stage of ts_parse_tsb(): interval and statistic */
+static int tsb_rate(struct ts_obj *obj)
+{
+        struct ts_err *err = &(obj->err);
 
-        /* interval and statistic */
-        if(obj->cfg.need_statistic && obj->prog0 && obj->prog0->is_STC_sync) {
+        if(obj->prog0 && obj->prog0->is_STC_sync) {
                 obj->interval = ts_timestamp_diff(obj->CTS, obj->CTS0, STC_OVF);
                 if(obj->interval >= obj->aim_interval) {
                         struct znode *znode;
@@ -991,9 +1367,18 @@ static int state_next_pkt(struct ts_obj *obj)
                         }
                 }
         }
+        return 0;
+}
 
-        /* PES head & ES data */
-        if(obj->cfg.need_pes && elem && (0 == tsh->transport_scrambling_control)) {
+/* stage of ts_parse_tsb(): PES head & ES data */
+static int tsb_pes(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_pid *pid = obj->pid;
+        struct ts_elem *elem = pid->elem; /* may be NULL */
+        struct ts_err *err = &(obj->err);
+
+        if(elem && (0 == tsh->transport_scrambling_control)) {
                 if(IS_TYPE(TS_TYPE_AUD, pid->type) || IS_TYPE(TS_TYPE_VID, pid->type)) {
                         ts_parse_pesh(obj);
                 }
@@ -1043,7 +1428,188 @@ static int state_next_pkt(struct ts_obj *obj)
                         elem->DTS = obj->DTS; /* record last DTS in elem */
                 }
         }
+        return 0;
+}
+
+/* stage of ts_parse_tsb(): reassemble PES packet, after tsb_pes() */
+static int tsb_pes_pkt(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_pid *pid = obj->pid;
+
+        if(!(pid->elem) || (0 != tsh->transport_scrambling_control)) {
+                return 0;
+        }
+
+        if(pid->is_pes_sync && obj->cfg.need_cc && obj->CC_lost) {
+                RPTINF("PES of 0x%04X: CC lost, drop it", (unsigned int)(obj->PID));
+                pid->is_pes_sync = 0;
+        }
 
+        if(tsh->payload_unit_start_indicator) {
+                if(pid->is_pes_sync) {
+                        if(pid->pes_total >= 6 && 0 == ((pid->pes_buf[4] << 8) | pid->pes_buf[5])) {
+                                pes_done(obj, pid->pes_total); /* unbounded, ended here */
+                        }
+                        else {
+                                RPTINF("PES of 0x%04X: short of PES_packet_length, drop it", (unsigned int)(obj->PID));
+                        }
+                }
+                pid->is_pes_sync = 1;
+                pid->pes_total = 0;
+                pid->pes_ADDR = obj->ADDR;
+        }
+
+        if(!(pid->is_pes_sync) || 0 == obj->PES_len) {
+                return 0;
+        }
+        if(0 != pes_append(obj, obj->PES, obj->PES_len)) {
+                pid->is_pes_sync = 0;
+                return -1;
+        }
+
+        /* bounded, ended by PES_packet_length */
+        if(pid->pes_total >= 6) {
+                int len = 6 + ((pid->pes_buf[4] << 8) | pid->pes_buf[5]);
+
+                if(6 != len && pid->pes_total >= len) {
+                        pes_done(obj, len);
+                        pid->is_pes_sync = 0;
+                }
+        }
+        return 0;
+}
+
+/* stage of ts_parse_tsh(): adaption field */
+static int tsh_af(struct ts_obj *obj)
+{
+        if(BIT(1) & obj->tsh.adaption_field_control) {
+                ts_parse_af(obj);
+        }
+        return 0;
+}
+
+/* stage of ts_parse_tsh(): calc STC and CTS, should be as early as possible */
+static int tsh_timestamp(struct ts_obj *obj)
+{
+        struct ts_ipt *ipt = &(obj->ipt);
+        struct ts_pid *pid = obj->pid; /* maybe NULL */
+
+        if(ipt->has_stc && ipt->has_cts) {
+                /* from another ts_obj, no PCR of other PID here */
+                obj->STC = ipt->STC;
+                obj->CTS = ipt->CTS;
+        }
+        else if(ipt->has_mts) {
+                int64_t dCTS = ts_timestamp_diff(ipt->MTS, obj->lCTS, (int64_t)MTS_OVF);
+
+                if(STC_OVF != obj->STC) {
+                        obj->STC = ts_timestamp_add(obj->STC, dCTS, STC_OVF);
+                }
+                else {
+                        obj->STC = ts_timestamp_add(0L, dCTS, STC_OVF);
+                }
+                obj->lCTS = ipt->MTS; /* record last CTS */
+
+                if(ipt->has_cts) {
+                        obj->CTS = ipt->CTS;
+                }
+                else {
+                        obj->CTS = obj->STC;
+                }
+        }
+        else {
+                struct ts_prog *prog; /* may be NULL */
+
+                /* STC: according to pid->prog */
+                if(pid && pid->prog) {
+                        prog = pid->prog;
+                        if((prog->is_STC_sync) &&
+                           (prog->PCRa != prog->PCRb)) {
+                                /* STCx - PCRb   ADDx - ADDb */
+                                /* ----------- = ----------- */
+                                /* PCRb - PCRa   ADDb - ADDa */
+                                obj->STC = ts_timestamp_add(prog->PCRb,
+                                                            ts_slope_mul(&(prog->slope), obj->ADDR - prog->ADDb),
+                                                            STC_OVF);
+                        }
+                }
+
+                /* CTS: according to prog0 */
+                if(ipt->has_cts) {
+                        obj->CTS = ipt->CTS;
+                }
+                else {
+                        if(obj->prog0) {
+                                prog = obj->prog0;
+                                if((prog->is_STC_sync) &&
+                                   (prog->PCRa != prog->PCRb)) {
+                                        /* CTSx - PCRb   ADDx - ADDb */
+                                        /* ----------- = ----------- */
+                                        /* PCRb - PCRa   ADDb - ADDa */
+                                        obj->CTS = ts_timestamp_add(prog->PCRb,
+                                                                    ts_slope_mul(&(prog->slope), obj->ADDR - prog->ADDb),
+                                                                    STC_OVF);
+                                }
+                        }
+                }
+        }
+        obj->STC_base = obj->STC / 300;
+        obj->STC_ext = obj->STC % 300;
+        obj->CTS_base = obj->CTS / 300;
+        obj->CTS_ext = obj->CTS % 300;
+        return 0;
+}
+
+/* stage of ts_parse_tsh(): calc CTS only, for TS_ROLE_RATE */
+static int tsh_cts(struct ts_obj *obj)
+{
+        struct ts_ipt *ipt = &(obj->ipt);
+        struct ts_prog *prog = obj->prog0; /* may be NULL */
+
+        if(ipt->has_mts || ipt->has_stc) {
+                return tsh_timestamp(obj); /* STC is the time line of MTS, or no calc */
+        }
+
+        if(ipt->has_cts) {
+                obj->CTS = ipt->CTS;
+        }
+        else if((prog) && (prog->is_STC_sync) &&
+                (prog->PCRa != prog->PCRb)) {
+                obj->CTS = ts_timestamp_add(prog->PCRb,
+                                            ts_slope_mul(&(prog->slope), obj->ADDR - prog->ADDb),
+                                            STC_OVF);
+        }
+        obj->CTS_base = obj->CTS / 300;
+        obj->CTS_ext = obj->CTS % 300;
+        return 0;
+}
+
+/* stage of ts_parse_tsh(): statistic */
+static int tsh_statistic(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_pid *pid = obj->pid;
+
+        pid->cnt++;
+        obj->sys_cnt++;
+        obj->nul_cnt += ((0x1FFF == tsh->PID) ? 1 : 0);
+        if((tsh->PID < 0x0020) || IS_TYPE(TS_TYPE_PMT, pid->type)) {
+                obj->psi_cnt++;
+                obj->is_psi_si = 1;
+        }
+        return 0;
+}
+
+/* stage of ts_parse_tsh(): PSI/SI section collect */
+static int tsh_sect(struct ts_obj *obj)
+{
+        struct ts_tsh *tsh = &(obj->tsh);
+        struct ts_pid *pid = obj->pid;
+
+        if((tsh->PID < 0x0020) || IS_TYPE(TS_TYPE_PMT, pid->type)) {
+                ts_ts2sect(obj);
+        }
         return 0;
 }
 
@@ -1052,7 +1618,7 @@ static int ts_parse_af(struct ts_obj *obj)
         int i;
         uint8_t dat;
         struct ts_af *af = &(obj->af);
-        uint8_t *tail;
+        const uint8_t *tail;
 
         obj->AF = obj->cur;
         dat = *(obj->cur)++;
@@ -1155,246 +1721,182 @@ static int ts_parse_af(struct ts_obj *obj)
 static int ts_ts2sect(struct ts_obj *obj)
 {
         uint8_t dat;
-        uint8_t *p;
         struct ts_tsh *tsh = &(obj->tsh);
         struct ts_pid *pid = obj->pid;
-        struct ts_pkt *pkt;
+        struct ts_sect new_sect; /* section in packet or arena, copied by ts_parse_sect() if kept */
+        int len; /* 3 + section_length */
 
-        /* collect packet(make pkt list) */
-        if(!(pid->pkt0)) {
+        if(!(pid->is_sect_sync)) {
                 /* waiting for section head */
-                if(tsh->payload_unit_start_indicator) {
-                        /* first packet of this section */
-                        dat = *(obj->cur)++; /* pointer_field */
-                        obj->cur += dat; /* point to section head now */
-                        pid->has_new_sech = 0;
-                        pid->payload_total = (obj->tail - obj->cur);
-                        pid->section_length = PRIVATE_SECTION_LENGTH_MAX; /* suppose maximum length */
-
-                        /* sect head 3-byte */
-                        p = obj->cur;
-                        for(pid->sech3_idx = 0; pid->sech3_idx < 3; pid->sech3_idx++) {
-                                if(p >= obj->tail) {
-                                        break;
-                                }
-                                pid->sech3[pid->sech3_idx] = *p++;
-                        }
-
-                        /* get section_length for single packet section */
-                        if(3 == pid->sech3_idx) {
-                                dat = pid->sech3[0];
-                                pid->table_id = dat;
-
-                                dat = pid->sech3[1];
-                                pid->section_length = dat & 0x0F;
-
-                                dat = pid->sech3[2];
-                                pid->section_length <<= 8;
-                                pid->section_length  |= dat;
-                        }
-
-                        if((int)(pid->section_length) > pid->payload_total) {
-                                /* multi-packets section, make pkt list */
-                                struct ts_pkt *new_pkt = (struct ts_pkt *)buddy_malloc(obj->mp, sizeof(struct ts_pkt));
-                                if(!new_pkt) {
-                                        RPTERR("malloc for pkt node failed");
-                                        return -1;
-                                }
-                                memcpy(new_pkt->pkt, obj->ipt.TS, TS_PKT_SIZE);
-                                new_pkt->payload_unit_start_indicator = 1;
-                                new_pkt->payload_size = (obj->tail - obj->cur);
-                                zlst_push(&(pid->pkt0), new_pkt);
-                        }
-                        else {
-                                /* single packet section, for efficienc: directly make section without pkt list */
-                                struct ts_sect *new_sect = (struct ts_sect *)buddy_malloc(obj->mp, sizeof(struct ts_sect));
-                                if(!new_sect) {
-                                        RPTERR("malloc section node failed");
-                                        goto ts2sect_free_pkt_list;
-                                }
+                if(!(tsh->payload_unit_start_indicator)) {
+                        RPTDBG("section async, ignore this packet");
+                        return -1;
+                }
 
-                                new_sect->section = (uint8_t *)buddy_malloc(obj->mp, 3 + pid->section_length);
-                                if(!new_sect->section) {
-                                        RPTERR("malloc data buffer of section node failed");
-                                        goto ts2sect_free_pkt_list;
-                                }
+                /* first packet of this section */
+                dat = *(obj->cur)++; /* pointer_field */
+                obj->cur += dat; /* point to section head now */
+                if(obj->cur > obj->tail) {
+                        RPTDBG("bad pointer_field(%d), ignore this packet", (int)dat);
+                        return -1;
+                }
 
+                /* single packet section, for efficiency: parse it in packet directly */
+                if(obj->cur + 3 <= obj->tail) {
+                        len = 3 + (((int)(obj->cur[1] & 0x0F) << 8) | (int)(obj->cur[2]));
+                        if(obj->cur + len <= obj->tail) {
 #if 0
 #define DEBUG_SECTION_FRAGMENT
 #endif
-                                memcpy(new_sect->section, obj->cur, 3 + pid->section_length);
 #ifdef DEBUG_SECTION_FRAGMENT
-                                fprintf(stderr, "(%02X %4d) 3+%d.\n", pid->table_id, pid->payload_total, pid->section_length);
+                                fprintf(stderr, "(%02X %4d) %d.\n", obj->cur[0], (int)(obj->tail - obj->cur), len);
 #endif
-                                //dump(new_sect->section, 3 + pid->section_length);
-                                ts_parse_sect(obj, new_sect); /* note: ts_parse_sect() should free new_sect */
+                                new_sect.section = (uint8_t *)(obj->cur); /* read only */
+                                ts_parse_sect(obj, &new_sect);
+                                return 0;
                         }
                 }
-                else { /* !(tsh->payload_unit_start_indicator) */
-                        RPTDBG("section async, ignore this packet");
-                        return -1;
-                }
-        }
-        else { /* (pid->pkt0) */
-                /* next packet of this section */
-                struct ts_pkt *new_pkt = (struct ts_pkt *)buddy_malloc(obj->mp, sizeof(struct ts_pkt));
-                if(!new_pkt) {
-                        RPTERR("malloc for packet node failed");
-                        goto ts2sect_free_pkt_list;
-                }
 
-                memcpy(new_pkt->pkt, obj->ipt.TS, TS_PKT_SIZE);
-                if(tsh->payload_unit_start_indicator) {
-                        new_pkt->payload_unit_start_indicator = 1;
-                        pid->has_new_sech = 1; /* a new section in this packet */
-                        dat = *(obj->cur)++; /* pointer_field */
+                /* multi-packets section, collect it in arena */
+                pid->is_sect_sync = 1;
+                pid->payload_total = 0;
+                pid->next_sech = -1;
+                pid->has_sech3 = 0;
+                pid->section_length = PRIVATE_SECTION_LENGTH_MAX; /* suppose maximum length */
+        }
+        else if(tsh->payload_unit_start_indicator) {
+                /* a new section head in this packet */
+                dat = *(obj->cur)++; /* pointer_field is just left length of this section */
+                if(obj->cur + dat > obj->tail) {
+                        RPTDBG("bad pointer_field(%d), drop this section", (int)dat);
+                        pid->is_sect_sync = 0;
+                        return -1;
                 }
-                else {
-                        new_pkt->payload_unit_start_indicator = 0;
+                if(pid->next_sech < 0) {
+                        pid->next_sech = pid->payload_total + (int)dat;
                 }
-                new_pkt->payload_size = (obj->tail - obj->cur);
-                pid->payload_total += new_pkt->payload_size;
-                zlst_push(&(pid->pkt0), new_pkt);
+        }
 
-                /* sect head 3-byte */
-                p = obj->cur;
-                for(; pid->sech3_idx < 3; pid->sech3_idx++) {
-                        if(p >= obj->tail) {
-                                break;
-                        }
-                        pid->sech3[pid->sech3_idx] = *p++;
-               }
+        /* next packet of this section: append payload only */
+        if(0 != sect_append(obj, obj->cur, (int)(obj->tail - obj->cur))) {
+                pid->is_sect_sync = 0;
+                return -1;
         }
 
         /* try to make section */
-        while(pid->pkt0) {
+        while(pid->is_sect_sync) {
                 /* get section_length */
-                if(3 == pid->sech3_idx) {
+                if(!(pid->has_sech3) && pid->payload_total >= 3) {
                         uint8_t section_syntax_indicator; /* 1-bit */
 
-                        dat = pid->sech3[0];
+                        dat = pid->sect_buf[0];
                         pid->table_id = dat;
 
-                        dat = pid->sech3[1];
+                        dat = pid->sect_buf[1];
                         section_syntax_indicator = (dat & BIT(7)) >> 7;
                         pid->section_length = dat & 0x0F;
 
-                        dat = pid->sech3[2];
+                        dat = pid->sect_buf[2];
                         pid->section_length <<= 8;
                         pid->section_length  |= dat;
 
-                        pid->sech3_idx = 4; /* got section_length */
+                        pid->has_sech3 = 1;
 
                         if(section_syntax_indicator) {
                                 if(pid->section_length > NORMAL_SECTION_LENGTH_MAX) {
                                         RPTERR("normal section_length(%d) > %d",
                                             (int)(pid->section_length), NORMAL_SECTION_LENGTH_MAX);
-                                        goto ts2sect_free_pkt_list;
+                                        pid->is_sect_sync = 0;
+                                        return -1;
                                 }
                         }
                         else { /* !(section_syntax_indicator) */
                                 if(pid->section_length > PRIVATE_SECTION_LENGTH_MAX) {
                                         RPTERR("private section_length(%d) > %d",
                                             (int)(pid->section_length), PRIVATE_SECTION_LENGTH_MAX);
-                                        goto ts2sect_free_pkt_list;
+                                        pid->is_sect_sync = 0;
+                                        return -1;
                                 }
                         }
                         RPTINF("table_id: 0x%02X, length: 3 + %d", (unsigned int)(pid->table_id), (int)(pid->section_length));
                 }
 
-                if(pid->payload_total >= (int)(3 + pid->section_length) || pid->has_new_sech) {
-                        /* has one section */
-                        struct ts_sect *new_sect;
-                        int left_length;
+                len = 3 + (int)(pid->section_length);
+                if(pid->next_sech < 0 && pid->payload_total < len) {
+                        break; /* not enough data to make section */
+                }
 
-                        new_sect = (struct ts_sect *)buddy_malloc(obj->mp, sizeof(struct ts_sect));
-                        if(!new_sect) {
-                                RPTERR("malloc section node failed");
-                                goto ts2sect_free_pkt_list;
+#ifdef DEBUG_SECTION_FRAGMENT
+                fprintf(stderr, "(%02X %4d) %d, next %d\n", pid->table_id, pid->payload_total, len, pid->next_sech);
+#endif
+                if(!(pid->has_sech3)) {
+                        RPTDBG("section head broken by the next section, ignore");
+                }
+                else if(pid->next_sech < 0 || pid->next_sech >= len) {
+                        /* has one section */
+                        RPTINF("section arena -> ts_sect and parse, table: 0x%02X", (unsigned int)(pid->table_id));
+                        new_sect.section = pid->sect_buf;
+                        ts_parse_sect(obj, &new_sect);
+                }
+                else {
+                        /* use start_indicator instead of section_length to determine section end,
+                         * the section is cut, parse it with 0 as the lost data to report error */
+                        new_sect.section = (uint8_t *)buddy_malloc(obj->mp, (size_t)len);
+                        if(!new_sect.section) {
+                                RPTERR("malloc data buffer of cut section failed");
+                                pid->is_sect_sync = 0;
+                                return -1;
                         }
+                        memcpy(new_sect.section, pid->sect_buf, (size_t)(pid->next_sech));
+                        memset(new_sect.section + pid->next_sech, 0, (size_t)(len - pid->next_sech));
+                        ts_parse_sect(obj, &new_sect);
+                        buddy_free(obj->mp, new_sect.section);
+                }
 
-                        new_sect->section = (uint8_t *)buddy_malloc(obj->mp, 3 + pid->section_length);
-                        if(!new_sect->section) {
-                                RPTERR("malloc data buffer of section node failed");
-                                goto ts2sect_free_pkt_list;
-                        }
+                if(pid->next_sech < 0 || pid->next_sech > pid->payload_total) {
+                        /* left data is padding, wait for next section head */
+                        pid->is_sect_sync = 0;
+                        break;
+                }
 
-                        p = new_sect->section;
-                        left_length = 3 + (int)(pid->section_length);
+                /* new section: move its head to the arena head, reset in place */
+                pid->payload_total -= pid->next_sech;
+                memmove(pid->sect_buf, pid->sect_buf + pid->next_sech, (size_t)(pid->payload_total));
+                pid->next_sech = -1;
+                pid->has_sech3 = 0;
+                pid->section_length = PRIVATE_SECTION_LENGTH_MAX; /* suppose maximum length */
+        } /* while(pid->is_sect_sync) */
+        return 0;
+}
 
-#ifdef DEBUG_SECTION_FRAGMENT
-                        fprintf(stderr, "(%02X %4d) 3+%d ", pid->table_id, pid->payload_total, pid->section_length);
-#endif
-                        RPTINF("pkt list -> ts_sect and parse, table: 0x%02X", (unsigned int)(pid->table_id));
-                        while(NULL != (pkt = (struct ts_pkt *)zlst_shift(&(pid->pkt0)))) {
-                                if(pkt->payload_unit_start_indicator && p != new_sect->section) {
-                                        /* use start_indicator instead of section_length to determine section end */
-                                        left_length = (int)(pkt->pkt[4]); /* pointer_field is just left length */
-                                }
+/* append data to the section arena of this PID, grow the arena by need */
+static int sect_append(struct ts_obj *obj, const uint8_t *buf, int len)
+{
+        struct ts_pid *pid = obj->pid;
+        int size = pid->payload_total + len;
 
-                                if(pkt->payload_size < left_length) {
-                                        /* part of big section */
-                                        memcpy(p, pkt->pkt + TS_PKT_SIZE - pkt->payload_size, (size_t)(pkt->payload_size));
-                                        p += pkt->payload_size;
-                                        left_length -= pkt->payload_size;
-                                        buddy_free(obj->mp, pkt);
-#ifdef DEBUG_SECTION_FRAGMENT
-                                        fprintf(stderr, "- %3d = %4d ", pkt->payload_size, left_length);
-#endif
-                                }
-                                else { /* (pkt->payload_size >= left_length) */
-                                        /* last packet of the section */
-                                        memcpy(p, pkt->pkt + TS_PKT_SIZE - pkt->payload_size, (size_t)(left_length));
-                                        pkt->payload_size -= left_length; /* maybe head of next section */
-#ifdef DEBUG_SECTION_FRAGMENT
-                                        fprintf(stderr, "- %3d ", left_length);
-#endif
-                                        //dump(new_sect->section, 3 + pid->section_length);
-                                        ts_parse_sect(obj, new_sect); /* note: ts_parse_sect() should free new_sect */
+        if(size > pid->sect_size) {
+                uint8_t *new_buf;
+                int new_size = ((pid->sect_size > 0) ? pid->sect_size : SECT_ARENA_MIN);
 
-                                        if(pkt->payload_unit_start_indicator && p != new_sect->section) {
-                                                /* new section */
-                                                obj->tail = pkt->pkt + TS_PKT_SIZE;
-                                                obj->cur = obj->tail - pkt->payload_size;
-#ifdef DEBUG_SECTION_FRAGMENT
-                                                fprintf(stderr, "(%d-byte new section head)\n", pkt->payload_size);
-                                                dump(obj->cur, pkt->payload_size);
-#endif
-                                                pid->payload_total = pkt->payload_size;
-                                                pid->has_new_sech = 0;
-                                                zlst_push(&(pid->pkt0), pkt);
-                                                pid->section_length = PRIVATE_SECTION_LENGTH_MAX; /* suppose maximum length */
-
-                                                /* sect head 3-byte */
-                                                p = obj->cur;
-                                                for(pid->sech3_idx = 0; pid->sech3_idx < 3; pid->sech3_idx++) {
-                                                        if(p >= obj->tail) {
-                                                                break;
-                                                        }
-                                                        pid->sech3[pid->sech3_idx] = *p++;
-                                                }
-                                        }
-                                        else {
-#ifdef DEBUG_SECTION_FRAGMENT
-                                                fprintf(stderr, "(%d-byte padding data)\n", pkt->payload_size);
-#endif
-                                                buddy_free(obj->mp, pkt);
-                                        }
-                                        break;
-                                }
-                        } /* while(pkt) */
+                while(new_size < size) {
+                        new_size <<= 1;
                 }
-                else { /* not enough data to make section */
-                        break;
+                new_buf = (uint8_t *)buddy_malloc(obj->mp, (size_t)new_size);
+                if(!new_buf) {
+                        RPTERR("malloc section arena(%d-byte) failed", new_size);
+                        return -1;
                 }
-        } /* while(pid->pkt0) */
-        return 0;
-
-ts2sect_free_pkt_list:
-        while(NULL != (pkt = (struct ts_pkt *)zlst_pop(&(pid->pkt0)))) {
-                buddy_free(obj->mp, pkt);
+                if(pid->sect_buf) {
+                        memcpy(new_buf, pid->sect_buf, (size_t)(pid->payload_total));
+                        buddy_free(obj->mp, pid->sect_buf);
+                }
+                pid->sect_buf = new_buf;
+                pid->sect_size = new_size;
         }
-        return -1;
+        memcpy(pid->sect_buf + pid->payload_total, buf, (size_t)len);
+        pid->payload_total = size;
+        return 0;
 }
 
 static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
@@ -1469,10 +1971,10 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
 #if 0
                         RPTERR("CRC error(0x%08X! 0x%08X?)",
                             obj->CRC_32_calc, obj->CRC_32);
-                        dump(obj->ipt.TS, TS_PKT_SIZE);
+                        dump(obj->TS, TS_PKT_SIZE);
                         dump(new_sect->section, 3 + new_sect->section_length);
 #endif
-                        goto release_sect;
+                        return -1;
                 }
         }
 
@@ -1481,7 +1983,7 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                 /* is PMT section */
                 if(!(pid->prog)) {
                         RPTWRN("PMT without corresponding program, ignore");
-                        goto release_sect;
+                        return -1;
                 }
                 tabl = &(pid->prog->tabl);
         }
@@ -1493,7 +1995,7 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                         tabl = (struct ts_tabl *)buddy_malloc(obj->mp, sizeof(struct ts_tabl));
                         if(!tabl) {
                                 RPTERR("malloc ts_tabl node failed");
-                                goto release_sect;
+                                return -1;
                         }
 
                         tabl->sect0 = NULL;
@@ -1506,7 +2008,7 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                         zlst_set_key(tabl, (int)(tabl->table_id));
                         if(0 != zlst_insert(&(obj->tabl0), tabl)) {
                                 free_tabl(obj->mp, tabl);
-                                goto release_sect;
+                                return -1;
                         }
                 }
         }
@@ -1536,11 +2038,15 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
         RPTDBG("search %d/%d in sect_list", (int)(new_sect->section_number), (int)(new_sect->last_section_number));
         sect = (struct ts_sect *)zlst_search(psect0, (int)(new_sect->section_number));
         if(!sect) {
-                sect = new_sect;
+                sect = copy_sect(obj->mp, new_sect); /* new_sect is in packet or arena */
+                if(!sect) {
+                        return -1;
+                }
                 RPTDBG("insert %d/%d in sect_list", (int)(sect->section_number), (int)(sect->last_section_number));
                 zlst_set_key(sect, (int)(sect->section_number));
                 if(0 != zlst_insert(psect0, sect)) {
-                        goto release_sect;
+                        free_sect(obj->mp, sect);
+                        return -1;
                 }
         }
         else {
@@ -1548,7 +2054,6 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                     (unsigned int)(sect->section_number),
                     (unsigned int)(sect->last_section_number),
                     (unsigned int)(sect->table_id));
-                free_sect(obj->mp, new_sect);
                 //return -1; FIXME: got SDT before PMT will lost service info, so parse again and again now
         }
         obj->sect = sect; /* has section */
@@ -1566,13 +2071,13 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
         /* PAT_error(table_id error) */
         if(0x0000 == pid->PID && 0x00 != sect->table_id) {
                 err->PAT_error |= ERR_1_3_1;
-                goto release_sect;
+                return -1;
         }
 
         /* CAT_error(table_id error) */
         if(0x0001 == pid->PID && 0x01 != sect->table_id) {
                 err->CAT_error |= ERR_2_6_1;
-                goto release_sect;
+                return -1;
         }
 
         /* parse */
@@ -1580,14 +2085,14 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                 case 0x00:
                         if(0x0000 != pid->PID) {
                                 RPTERR("PAT: PID is not 0x0000 but 0x%04X, ignore!", (unsigned int)(pid->PID));
-                                goto release_sect;
+                                return -1;
                         }
                         ts_parse_secb_pat(obj);
                         break;
                 case 0x01:
                         if(0x0001 != pid->PID) {
                                 RPTERR("CAT: PID is not 0x0001 but 0x%04X, ignore!", (unsigned int)(pid->PID));
-                                goto release_sect;
+                                return -1;
                         }
                         obj->has_CAT = 1;
                         ts_parse_secb_cat(obj);
@@ -1595,14 +2100,14 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                 case 0x02:
                         if(!IS_TYPE(TS_TYPE_PMT, pid->type)) {
                                 RPTERR("PMT: PID is NOT PMT_PID but 0x%04X, ignore!", (unsigned int)(pid->PID));
-                                goto release_sect;
+                                return -1;
                         }
                         ts_parse_secb_pmt(obj);
                         break;
                 case 0x42:
                         if(0x0011 != pid->PID) {
                                 RPTERR("SDT: PID is not 0x0011 but 0x%04X, ignore!", (unsigned int)(pid->PID));
-                                goto release_sect;
+                                return -1;
                         }
                         ts_parse_secb_sdt(obj);
                         break;
@@ -1611,10 +2116,6 @@ static int ts_parse_sect(struct ts_obj *obj, struct ts_sect *new_sect)
                         break;
         }
         return 0;
-
-release_sect:
-        free_sect(obj->mp, new_sect);
-        return -1;
 }
 
 static int ts_parse_secb_pat(struct ts_obj *obj)
@@ -1728,6 +2229,7 @@ static int ts_parse_secb_pat(struct ts_obj *obj)
                         prog->PCRa = STC_OVF;
                         prog->ADDb = 0;
                         prog->PCRb = STC_OVF;
+                        memset(&(prog->slope), 0, sizeof(struct ts_slope));
                         prog->is_STC_sync = 0;
 
                         RPTDBG("insert 0x%04X in prog_list", (unsigned int)(prog->program_number));
@@ -2184,7 +2686,7 @@ static int ts_parse_pesh(struct ts_obj *obj)
                 if(0x000001 != pesh->packet_start_code_prefix) {
                         RPTERR("PES packet start code prefix(0x%06X) NOT 0x000001!",
                             (unsigned int)(pesh->packet_start_code_prefix));
-                        dump(obj->ipt.TS, TS_PKT_SIZE);
+                        dump(obj->TS, TS_PKT_SIZE);
 #if 0
                         return -1;
 #endif
@@ -2226,6 +2728,103 @@ static int ts_parse_pesh(struct ts_obj *obj)
         return 0;
 }
 
+/* append data to the PES arena of this PID, grow the arena by need */
+static int pes_append(struct ts_obj *obj, const uint8_t *buf, int len)
+{
+        struct ts_pid *pid = obj->pid;
+        int size = pid->pes_total + len;
+
+        if(size > pid->pes_size) {
+                uint8_t *new_buf;
+                int new_size = ((pid->pes_size > 0) ? pid->pes_size : PES_ARENA_MIN);
+
+                while(new_size < size) {
+                        new_size <<= 1;
+                }
+                if(new_size > PES_ARENA_MAX) {
+                        RPTWRN("PES of 0x%04X: bigger than %d-byte, drop it", (unsigned int)(obj->PID), PES_ARENA_MAX);
+                        return -1;
+                }
+                new_buf = (uint8_t *)buddy_malloc(obj->mp, (size_t)new_size);
+                if(!new_buf) {
+                        RPTERR("malloc PES arena(%d-byte) failed", new_size);
+                        return -1;
+                }
+                if(pid->pes_buf) {
+                        memcpy(new_buf, pid->pes_buf, (size_t)(pid->pes_total));
+                        buddy_free(obj->mp, pid->pes_buf);
+                }
+                pid->pes_buf = new_buf;
+                pid->pes_size = new_size;
+        }
+        memcpy(pid->pes_buf + pid->pes_total, buf, (size_t)len);
+        pid->pes_total = size;
+        return 0;
+}
+
+/* PES packet of pes_buf[len] is complete: keep it in pes_last, tell the user */
+static void pes_done(struct ts_obj *obj, int len)
+{
+        struct ts_pid *pid = obj->pid;
+        struct ts_pes *pes = &(pid->pes);
+        uint8_t *buf = pid->pes_buf;
+        int size = pid->pes_size;
+
+        /* swap the arena, no copy */
+        pid->pes_buf = pid->pes_last;
+        pid->pes_size = pid->pes_last_size;
+        pid->pes_last = buf;
+        pid->pes_last_size = size;
+        pid->pes_total = 0;
+
+        pes->PID = obj->PID;
+        pes->ADDR = pid->pes_ADDR;
+        pes->stream_id = buf[3];
+        pes->PES_packet_length = (uint16_t)((buf[4] << 8) | buf[5]);
+        pes->buf = buf;
+        pes->len = len;
+        pes->ES = buf + 6;
+        pes->ES_len = len - 6;
+        pes->has_pts = 0;
+        pes->has_dts = 0;
+
+        /* stream_id with PES head after PES_packet_length, see ts_parse_pesh_switch() */
+        if(0xBC != pes->stream_id && /* program_stream_map */
+           0xBE != pes->stream_id && /* padding_stream */
+           0xBF != pes->stream_id && /* private_stream_2 */
+           0xF0 != pes->stream_id && /* ECM */
+           0xF1 != pes->stream_id && /* EMM */
+           0xF2 != pes->stream_id && /* DSMCC_stream */
+           0xF8 != pes->stream_id && /* ITU-T Rec. H.222.1 type E */
+           0xFF != pes->stream_id && /* program_stream_directory */
+           len >= 9 && 0x80 == (buf[6] & 0xC0) &&
+           len >= 9 + buf[8]) {
+                const uint8_t *p = buf + 9;
+                int flag = (buf[7] >> 6);
+
+                if((flag & 0x2) && buf[8] >= 5) {
+                        pes->has_pts = 1;
+                        pes->PTS = ((int64_t)(p[0] & 0x0E) << 29) | (p[1] << 22) |
+                                   ((p[2] & 0xFE) << 14) | (p[3] << 7) | (p[4] >> 1);
+                        pes->DTS = pes->PTS;
+                        p += 5;
+                }
+                if(3 == flag && buf[8] >= 10) {
+                        pes->has_dts = 1;
+                        pes->DTS = ((int64_t)(p[0] & 0x0E) << 29) | (p[1] << 22) |
+                                   ((p[2] & 0xFE) << 14) | (p[3] << 7) | (p[4] >> 1);
+                }
+                pes->ES = buf + 9 + buf[8];
+                pes->ES_len = len - 9 - buf[8];
+        }
+
+        obj->pes = pes;
+        if(obj->pes_cb) {
+                obj->pes_cb(obj->pes_arg, pes);
+        }
+        return;
+}
+
 static int ts_parse_pesh_switch(struct ts_obj *obj)
 {
         struct ts_pesh *pesh = &(obj->pesh);
@@ -2262,7 +2861,7 @@ static int ts_parse_pesh_detail(struct ts_obj *obj)
 {
         struct ts_pesh *pesh = &(obj->pesh);
         uint8_t dat;
-        uint8_t *es;
+        const uint8_t *es;
 
         dat = *(obj->cur)++;
         pesh->PES_scrambling_control = (dat & (BIT(5) | BIT(4))) >> 4;
@@ -2372,7 +2971,7 @@ static int ts_parse_pesh_detail(struct ts_obj *obj)
         }
         else if(0x01 == pesh->PTS_DTS_flags) { /* '01' */
                 RPTERR("PTS_DTS_flags error!");
-                dump(obj->ipt.TS, TS_PKT_SIZE);
+                dump(obj->TS, TS_PKT_SIZE);
                 return -1;
         }
         else {
@@ -2529,7 +3128,7 @@ static struct ts_pid *update_pid_list(struct ts_obj *obj, struct ts_pid *new_pid
 {
         struct ts_pid *pid;
 
-        pid = (struct ts_pid *)zlst_search(&(obj->pid0), (int)(new_pid->PID));
+        pid = obj->pid_tab[new_pid->PID & 0x1FFF];
         if(pid) {
                 /* is in pid_list already, just update information */
                 pid->PID = new_pid->PID;
@@ -2547,7 +3146,16 @@ static struct ts_pid *update_pid_list(struct ts_obj *obj, struct ts_pid *new_pid
                         RPTERR("malloc pid node failed");
                         return NULL;
                 }
-                pid->pkt0 = NULL; /* wait to sync with section head */
+                pid->sect_buf = NULL; /* section arena is malloced by need */
+                pid->sect_size = 0;
+                pid->is_sect_sync = 0; /* wait to sync with section head */
+                pid->pes_buf = NULL; /* PES arena is malloced by need */
+                pid->pes_size = 0;
+                pid->pes_total = 0;
+                pid->is_pes_sync = 0; /* wait to sync with PES head */
+                pid->pes_last = NULL;
+                pid->pes_last_size = 0;
+                pid->pes_batch = 0;
 
                 pid->PID = new_pid->PID;
                 pid->type = new_pid->type;
@@ -2564,6 +3172,7 @@ static struct ts_pid *update_pid_list(struct ts_obj *obj, struct ts_pid *new_pid
                         free_pid(obj->mp, pid);
                         return NULL;
                 }
+                obj->pid_tab[pid->PID & 0x1FFF] = pid;
         }
         return pid;
 }
@@ -2636,11 +3245,14 @@ static const struct stream_type_table *elem_type(uint8_t stream_type)
         return p;
 }
 
-static int dump(uint8_t *buf, int len)
+static int dump(const uint8_t *buf, int len)
 {
-        uint8_t *p = buf;
+        const uint8_t *p = buf;
         int i;
 
+        if(ERR_LVL > rpt_lvl) {
+                return 0; /* with the report before it */
+        }
         for(i = 0; i < len; i++) {
                 fprintf(stderr, "%02X ", (unsigned int)(*p++));
         }
@@ -2649,75 +3261,6 @@ static int dump(uint8_t *buf, int len)
         return 0;
 }
 
-uint32_t ts_crc(void *buf, size_t size, int mode)
-{
-        int bitcount = 0;
-        int bitinbyte = 0;
-        unsigned short databit;
-        unsigned short shiftreg[32];
-        /*                      0 1 2 3 4 5 6 7 8 */
-        unsigned short g08[] = {1,1,1,0,0,0,0,0,1};
-        /*                      0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 */
-        unsigned short g16[] = {1,0,0,0,0,0,0,0,0,0,0,0,1,0,0,1,1};
-        /*                      0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 */
-        unsigned short g32[] = {1,1,1,0,1,1,0,1,1,0,1,1,1,0,0,0,1,0,0,0,0,0,1,1,0,0,1,0,0,0,0,0,1};
-
-        unsigned short *g;
-        int i,nrbits;
-        char *data;
-        int cnt;
-        uint32_t crc;
-
-        switch(mode) {
-                case  8: g = g08; cnt =  8; break;
-                case 16: g = g16; cnt = 16; break;
-                default: g = g32; cnt = 32; break;
-        }
-
-        /* Initialize shift register's to '1' */
-        for(i = 0; i < cnt; i++) {
-                shiftreg[i] = 1;
-        }
-
-        /* Calculate nr of data bits */
-        nrbits = ((int) size) * 8;
-        data = buf;
-
-        while(bitcount < nrbits) {
-                /* Fetch bit from bitstream */
-                databit = (unsigned short)(*data  & (0x80 >> bitinbyte));
-                databit = (unsigned short)(databit >> (7 - bitinbyte));
-                bitinbyte++;
-                bitcount++;
-                if(bitinbyte == 8) {
-                        bitinbyte = 0;
-                        data++;
-                }
-
-                /* Perform the shift and modula 2 addition */
-                databit ^= shiftreg[cnt - 1];
-                i = cnt - 1;
-                while (i != 0) {
-                        if (g[i]) {
-                                shiftreg[i] = shiftreg[i-1] ^ databit;
-                        }
-                        else {
-                                shiftreg[i] = shiftreg[i-1];
-                        }
-                        i--;
-                }
-                shiftreg[0] = databit;
-        }
-
-        /* make CRC an UIMSBF */
-        crc = 0;
-        for(i = 0; i < cnt; i++) {
-                crc = (crc << 1) | ((unsigned int) shiftreg[cnt - 1 - i]);
-        }
-
-        return crc;
-}
-
 #define timestamp_assert(expr, fmt...) do { \
         if(!(expr)) { \
                 fprintf(stderr, "%s: %d: assert (%s) failed: ", __FILE__, __LINE__, #expr); \
@@ -2765,3 +3308,56 @@ int64_t ts_timestamp_diff(int64_t t1, int64_t t0, int64_t ovf)
 
         return td; /* [-hovf, +hovf) */
 }
+
+int ts_slope_set(struct ts_slope *slope, int64_t dy, int64_t dx)
+{
+        uint64_t ay;
+        uint64_t r;
+        uint64_t f;
+        int i;
+
+        memset(slope, 0, sizeof(struct ts_slope));
+        if(dx <= 0) {
+                RPTERR("bad dx: %lld", (long long int)dx);
+                return -1;
+        }
+
+        slope->neg = (dy < 0);
+        ay = (dy < 0) ? (uint64_t)0 - (uint64_t)dy : (uint64_t)dy;
+        slope->i = ay / (uint64_t)dx;
+        r = ay % (uint64_t)dx;
+
+        /* f = r * 2^32 / dx, bit by bit: no overflow for any dx */
+        f = 0;
+        for(i = 0; i < 32; i++) {
+                r <<= 1;
+                f <<= 1;
+                if(r >= (uint64_t)dx) {
+                        r -= (uint64_t)dx;
+                        f |= 1;
+                }
+        }
+
+        /* round up, so x * k is exact when x * dy / dx is an integer */
+        if(r) {
+                f++;
+                if(f > 0xFFFFFFFF) {
+                        slope->i++;
+                        f = 0;
+                }
+        }
+        slope->f = (uint32_t)f;
+        return 0;
+}
+
+int64_t ts_slope_mul(const struct ts_slope *slope, int64_t x)
+{
+        uint64_t ax;
+        uint64_t y;
+
+        ax = (x < 0) ? (uint64_t)0 - (uint64_t)x : (uint64_t)x;
+        y  = slope->i * ax;
+        y += (uint64_t)slope->f * (ax >> 32);
+        y += ((uint64_t)slope->f * (ax & 0xFFFFFFFF)) >> 32;
+        return ((x < 0) != slope->neg) ? -(int64_t)y : (int64_t)y;
+}
@@ -149,7 +149,13 @@ struct ts_err {
         int TDT_error; /* 3.8 */
         int Empty_buffer_error; /* 3.9 */
         int Data_delay_error; /* 3.10 */
+
+        /* Network: RTP of the datagram, not in TR 101 290 */
+#define ERR_RTP_0 (1<<0) /* sequence_number discontinuity, RTP packet lost */
+#define ERR_RTP_1 (1<<1) /* interarrival jitter over TS_RTP_JITTER_MAX */
+        int RTP_error;
 };
+#define TS_RTP_JITTER_MAX (10 * STC_MS)
 
 /* TS head */
 struct ts_tsh {
@@ -286,6 +292,13 @@ struct ts_elem {
         int is_pes_align; /* met first PES head */
 };
 
+/* fixed-point slope: k = dy / dx = i + f / 2^32, sign in neg */
+struct ts_slope {
+        uint64_t i; /* integer part of |k| */
+        uint32_t f; /* fraction part of |k|, 32-bit */
+        int neg; /* true: k < 0 */
+};
+
 /* node of program list */
 struct ts_prog {
         struct znode cvfl; /* common variable for list */
@@ -316,10 +329,32 @@ struct ts_prog {
         int64_t PCRa; /* PCR packet a: PCR value */
         int64_t ADDb; /* PCR packet b: packet address */
         int64_t PCRb; /* PCR packet b: PCR value */
+        struct ts_slope slope; /* (PCRb - PCRa) / (ADDb - ADDa), set when PCR arrive */
         int is_STC_sync; /* true: PCRa and PCRb OK, STC can be calc */
 };
 
-/* node of packet list, for ts2sect() or sect2ts() */
+/* whole PES packet of one elem PID, output of PES reassembly */
+struct ts_pes {
+        uint16_t PID;
+        uint8_t stream_id;
+        uint16_t PES_packet_length; /* 0 means unbounded, ended by the next PUSI */
+        int64_t ADDR; /* address of the packet with PES head */
+        /*@temp@*/
+        const uint8_t *buf; /* from packet_start_code_prefix, valid until the next PES of this PID */
+        int len;
+        /*@temp@*/
+        const uint8_t *ES; /* ES data after PES head, in buf[] */
+        int ES_len;
+        int has_pts;
+        int64_t PTS;
+        int has_dts;
+        int64_t DTS; /* DTS = PTS if no DTS */
+};
+
+/* callback when a PES packet is complete */
+typedef void (*ts_pes_f)(void *arg, const struct ts_pes *pes);
+
+/* node of packet list, for sect2ts(), ts2sect() uses section arena of ts_pid */
 struct ts_pkt {
         struct znode cvfl; /* common variable for list */
 
@@ -349,24 +384,45 @@ struct ts_pid {
         uint32_t cnt; /* packet received from last PCR */
         uint32_t lcnt; /* packet received from PCRa to PCRb */
 
-        /* only for PID with PSI/SI */
-        /*@temp@*/
-        struct ts_pkt *pkt0;
-        int payload_total; /* accumulate size_of_payload packet by packet */
-        int has_new_sech; /* true, if second section head in pkt list */
-        int sech3_idx; /* 0~3, 3 means sech3 is OK */
-        uint8_t sech3[3]; /* collect first 3-byte to get section_length */
+        /* only for PID with PSI/SI: section arena, payload of the section */
+        /*@only@*/
+        /*@null@*/
+        uint8_t *sect_buf; /* reused by the next section, freed with pid */
+        int sect_size; /* size of sect_buf, grow by need */
+        int is_sect_sync; /* true, if collecting a section from its head */
+        int payload_total; /* bytes of payload in sect_buf */
+        int next_sech; /* offset of the next section head in sect_buf, -1: none */
+        int has_sech3; /* true, if got section_length from the 3-byte head */
         uint8_t table_id; /* TABLE_ID_TABLE */
         uint16_t section_length; /* 12-bit */
+
+        /* only for elem PID with cfg.need_pes_pkt: PES arena, swapped with pes_last when complete */
+        /*@only@*/
+        /*@null@*/
+        uint8_t *pes_buf; /* PES packet in collecting, freed with pid */
+        int pes_size; /* size of pes_buf, grow by need */
+        int pes_total; /* bytes of PES packet in pes_buf */
+        int is_pes_sync; /* true, if collecting a PES packet from its head */
+        int64_t pes_ADDR; /* address of the packet with PES head in pes_buf */
+        /*@only@*/
+        /*@null@*/
+        uint8_t *pes_last; /* buffer of pes.buf, freed with pid */
+        int pes_last_size;
+        struct ts_pes pes; /* the last complete PES packet */
+        uint32_t pes_batch; /* the ts_parse_batch() call which completed pes */
 };
 
 /* input: information about one packet, tell me as more as you can :-) */
 struct ts_ipt {
         uint8_t TS[TS_PKT_SIZE]; /* TS data */
+        /*@temp@*/
+        /*@null@*/
+        const uint8_t *pTS; /* borrowed TS data(e.g. mmap), NULL means TS[] */
         uint8_t RS[16]; /* RS data */
         int64_t ADDR; /* address of sync-byte(unit: byte) */
         int64_t MTS; /* MTS Time Stamp */
         int64_t CTS; /* according to clock of real time, MUX or appointed PCR */
+        int64_t STC; /* of this packet from another ts_obj, which parses all packets */
 
         /* 0 means corresponding data can not be used */
         int has_ts; /* data in TS[] is OK */
@@ -374,6 +430,12 @@ struct ts_ipt {
         int has_addr; /* data of ADDR is OK */
         int has_mts; /* data of MTS is OK */
         int has_cts; /* data of CTS is OK */
+        int has_stc; /* data of STC is OK, with has_cts */
+
+        /* RTP header of the datagram, set with the first packet in it */
+        uint32_t RTP_lost; /* RTP packet lost just before this TS packet */
+        int64_t RTP_jitter; /* interarrival jitter of RFC 3550, unit: STC */
+        int has_rtp; /* data of RTP_xxx is OK */
 };
 
 /* configurations for libts */
@@ -386,12 +448,30 @@ struct ts_cfg {
         int need_pes;  /* not 0: parse PES head(PTS, DTS) */
         int need_pes_align; /* not 0: ignore data before first PES head */
         int need_statistic; /* not 0: need statistic information */
+        int need_pes_pkt; /* not 0: reassemble whole PES packet, with need_af and need_pes, need_cc to drop the one with CC lost */
 };
 
+struct ts_obj;
+typedef int (*ts_stage_t)(struct ts_obj *obj); /* one stage of packet parse */
+#define TS_STAGE_MAX (8) /* with NULL at the end */
+
+/* role of a PID, for some ts_obj to share the PIDs of one stream */
+#define TS_ROLE_ALL     (0) /* all stages from cfg, default */
+#define TS_ROLE_PCR     (1) /* AF, timestamp, statistic and PCR: for STC of its program */
+#define TS_ROLE_CNT     (2) /* timestamp and statistic: for CTS and rate */
+#define TS_ROLE_RATE    (3) /* CTS and statistic, no STC of the PID: for rate only */
+#define TS_ROLE_MAX     (4)
+
 /* object about one transfer stream */
 struct ts_obj {
         struct ts_ipt ipt; /* input */
         struct ts_cfg cfg; /* config */
+        ts_stage_t tsh_stage[TS_ROLE_MAX][TS_STAGE_MAX]; /* resolved from cfg, for ts_parse_tsh() */
+        ts_stage_t tsb_stage[TS_ROLE_MAX][TS_STAGE_MAX]; /* resolved from cfg, for ts_parse_tsb() */
+        /*@temp@*/
+        /*@null@*/
+        const uint8_t *role; /* role[0x2000]: TS_ROLE_xxx of each PID, NULL means TS_ROLE_ALL */
+        int is_quiet; /* TS_QUIET */
 
         /* CTS */
         int64_t CTS; /* according to clock of real time, MUX or appointed PCR */
@@ -410,9 +490,14 @@ struct ts_obj {
         int CC_find;
         int CC_lost; /* lost != 0 means CC wrong */
 
+        /* RTP */
+        uint32_t RTP_lost; /* network loss, tell it from CC_lost of mux */
+        int64_t RTP_jitter;
+        int is_RTP_jitter; /* over TS_RTP_JITTER_MAX, wait for below half of it */
+
         /* AF */
         /*@temp@*/
-        uint8_t *AF; /* point to adaptation_fields in ipt.TS[] */
+        const uint8_t *AF; /* point to adaptation_fields in this packet */
         int AF_len; /* 0 means no AF */
 
         /* PCR */
@@ -426,7 +511,7 @@ struct ts_obj {
 
         /* PES */
         /*@temp@*/
-        uint8_t *PES; /* point to PES fragment in ipt.TS[] */
+        const uint8_t *PES; /* point to PES fragment in this packet */
         int PES_len; /* 0 means no PES */
 
         /* PTS */
@@ -444,9 +529,18 @@ struct ts_obj {
 
         /* ES */
         /*@temp@*/
-        uint8_t *ES; /* point to ES fragment in ipt.TS[] */
+        const uint8_t *ES; /* point to ES fragment in this packet */
         int ES_len; /* 0 means no ES */
 
+        /* PES packet */
+        /*@temp@*/
+        /*@null@*/
+        struct ts_pes *pes; /* the last PES packet complete in this packet, NULL means none */
+        /*@null@*/
+        ts_pes_f pes_cb; /* called for each PES packet complete, NULL means none */
+        void *pes_arg;
+        uint32_t batch; /* count of ts_parse_batch() call, for pid->pes_batch */
+
         uint16_t concerned_pid; /* used for PSI parsing */
         uint16_t PID;
 
@@ -454,6 +548,8 @@ struct ts_obj {
         struct ts_pid *pid; /* point to the node in pid_list */
 
         /* TS information */
+        /*@temp@*/
+        const uint8_t *TS; /* point to this packet: ipt.pTS or ipt.TS[] */
         int64_t ADDR; /* address of sync-byte(unit: byte) */
         int64_t cnt; /* count of this packet in this stream, start from 0 */
 
@@ -461,7 +557,9 @@ struct ts_obj {
         struct ts_af af; /* info about af of this packet */
         struct ts_pesh pesh; /* info about pesh of this packet */
         /*@temp@*/
-        struct ts_pid *pid0; /* pid list of this stream */
+        struct ts_pid *pid0; /* pid list of this stream, sorted by PID */
+        /*@temp@*/
+        struct ts_pid *pid_tab[0x2000]; /* index of pid list by PID, NULL: not in list */
 
         /* PSI/SI table */
         uint16_t transport_stream_id;
@@ -506,9 +604,38 @@ struct ts_obj {
 
         /* special variables for packet analyse */
         /*@temp@*/
-        uint8_t *cur; /* point to the current data in TS[] */
+        const uint8_t *cur; /* point to the current data in this packet */
+        /*@temp@*/
+        const uint8_t *tail; /* point to the next data after this packet */
+};
+
+/* event of one packet, output of ts_parse_batch() */
+#define TS_EVT_PUSI     (1<<0) /* payload_unit_start_indicator is 1 */
+#define TS_EVT_PCR      (1<<1) /* has PCR */
+#define TS_EVT_PTS      (1<<2) /* has PTS */
+#define TS_EVT_DTS      (1<<3) /* has DTS */
+#define TS_EVT_SECT     (1<<4) /* a section is complete in this packet */
+#define TS_EVT_PES      (1<<5) /* a PES packet is complete in this packet */
+#define TS_EVT_RAI      (1<<6) /* random_access_indicator is 1 */
+#define TS_EVT_SYNC_ERR (1<<8) /* sync_byte is not 0x47 */
+#define TS_EVT_TEI_ERR  (1<<9) /* transport_error_indicator is 1 */
+#define TS_EVT_CC_ERR   (1<<10) /* continuity_counter lost */
+#define TS_EVT_CRC_ERR  (1<<11) /* CRC_32 of section is wrong */
+struct ts_evt {
+        int64_t ADDR; /* address of this packet(unit: byte) */
+        int64_t PCR; /* valid with TS_EVT_PCR */
+        int64_t PTS; /* valid with TS_EVT_PTS */
+        int64_t DTS; /* valid with TS_EVT_DTS */
+        /*@temp@*/
+        /*@null@*/
+        struct ts_sect *sect; /* valid with TS_EVT_SECT, node in sect_list */
         /*@temp@*/
-        uint8_t *tail; /* point to the next data after TS[] */
+        /*@null@*/
+        const struct ts_pes *pes; /* valid with TS_EVT_PES, until the next PES of this PID,
+                                   * so at most one PES of each PID in one batch */
+        uint16_t PID;
+        uint16_t flag; /* TS_EVT_xxx */
+        int CC_lost; /* valid with TS_EVT_CC_ERR */
 };
 
 /*@only@*/
@@ -520,11 +647,42 @@ int ts_destroy(/*@only@*/ /*@null@*/ struct ts_obj *obj);
 #define TS_INIT         (0) /* init object for new application */
 #define TS_SCFG         (1) /* set ts_cfg to object */
 #define TS_TIDY         (2) /* tidy wild pointer in object */
+#define TS_SROLE        (3) /* set role table(uint8_t[0x2000], kept by user) to object */
+#define TS_SEEK         (4) /* the next packet does not follow the last one, e.g. file seek */
+#define TS_QUIET        (5) /* arg not NULL: no report on stderr while parsing, e.g. a copy of another ts_obj */
 int ts_ioctl(struct ts_obj *obj, int cmd, void *arg);
 
+/* call f(arg, pes) for each PES packet reassembled with cfg.need_pes_pkt,
+ * pes is valid until the next PES of the same PID; f: NULL means stop */
+int ts_pes_callback(struct ts_obj *obj, /*@null@*/ ts_pes_f f, void *arg);
+
 int ts_parse_tsh(struct ts_obj *obj);
 int ts_parse_tsb(struct ts_obj *obj);
 
+/* parse n packets in pkts[] with ts_parse_tsh() and ts_parse_tsb(),
+ *      stride: 188(TS), 192(MTS: 4-byte MTS + TS) or 204(TS + 16-byte RS)
+ *      evt[n]: event of each packet
+ *      ADDR: from ipt.ADDR if ipt.has_addr, or follow the last packet;
+ *            ipt.ADDR is the address of the next block after return
+ *      return: packet number parsed, or -1 if something wrong
+ * pkts[] is used in place(ipt.pTS), obj->TS is valid as long as pkts[]
+ * evt[].pes points to the record of the PID, not a copy, so the batch stops
+ * before a packet on the PID which has completed a PES in this batch, and
+ * return less than n: call again for the rest of pkts[]
+ */
+int ts_parse_batch(struct ts_obj *obj, const uint8_t *pkts, size_t n, size_t stride,
+                   /*@out@*/ struct ts_evt *evt);
+
+/* hash of the state which the parse of next packets depends on: CC, PCR,
+ * PTS, STC, CTS, section collect, etc, for some ts_obj parsing parts of one
+ * stream to check if they meet with the same state at the border
+ *      mask: TS_HASH_xxx, the state some report needs more
+ */
+#define TS_HASH_ERR     (1<<0) /* err, and statistic interval if CAT_error may occur */
+#define TS_HASH_RATE    (1<<1) /* statistic interval and packet count */
+#define TS_HASH_SECT    (1<<2) /* data of the sections in table list */
+uint64_t ts_state_hash(const struct ts_obj *obj, int mask);
+
 uint32_t ts_crc(void *buf, size_t size, int mode);
 
 /* calculate timestamp:
@@ -540,6 +698,12 @@ int64_t ts_timestamp_add(int64_t t0, int64_t td, int64_t ovf);
 /* return: td = t1 - t0 */
 int64_t ts_timestamp_diff(int64_t t1, int64_t t0, int64_t ovf);
 
+/* set slope: k = dy / dx, dx > 0, return -1 if dx is bad */
+int ts_slope_set(/*@out@*/ struct ts_slope *slope, int64_t dy, int64_t dx);
+
+/* return: x * k, truncated toward zero, error less than 1 when |x| < 2^32 */
+int64_t ts_slope_mul(const struct ts_slope *slope, int64_t x);
+
 #ifdef __cplusplus
 }
 #endif
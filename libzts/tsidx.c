@@ -0,0 +1,569 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: tsidx.c
+ * funx: random-access index of TS file, kept in a sidecar file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h> /* for uint?_t, etc */
+#include <string.h> /* for memset, memcpy, etc */
+
+#include "buddy.h"
+#include "ts.h"
+#include "tsidx.h"
+
+/* report level and macro */
+#define ERR_LVL (1) /* error, system error */
+#define WRN_LVL (2) /* warning, maybe wrong, maybe OK */
+#define INF_LVL (3) /* important information */
+#define DBG_LVL (4) /* debug information */
+
+#define RPTERR(fmt...) do {if(ERR_LVL <= rpt_lvl) {fprintf(stderr, "%s: %d: err: ", __FILE__, __LINE__); fprintf(stderr, fmt); fprintf(stderr, "\n");}} while(0)
+#define RPTWRN(fmt...) do {if(WRN_LVL <= rpt_lvl) {fprintf(stderr, "%s: %d: wrn: ", __FILE__, __LINE__); fprintf(stderr, fmt); fprintf(stderr, "\n");}} while(0)
+#define RPTINF(fmt...) do {if(INF_LVL <= rpt_lvl) {fprintf(stderr, "%s: %d: inf: ", __FILE__, __LINE__); fprintf(stderr, fmt); fprintf(stderr, "\n");}} while(0)
+#define RPTDBG(fmt...) do {if(DBG_LVL <= rpt_lvl) {fprintf(stderr, "%s: %d: dbg: ", __FILE__, __LINE__); fprintf(stderr, fmt); fprintf(stderr, "\n");}} while(0)
+
+#define MP_ORDER (24) /* memory pool for ts_obj: 16MB */
+#define BATCH_NUM (256) /* packet number of each ts_parse_batch() */
+#define ENT_MIN (1024) /* first entry number of ent[] and ver[] */
+#define PCR_JUMP_MAX (10 * (int64_t)STC_1S) /* bigger PCR step is a discontinuity, add 0 */
+#define VER_NONE (0xFF) /* no version yet, version_number is 5-bit */
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+/* head of index file */
+static const char IDX_MAGIC[8] = {'T', 'S', 'I', 'D', 'X', 0, 0, 1};
+#define IDX_ENDIAN (0x01020304) /* read back in other byte order means other machine */
+struct ts_idx_head {
+        char magic[8];
+        uint32_t endian;
+        int32_t stride;
+        int32_t interval;
+        int32_t PCR_PID; /* -1 means no PCR, 0 in old file means not saved */
+        int64_t PCR0;
+        int64_t pkt_cnt;
+        int64_t ent_cnt;
+        int64_t ver_cnt;
+};
+
+static struct ts_idx_ent *add_ent(struct ts_idx *idx, const struct ts_evt *evt, int64_t cnt);
+static int add_ver(struct ts_idx *idx, const struct ts_evt *evt, int64_t cnt);
+static int64_t key_of(const struct ts_idx_ent *ent, int by);
+
+struct ts_idx *ts_idx_create(int stride, int interval)
+{
+        struct ts_idx *idx;
+        struct ts_cfg cfg;
+
+        if(TS_PKT_SIZE != stride && 192 != stride && 204 != stride) {
+                RPTERR("ts_idx_create: bad stride(%d)", stride);
+                return NULL;
+        }
+        if(interval < 0) {
+                RPTERR("ts_idx_create: bad interval(%d)", interval);
+                return NULL;
+        }
+
+        idx = (struct ts_idx *)malloc(sizeof(struct ts_idx));
+        if(NULL == idx) {
+                RPTERR("malloc index failed");
+                return NULL;
+        }
+        memset(idx, 0, sizeof(struct ts_idx));
+        idx->stride = stride;
+        idx->interval = interval;
+        idx->PCR0 = -1;
+        idx->PCR_PID = -1;
+        memset(idx->ver_last, VER_NONE, sizeof(idx->ver_last));
+
+        idx->mp = buddy_create(MP_ORDER, 6);
+        if(NULL == idx->mp) {
+                RPTERR("malloc memory pool of index failed");
+                ts_idx_destroy(idx);
+                return NULL;
+        }
+        buddy_init(idx->mp);
+        idx->ts = ts_create(idx->mp);
+        if(NULL == idx->ts) {
+                RPTERR("malloc ts object of index failed");
+                ts_idx_destroy(idx);
+                return NULL;
+        }
+
+        /* PSI for the PES PIDs, AF for PCR and RAI, PES head for PTS */
+        memset(&cfg, 0, sizeof(struct ts_cfg));
+        cfg.need_af = 1;
+        cfg.need_psi = 1;
+        cfg.need_pes = 1;
+        ts_ioctl(idx->ts, TS_INIT, 0);
+        ts_ioctl(idx->ts, TS_SCFG, &cfg);
+        return idx;
+}
+
+void ts_idx_destroy(struct ts_idx *idx)
+{
+        if(NULL == idx) {
+                return;
+        }
+        if(NULL != idx->ts) {
+                ts_destroy(idx->ts);
+        }
+        if(NULL != idx->mp) {
+                buddy_destroy(idx->mp);
+        }
+        free(idx->ent);
+        free(idx->ver);
+        free(idx);
+}
+
+int ts_idx_add(struct ts_idx *idx, const uint8_t *pkts, size_t n, int64_t addr)
+{
+        struct ts_evt evt[BATCH_NUM];
+        struct ts_idx_ent *ent;
+        size_t i;
+        size_t m;
+        int rslt;
+        int64_t interval;
+
+        if(!idx || !(idx->ts) || !pkts) {
+                RPTERR("ts_idx_add: bad parameter");
+                return -1;
+        }
+        interval = (int64_t)(idx->interval) * STC_MS;
+
+        while(n > 0) {
+                m = ((n < BATCH_NUM) ? n : BATCH_NUM);
+                idx->ts->ipt.ADDR = addr;
+                idx->ts->ipt.has_addr = 1;
+                rslt = ts_parse_batch(idx->ts, pkts, m, idx->stride, evt);
+                if(rslt <= 0) {
+                        return -1;
+                }
+                m = (size_t)rslt; /* stop early for evt[].pes */
+
+                for(i = 0; i < m; i++) {
+                        const struct ts_evt *e = evt + i;
+                        int64_t cnt = idx->pkt_cnt + (int64_t)i;
+                        uint16_t flag = 0;
+
+                        /* time: STC of the index PCR PID, unwrapped */
+                        if((e->flag & TS_EVT_PCR) && idx->PCR_PID < 0) {
+                                idx->PCR_PID = e->PID;
+                                idx->PCR0 = e->PCR;
+                                idx->PCR = e->PCR;
+                                idx->time = 0;
+                                idx->pcr_time = -interval; /* first PCR has entry */
+                                idx->pts_time = -interval;
+                        }
+                        if((e->flag & TS_EVT_PCR) && e->PID == idx->PCR_PID) {
+                                int64_t td = ts_timestamp_diff(e->PCR, idx->PCR, STC_OVF);
+
+                                idx->time += ((td < 0 || td > PCR_JUMP_MAX) ? 0 : td);
+                                idx->PCR = e->PCR;
+                                if(idx->time - idx->pcr_time >= interval) {
+                                        flag |= TS_IDX_PCR;
+                                        idx->pcr_time = idx->time;
+                                }
+                        }
+
+                        /* PES head: always with RAI, or PTS of the PCR PID by interval */
+                        if((e->flag & TS_EVT_PUSI) && (e->flag & TS_EVT_PTS)) {
+                                if(e->flag & TS_EVT_RAI) {
+                                        flag |= (TS_IDX_PTS | TS_IDX_RAI);
+                                }
+                                else if(e->PID == idx->PCR_PID &&
+                                        idx->time - idx->pts_time >= interval) {
+                                        flag |= TS_IDX_PTS;
+                                }
+                                if(flag & TS_IDX_PTS) {
+                                        flag |= ((e->flag & TS_EVT_DTS) ? TS_IDX_DTS : 0);
+                                        idx->pts_time = idx->time;
+                                }
+                        }
+
+                        /* the first packet has entry, for packet number of the leading ones */
+                        if(0 != flag || 0 == cnt) {
+                                ent = add_ent(idx, e, cnt);
+                                if(NULL == ent) {
+                                        return -1;
+                                }
+                                ent->flag = flag;
+                        }
+
+                        if((e->flag & TS_EVT_SECT) && NULL != e->sect) {
+                                if(0 != add_ver(idx, e, cnt)) {
+                                        return -1;
+                                }
+                        }
+                }
+
+                idx->pkt_cnt += (int64_t)m;
+                addr += (int64_t)m * idx->stride;
+                pkts += m * idx->stride;
+                n -= m;
+        }
+        return 0;
+}
+
+int ts_idx_save(const struct ts_idx *idx, const char *name)
+{
+        FILE *fd;
+        struct ts_idx_head head;
+
+        if(!idx || !name) {
+                RPTERR("ts_idx_save: bad parameter");
+                return -1;
+        }
+
+        memset(&head, 0, sizeof(head));
+        memcpy(head.magic, IDX_MAGIC, sizeof(head.magic));
+        head.endian = IDX_ENDIAN;
+        head.stride = idx->stride;
+        head.interval = idx->interval;
+        head.PCR_PID = idx->PCR_PID;
+        head.PCR0 = idx->PCR0;
+        head.pkt_cnt = idx->pkt_cnt;
+        head.ent_cnt = idx->ent_cnt;
+        head.ver_cnt = idx->ver_cnt;
+
+        fd = fopen(name, "wb");
+        if(NULL == fd) {
+                RPTERR("open \"%s\" failed", name);
+                return -1;
+        }
+        if(1 != fwrite(&head, sizeof(head), 1, fd) ||
+           (size_t)(idx->ent_cnt) != fwrite(idx->ent, sizeof(struct ts_idx_ent), (size_t)(idx->ent_cnt), fd) ||
+           (size_t)(idx->ver_cnt) != fwrite(idx->ver, sizeof(struct ts_idx_ver), (size_t)(idx->ver_cnt), fd)) {
+                RPTERR("write \"%s\" failed", name);
+                fclose(fd);
+                return -1;
+        }
+        if(0 != fclose(fd)) {
+                RPTERR("close \"%s\" failed", name);
+                return -1;
+        }
+        return 0;
+}
+
+struct ts_idx *ts_idx_load(const char *name)
+{
+        FILE *fd;
+        struct ts_idx_head head;
+        struct ts_idx *idx;
+        long size;
+
+        if(!name) {
+                RPTERR("ts_idx_load: bad parameter");
+                return NULL;
+        }
+
+        fd = fopen(name, "rb");
+        if(NULL == fd) {
+                RPTERR("open \"%s\" failed", name);
+                return NULL;
+        }
+        if(1 != fread(&head, sizeof(head), 1, fd) ||
+           0 != memcmp(head.magic, IDX_MAGIC, sizeof(head.magic))) {
+                RPTERR("\"%s\" is not index file", name);
+                fclose(fd);
+                return NULL;
+        }
+        if(IDX_ENDIAN != head.endian) {
+                RPTERR("\"%s\" is made on machine with other byte order", name);
+                fclose(fd);
+                return NULL;
+        }
+        fseek(fd, 0, SEEK_END);
+        size = ftell(fd);
+        if(head.ent_cnt < 0 || head.ver_cnt < 0 ||
+           (int64_t)size != (int64_t)sizeof(head) +
+                            head.ent_cnt * (int64_t)sizeof(struct ts_idx_ent) +
+                            head.ver_cnt * (int64_t)sizeof(struct ts_idx_ver)) {
+                RPTERR("\"%s\" is broken", name);
+                fclose(fd);
+                return NULL;
+        }
+        fseek(fd, (long)sizeof(head), SEEK_SET);
+
+        idx = (struct ts_idx *)malloc(sizeof(struct ts_idx));
+        if(NULL == idx) {
+                RPTERR("malloc index failed");
+                fclose(fd);
+                return NULL;
+        }
+        memset(idx, 0, sizeof(struct ts_idx));
+        idx->stride = head.stride;
+        idx->interval = head.interval;
+        idx->PCR_PID = head.PCR_PID;
+        idx->PCR0 = head.PCR0;
+        idx->pkt_cnt = head.pkt_cnt;
+        idx->ent_cnt = head.ent_cnt;
+        idx->ver_cnt = head.ver_cnt;
+        idx->ent = (struct ts_idx_ent *)malloc((size_t)(head.ent_cnt + 1) * sizeof(struct ts_idx_ent));
+        idx->ver = (struct ts_idx_ver *)malloc((size_t)(head.ver_cnt + 1) * sizeof(struct ts_idx_ver));
+        if(NULL == idx->ent || NULL == idx->ver) {
+                RPTERR("malloc index entry failed");
+                ts_idx_destroy(idx);
+                fclose(fd);
+                return NULL;
+        }
+        if((size_t)(head.ent_cnt) != fread(idx->ent, sizeof(struct ts_idx_ent), (size_t)(head.ent_cnt), fd) ||
+           (size_t)(head.ver_cnt) != fread(idx->ver, sizeof(struct ts_idx_ver), (size_t)(head.ver_cnt), fd)) {
+                RPTERR("read \"%s\" failed", name);
+                ts_idx_destroy(idx);
+                fclose(fd);
+                return NULL;
+        }
+        fclose(fd);
+        return idx;
+}
+
+struct ts_idx *ts_idx_open(const char *name, int stride, const char *pos, int64_t *addr)
+{
+        struct ts_idx *idx;
+        int by;
+        int64_t val;
+
+        if(!name || !pos || !addr) {
+                RPTERR("ts_idx_open: bad parameter");
+                return NULL;
+        }
+        if(0 != ts_idx_pos(pos, &by, &val)) {
+                return NULL;
+        }
+        idx = ts_idx_load(name);
+        if(NULL == idx) {
+                RPTERR("no index, make it with \"tsana -mkidx 500\" first");
+                return NULL;
+        }
+        if(idx->stride != stride) {
+                RPTERR("\"%s\" is index of %d-byte packet, not %d", name, idx->stride, stride);
+                ts_idx_destroy(idx);
+                return NULL;
+        }
+        *addr = ts_idx_addr(idx, by, val);
+        if(*addr < 0) {
+                ts_idx_destroy(idx);
+                return NULL;
+        }
+        return idx;
+}
+
+int64_t ts_idx_seek(const struct ts_idx *idx, int by, int64_t val)
+{
+        int64_t lo;
+        int64_t hi;
+        int64_t mid;
+
+        if(!idx) {
+                return -1;
+        }
+        if(TS_IDX_BY_PCR == by) {
+                if(idx->PCR0 < 0) {
+                        RPTERR("no PCR in index");
+                        return -1;
+                }
+                if(val < 0 || val >= STC_OVF) {
+                        RPTERR("bad PCR(%lld)", (long long int)val);
+                        return -1;
+                }
+                val = ts_timestamp_diff(val, idx->PCR0, STC_OVF);
+                if(val < 0) {
+                        /* after wrap around, or before PCR0 */
+                        val += STC_OVF;
+                        if(idx->ent_cnt <= 0 || val > idx->ent[idx->ent_cnt - 1].time) {
+                                val = 0;
+                        }
+                }
+                by = TS_IDX_BY_TIME;
+        }
+
+        /* the last one with key <= val: ent[lo] <= val < ent[hi] */
+        lo = -1;
+        hi = idx->ent_cnt;
+        while(hi - lo > 1) {
+                mid = lo + ((hi - lo) >> 1);
+                if(key_of(idx->ent + mid, by) <= val) {
+                        lo = mid;
+                }
+                else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+int64_t ts_idx_rai(const struct ts_idx *idx, int64_t i)
+{
+        int64_t j;
+
+        if(!idx || i >= idx->ent_cnt) {
+                return -1;
+        }
+
+        /* RAI of the PCR PID, mostly video, then RAI of any PID */
+        for(j = i; j >= 0 && idx->PCR_PID > 0; j--) {
+                if((idx->ent[j].flag & TS_IDX_RAI) && idx->ent[j].PID == idx->PCR_PID) {
+                        return j;
+                }
+        }
+        for(j = i; j >= 0; j--) {
+                if(idx->ent[j].flag & TS_IDX_RAI) {
+                        return j;
+                }
+        }
+        return -1;
+}
+
+int ts_idx_psi(const struct ts_idx *idx, int64_t addr, int64_t *from, int64_t *to)
+{
+        int64_t i;
+
+        if(!idx || !from || !to) {
+                return -1;
+        }
+
+        /* ver[] is sorted by ADDR: ver[i - 1] < addr <= ver[i] */
+        i = 0;
+        while(i < idx->ver_cnt && idx->ver[i].ADDR < addr) {
+                i++;
+        }
+        if(0 == i) {
+                return -1;
+        }
+        *from = idx->ver[i - 1].ADDR;
+        *to = ((i < idx->ver_cnt) ? idx->ver[i].ADDR : -1);
+        return 0;
+}
+
+int ts_idx_pos(const char *str, int *by, int64_t *val)
+{
+        char *end;
+
+        if(!str || !by || !val) {
+                return -1;
+        }
+        if(0 == strncmp(str, "pkt:", 4)) {
+                *by = TS_IDX_BY_CNT;
+                *val = strtoll(str + 4, &end, 0);
+        }
+        else if(0 == strncmp(str, "pcr:", 4)) {
+                *by = TS_IDX_BY_PCR;
+                *val = strtoll(str + 4, &end, 0);
+        }
+        else {
+                double sec = strtod(str, &end);
+
+                *by = TS_IDX_BY_TIME;
+                *val = (int64_t)(sec * STC_1S);
+        }
+        if(end == str || '\0' != *end || *val < 0) {
+                RPTERR("bad position: \"%s\"", str);
+                return -1;
+        }
+        return 0;
+}
+
+int64_t ts_idx_addr(const struct ts_idx *idx, int by, int64_t val)
+{
+        int64_t i;
+        int64_t j;
+
+        if(!idx || idx->ent_cnt <= 0) {
+                RPTERR("empty index");
+                return -1;
+        }
+
+        i = ts_idx_seek(idx, by, val);
+        if(TS_IDX_BY_CNT == by) {
+                if(i < 0 || val >= idx->pkt_cnt) {
+                        RPTERR("packet %lld is out of index(%lld packets)",
+                               (long long int)val, (long long int)(idx->pkt_cnt));
+                        return -1;
+                }
+                return idx->ent[i].ADDR + (val - idx->ent[i].cnt) * idx->stride;
+        }
+
+        /* time or PCR: from random access point, for decoder */
+        i = ((i < 0) ? 0 : i);
+        j = ts_idx_rai(idx, i);
+        return idx->ent[((j < 0) ? i : j)].ADDR;
+}
+
+static struct ts_idx_ent *add_ent(struct ts_idx *idx, const struct ts_evt *evt, int64_t cnt)
+{
+        struct ts_idx_ent *ent;
+
+        if(idx->ent_cnt >= idx->ent_size) {
+                int64_t size = ((idx->ent_size > 0) ? (idx->ent_size << 1) : ENT_MIN);
+
+                ent = (struct ts_idx_ent *)realloc(idx->ent, (size_t)size * sizeof(struct ts_idx_ent));
+                if(NULL == ent) {
+                        RPTERR("malloc index entry failed");
+                        return NULL;
+                }
+                idx->ent = ent;
+                idx->ent_size = size;
+        }
+
+        ent = idx->ent + idx->ent_cnt;
+        memset(ent, 0, sizeof(struct ts_idx_ent));
+        ent->ADDR = evt->ADDR;
+        ent->cnt = cnt;
+        ent->time = idx->time;
+        ent->PCR = ((evt->flag & TS_EVT_PCR) ? evt->PCR : -1);
+        ent->PTS = ((evt->flag & TS_EVT_PTS) ? evt->PTS : -1);
+        ent->DTS = ((evt->flag & TS_EVT_DTS) ? evt->DTS : -1);
+        ent->PID = evt->PID;
+        idx->ent_cnt++;
+        return ent;
+}
+
+static int add_ver(struct ts_idx *idx, const struct ts_evt *evt, int64_t cnt)
+{
+        const struct ts_sect *sect = evt->sect;
+        struct ts_idx_ver *ver;
+
+        if(0x00 != sect->table_id && 0x02 != sect->table_id) {
+                return 0; /* PAT and PMT only */
+        }
+        if(sect->version_number == idx->ver_last[evt->PID]) {
+                return 0;
+        }
+        idx->ver_last[evt->PID] = sect->version_number;
+
+        if(idx->ver_cnt >= idx->ver_size) {
+                int64_t size = ((idx->ver_size > 0) ? (idx->ver_size << 1) : ENT_MIN);
+
+                ver = (struct ts_idx_ver *)realloc(idx->ver, (size_t)size * sizeof(struct ts_idx_ver));
+                if(NULL == ver) {
+                        RPTERR("malloc index version failed");
+                        return -1;
+                }
+                idx->ver = ver;
+                idx->ver_size = size;
+        }
+
+        ver = idx->ver + idx->ver_cnt;
+        memset(ver, 0, sizeof(struct ts_idx_ver));
+        ver->ADDR = evt->ADDR;
+        ver->cnt = cnt;
+        ver->PID = evt->PID;
+        ver->table_id_extension = sect->table_id_extension;
+        ver->table_id = sect->table_id;
+        ver->version_number = sect->version_number;
+        idx->ver_cnt++;
+        return 0;
+}
+
+static int64_t key_of(const struct ts_idx_ent *ent, int by)
+{
+        switch(by) {
+                case TS_IDX_BY_CNT:
+                        return ent->cnt;
+                case TS_IDX_BY_TIME:
+                        return ent->time;
+                default:
+                        return ent->ADDR;
+        }
+}
@@ -0,0 +1,132 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: tsidx.h
+ * funx: random-access index of TS file, kept in a sidecar file
+ *
+ * index file: head, ent[ent_cnt], ver[ver_cnt], in host byte order
+ * ent[]: sorted by ADDR, cnt and time, so seek is a binary search
+ */
+
+#ifndef _TSIDX_H
+#define _TSIDX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* for uint?_t, etc */
+#include <stddef.h> /* for size_t */
+
+#define TS_IDX_PCR      (1<<0) /* PCR packet of the index PCR PID */
+#define TS_IDX_PTS      (1<<1) /* PES head with PTS */
+#define TS_IDX_DTS      (1<<2) /* PES head with DTS */
+#define TS_IDX_RAI      (1<<3) /* random_access_indicator is 1 */
+
+/* one entry of the index */
+struct ts_idx_ent {
+        int64_t ADDR; /* address of the packet(unit: byte) */
+        int64_t cnt; /* packet number, from 0 */
+        int64_t time; /* STC from PCR0, unwrapped, unit: 1/27MHz */
+        int64_t PCR; /* valid with TS_IDX_PCR */
+        int64_t PTS; /* valid with TS_IDX_PTS */
+        int64_t DTS; /* valid with TS_IDX_DTS */
+        uint16_t PID;
+        uint16_t flag; /* TS_IDX_xxx */
+        uint32_t resv;
+};
+
+/* one change of PAT or PMT version */
+struct ts_idx_ver {
+        int64_t ADDR; /* address of the packet with the end of the section */
+        int64_t cnt;
+        uint16_t PID;
+        uint16_t table_id_extension; /* transport_stream_id or program_number */
+        uint8_t table_id;
+        uint8_t version_number;
+        uint16_t resv;
+};
+
+/* seek by */
+#define TS_IDX_BY_CNT   (0) /* packet number */
+#define TS_IDX_BY_TIME  (1) /* STC from PCR0 */
+#define TS_IDX_BY_PCR   (2) /* PCR value */
+
+struct ts_idx {
+        int stride; /* 188(TS), 192(MTS) or 204(TSRS) */
+        int interval; /* min time between PCR entries, or PTS entries without RAI, unit: ms */
+        int64_t PCR0; /* the first PCR of the index PCR PID, time 0; -1 means no PCR */
+        int64_t pkt_cnt; /* packet indexed */
+        int64_t ent_cnt;
+        /*@only@*/
+        struct ts_idx_ent *ent;
+        int64_t ver_cnt;
+        /*@only@*/
+        struct ts_idx_ver *ver;
+
+        int PCR_PID; /* the first PID with PCR, -1 means not found */
+
+        /* for ts_idx_add() only */
+        int64_t ent_size; /* malloced entry number */
+        int64_t ver_size;
+        /*@null@*/
+        void *mp; /* memory pool of ts */
+        /*@null@*/
+        struct ts_obj *ts;
+        int64_t PCR; /* the last PCR */
+        int64_t time; /* time of the last PCR */
+        int64_t pcr_time; /* time of the last PCR entry */
+        int64_t pts_time; /* time of the last PTS entry */
+        uint8_t ver_last[0x2000]; /* the last version of PAT/PMT on each PID, 0xFF means none */
+};
+
+/* for index build: stride of the file, interval(ms) of the entries */
+/*@only@*/
+/*@null@*/
+struct ts_idx *ts_idx_create(int stride, int interval);
+void ts_idx_destroy(/*@only@*/ /*@null@*/ struct ts_idx *idx);
+
+/* index n packets in pkts[], pkts[0] is at addr of the file, follow the last ones */
+int ts_idx_add(struct ts_idx *idx, const uint8_t *pkts, size_t n, int64_t addr);
+
+int ts_idx_save(const struct ts_idx *idx, const char *name);
+
+/* load index file, ts_idx_destroy() it after use */
+/*@only@*/
+/*@null@*/
+struct ts_idx *ts_idx_load(const char *name);
+
+/* ts_idx_load() and check it with stride of the file, then address of position pos
+ * for ts_idx_pos() and ts_idx_addr(); ts_idx_destroy() it after use */
+/*@only@*/
+/*@null@*/
+struct ts_idx *ts_idx_open(const char *name, int stride, const char *pos, int64_t *addr);
+
+/* the last entry with key <= val, -1 means before the first one
+ *      by: TS_IDX_BY_xxx
+ *      val: packet number, time(unit: 1/27MHz) or PCR
+ */
+int64_t ts_idx_seek(const struct ts_idx *idx, int by, int64_t val);
+
+/* entry i or the nearest one before it with TS_IDX_RAI, -1 means none;
+ * RAI of the index PCR PID first, RAI of other PID if it has none */
+int64_t ts_idx_rai(const struct ts_idx *idx, int64_t i);
+
+/* PAT and PMT in force at addr: no version change in [*from, *to),
+ * *from is the last change before addr, *to < 0 means the end of file
+ * return 0, or -1 if no PAT or PMT before addr */
+int ts_idx_psi(const struct ts_idx *idx, int64_t addr, int64_t *from, int64_t *to);
+
+/* position string: "12.5" seconds from PCR0, "pcr:0x1234" or "pkt:1000"
+ * return 0 and set *by and *val, or -1 if bad */
+int ts_idx_pos(const char *str, int *by, int64_t *val);
+
+/* address of the packet to start from for position by/val, -1 means bad index
+ *      time and PCR: entry with RAI before it, for decoder
+ *      packet number: the packet itself, counted from the entry before it
+ */
+int64_t ts_idx_addr(const struct ts_idx *idx, int by, int64_t val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TSIDX_H */
@@ -8,6 +8,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "config.h" /* for SYS_* macro, generated by configure */
+
+#ifdef SYS_WINDOWS
+#       include <io.h> /* for _setmode() */
+#       include <fcntl.h> /* for _O_BINARY */
+#endif
+
 #include "if.h"
 
 /* for function to_byte() */
@@ -232,3 +239,158 @@ int next_nuint_hex(long long int *sint, char **text, int max)
 
         return cnt;
 }
+
+/* binary record */
+static void put_u64(uint8_t *p, int64_t x)
+{
+        int i;
+
+        for(i = 7; i >= 0; i--) {
+                p[i] = (uint8_t)(x & 0xFF);
+                x >>= 8;
+        }
+}
+
+static int64_t get_u64(const uint8_t *p)
+{
+        int i;
+        uint64_t x = 0;
+
+        for(i = 0; i < 8; i++) {
+                x = (x << 8) | *p++;
+        }
+        return (int64_t)x;
+}
+
+int rec_binmode(FILE *fd)
+{
+#ifdef SYS_WINDOWS
+        if(-1 == _setmode(_fileno(fd), _O_BINARY)) {
+                return -1;
+        }
+#else
+        (void)fd;
+#endif
+        return 0;
+}
+
+int rec_is_bin(FILE *fd)
+{
+        int ch;
+
+        ch = getc(fd);
+        if(EOF == ch) {
+                return 0;
+        }
+        ungetc(ch, fd);
+        return (REC_SYNC == ch) ? 1 : 0;
+}
+
+int rec_write(FILE *fd, const struct rec *rec)
+{
+        uint8_t buf[REC_HEAD_SIZE + 188 + 16 + 3 * 8]; /* all fields but DATA */
+        uint8_t *p = buf;
+        int len = 0;
+
+        if(rec->flag & REC_DATA) {
+                len = rec->len;
+                if(len < 0 || len > REC_DATA_MAX) {
+                        return -1;
+                }
+        }
+
+        *p++ = REC_SYNC;
+        *p++ = (uint8_t)rec->flag;
+        *p++ = (uint8_t)(len >> 8);
+        *p++ = (uint8_t)(len);
+        if(rec->flag & REC_TS) {
+                memcpy(p, rec->TS, 188);
+                p += 188;
+        }
+        if(rec->flag & REC_RS) {
+                memcpy(p, rec->RS, 16);
+                p += 16;
+        }
+        if(rec->flag & REC_ADDR) {
+                put_u64(p, rec->ADDR);
+                p += 8;
+        }
+        if(rec->flag & REC_MTS) {
+                put_u64(p, rec->MTS);
+                p += 8;
+        }
+        if(rec->flag & REC_CTS) {
+                put_u64(p, rec->CTS);
+                p += 8;
+        }
+
+        if(1 != fwrite(buf, (size_t)(p - buf), 1, fd)) {
+                return -1;
+        }
+        if(0 != len && 1 != fwrite(rec->DATA, (size_t)len, 1, fd)) {
+                return -1;
+        }
+        return 0;
+}
+
+int rec_read(FILE *fd, struct rec *rec, int max)
+{
+        uint8_t head[REC_HEAD_SIZE];
+        uint8_t num[3 * 8]; /* ADDR, MTS, CTS */
+        uint8_t *p = num;
+        size_t size;
+        int len;
+
+        size = fread(head, 1, REC_HEAD_SIZE, fd);
+        if(0 == size) {
+                return REC_EOF;
+        }
+        if(REC_HEAD_SIZE != size || REC_SYNC != head[0]) {
+                return REC_ERR;
+        }
+
+        rec->flag = head[1];
+        len = (head[2] << 8) | head[3];
+        rec->len = 0;
+
+        if(rec->flag & REC_TS) {
+                if(1 != fread(rec->TS, 188, 1, fd)) {
+                        return REC_ERR;
+                }
+        }
+        if(rec->flag & REC_RS) {
+                if(1 != fread(rec->RS, 16, 1, fd)) {
+                        return REC_ERR;
+                }
+        }
+
+        size = 0;
+        size += ((rec->flag & REC_ADDR) ? 8 : 0);
+        size += ((rec->flag & REC_MTS) ? 8 : 0);
+        size += ((rec->flag & REC_CTS) ? 8 : 0);
+        if(0 != size && 1 != fread(num, size, 1, fd)) {
+                return REC_ERR;
+        }
+        if(rec->flag & REC_ADDR) {
+                rec->ADDR = get_u64(p);
+                p += 8;
+        }
+        if(rec->flag & REC_MTS) {
+                rec->MTS = get_u64(p);
+                p += 8;
+        }
+        if(rec->flag & REC_CTS) {
+                rec->CTS = get_u64(p);
+        }
+
+        if(rec->flag & REC_DATA) {
+                if(len > max || NULL == rec->DATA) {
+                        return REC_ERR;
+                }
+                if(0 != len && 1 != fread(rec->DATA, (size_t)len, 1, fd)) {
+                        return REC_ERR;
+                }
+                rec->len = len;
+        }
+        return REC_OK;
+}
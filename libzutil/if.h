@@ -10,6 +10,7 @@
 extern "C" {
 #endif
 
+#include <stdio.h> /* for FILE */
 #include <stdint.h> /* for uintN_t, etc */
 
 int b2t(char *DST, const uint8_t *PTR, int len);
@@ -17,6 +18,44 @@ int next_tag(char **tag, char **text);
 int next_nbyte_hex(uint8_t *byte, char **text, int max);
 int next_nuint_hex(long long int *sint, char **text, int max);
 
+/* binary record, the same fields as text line, but no hex convert
+ *
+ * head: sync(0xB8), flag, DATA length(16-bit, big-endian)
+ * body: TS[188], RS[16], ADDR, MTS, CTS(64-bit, big-endian), DATA[len]
+ *       only the fields marked in flag are present, in the order above
+ */
+#define REC_SYNC                        (0xB8) /* never '*', to tell from text line */
+#define REC_HEAD_SIZE                   (4)
+#define REC_DATA_MAX                    (0xFFFF)
+
+#define REC_TS                          (1 << 0) /* has TS[188] */
+#define REC_RS                          (1 << 1) /* has RS[16] */
+#define REC_ADDR                        (1 << 2) /* has ADDR */
+#define REC_MTS                         (1 << 3) /* has MTS */
+#define REC_CTS                         (1 << 4) /* has CTS */
+#define REC_DATA                        (1 << 5) /* has DATA[len] */
+
+/* return value of rec_read() */
+#define REC_OK                          (0)
+#define REC_EOF                         (+1) /* normal end of stream */
+#define REC_ERR                         (-1) /* bad sync or truncated record */
+
+struct rec {
+        int flag; /* REC_TS | REC_RS | ... */
+        uint8_t *TS; /* 188-byte, buffer of caller */
+        uint8_t *RS; /* 16-byte, buffer of caller */
+        uint8_t *DATA; /* len-byte, buffer of caller */
+        int len; /* DATA length */
+        int64_t ADDR;
+        int64_t MTS;
+        int64_t CTS;
+};
+
+int rec_binmode(FILE *fd); /* for MinGW: no '\n' -> "\r\n" */
+int rec_is_bin(FILE *fd); /* peek first byte, 1: binary record; 0: text line; rec_binmode() first */
+int rec_write(FILE *fd, const struct rec *rec);
+int rec_read(FILE *fd, struct rec *rec, int max); /* max: DATA buffer size */
+
 #ifdef __cplusplus
 }
 #endif
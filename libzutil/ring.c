@@ -0,0 +1,236 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: ring.c
+ * funx: lock-free SPSC ring of variable size records, between two threads
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h> /* for uint?_t, etc */
+#include <time.h> /* for clock_gettime() */
+#include <pthread.h>
+
+#include "common.h"
+#include "ring.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define HEAD_SIZE       (8) /* record head: uint32_t len, 8-byte align */
+#define PAD_LEN         (0xFFFFFFFF) /* len of pad record: skip to buf[0] */
+#define SLOT(len)       ((HEAD_SIZE + (len) + 7) & ~(size_t)7)
+#define WAIT_NS         (1000000) /* sleep at most 1ms: report delay, or lost wake */
+
+/* head and tail only increase, (head - tail) is the used size */
+struct ring {
+        uint8_t *buf;
+        size_t size;
+        size_t mask;
+
+        /* producer */
+        size_t head __attribute__((aligned(64))); /* shared: committed bytes */
+        size_t next_head; /* head after ring_commit() */
+        size_t len; /* len of last ring_reserve() */
+        size_t want; /* free size for producer to go on */
+        int prod_wait; /* shared: producer is waiting */
+        long full_cnt;
+
+        /* consumer */
+        size_t tail __attribute__((aligned(64))); /* shared: released bytes */
+        size_t next_tail; /* tail after ring_release() */
+        int cons_wait; /* shared: consumer is waiting */
+
+        int is_closed; /* shared */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+};
+
+static void wait_for(struct ring *r, int *flag, const size_t *var, size_t seen);
+static void wake(struct ring *r);
+
+struct ring *ring_create(size_t size)
+{
+        struct ring *r;
+
+        if(size < 1024 || 0 != (size & (size - 1))) {
+                RPTERR("bad ring size: %zu", size);
+                return NULL;
+        }
+
+        r = (struct ring *)calloc(1, sizeof(struct ring));
+        if(NULL == r) {
+                RPTERR("malloc ring failed");
+                return NULL;
+        }
+        r->buf = (uint8_t *)malloc(size);
+        if(NULL == r->buf) {
+                RPTERR("malloc ring buffer(%zu-byte) failed", size);
+                free(r);
+                return NULL;
+        }
+        r->size = size;
+        r->mask = size - 1;
+        pthread_mutex_init(&(r->mutex), NULL);
+        pthread_cond_init(&(r->cond), NULL);
+        return r;
+}
+
+void ring_destroy(struct ring *r)
+{
+        if(NULL == r) {
+                return;
+        }
+        pthread_cond_destroy(&(r->cond));
+        pthread_mutex_destroy(&(r->mutex));
+        free(r->buf);
+        free(r);
+        return;
+}
+
+void *ring_reserve(struct ring *r, size_t len)
+{
+        size_t need = SLOT(len);
+        size_t head = r->head; /* only producer change it */
+        size_t pos = head & r->mask;
+        size_t room = r->size - pos; /* to the end of buf */
+        size_t tail;
+        size_t want;
+
+        if(need > (r->size >> 1)) {
+                RPTERR("record(%zu-byte) too big for ring", len);
+                return NULL;
+        }
+
+        want = ((need <= room) ? need : room + need);
+        __atomic_store_n(&(r->want), want, __ATOMIC_RELAXED); /* read by consumer to wake */
+        while(r->size - (head - (tail = __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE))) < want) {
+                r->full_cnt++;
+                wait_for(r, &(r->prod_wait), &(r->tail), tail);
+        }
+
+        if(need > room) {
+                /* no room at the end, pad and go to buf[0] */
+                *(uint32_t *)(r->buf + pos) = PAD_LEN;
+                head += room;
+                pos = 0;
+        }
+        *(uint32_t *)(r->buf + pos) = (uint32_t)len;
+        r->next_head = head + need;
+        r->len = len;
+        return r->buf + pos + HEAD_SIZE;
+}
+
+void ring_shrink(struct ring *r, size_t len)
+{
+        size_t pos = (r->next_head - SLOT(r->len)) & r->mask;
+
+        if(len >= r->len) {
+                return;
+        }
+        *(uint32_t *)(r->buf + pos) = (uint32_t)len;
+        r->next_head -= SLOT(r->len) - SLOT(len);
+        r->len = len;
+        return;
+}
+
+void ring_commit(struct ring *r)
+{
+        __atomic_store_n(&(r->head), r->next_head, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); /* store head before load flag */
+        if(__atomic_load_n(&(r->cons_wait), __ATOMIC_SEQ_CST)) {
+                /* wake consumer for a batch, else it wakes itself after WAIT_NS */
+                if(r->next_head - __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE) >= (r->size >> 4)) {
+                        wake(r);
+                }
+        }
+        return;
+}
+
+void ring_close(struct ring *r)
+{
+        __atomic_store_n(&(r->is_closed), 1, __ATOMIC_SEQ_CST);
+        wake(r);
+        return;
+}
+
+const void *ring_peek(struct ring *r, size_t *len)
+{
+        size_t tail = r->tail; /* only consumer change it */
+        size_t head;
+        size_t pos;
+        uint32_t l;
+
+        while(1) {
+                head = __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE);
+                if(tail == head) {
+                        if(__atomic_load_n(&(r->is_closed), __ATOMIC_SEQ_CST) &&
+                           tail == __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE)) {
+                                return NULL; /* all records done */
+                        }
+                        wait_for(r, &(r->cons_wait), &(r->head), head);
+                        continue;
+                }
+
+                pos = tail & r->mask;
+                l = *(uint32_t *)(r->buf + pos);
+                if(PAD_LEN == l) {
+                        tail += r->size - pos;
+                        __atomic_store_n(&(r->tail), tail, __ATOMIC_RELEASE);
+                        continue;
+                }
+
+                r->next_tail = tail + SLOT(l);
+                *len = (size_t)l;
+                return r->buf + pos + HEAD_SIZE;
+        }
+}
+
+void ring_release(struct ring *r)
+{
+        size_t tail = r->next_tail;
+
+        __atomic_store_n(&(r->tail), tail, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); /* store tail before load flag */
+        if(__atomic_load_n(&(r->prod_wait), __ATOMIC_SEQ_CST)) {
+                size_t free = r->size - (__atomic_load_n(&(r->head), __ATOMIC_ACQUIRE) - tail);
+
+                /* wake producer after half ring is free, not for each record */
+                if(free >= __atomic_load_n(&(r->want), __ATOMIC_RELAXED) && free >= (r->size >> 1)) {
+                        wake(r);
+                }
+        }
+        return;
+}
+
+long ring_full_cnt(const struct ring *r)
+{
+        return r->full_cnt;
+}
+
+/* sleep until *var != seen, or WAIT_NS passed */
+static void wait_for(struct ring *r, int *flag, const size_t *var, size_t seen)
+{
+        struct timespec ts;
+
+        pthread_mutex_lock(&(r->mutex));
+        __atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+        if(seen == __atomic_load_n(var, __ATOMIC_SEQ_CST) &&
+           !__atomic_load_n(&(r->is_closed), __ATOMIC_SEQ_CST)) {
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += WAIT_NS;
+                if(ts.tv_nsec >= 1000000000) {
+                        ts.tv_sec++;
+                        ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&(r->cond), &(r->mutex), &ts);
+        }
+        __atomic_store_n(flag, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&(r->mutex));
+        return;
+}
+
+static void wake(struct ring *r)
+{
+        pthread_mutex_lock(&(r->mutex));
+        pthread_cond_broadcast(&(r->cond));
+        pthread_mutex_unlock(&(r->mutex));
+        return;
+}
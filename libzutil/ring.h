@@ -0,0 +1,51 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: ring.h
+ * funx: lock-free SPSC ring of variable size records, between two threads
+ */
+
+#ifndef _RING_H
+#define _RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* for size_t */
+
+/* one producer thread and one consumer thread:
+ *
+ * producer: p = ring_reserve(r, len); fill p[len]; ring_commit(r);
+ *           ...; ring_close(r);
+ * consumer: while(NULL != (p = ring_peek(r, &len))) {use p[len]; ring_release(r);}
+ *
+ * ring_reserve() waits while the ring is full, and ring_peek() waits while
+ * it is empty, so a slow consumer holds back the producer(backpressure)
+ */
+struct ring;
+
+/* size: ring buffer size, power of 2; a record can use at most half of it */
+/*@null@*/
+/*@only@*/
+struct ring *ring_create(size_t size);
+void ring_destroy(/*@only@*/ /*@null@*/ struct ring *r);
+
+/* producer */
+/*@null@*/
+void *ring_reserve(struct ring *r, size_t len); /* NULL: len too big */
+void ring_shrink(struct ring *r, size_t len); /* use only len-byte of last ring_reserve() */
+void ring_commit(struct ring *r); /* the record of last ring_reserve() is ready */
+void ring_close(struct ring *r); /* no more record */
+
+/* consumer */
+/*@null@*/
+const void *ring_peek(struct ring *r, size_t *len); /* NULL: closed and empty */
+void ring_release(struct ring *r); /* the record of last ring_peek() is done */
+
+/* number of waits because of full ring, for report */
+long ring_full_cnt(const struct ring *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RING_H */
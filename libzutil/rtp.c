@@ -0,0 +1,108 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: rtp.c
+ * funx: RTP(RFC 3550) header of MPEG-TS over UDP(RFC 2250)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "rtp.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define RTP_DROPOUT (3000) /* bigger gap of sequence_number means restart, RFC 3550 A.1 */
+#define RTP_MISORDER (100) /* smaller step back of sequence_number means disorder */
+#define NS_TO_RTP(ns) (((ns) / 100000) * 9 + ((ns) % 100000) * 9 / 100000) /* ns -> 1/RTP_CLOCK */
+
+size_t rtp_payload(const uint8_t *buf, size_t len, size_t *plen, int force)
+{
+        size_t off;
+        size_t pad = 0;
+
+        if(len < RTP_HEAD_LEN || 2 != (buf[0] >> 6)) {
+                return 0; /* not version 2, e.g. 0x47 of TS */
+        }
+        off = RTP_HEAD_LEN + 4 * (size_t)(buf[0] & 0x0F); /* CSRC list */
+        if(buf[0] & 0x10) { /* header extension */
+                if(off + 4 > len) {
+                        return 0;
+                }
+                off += 4 + 4 * (size_t)((buf[off + 2] << 8) | buf[off + 3]);
+        }
+        if(buf[0] & 0x20) { /* padding, count in the last byte */
+                pad = buf[len - 1];
+        }
+        if(off + pad >= len) {
+                return 0;
+        }
+        if(!force && 0x47 != buf[off]) {
+                return 0; /* maybe other payload, keep the datagram */
+        }
+
+        *plen = len - off - pad;
+        return off;
+}
+
+uint32_t rtp_count(struct rtp *rtp, const uint8_t *buf, int64_t arrival)
+{
+        uint16_t seq;
+        uint32_t timestamp;
+        uint16_t delta;
+        uint32_t lost;
+
+        seq = (uint16_t)((buf[2] << 8) | buf[3]);
+        timestamp = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7];
+        arrival = NS_TO_RTP(arrival);
+
+        rtp->cnt++;
+        if(rtp->is_sync) {
+                delta = (uint16_t)(seq - rtp->seq);
+                if(0 == delta || delta > 0x10000 - RTP_MISORDER) {
+                        rtp->disorder++; /* duplicated or late, no jitter for it */
+                        return 0;
+                }
+                if(delta <= RTP_DROPOUT) {
+                        lost = (uint32_t)delta - 1;
+                        rtp->lost += lost;
+
+                        /* interarrival jitter, the wrap of timestamp is OK */
+                        if(0 != arrival && 0 != rtp->arrival) {
+                                int64_t d = (arrival - rtp->arrival) - (int32_t)(timestamp - rtp->timestamp);
+
+                                d = ((d < 0) ? -d : d);
+                                rtp->jitter += (uint64_t)d - ((rtp->jitter + 8) >> 4);
+                        }
+                        rtp->seq = seq;
+                        rtp->timestamp = timestamp;
+                        rtp->arrival = arrival;
+                        return lost;
+                }
+                RPTINF("sequence_number jump: %u -> %u, sync again", (unsigned int)(rtp->seq), (unsigned int)seq);
+        }
+
+        rtp->is_sync = 1;
+        rtp->seq = seq;
+        rtp->timestamp = timestamp;
+        rtp->arrival = arrival;
+        return 0;
+}
+
+void rtp_head(uint8_t *buf, uint16_t seq, int64_t time, uint32_t ssrc)
+{
+        uint32_t timestamp = (uint32_t)NS_TO_RTP(time);
+
+        buf[0] = 0x80; /* version 2, no padding, extension and CSRC */
+        buf[1] = RTP_PT_MP2T; /* marker 0 */
+        buf[2] = (uint8_t)(seq >> 8);
+        buf[3] = (uint8_t)(seq);
+        buf[4] = (uint8_t)(timestamp >> 24);
+        buf[5] = (uint8_t)(timestamp >> 16);
+        buf[6] = (uint8_t)(timestamp >> 8);
+        buf[7] = (uint8_t)(timestamp);
+        buf[8] = (uint8_t)(ssrc >> 24);
+        buf[9] = (uint8_t)(ssrc >> 16);
+        buf[10] = (uint8_t)(ssrc >> 8);
+        buf[11] = (uint8_t)(ssrc);
+        return;
+}
@@ -0,0 +1,50 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: rtp.h
+ * funx: RTP(RFC 3550) header of MPEG-TS over UDP(RFC 2250)
+ */
+
+#ifndef _RTP_H
+#define _RTP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* for uint?_t, etc */
+#include <stddef.h> /* for size_t */
+
+#define RTP_CLOCK (90000) /* timestamp clock of MPEG-TS payload, RFC 2250 */
+#define RTP_HEAD_LEN (12) /* fixed part of RTP header */
+#define RTP_PT_MP2T (33) /* payload type of MPEG-TS, RFC 3551 */
+
+/* statistic of one RTP stream, zero it before the first packet */
+struct rtp {
+        int is_sync; /* seq, timestamp and arrival are OK */
+        uint16_t seq; /* the last sequence_number */
+        uint32_t timestamp; /* the last timestamp, unit: 1/RTP_CLOCK */
+        int64_t arrival; /* the last arrival time, unit: 1/RTP_CLOCK, 0 means unknown */
+        uint64_t cnt; /* RTP packet counted */
+        uint64_t lost; /* RTP packet lost, from the gap of sequence_number */
+        uint64_t disorder; /* RTP packet duplicated or out of order */
+        uint64_t jitter; /* interarrival jitter x16, unit: 1/RTP_CLOCK, RFC 3550 A.8 */
+};
+
+/* check the header of datagram buf[len]; force: not 0 means the datagram
+ * must be RTP(rtp://), 0 means RTP only if MPEG-TS follows the header(udp://)
+ * return payload offset in buf[], *plen is payload length without padding;
+ * return 0 means not RTP, use the whole datagram */
+size_t rtp_payload(const uint8_t *buf, size_t len, size_t *plen, int force);
+
+/* count one RTP packet by its header, arrival: receive time(unit: ns), 0 means unknown
+ * return packet number lost just before this one */
+uint32_t rtp_count(struct rtp *rtp, const uint8_t *buf, int64_t arrival);
+
+/* write the fixed header of MPEG-TS payload to buf[RTP_HEAD_LEN], no CSRC and extension
+ *      time: send time of the datagram(unit: ns), as timestamp of RTP_CLOCK */
+void rtp_head(uint8_t *buf, uint16_t seq, int64_t time, uint32_t ssrc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RTP_H */
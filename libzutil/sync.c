@@ -0,0 +1,290 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: sync.c
+ * funx: judge packet size and sync position of TS data
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h> /* for uintN_t, PRIX64, etc */
+#include <pthread.h> /* for pthread_once() */
+
+#include "config.h" /* for fseek, ARCH_xxx, generated by configure */
+
+#if defined(__GNUC__) && (defined(ARCH_X86_64) || defined(ARCH_X86))
+#define HAVE_SIMD 1
+#include <immintrin.h> /* for _mm_cmpeq_epi8, _mm256_cmpeq_epi8, etc */
+#endif
+
+#include "common.h"
+#include "sync.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define SYNC_TIME       3 /* SYNC_TIME syncs means TS sync */
+#define ASYNC_BYTE      4096 /* head ASYNC_BYTE bytes async means BIN file */
+#define STRIDE_MAX      204
+#define JUDGE_SIZE      (ASYNC_BYTE + 1 + (SYNC_TIME - 1) * STRIDE_MAX) /* data for judge */
+
+static const int stride[] = {188, 192, 204}; /* try in this order at each offset */
+#define STRIDE_NUM      ((int)(sizeof(stride) / sizeof(stride[0])))
+
+/* scan buf[*from, len), return offset of sync-byte or -1, *from is the next offset to scan */
+typedef int (*scan_fx_t)(const uint8_t *buf, size_t len, size_t *from, int *size);
+
+static scan_fx_t scan_fx = NULL;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT; /* chunk and group threads sync at the same time */
+
+static void scan_init(void);
+
+static int scan_c(const uint8_t *buf, size_t len, size_t *from, int *size);
+#ifdef HAVE_SIMD
+static int scan_sse2(const uint8_t *buf, size_t len, size_t *from, int *size);
+static int scan_avx2(const uint8_t *buf, size_t len, size_t *from, int *size);
+static int pick(uint32_t *mask, size_t off, int *size);
+#endif
+static int judge_buf(const uint8_t *buf, size_t len, int is_eof, int64_t *addr, int *size);
+
+int sync_scan(const uint8_t *buf, size_t len, int *size)
+{
+        size_t from = 0;
+        int off;
+
+        pthread_once(&scan_once, scan_init);
+        off = scan_fx(buf, len, &from, size);
+        if(off < 0 && from < len) {
+                off = scan_c(buf, len, &from, size); /* tail of SIMD kernel */
+        }
+        if(off < 0) {
+                return -1;
+        }
+        return (192 == *size) ? (off - 4) : off; /* MTS head before sync-byte */
+}
+
+/* pick the scan kernel for this CPU */
+static void scan_init(void)
+{
+        scan_fx = scan_c;
+#ifdef HAVE_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+                scan_fx = scan_avx2;
+        }
+        else if(__builtin_cpu_supports("sse2")) {
+                scan_fx = scan_sse2;
+        }
+#endif
+        return;
+}
+
+int sync_goto(FILE *fd, const uint8_t *map, int64_t map_size, int64_t *addr, int type, int *size)
+{
+        int off = ((FILE_MTS == type) ? 4 : 0);
+        uint8_t buf[STRIDE_MAX];
+
+        /* judge_type() needs some packets after *addr, so not for the last ones */
+        if(FILE_TS == type || FILE_MTS == type || FILE_TSRS == type) {
+                if(map) {
+                        if(*addr + *size <= map_size && 0x47 == map[*addr + off]) {
+                                return type;
+                        }
+                }
+                else if(0 == fseek(fd, (long)*addr, SEEK_SET) &&
+                        1 == fread(buf, (size_t)*size, 1, fd) && 0x47 == buf[off]) {
+                        fseek(fd, (long)*addr, SEEK_SET);
+                        return type;
+                }
+        }
+        return (map) ? judge_type_mem(map, map_size, addr, size) : judge_type(fd, addr, size);
+}
+
+/* for TS data: scan a block from *addr for the sync position and packet size */
+int judge_type(FILE *fd, int64_t *addr, int *size)
+{
+        uint8_t buf[JUDGE_SIZE];
+        size_t len;
+        int type;
+
+        RPTINF("judge type from 0x%"PRIX64, *addr);
+        fseek(fd, (long)*addr, SEEK_SET);
+        len = fread(buf, 1, JUDGE_SIZE, fd);
+
+        type = judge_buf(buf, len, (len <= ASYNC_BYTE), addr, size);
+        if(type >= 0) {
+                fseek(fd, (long)*addr, SEEK_SET);
+        }
+        return type;
+}
+
+int judge_type_mem(const uint8_t *map, int64_t map_size, int64_t *addr, int *size)
+{
+        int64_t left = map_size - *addr;
+
+        RPTINF("judge type from 0x%"PRIX64" in memory", *addr);
+        if(left <= 0) {
+                return -1;
+        }
+        if(left > JUDGE_SIZE) {
+                left = JUDGE_SIZE;
+        }
+        return judge_buf(map + *addr, (size_t)left, (left <= ASYNC_BYTE), addr, size);
+}
+
+static int judge_buf(const uint8_t *buf, size_t len, int is_eof, int64_t *addr, int *size)
+{
+        int off;
+        int sz;
+
+        off = sync_scan(buf, len, &sz);
+        if(off < 0 || off > ASYNC_BYTE) {
+                if(is_eof) {
+                        return -1; /* too short to say it is BIN */
+                }
+                RPTINF("unlock over %d-byte, it is BIN", ASYNC_BYTE);
+                return FILE_BIN;
+        }
+
+        if(off != 0) {
+                RPTWRN("pass %d-byte from 0x%"PRIX64" (%"PRId64")", off, *addr, *addr);
+        }
+        *addr += off;
+        *size = sz;
+        RPTINF("it is %s", (188 == sz) ? "TS" : ((192 == sz) ? "MTS" : "TSRS"));
+        return (188 == sz) ? FILE_TS : ((192 == sz) ? FILE_MTS : FILE_TSRS);
+}
+
+static int scan_c(const uint8_t *buf, size_t len, size_t *from, int *size)
+{
+        size_t off;
+        int i;
+        int n;
+        size_t s;
+
+        for(off = *from; off < len; off++) {
+                if(0x47 != buf[off]) {
+                        continue;
+                }
+                for(i = 0; i < STRIDE_NUM; i++) {
+                        s = (size_t)stride[i];
+                        if(192 == s && off < 4) {
+                                continue; /* no room for MTS head */
+                        }
+                        if(off + (SYNC_TIME - 1) * s >= len) {
+                                continue;
+                        }
+                        for(n = 1; n < SYNC_TIME && 0x47 == buf[off + n * s]; n++) {
+                        }
+                        if(SYNC_TIME == n) {
+                                *from = off + 1;
+                                *size = (int)s;
+                                return (int)off;
+                        }
+                }
+        }
+        *from = len;
+        return -1;
+}
+
+#ifdef HAVE_SIMD
+/* mask[i]: bit b set means sync at (off + b) with stride[i], pick the first */
+static int pick(uint32_t *mask, size_t off, int *size)
+{
+        uint32_t all;
+        int b;
+        int i;
+
+        if(off < 4) {
+                mask[1] &= ~((1u << (4 - off)) - 1); /* no room for MTS head */
+        }
+        all = 0;
+        for(i = 0; i < STRIDE_NUM; i++) {
+                all |= mask[i];
+        }
+        if(0 == all) {
+                return -1;
+        }
+        b = __builtin_ctz(all);
+        for(i = 0; i < STRIDE_NUM; i++) {
+                if(mask[i] & (1u << b)) {
+                        *size = stride[i];
+                        break;
+                }
+        }
+        return (int)off + b;
+}
+
+/* check 16 offsets at a time */
+__attribute__((target("sse2")))
+static int scan_sse2(const uint8_t *buf, size_t len, size_t *from, int *size)
+{
+        const __m128i sync = _mm_set1_epi8(0x47);
+        uint32_t mask[STRIDE_NUM];
+        size_t off;
+        int i;
+        int n;
+        int rslt;
+
+        for(off = *from; off + 16 + (SYNC_TIME - 1) * STRIDE_MAX <= len; off += 16) {
+                const uint8_t *p = buf + off;
+                __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), sync);
+
+                if(0 == _mm_movemask_epi8(m0)) {
+                        continue;
+                }
+                for(i = 0; i < STRIDE_NUM; i++) {
+                        __m128i m = m0;
+
+                        for(n = 1; n < SYNC_TIME; n++) {
+                                __m128i d = _mm_loadu_si128((const __m128i *)(p + n * stride[i]));
+
+                                m = _mm_and_si128(m, _mm_cmpeq_epi8(d, sync));
+                        }
+                        mask[i] = (uint32_t)_mm_movemask_epi8(m);
+                }
+                rslt = pick(mask, off, size);
+                if(rslt >= 0) {
+                        *from = (size_t)rslt + 1;
+                        return rslt;
+                }
+        }
+        *from = off;
+        return -1;
+}
+
+/* check 32 offsets at a time */
+__attribute__((target("avx2")))
+static int scan_avx2(const uint8_t *buf, size_t len, size_t *from, int *size)
+{
+        const __m256i sync = _mm256_set1_epi8(0x47);
+        uint32_t mask[STRIDE_NUM];
+        size_t off;
+        int i;
+        int n;
+        int rslt;
+
+        for(off = *from; off + 32 + (SYNC_TIME - 1) * STRIDE_MAX <= len; off += 32) {
+                const uint8_t *p = buf + off;
+                __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), sync);
+
+                if(0 == _mm256_movemask_epi8(m0)) {
+                        continue;
+                }
+                for(i = 0; i < STRIDE_NUM; i++) {
+                        __m256i m = m0;
+
+                        for(n = 1; n < SYNC_TIME; n++) {
+                                __m256i d = _mm256_loadu_si256((const __m256i *)(p + n * stride[i]));
+
+                                m = _mm256_and_si256(m, _mm256_cmpeq_epi8(d, sync));
+                        }
+                        mask[i] = (uint32_t)_mm256_movemask_epi8(m);
+                }
+                rslt = pick(mask, off, size);
+                if(rslt >= 0) {
+                        *from = (size_t)rslt + 1;
+                        return rslt;
+                }
+        }
+        *from = off;
+        return -1;
+}
+#endif
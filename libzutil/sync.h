@@ -0,0 +1,54 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: sync.h
+ * funx: judge packet size and sync position of TS data
+ */
+
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h> /* for FILE */
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uintN_t, etc */
+
+enum FILE_TYPE
+{
+        FILE_MTS, /* 4-byte MTS + 188-byte TS */
+        FILE_TSRS, /* 188-byte TS + 16-byte RS */
+        FILE_TS, /* 188-byte TS */
+        FILE_BIN, /* not TS data */
+        FILE_UNKNOWN
+};
+
+/* judge type from *addr, return FILE_xxx or -1(EOF)
+ * addr: [in] search from here; [out] head of the first packet
+ * size: [out] packet size, untouched for FILE_BIN
+ * the file position is set to *addr when return FILE_xxx
+ */
+int judge_type(FILE *fd, int64_t *addr, int *size);
+
+/* judge type of map[map_size] from *addr, as judge_type() without file I/O */
+int judge_type_mem(const uint8_t *map, int64_t map_size, int64_t *addr, int *size);
+
+/* go to the packet at *addr of TS data judged as type with packet size *size,
+ * the head there is taken as it is, judge_type(_mem)() again only if no 0x47 there
+ * map: map[map_size] of the file, NULL means fd
+ * return FILE_xxx or -1(EOF) as judge_type(), *addr and *size as judge_type() too
+ */
+int sync_goto(FILE *fd, const uint8_t *map, int64_t map_size, int64_t *addr, int type, int *size);
+
+/* search TS sync in buf[len], with SSE2/AVX2 if CPU has
+ * return: offset of the first packet head, or -1 if no sync
+ * size: [out] packet size, 188(TS), 192(MTS) or 204(TSRS)
+ * sync means 3 sync-bytes at the same stride
+ */
+int sync_scan(const uint8_t *buf, size_t len, int *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYNC_H */
@@ -3,9 +3,13 @@
  * funx: UDP access
  */
 
+#ifndef _GNU_SOURCE
+#       define _GNU_SOURCE /* for recvmmsg() */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h> /* for clock_gettime() */
 
 #include "config.h" /* for SYS_* macro, generated by configure */
 
@@ -22,8 +26,16 @@ typedef int socklen_t;
 #       include <unistd.h> /* for close() */
 #       include <fcntl.h> /* for fcntl(), O_NONBLOCK, etc */
 #       include <sys/select.h> /* for select(), etc */
+#       include <sys/uio.h> /* for struct iovec */
 #       include <errno.h>
-#       define __USE_GNU /* for 'struct ip_mreq' in CentOS x64 */
+#       ifndef __USE_GNU
+#               define __USE_GNU /* for 'struct ip_mreq' in CentOS x64 */
+#       endif
+#endif
+
+#if defined(SYS_LINUX) && defined(MSG_WAITFORONE)
+#       define HAVE_RECVMMSG 1 /* receive some datagrams in one syscall */
+#       define HAVE_SENDMMSG 1 /* send some datagrams in one syscall */
 #endif
 
 #include "common.h"
@@ -32,6 +44,9 @@ typedef int socklen_t;
 static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 
 #define UDP_LENGTH_MAX (1536)
+#define UDP_RING_NUM (64) /* datagram number of receive ring, about 0.5ms of 1Gbit/s */
+#define UDP_RCVBUF (8 << 20) /* socket receive buffer, about 64ms of 1Gbit/s */
+#define UDP_SEND_NUM (64) /* max datagram number of one sendmmsg() */
 
 struct udp {
         int sock;
@@ -40,9 +55,24 @@ struct udp {
 
         char addr[32];
         char src_addr[32]; /* for IGMP v3 */
+
+        /* receive ring for udp_recv(), malloced when first use */
+        uint8_t *ring; /* UDP_RING_NUM x UDP_LENGTH_MAX */
+        struct udp_dgram dgram[UDP_RING_NUM];
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr msg[UDP_RING_NUM];
+        struct iovec iov[UDP_RING_NUM];
+        uint8_t ctrl[UDP_RING_NUM][CMSG_SPACE(sizeof(uint32_t)) +
+                                   CMSG_SPACE(sizeof(struct timespec))]; /* for SO_RXQ_OVFL and SO_TIMESTAMPNS */
+#endif
+        uint64_t drop; /* datagram dropped by kernel for full receive buffer */
 };
 
 static int report(const char *str);
+static int wait_send(struct udp *udp);
+static void set_rcvbuf(struct udp *udp);
+static int ring_init(struct udp *udp);
+static int64_t now_ns(void);
 
 intptr_t udp_open(char *src_addr, char *addr, unsigned short port, char *mode)
 {
@@ -53,6 +83,8 @@ intptr_t udp_open(char *src_addr, char *addr, unsigned short port, char *mode)
                 RPTERR("malloc failed");
                 return (intptr_t)NULL;
         }
+        udp->ring = NULL;
+        udp->drop = 0;
 
         strcpy(udp->addr, addr);
 
@@ -96,6 +128,11 @@ intptr_t udp_open(char *src_addr, char *addr, unsigned short port, char *mode)
                            (char *)&reuseaddr, (socklen_t)sizeof(int));
         }
 
+        /* big receive buffer to hold the burst, and count the drop */
+        if('r' == mode[0]) {
+                set_rcvbuf(udp);
+        }
+
         /* name the socket */
         {
                 struct sockaddr_in local;
@@ -197,6 +234,9 @@ int udp_close(intptr_t id)
         close(udp->sock);
 #endif
 
+        if(udp->ring) {
+                free(udp->ring);
+        }
         free(udp);
         return 0;
 }
@@ -228,6 +268,169 @@ ssize_t udp_read(intptr_t id, void *buf)
         return rslt;
 }
 
+int udp_recv(intptr_t id, const struct udp_dgram **dgram, int timeout)
+{
+        struct udp *udp = (struct udp *)id;
+        fd_set fds;
+        struct timeval tv;
+        int64_t now;
+        int cnt;
+        int i;
+
+        if(NULL == udp) {
+                RPTERR("bad id");
+                return -1;
+        }
+        if(NULL == udp->ring && 0 != ring_init(udp)) {
+                return -1;
+        }
+        *dgram = udp->dgram;
+
+        FD_ZERO(&fds);
+        FD_SET(udp->sock, &fds);
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        if(select(udp->sock + 1, &fds, NULL, NULL, ((timeout < 0) ? NULL : &tv)) < 0) {
+                report("select failed");
+                return 0;
+        }
+        if(!FD_ISSET(udp->sock, &fds)) {
+                return 0;
+        }
+
+#ifdef HAVE_RECVMMSG
+        for(i = 0; i < UDP_RING_NUM; i++) {
+                udp->msg[i].msg_hdr.msg_controllen = sizeof(udp->ctrl[i]); /* changed by kernel */
+        }
+        cnt = recvmmsg(udp->sock, udp->msg, UDP_RING_NUM, 0, NULL); /* nonblock socket */
+        if(cnt < 0) {
+                if(EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+                        report("recvmmsg failed");
+                }
+                return 0;
+        }
+        now = now_ns(); /* for the datagram without SO_TIMESTAMPNS */
+        for(i = 0; i < cnt; i++) {
+                struct msghdr *hdr = &(udp->msg[i].msg_hdr);
+                struct cmsghdr *cmsg;
+
+                udp->dgram[i].len = udp->msg[i].msg_len;
+                udp->dgram[i].arrival = now;
+                for(cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+                        if(SOL_SOCKET == cmsg->cmsg_level && SO_RXQ_OVFL == cmsg->cmsg_type) {
+                                uint32_t drop;
+
+                                memcpy(&drop, CMSG_DATA(cmsg), sizeof(drop));
+                                udp->drop = drop; /* count of this socket, from the beginning */
+                        }
+#ifdef SO_TIMESTAMPNS
+                        if(SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMPNS == cmsg->cmsg_type) {
+                                struct timespec ts;
+
+                                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                                udp->dgram[i].arrival = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+                        }
+#endif
+                }
+        }
+#else
+        {
+                ssize_t rslt;
+
+                rslt = recvfrom(udp->sock, (char *)(udp->ring), UDP_LENGTH_MAX, 0,
+                                (struct sockaddr *)&(udp->remote),
+                                &(udp->socklen));
+                cnt = ((rslt > 0) ? 1 : 0);
+                udp->dgram[0].len = ((rslt > 0) ? (size_t)rslt : 0);
+                udp->dgram[0].arrival = now_ns();
+                (void)i;
+                (void)now;
+        }
+#endif
+        return cnt;
+}
+
+int udp_send(intptr_t id, const struct udp_dgram *dgram, int cnt)
+{
+        struct udp *udp = (struct udp *)id;
+        int sent = 0;
+
+        if(NULL == udp) {
+                RPTERR("bad id");
+                return -1;
+        }
+
+#ifdef HAVE_SENDMMSG
+        while(sent < cnt) {
+                struct mmsghdr msg[UDP_SEND_NUM];
+                struct iovec iov[UDP_SEND_NUM];
+                int n = (((cnt - sent) < UDP_SEND_NUM) ? (cnt - sent) : UDP_SEND_NUM);
+                int rslt;
+                int i;
+
+                memset(msg, 0, (size_t)n * sizeof(struct mmsghdr));
+                for(i = 0; i < n; i++) {
+                        iov[i].iov_base = (void *)(dgram[sent + i].buf);
+                        iov[i].iov_len = dgram[sent + i].len;
+                        msg[i].msg_hdr.msg_name = &(udp->remote);
+                        msg[i].msg_hdr.msg_namelen = udp->socklen;
+                        msg[i].msg_hdr.msg_iov = &(iov[i]);
+                        msg[i].msg_hdr.msg_iovlen = 1;
+                }
+                rslt = sendmmsg(udp->sock, msg, (unsigned int)n, 0); /* nonblock socket */
+                if(rslt < 0) {
+                        if((EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) && 0 == wait_send(udp)) {
+                                continue;
+                        }
+                        report("sendmmsg failed");
+                        return ((sent) ? sent : -1);
+                }
+                sent += rslt;
+        }
+#else
+        while(sent < cnt) {
+                ssize_t rslt;
+
+                rslt = sendto(udp->sock, dgram[sent].buf, dgram[sent].len, 0,
+                              (struct sockaddr *)&(udp->remote),
+                              udp->socklen);
+                if(rslt < 0) {
+#ifndef SYS_WINDOWS
+                        if((EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) && 0 == wait_send(udp)) {
+                                continue;
+                        }
+#endif
+                        report("sendto failed");
+                        return ((sent) ? sent : -1);
+                }
+                sent++;
+        }
+#endif
+        return sent;
+}
+
+int udp_fd(intptr_t id)
+{
+        struct udp *udp = (struct udp *)id;
+
+        if(NULL == udp) {
+                RPTERR("bad id");
+                return -1;
+        }
+        return udp->sock;
+}
+
+uint64_t udp_drop(intptr_t id)
+{
+        struct udp *udp = (struct udp *)id;
+
+        if(NULL == udp) {
+                RPTERR("bad id");
+                return 0;
+        }
+        return udp->drop;
+}
+
 ssize_t udp_write(intptr_t id, const void *buf, size_t len)
 {
         struct udp *udp = (struct udp *)id;
@@ -245,6 +448,98 @@ ssize_t udp_write(intptr_t id, const void *buf, size_t len)
         return rslt;
 }
 
+/* try to get UDP_RCVBUF, the max of normal user is net.core.rmem_max */
+static void set_rcvbuf(struct udp *udp)
+{
+        int size = UDP_RCVBUF;
+        int real = 0;
+        socklen_t len = (socklen_t)sizeof(real);
+
+#ifdef SO_RCVBUFFORCE
+        if(0 != setsockopt(udp->sock, SOL_SOCKET, SO_RCVBUFFORCE, (char *)&size, (socklen_t)sizeof(size)))
+#endif
+        {
+                setsockopt(udp->sock, SOL_SOCKET, SO_RCVBUF, (char *)&size, (socklen_t)sizeof(size));
+        }
+        if(0 == getsockopt(udp->sock, SOL_SOCKET, SO_RCVBUF, (char *)&real, &len) && real < size) {
+                RPTINF("SO_RCVBUF: %d-byte, less than %d-byte, see net.core.rmem_max", real, size);
+        }
+
+#ifdef SO_RXQ_OVFL
+        {
+                int on = 1;
+
+                if(0 != setsockopt(udp->sock, SOL_SOCKET, SO_RXQ_OVFL, (char *)&on, (socklen_t)sizeof(on))) {
+                        RPTINF("SO_RXQ_OVFL failed, no drop count");
+                }
+        }
+#endif
+
+#ifdef SO_TIMESTAMPNS
+        {
+                int on = 1;
+
+                if(0 != setsockopt(udp->sock, SOL_SOCKET, SO_TIMESTAMPNS, (char *)&on, (socklen_t)sizeof(on))) {
+                        RPTINF("SO_TIMESTAMPNS failed, use the time of udp_recv()");
+                }
+        }
+#endif
+        return;
+}
+
+static int ring_init(struct udp *udp)
+{
+        int i;
+
+        udp->ring = (uint8_t *)malloc(UDP_RING_NUM * UDP_LENGTH_MAX);
+        if(NULL == udp->ring) {
+                RPTERR("malloc receive ring failed");
+                return -1;
+        }
+        for(i = 0; i < UDP_RING_NUM; i++) {
+                udp->dgram[i].buf = udp->ring + i * UDP_LENGTH_MAX;
+                udp->dgram[i].len = 0;
+                udp->dgram[i].arrival = 0;
+#ifdef HAVE_RECVMMSG
+                udp->iov[i].iov_base = udp->ring + i * UDP_LENGTH_MAX;
+                udp->iov[i].iov_len = UDP_LENGTH_MAX;
+                memset(&(udp->msg[i]), 0, sizeof(struct mmsghdr));
+                udp->msg[i].msg_hdr.msg_iov = &(udp->iov[i]);
+                udp->msg[i].msg_hdr.msg_iovlen = 1;
+                udp->msg[i].msg_hdr.msg_control = udp->ctrl[i];
+                udp->msg[i].msg_hdr.msg_controllen = sizeof(udp->ctrl[i]);
+#endif
+        }
+        return 0;
+}
+
+/* wait until the socket buffer is not full */
+static int wait_send(struct udp *udp)
+{
+        fd_set fds;
+
+        FD_ZERO(&fds);
+        FD_SET(udp->sock, &fds);
+        if(select(udp->sock + 1, NULL, &fds, NULL, NULL) < 0) {
+                return -1;
+        }
+        return 0;
+}
+
+static int64_t now_ns(void)
+{
+#ifdef SYS_WINDOWS
+        return 0; /* unknown */
+#else
+        struct timespec ts;
+
+        if(0 != clock_gettime(CLOCK_REALTIME, &ts)) {
+                return 0;
+        }
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 static int report(const char *str)
 {
         int err;
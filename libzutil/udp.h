@@ -11,12 +11,31 @@ extern "C" {
 #endif
 
 #include <stdint.h> /* for uint?_t, etc */
+#include <sys/types.h> /* for ssize_t */
+
+/* one datagram in the receive ring of udp */
+struct udp_dgram {
+        const uint8_t *buf;
+        size_t len;
+        int64_t arrival; /* receive time(unit: ns), SO_TIMESTAMPNS or udp_recv(), 0 means unknown */
+};
 
 intptr_t udp_open(char *src_addr, char *addr, unsigned short port, char *mode);
 int udp_close(intptr_t id);
 ssize_t udp_read(intptr_t id, void *buf);
 ssize_t udp_write(intptr_t id, const void *buf, size_t len);
 
+/* receive some datagrams with one recvmmsg(), wait at most timeout ms(-1: forever)
+ * for the first one; dgram[i] points to the receive ring, valid until next
+ * udp_recv(), no copy; return datagram number, 0 means none this time, -1 means error */
+int udp_recv(intptr_t id, const struct udp_dgram **dgram, int timeout);
+
+/* send cnt datagrams with sendmmsg(), wait when the socket buffer is full;
+ * return datagram number sent, -1 means error */
+int udp_send(intptr_t id, const struct udp_dgram *dgram, int cnt);
+int udp_fd(intptr_t id); /* socket, for upoll */
+uint64_t udp_drop(intptr_t id); /* datagram dropped by kernel, from SO_RXQ_OVFL */
+
 #ifdef __cplusplus
 }
 #endif
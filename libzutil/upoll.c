@@ -0,0 +1,209 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: upoll.c
+ * funx: wait for datagrams of many UDP sockets in one thread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h" /* for SYS_* macro, generated by configure */
+
+#ifdef SYS_WINDOWS
+#       define WIN32_LEAN_AND_MEAN
+#       include <winsock2.h>
+#else /* unix-like PLATFORM */
+#       include <unistd.h> /* for close() */
+#       include <sys/select.h> /* for select(), etc */
+#       include <errno.h>
+#endif
+
+#ifdef SYS_LINUX
+#       include <sys/epoll.h> /* for epoll_create1(), etc */
+#endif
+
+#include "common.h"
+#include "udp.h"
+#include "upoll.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define UPOLL_MIN (16) /* initial socket number of list */
+
+struct upoll {
+        /* all the sockets, for select() */
+        int *sock;
+        void **arg;
+        int cnt;
+        int size; /* malloced number */
+
+#ifdef SYS_LINUX
+        int epfd;
+        struct epoll_event *evt; /* result of epoll_wait(), size of list */
+#endif
+};
+
+intptr_t upoll_create(void)
+{
+        struct upoll *up;
+
+        up = (struct upoll *)calloc(1, sizeof(struct upoll));
+        if(NULL == up) {
+                RPTERR("malloc failed");
+                return (intptr_t)NULL;
+        }
+
+#ifdef SYS_LINUX
+        up->epfd = epoll_create1(0);
+        if(up->epfd < 0) {
+                RPTERR("epoll_create1 failed, errno: %d", errno);
+                free(up);
+                return (intptr_t)NULL;
+        }
+#endif
+        return (intptr_t)up;
+}
+
+int upoll_destroy(intptr_t id)
+{
+        struct upoll *up = (struct upoll *)id;
+
+        if(NULL == up) {
+                RPTERR("bad id");
+                return -1;
+        }
+
+#ifdef SYS_LINUX
+        close(up->epfd);
+        free(up->evt);
+#endif
+        free(up->sock);
+        free(up->arg);
+        free(up);
+        return 0;
+}
+
+int upoll_add(intptr_t id, intptr_t udp, void *arg)
+{
+        struct upoll *up = (struct upoll *)id;
+        int sock;
+
+        if(NULL == up) {
+                RPTERR("bad id");
+                return -1;
+        }
+        sock = udp_fd(udp);
+        if(sock < 0) {
+                return -1;
+        }
+
+        if(up->cnt == up->size) {
+                int size = ((up->size) ? (up->size * 2) : UPOLL_MIN);
+                int *new_sock;
+                void **new_arg;
+
+                new_sock = (int *)realloc(up->sock, size * sizeof(int));
+                if(NULL == new_sock) {
+                        RPTERR("malloc socket list failed");
+                        return -1;
+                }
+                up->sock = new_sock;
+                new_arg = (void **)realloc(up->arg, size * sizeof(void *));
+                if(NULL == new_arg) {
+                        RPTERR("malloc socket list failed");
+                        return -1;
+                }
+                up->arg = new_arg;
+#ifdef SYS_LINUX
+                {
+                        struct epoll_event *new_evt;
+
+                        new_evt = (struct epoll_event *)realloc(up->evt, size * sizeof(struct epoll_event));
+                        if(NULL == new_evt) {
+                                RPTERR("malloc socket list failed");
+                                return -1;
+                        }
+                        up->evt = new_evt;
+                }
+#endif
+                up->size = size;
+        }
+
+#ifdef SYS_LINUX
+        {
+                struct epoll_event evt;
+
+                memset(&evt, 0, sizeof(evt));
+                evt.events = EPOLLIN; /* level triggered */
+                evt.data.ptr = arg;
+                if(0 != epoll_ctl(up->epfd, EPOLL_CTL_ADD, sock, &evt)) {
+                        RPTERR("epoll_ctl add socket %d failed, errno: %d", sock, errno);
+                        return -1;
+                }
+        }
+#else
+        if(sock >= FD_SETSIZE) {
+                RPTERR("socket %d is out of FD_SETSIZE(%d)", sock, FD_SETSIZE);
+                return -1;
+        }
+#endif
+
+        up->sock[up->cnt] = sock;
+        up->arg[up->cnt] = arg;
+        up->cnt++;
+        return 0;
+}
+
+int upoll_wait(intptr_t id, void **arg, int max, int timeout)
+{
+        struct upoll *up = (struct upoll *)id;
+        int cnt;
+        int i;
+
+        if(NULL == up) {
+                RPTERR("bad id");
+                return -1;
+        }
+        if(0 == up->cnt) {
+                RPTERR("no socket");
+                return -1;
+        }
+
+#ifdef SYS_LINUX
+        cnt = epoll_wait(up->epfd, up->evt, ((max < up->cnt) ? max : up->cnt), timeout);
+        if(cnt < 0) {
+                if(EINTR == errno) {
+                        return 0;
+                }
+                RPTERR("epoll_wait failed, errno: %d", errno);
+                return -1;
+        }
+        for(i = 0; i < cnt; i++) {
+                arg[i] = up->evt[i].data.ptr;
+        }
+#else
+        {
+                fd_set fds;
+                struct timeval tv;
+                int sock_max = 0;
+
+                FD_ZERO(&fds);
+                for(i = 0; i < up->cnt; i++) {
+                        FD_SET(up->sock[i], &fds);
+                        sock_max = ((up->sock[i] > sock_max) ? up->sock[i] : sock_max);
+                }
+                tv.tv_sec = timeout / 1000;
+                tv.tv_usec = (timeout % 1000) * 1000;
+                if(select(sock_max + 1, &fds, NULL, NULL, ((timeout < 0) ? NULL : &tv)) < 0) {
+                        RPTERR("select failed");
+                        return -1;
+                }
+                for(cnt = 0, i = 0; i < up->cnt && cnt < max; i++) {
+                        if(FD_ISSET(up->sock[i], &fds)) {
+                                arg[cnt++] = up->arg[i];
+                        }
+                }
+        }
+#endif
+        return cnt;
+}
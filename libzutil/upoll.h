@@ -0,0 +1,35 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: upoll.h
+ * funx: wait for datagrams of many UDP sockets in one thread
+ */
+
+#ifndef _UPOLL_H
+#define _UPOLL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* for intptr_t, etc */
+
+/* epoll on Linux, select on other system(at most FD_SETSIZE sockets):
+ *
+ * id = upoll_create(); upoll_add(id, udp, arg); ...
+ * while(...) {n = upoll_wait(id, arg, max, timeout); udp_recv() for arg[0, n);}
+ * upoll_destroy(id);
+ *
+ * level triggered: a socket with datagram left is returned again
+ */
+intptr_t upoll_create(void);
+int upoll_destroy(intptr_t id);
+int upoll_add(intptr_t id, intptr_t udp, void *arg); /* arg: returned by upoll_wait() */
+
+/* wait at most timeout ms(-1: forever), arg[] of readable sockets
+ * return socket number, 0 means timeout, -1 means error */
+int upoll_wait(intptr_t id, void **arg, int max, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UPOLL_H */
@@ -8,6 +8,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h> /* for tolower() */
+#include <inttypes.h> /* for PRIu64, etc */
+
+#include "config.h" /* for SYS_* macro, generated by configure */
+
+#ifndef SYS_WINDOWS
+#       include <sys/types.h>
+#       include <sys/stat.h> /* for fstat() */
+#       include <sys/mman.h> /* for mmap(), madvise(), etc */
+#       include <fcntl.h> /* for posix_fadvise() */
+#endif
 
 #include "common.h"
 #include "url.h"
@@ -15,6 +25,7 @@
 static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 
 static int parse_url(struct url *url, const char *str);
+static int next_dgram(struct url *url);
 
 struct url *url_open(const char *str, char *mode)
 {
@@ -32,6 +43,8 @@ struct url *url_open(const char *str, char *mode)
         url->port = 0;
         url->disk = NULL;
         url->path_fname = NULL;
+        url->map = NULL;
+        url->map_size = 0;
 
         if(0 != parse_url(url, str)) {
                 free(url);
@@ -40,8 +53,14 @@ struct url *url_open(const char *str, char *mode)
 
         switch(url->scheme) {
                 case SCH_UDP:
-                        url->pbuf = url->buf;
+                case SCH_RTP:
+                        url->dgram = NULL;
+                        url->dgram_cnt = 0;
+                        url->dgram_idx = 0;
+                        url->pbuf = NULL;
                         url->ts_cnt = 0;
+                        url->drop = 0;
+                        memset(&(url->rtp), 0, sizeof(struct rtp));
                         url->udp = udp_open(url->user, url->host, url->port, mode);
                         if(0 == url->udp) {
                                 printf("Socket error!\n");
@@ -71,9 +90,15 @@ int url_close(struct url *url)
 
         switch(url->scheme) {
                 case SCH_UDP:
+                case SCH_RTP:
                         udp_close(url->udp);
                         break;
                 default: /* SCH_FILE */
+#ifndef SYS_WINDOWS
+                        if(url->map) {
+                                munmap((void *)url->map, (size_t)url->map_size);
+                        }
+#endif
                         fclose(url->fd);
                         break;
         }
@@ -93,6 +118,7 @@ int url_seek(struct url *url, long offset, int origin)
 
         switch(url->scheme) {
                 case SCH_UDP:
+                case SCH_RTP:
                         /* do nothing! */
                         break;
                 default: /* SCH_FILE */
@@ -114,6 +140,7 @@ int url_getc(struct url *url)
 
         switch(url->scheme) {
                 case SCH_UDP:
+                case SCH_RTP:
                         rslt = 0x47; /* to cheat host */
                         break;
                 default: /* SCH_FILE */
@@ -136,27 +163,22 @@ size_t url_read(void *buf, size_t size, size_t nobj, struct url *url)
 
         switch(url->scheme) {
                 case SCH_UDP:
-                        if(url->ts_cnt == 0) {
-                                size_t rslt;
-
-                                rslt = udp_read(url->udp, url->buf);
-                                RPTINF("read %zd-byte", rslt);
-                                if(rslt > 0) {
-                                        url->ts_cnt += rslt;
-                                        url->pbuf = url->buf;
+                case SCH_RTP:
+                        /* the object may cross datagrams */
+                        cobj = nobj;
+                        while(byte_needed > 0) {
+                                size_t len;
+
+                                if(0 == url->ts_cnt && 0 != next_dgram(url)) {
+                                        cobj = 0;
+                                        break;
                                 }
-                        }
-                        if(url->ts_cnt >= byte_needed) {
-                                memcpy(buf, url->pbuf, byte_needed);
-                                url->pbuf += byte_needed;
-                                url->ts_cnt -= byte_needed;
-                                cobj = nobj;
-                        }
-                        else {
-                                memcpy(buf, url->pbuf, url->ts_cnt);
-                                url->pbuf += url->ts_cnt;
-                                url->ts_cnt -= url->ts_cnt;
-                                cobj = url->ts_cnt;
+                                len = ((url->ts_cnt < byte_needed) ? url->ts_cnt : byte_needed);
+                                memcpy(buf, url->pbuf, len);
+                                buf = (uint8_t *)buf + len;
+                                url->pbuf += len;
+                                url->ts_cnt -= len;
+                                byte_needed -= len;
                         }
                         break;
                 default: /* SCH_FILE */
@@ -172,6 +194,119 @@ size_t url_write(const void *buf, size_t size, size_t nobj, struct url *url)
         return udp_write(url->udp, buf, size * nobj);
 }
 
+size_t url_pkts(struct url *url, const uint8_t **pkt, size_t size, size_t max)
+{
+        size_t cnt = 0;
+
+        if(NULL == url || !URL_IS_UDP(url) || 0 == size) {
+                return 0;
+        }
+
+        while(cnt < max) {
+                if(url->ts_cnt < size) {
+                        if(0 != cnt) {
+                                break; /* do not wait for the next datagram */
+                        }
+                        if(0 != next_dgram(url)) {
+                                return 0;
+                        }
+                        continue;
+                }
+                pkt[cnt++] = url->pbuf;
+                url->pbuf += size;
+                url->ts_cnt -= size;
+        }
+        return cnt;
+}
+
+const uint8_t *url_map(struct url *url, int64_t *size)
+{
+#ifdef SYS_WINDOWS
+        (void)url;
+        (void)size;
+        return NULL;
+#else
+        int fd;
+        struct stat st;
+        void *map;
+
+        if(NULL == url || URL_IS_UDP(url)) {
+                return NULL;
+        }
+        if(url->map) {
+                *size = url->map_size;
+                return url->map;
+        }
+
+        fd = fileno(url->fd);
+        if(0 != fstat(fd, &st) || !S_ISREG(st.st_mode) || 0 == st.st_size) {
+                return NULL; /* pipe, device, etc */
+        }
+        if((uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+                return NULL; /* too big for 32-bit system */
+        }
+
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(MAP_FAILED == map) {
+                RPTWRN("mmap \"%s\" failed, use fread instead", url->path_fname);
+                return NULL;
+        }
+
+        /* read ahead as much as possible, the data is used only once */
+        (void)madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        (void)madvise(map, (size_t)st.st_size, MADV_HUGEPAGE); /* ignored by some file system */
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        url->map = (const uint8_t *)map;
+        url->map_size = (int64_t)st.st_size;
+        *size = url->map_size;
+        return url->map;
+#endif
+}
+
+/* next datagram in the ring, receive again when all are used, report new drop;
+ * strip RTP header and count its sequence_number and jitter */
+static int next_dgram(struct url *url)
+{
+        const struct udp_dgram *dgram;
+        uint64_t drop;
+        size_t off;
+        size_t len;
+
+        while(url->dgram_idx >= url->dgram_cnt) {
+                url->dgram_cnt = udp_recv(url->udp, &(url->dgram), -1);
+                url->dgram_idx = 0;
+                if(url->dgram_cnt < 0) {
+                        url->dgram_cnt = 0;
+                        return -1;
+                }
+                RPTDBG("recv %d datagram", url->dgram_cnt);
+
+                drop = udp_drop(url->udp);
+                if(drop != url->drop) {
+                        RPTWRN("%"PRIu64" datagram dropped by kernel, %"PRIu64" in all, receive buffer is full",
+                               drop - url->drop, drop);
+                        url->drop = drop;
+                }
+        }
+
+        dgram = url->dgram + url->dgram_idx++;
+        url->pbuf = dgram->buf;
+        url->ts_cnt = dgram->len;
+
+        off = rtp_payload(dgram->buf, dgram->len, &len, (SCH_RTP == url->scheme));
+        if(0 != off) {
+                (void)rtp_count(&(url->rtp), dgram->buf, dgram->arrival);
+                url->pbuf += off;
+                url->ts_cnt = len;
+        }
+        return 0;
+}
+
 #define RFC1738 "[<scheme>://[[<user>[:<password>]@]<host>[:<port>]]][[/<disk>:]*[/<dir>]/<fname>]"
 static int parse_url(struct url *url, const char *str)
 {
@@ -210,11 +345,12 @@ static int parse_url(struct url *url, const char *str)
         else {
                 RPTDBG("scheme: file");
                 url->scheme = SCH_LFILE;
+                url->path_fname = url->url;
         }
 
-        /* UDP scheme */
-        if(0 == strcmp(url->url, "udp")) {
-                url->scheme = SCH_UDP;
+        /* UDP and RTP scheme */
+        if(0 == strcmp(url->url, "udp") || 0 == strcmp(url->url, "rtp")) {
+                url->scheme = (('u' == url->url[0]) ? SCH_UDP : SCH_RTP);
 
                 if(0 == memcmp(pattern, "*://*:*", 7)) { /* udp://host:port */
                         rslt = strtok(NULL, ":");
@@ -249,7 +385,7 @@ static int parse_url(struct url *url, const char *str)
                         RPTDBG("port: %d", url->port);
                 }
                 else {
-                        fprintf(stderr, "URL syntax error for UDP scheme!\n");
+                        fprintf(stderr, "URL syntax error for UDP/RTP scheme!\n");
                         fprintf(stderr, "    " RFC1738 "\n");
                         return -1;
                 }
@@ -258,7 +394,16 @@ static int parse_url(struct url *url, const char *str)
                 /* file:///.../stream.ts */
                 /* file:///E:/.../stream.ts */
                 url->scheme = SCH_FILE;
-                url->path_fname = url->url;
+                rslt = strtok(NULL, "");
+                if(NULL == rslt || strlen(rslt) < 3) {
+                        fprintf(stderr, "URL syntax error for FILE scheme!\n");
+                        fprintf(stderr, "    " RFC1738 "\n");
+                        return -1;
+                }
+                url->path_fname = rslt + 2; /* add 2 to pass "//" */
+                if(':' == url->path_fname[2]) {
+                        url->path_fname++; /* "/E:/..." -> "E:/..." */
+                }
         }
 
         return 0;
@@ -14,15 +14,19 @@ extern "C" {
 #include <stdint.h> /* for uint?_t, etc */
 
 #include "udp.h"
+#include "rtp.h"
 
 #define MAX_STRING_LENGTH 256
 
 enum scheme {
-        SCH_UDP,  /* udp://... */
+        SCH_UDP,  /* udp://..., RTP header is stripped if MPEG-TS follows it */
+        SCH_RTP,  /* rtp://..., MPEG-TS over RTP over UDP(RFC 2250) */
         SCH_FILE, /* file://... */
         SCH_LFILE /* local file, without "file://" scheme prefix */
 };
 
+#define URL_IS_UDP(url) (SCH_UDP == (url)->scheme || SCH_RTP == (url)->scheme)
+
 struct url {
         char url[MAX_STRING_LENGTH];
 
@@ -39,10 +43,19 @@ struct url {
         FILE *fd;
         intptr_t udp;
 
-        /* data buffer */
-        char buf[8*188]; /* for UDP data */
-        char *pbuf;
-        size_t ts_cnt;
+        /* datagrams in the receive ring of udp, without copy */
+        const struct udp_dgram *dgram;
+        int dgram_cnt;
+        int dgram_idx; /* next datagram */
+        const uint8_t *pbuf; /* data left in this datagram */
+        size_t ts_cnt; /* byte number left in this datagram */
+        uint64_t drop; /* datagram dropped by kernel, reported */
+        struct rtp rtp; /* sequence_number and jitter of RTP datagrams */
+
+        /* memory map of file */
+        /*@null@*/
+        const uint8_t *map; /* NULL means no map */
+        int64_t map_size;
 };
 
 struct url *url_open(const char *str, char *mode);
@@ -52,6 +65,15 @@ int url_getc(struct url *url);
 size_t url_read(void *buf, size_t size, size_t nobj, struct url *url);
 size_t url_write(const void *buf, size_t size, size_t nobj, struct url *url);
 
+/* UDP and RTP only: point pkt[] to at most max objects of size-byte in the received
+ * datagrams, without copy, valid until next url_pkts() or url_read();
+ * the tail of datagram shorter than size is dropped;
+ * return object number, 0 means error or not UDP */
+size_t url_pkts(struct url *url, const uint8_t **pkt, size_t size, size_t max);
+
+/* map the whole file for sequential read, NULL means use url_read() instead */
+const uint8_t *url_map(struct url *url, int64_t *size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,32 @@ int main(int argc, char *argv[])
                 return -1;
         }
 
+        rec_binmode(stdin); /* before the peek, text line parse ignores '\r' */
+        if(rec_is_bin(stdin)) {
+                struct rec rec;
+                int rslt;
+
+                rec.TS = bbuf;
+                rec.RS = bbuf + 188;
+                rec.DATA = bbuf + 188 + 16;
+                while(REC_OK == (rslt = rec_read(stdin, &rec, LINE_LENGTH_MAX / 3 - 188 - 16))) {
+                        if(rec.flag & REC_TS) {
+                                (void)fwrite(rec.TS, 188, 1, fd_o);
+                        }
+                        if(rec.flag & REC_RS) {
+                                (void)fwrite(rec.RS, 16, 1, fd_o);
+                        }
+                        if((rec.flag & REC_DATA) && 0 != rec.len) {
+                                (void)fwrite(rec.DATA, (size_t)rec.len, 1, fd_o);
+                        }
+                }
+                if(REC_ERR == rslt) {
+                        RPTERR("bad binary record");
+                }
+                fclose(fd_o);
+                return 0;
+        }
+
         while(NULL != fgets(tbuf, LINE_LENGTH_MAX, stdin)) {
                 pt = tbuf;
                 while(0 == next_tag(&tag, &pt)) {
@@ -97,6 +123,7 @@ static void show_help()
 {
         fprintf(stdout,
                 "'tobin' read from stdin, translate 'XY ' to 0xXY, send to file.\n"
+                "binary record from \"catts -b\" or \"catip -b\" is detected and written directly.\n"
                 "\n"
                 "Usage: tobin [OPTION] file [OPTION]\n"
                 "\n"
@@ -0,0 +1,569 @@
+/* vim: set tabstop=8 shiftwidth=8:
+ * name: toip.c
+ * funx: send UDP packet with text data in stdin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* for strcmp, etc */
+#include <strings.h> /* for strncasecmp */
+#include <inttypes.h> /* for PRId64, etc */
+#include <time.h> /* for clock_nanosleep(), etc */
+#include <errno.h>
+
+#include "config.h" /* for SYS_* macro, generated by configure */
+
+#ifdef SYS_LINUX
+#       include <sys/prctl.h> /* for PR_SET_TIMERSLACK */
+#endif
+
+#include "tstool_config.h"
+#include "common.h"
+#include "if.h"
+#include "url.h"
+#include "rtp.h" /* for rtp_head() */
+#include "ts.h"
+
+static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
+
+#define DGRAM_PKT (7) /* TS packets in one datagram */
+#define SEND_BATCH (64) /* max datagram number of one udp_send() */
+#define PKT_QUEUE (16384) /* TS packets between two PCR, about 250ms of 100Mbit/s */
+#define CLK_GAP_MAX (1000 * MTS_MS) /* bigger MTS or PCR gap means discontinuity */
+#define STAT_NS (1000000000LL) /* report interval of -jitter */
+
+/* time line: due time of the packet with clock clk(27MHz, MTS or PCR) */
+struct line {
+        int is_sync; /* base and clk are OK */
+        int64_t base; /* CLOCK_MONOTONIC(unit: ns) of tick 0 */
+        int64_t tick; /* 27MHz ticks from base, discontinuity is not counted */
+        int64_t clk; /* the last MTS or PCR */
+        int64_t ovf; /* MTS_OVF or STC_OVF */
+};
+
+/* datagrams to send in one batch, the first one decides the send time */
+struct batch {
+        uint8_t buf[SEND_BATCH][RTP_HEAD_LEN + 188 * DGRAM_PKT];
+        struct udp_dgram dgram[SEND_BATCH];
+        int64_t due[SEND_BATCH]; /* unit: ns */
+        int cnt; /* full datagram number */
+        int pkt; /* packet number in dgram[cnt] */
+};
+
+/* measured result of the send time, for -jitter */
+struct meter {
+        int64_t t0; /* begin of this report interval */
+        int64_t cnt; /* datagram */
+        int64_t byte;
+        int64_t late_sum; /* |send time - due time| */
+        int64_t late_max;
+        int64_t jit_sum; /* |send interval - due interval| of neighbour datagrams */
+        int64_t jit_max;
+        int64_t last_t; /* send time of the last datagram, 0 means none */
+        int64_t last_due;
+};
+
+static struct url *fd_o = NULL;
+static char file_o[FILENAME_MAX] = "";
+static int is_bin = 0; /* stdin is binary record, not text line */
+static int is_jitter = 0; /* report the measured jitter of send time */
+static int64_t slack = 0; /* datagram due in slack(ns) after the first one goes in its batch */
+static int rtp_len = 0; /* RTP_HEAD_LEN for rtp://, 0 for udp:// */
+static uint16_t rtp_seq; /* sequence_number of the next datagram */
+static uint32_t rtp_ssrc;
+
+static struct batch bat;
+static struct meter st_iv; /* this report interval */
+static struct meter st_all; /* from the beginning */
+
+/* PCR mode: the packets after the last PCR, wait for the next PCR */
+static uint8_t queue[PKT_QUEUE][188];
+static int queue_cnt = 0;
+static int pcr_pid = -1; /* pace by the PCR of this PID, the first PID with PCR */
+static int64_t pcr_due = 0; /* due time of the last PCR packet */
+static int64_t pkt_ns = 0; /* packet interval between the last two PCR, unit: ns */
+
+static int deal_with_parameter(int argc, char *argv[]);
+static int get_pkt(uint8_t *ts, int *ts_len, int64_t *mts);
+static void show_help();
+static void show_version();
+
+static int64_t now_ns(void);
+static void sleep_until(int64_t ns);
+static int64_t line_due(struct line *line, int64_t clk);
+static int get_pcr(const uint8_t *ts, int *pid, int64_t *pcr);
+static void pace_pcr(struct line *line, const uint8_t *ts);
+static void pace_pkt(const uint8_t *ts, int64_t due);
+static void dgram_end(void);
+static void flush(int cnt);
+static void meter_add(struct meter *st, int64_t t, int64_t due, size_t len);
+static void meter_show(const char *tag, const struct meter *st, int64_t t);
+
+/* read packets, give each a due time by MTS, or by PCR when no MTS,
+ * then send 7 packets in one datagram at the due time of its first packet
+ */
+int main(int argc, char *argv[])
+{
+        int cnt;
+        int rslt;
+        uint8_t ts[188 + 10];
+        int64_t MTS = 0LL;
+        int is_mts = -1; /* -1: unknown, decided by the first packet */
+        struct line line;
+
+        if(0 != deal_with_parameter(argc, argv)) {
+                return -1;
+        }
+
+        /* before url_open(), which creates file */
+        if(0 != strncasecmp(file_o, "udp://", 6) && 0 != strncasecmp(file_o, "rtp://", 6)) {
+                RPTERR("\"%s\" is not udp:// or rtp://, use tobin for file", file_o);
+                return -1;
+        }
+        fd_o = url_open(file_o, "wb");
+        if(NULL == fd_o) {
+                RPTERR("open \"%s\" failed", file_o);
+                return -1;
+        }
+        if(SCH_RTP == fd_o->scheme) {
+                rtp_len = RTP_HEAD_LEN;
+                srand((unsigned int)now_ns());
+                rtp_seq = (uint16_t)rand(); /* random start, RFC 3550 */
+                rtp_ssrc = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        }
+
+        rec_binmode(stdin); /* before the peek, text line parse ignores '\r' */
+        is_bin = rec_is_bin(stdin);
+
+#ifdef PR_SET_TIMERSLACK
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL); /* wake up at once, 50us by default */
+#endif
+
+        memset(&line, 0, sizeof(line));
+        memset(&bat, 0, sizeof(bat));
+        memset(&st_iv, 0, sizeof(st_iv));
+        memset(&st_all, 0, sizeof(st_all));
+        while(0 <= (rslt = get_pkt(ts, &cnt, &MTS))) {
+                if(188 != cnt) {
+                        continue; /* no TS data */
+                }
+                if(-1 == is_mts) {
+                        is_mts = rslt;
+                        line.ovf = ((is_mts) ? MTS_OVF : STC_OVF);
+                        RPTINF("pace by %s", ((is_mts) ? "MTS" : "PCR"));
+                }
+
+                if(is_mts) {
+                        /* the packet without MTS goes with the last one */
+                        pace_pkt(ts, line_due(&line, ((rslt) ? MTS : line.clk)));
+                }
+                else {
+                        pace_pcr(&line, ts);
+                }
+        }
+
+        /* the rest */
+        if(!is_mts && queue_cnt) {
+                int i;
+
+                for(i = 0; i < queue_cnt; i++) {
+                        pace_pkt(queue[i], pcr_due + pkt_ns * (i + 1));
+                }
+        }
+        if(bat.pkt) {
+                dgram_end();
+        }
+        if(bat.cnt) {
+                flush(bat.cnt);
+        }
+        if(is_jitter && st_all.cnt) {
+                meter_show("*total", &st_all, now_ns());
+        }
+
+        url_close(fd_o);
+        return 0;
+}
+
+static int64_t now_ns(void)
+{
+        struct timespec tp;
+
+        clock_gettime(CLOCK_MONOTONIC, &tp);
+        return (int64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+/* absolute time, not drift with the time of the loop */
+static void sleep_until(int64_t ns)
+{
+        struct timespec tp;
+
+        tp.tv_sec = (time_t)(ns / 1000000000);
+        tp.tv_nsec = (long)(ns % 1000000000);
+        while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tp, NULL)) {
+                /* again */
+        }
+        return;
+}
+
+/* due time of clk on the time line, start from now */
+static int64_t line_due(struct line *line, int64_t clk)
+{
+        int64_t dclk;
+
+        if(!(line->is_sync)) {
+                line->is_sync = 1;
+                line->base = now_ns();
+                line->tick = 0;
+                line->clk = clk;
+                return line->base;
+        }
+
+        dclk = ts_timestamp_diff(clk, line->clk, line->ovf);
+        if(0 <= dclk && dclk < CLK_GAP_MAX) {
+                line->tick += dclk;
+        }
+        else {
+                /* go on from the last due time */
+                RPTWRN("!(0 <= dclk < %dms): %" PRId64 ", discontinuity", (int)(CLK_GAP_MAX / MTS_MS), dclk);
+        }
+        line->clk = clk;
+        return line->base + line->tick * 1000 / 27; /* 27MHz -> ns */
+}
+
+/* return 1 if PCR in ts[] */
+static int get_pcr(const uint8_t *ts, int *pid, int64_t *pcr)
+{
+        int64_t base;
+
+        if(0x47 != ts[0] ||
+           !(ts[3] & 0x20) || /* no adaptation_field */
+           ts[4] < 7 || /* adaptation_field_length */
+           !(ts[5] & 0x10)) { /* PCR_flag */
+                return 0;
+        }
+        *pid = ((ts[1] & 0x1F) << 8) | ts[2];
+        base = ((int64_t)ts[6] << 25) | (ts[7] << 17) | (ts[8] << 9) | (ts[9] << 1) | (ts[10] >> 7);
+        *pcr = base * 300 + (((ts[10] & 0x01) << 8) | ts[11]);
+        return 1;
+}
+
+/* queue the packets until the next PCR, then spread them between the two PCR */
+static void pace_pcr(struct line *line, const uint8_t *ts)
+{
+        int64_t pcr;
+        int64_t due;
+        int pid;
+        int i;
+
+        memcpy(queue[queue_cnt++], ts, 188);
+        if(get_pcr(ts, &pid, &pcr) && (-1 == pcr_pid || pid == pcr_pid)) {
+                due = line_due(line, pcr);
+                if(-1 == pcr_pid) {
+                        /* the first PCR, send the packets before it at once */
+                        pcr_pid = pid;
+                        RPTINF("pace by PCR of PID 0x%04X", (unsigned int)pid);
+                        pcr_due = due;
+                        for(i = 0; i < queue_cnt; i++) {
+                                pace_pkt(queue[i], due);
+                        }
+                        queue_cnt = 0;
+                        return;
+                }
+                if(due > pcr_due) {
+                        pkt_ns = (due - pcr_due) / queue_cnt;
+                }
+                for(i = 0; i < queue_cnt; i++) {
+                        pace_pkt(queue[i], pcr_due + (due - pcr_due) * (i + 1) / queue_cnt);
+                }
+                pcr_due = due;
+                queue_cnt = 0;
+        }
+        else if(PKT_QUEUE == queue_cnt) {
+                /* PCR is lost, go on with the last packet interval */
+                RPTWRN("no PCR in %d packets", PKT_QUEUE);
+                for(i = 0; i < queue_cnt; i++) {
+                        pcr_due += pkt_ns;
+                        pace_pkt(queue[i], pcr_due);
+                }
+                queue_cnt = 0;
+        }
+        return;
+}
+
+/* put packet into datagram, send the batch when the new datagram can not go with it */
+static void pace_pkt(const uint8_t *ts, int64_t due)
+{
+        struct udp_dgram *dgram = bat.dgram + bat.cnt;
+
+        if(0 == bat.pkt) {
+                bat.due[bat.cnt] = due;
+                dgram->buf = bat.buf[bat.cnt];
+        }
+        memcpy(bat.buf[bat.cnt] + rtp_len + bat.pkt * 188, ts, 188);
+        if(DGRAM_PKT != ++(bat.pkt)) {
+                return;
+        }
+        dgram_end();
+
+        /* the late datagrams and the ones in slack go together */
+        if(bat.cnt > 1) {
+                int64_t t = now_ns();
+
+                t = ((bat.due[0] > t) ? bat.due[0] : t);
+                if(bat.due[bat.cnt - 1] > t + slack) {
+                        flush(bat.cnt - 1);
+                }
+        }
+        if(SEND_BATCH == bat.cnt) {
+                flush(bat.cnt);
+        }
+        return;
+}
+
+/* close dgram[cnt] with the packets in it, RTP header with its due time for rtp:// */
+static void dgram_end(void)
+{
+        struct udp_dgram *dgram = bat.dgram + bat.cnt;
+
+        if(rtp_len) {
+                rtp_head(bat.buf[bat.cnt], rtp_seq++, bat.due[bat.cnt], rtp_ssrc);
+        }
+        dgram->len = (size_t)(rtp_len + bat.pkt * 188);
+        bat.pkt = 0;
+        bat.cnt++;
+        return;
+}
+
+/* send the first cnt full datagrams at the due time of dgram[0], keep the rest */
+static void flush(int cnt)
+{
+        int64_t t;
+        int i;
+
+        sleep_until(bat.due[0]);
+        if(cnt != udp_send(fd_o->udp, bat.dgram, cnt)) {
+                RPTERR("send datagram failed");
+        }
+        t = now_ns();
+
+        if(is_jitter) {
+                for(i = 0; i < cnt; i++) {
+                        meter_add(&st_iv, t, bat.due[i], bat.dgram[i].len);
+                        meter_add(&st_all, t, bat.due[i], bat.dgram[i].len);
+                }
+                if(t - st_iv.t0 >= STAT_NS) {
+                        meter_show("*jitter", &st_iv, t);
+                        st_iv.t0 = t;
+                        st_iv.cnt = 0;
+                        st_iv.byte = 0;
+                        st_iv.late_sum = 0;
+                        st_iv.late_max = 0;
+                        st_iv.jit_sum = 0;
+                        st_iv.jit_max = 0;
+                }
+        }
+
+        /* move the rest to the head */
+        for(i = cnt; i < bat.cnt; i++) {
+                memcpy(bat.buf[i - cnt], bat.buf[i], bat.dgram[i].len);
+                bat.dgram[i - cnt].buf = bat.buf[i - cnt];
+                bat.dgram[i - cnt].len = bat.dgram[i].len;
+                bat.due[i - cnt] = bat.due[i];
+        }
+        bat.cnt -= cnt;
+        return;
+}
+
+static void meter_add(struct meter *st, int64_t t, int64_t due, size_t len)
+{
+        int64_t late = t - due;
+        int64_t jit;
+
+        if(0 == st->t0) {
+                st->t0 = t;
+        }
+        late = ((late < 0) ? -late : late);
+        st->late_sum += late;
+        st->late_max = ((late > st->late_max) ? late : st->late_max);
+        if(st->last_t) {
+                jit = (t - st->last_t) - (due - st->last_due);
+                jit = ((jit < 0) ? -jit : jit);
+                st->jit_sum += jit;
+                st->jit_max = ((jit > st->jit_max) ? jit : st->jit_max);
+        }
+        st->last_t = t;
+        st->last_due = due;
+        st->cnt++;
+        st->byte += (int64_t)len;
+        return;
+}
+
+static void meter_show(const char *tag, const struct meter *st, int64_t t)
+{
+        double iv = (double)(t - st->t0) / 1e9;
+
+        fprintf(stdout, "%s, %.3f s, %" PRId64 " datagram, %.3f Mbit/s, "
+                "late %.1f us(max %.1f us), jitter %.1f us(max %.1f us),\n",
+                tag, iv, st->cnt, ((iv > 0) ? (double)(st->byte) * 8 / iv / 1e6 : 0.0),
+                (double)(st->late_sum) / (double)(st->cnt) / 1e3, (double)(st->late_max) / 1e3,
+                (double)(st->jit_sum) / (double)(st->cnt) / 1e3, (double)(st->jit_max) / 1e3);
+        fflush(stdout);
+        return;
+}
+
+/* get one packet from stdin, text line or binary record
+ * return: -1: EOF; 0: packet without MTS; 1: packet with MTS
+ */
+static int get_pkt(uint8_t *ts, int *ts_len, int64_t *mts)
+{
+        char tbuf[LINE_LENGTH_MAX + 10]; /* txt data buffer */
+        char *tag;
+        char *pt;
+        long long int data;
+        int has_mts = 0;
+
+        *ts_len = 0;
+        if(is_bin) {
+                struct rec rec;
+                uint8_t rs[16]; /* ignored */
+
+                rec.TS = ts;
+                rec.RS = rs;
+                rec.DATA = NULL;
+                if(REC_OK != rec_read(stdin, &rec, 0)) {
+                        return -1;
+                }
+                if(rec.flag & REC_TS) {
+                        *ts_len = 188;
+                }
+                if(rec.flag & REC_MTS) {
+                        *mts = rec.MTS;
+                        has_mts = 1;
+                }
+                return has_mts;
+        }
+
+        if(NULL == fgets(tbuf, LINE_LENGTH_MAX, stdin)) {
+                return -1;
+        }
+        pt = tbuf;
+        while(0 == next_tag(&tag, &pt)) {
+                if(0 == strcmp(tag, "*ts")) {
+                        *ts_len = next_nbyte_hex(ts, &pt, 188);
+                }
+                else if(0 == strcmp(tag, "*mts")) {
+                        next_nuint_hex(&data, &pt, 1);
+                        *mts = (int64_t)data;
+                        has_mts = 1;
+                }
+        }
+        return has_mts;
+}
+
+static int deal_with_parameter(int argc, char *argv[])
+{
+        int i;
+
+        if(1 == argc) {
+                /* no parameter */
+                fprintf(stderr, "No URL to process...\n\n");
+                show_help();
+                return -1;
+        }
+
+        for(i = 1; i < argc; i++) {
+                if('-' == argv[i][0]) {
+                        if(0 == strcmp(argv[i], "-h") ||
+                           0 == strcmp(argv[i], "--help")) {
+                                show_help();
+                                return -1;
+                        }
+                        else if(0 == strcmp(argv[i], "-v") ||
+                                0 == strcmp(argv[i], "--version")) {
+                                show_version();
+                                return -1;
+                        }
+                        else if(0 == strcmp(argv[i], "-jitter")) {
+                                is_jitter = 1;
+                        }
+                        else if(0 == strcmp(argv[i], "-batch")) {
+                                int dat;
+
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-batch'!\n");
+                                        return -1;
+                                }
+                                sscanf(argv[i], "%i" , &dat);
+                                if(0 <= dat && dat <= 100000) { /* 0 ~ 100ms */
+                                        slack = (int64_t)dat * 1000;
+                                }
+                                else {
+                                        fprintf(stderr,
+                                                "bad variable for '-batch': %d, use 0us instead!\n",
+                                                dat);
+                                }
+                        }
+                        else {
+                                RPTERR("wrong parameter: %s", argv[i]);
+                                return -1;
+                        }
+                }
+                else {
+                        strcpy(file_o, argv[i]);
+                }
+        }
+
+        return 0;
+}
+
+static void show_help()
+{
+        puts("'toip' read from stdin, convert to UDP, send to IP according to MTS,");
+        puts("or according to PCR when there is no MTS, as constant bitrate between PCR.");
+        puts("stdin can be text line or binary record(\"catts -b\"), judged automatically.");
+        puts("");
+        puts("Usage: toip [OPTION] udp://@xxx.xxx.xxx.xxx:xxxx [OPTION]");
+        puts("       toip [OPTION] rtp://@xxx.xxx.xxx.xxx:xxxx [OPTION]");
+        puts("");
+        puts("rtp:// puts RTP header(RFC 2250) before the packets of each datagram.");
+        puts("");
+        puts("Options:");
+        puts("");
+        puts(" -jitter          report the measured send time each second:");
+        puts("                  \"*jitter, interval, datagram, rate, late(max), jitter(max), \"");
+        puts(" -batch <us>      send the datagrams due in us after the first one with one");
+        puts("                  sendmmsg(), default: 0, only the late ones");
+        puts(" -h, --help       print this information only");
+        puts(" -v, --version    print my version only");
+        puts("");
+        puts("Examples:");
+        puts("  catts *.mts | toip udp://@:1234");
+        puts("  catts -b *.mts | toip udp://@:1234");
+        puts("  catts *.mts | toip udp://@224.165.54.210:1234");
+        puts("  catts *.ts | tsana -ts -mts | toip udp://@:1234");
+        puts("  catts -b xxx.ts | toip -jitter udp://@224.165.54.210:1234");
+        puts("  catts -b xxx.ts | toip rtp://@224.165.54.210:1234");
+        puts("");
+        puts("Report bugs to <zhoucheng@tsinghua.org.cn>.");
+        return;
+}
+
+static void show_version()
+{
+        char str[100];
+
+        sprintf(str, "toip of tstools v%s (%s)", VERSION_STR, REVISION);
+        puts(str);
+        sprintf(str, "Build time: %s %s", __DATE__, __TIME__);
+        puts(str);
+        puts("");
+        puts("Copyright (C) 2009,2010,2011,2012 ZHOU Cheng.");
+        puts("License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>");
+        puts("This is free software; contact author for additional information.");
+        puts("There is NO warranty; not even for MERCHANTABILITY or FITNESS FOR");
+        puts("A PARTICULAR PURPOSE.");
+        puts("");
+        puts("Written by ZHOU Cheng.");
+        return;
+}
@@ -6,19 +6,29 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h> /* for isatty() */
+#include <stddef.h> /* for offsetof() */
+#include <unistd.h> /* for isatty(), write(), etc */
+#include <fcntl.h> /* for open() */
+#include <errno.h> /* for errno */
+#include <sys/stat.h> /* for mkdir() */
 #include <string.h> /* for strcmp(), etc */
 #include <time.h> /* for localtime(), etc */
 #include<sys/time.h> /* for gettimeofday() */
 #include <inttypes.h> /* for uint?_t, PRIX64, etc */
+#include <pthread.h> /* for pthread_create(), etc */
 
 #include "config.h" /* for SYS_* macro, generated by configure */
 
 #include "tstool_config.h"
 #include "common.h"
 #include "if.h"
+#include "url.h"
+#include "sync.h" /* for judge_type(), judge_type_mem() */
+#include "ring.h" /* for ring_reserve(), etc */
+#include "upoll.h" /* for upoll_wait(), etc */
 #include "buddy.h" /* for BUDDY_ORDER_MAX */
 #include "ts.h" /* has "list.h" already */
+#include "tsidx.h" /* for ts_idx_create(), etc */
 #include "UTF_GB.h"
 
 #include "param_xml.h"
@@ -52,7 +62,23 @@ static int rpt_lvl = WRN_LVL; /* report level: ERR, WRN, INF, DBG */
 #define STC_US                          (27) /* 27 clk means 1(us) */
 #define STC_MS                          (27 * 1000) /* uint: do NOT use 1e3  */
 
-#define MP_ORDER_DEFAULT ((size_t)20) /* default memory pool size: (1 << MP_ORDER_DEFAULT) */
+#define MP_ORDER_DEFAULT ((size_t)20) /* default memory arena size: (1 << MP_ORDER_DEFAULT) */
+
+#define RING_SIZE (1 << 22) /* 4MB, event records from parse thread to report thread */
+#define EVT_SIZE_MAX (sizeof(struct evt) + 2 * 0x2000 * sizeof(struct evt_rate) + 4096 + 8)
+#define SHARD_MAX (16) /* max thread number of -shard */
+#define PKT_BLK (64) /* TS packets in one block, from read thread to shard thread */
+#define CHUNK_MAX (16) /* max thread number of -chunk */
+#define CHUNK_PKT_MIN (1024) /* min TS packets in one chunk */
+#define SPOOL_BUF (1 << 20) /* 1MB, stdio buffer of spool file */
+#define GROUP_MAX (256) /* max URL number in one process */
+#define WORKER_MAX (16) /* max thread number of -worker */
+#define WORKER_DEFAULT (4) /* default thread number for more than one URL */
+#define GROUP_WAIT_MS (1000) /* wake up to check exit of all groups */
+#define DEMUX_BUF (1 << 17) /* 128KB, aligned write buffer of each PID for -demux */
+#define DEMUX_ALIGN (4096) /* address and size of each write, except the last one */
+#define PSI_SCAN_MAX (1 << 16) /* max packets from the head to find PAT and PMT for -start */
+#define RTP_JITTER_STC(rtp) ((int64_t)((rtp)->jitter * 300 / 16)) /* x16 of 90kHz -> 27MHz */
 
 struct pid_type_table {
         int   type; /* TS_TYPE_xxx */
@@ -176,8 +202,90 @@ struct aim {
         int err;
 };
 
+/* output file of one PID for -demux, written in DEMUX_BUF blocks */
+struct demux {
+        int fd;
+        uint8_t *buf; /* DEMUX_BUF-byte, DEMUX_ALIGN aligned */
+        size_t len; /* data in buf[] */
+        int64_t total; /* bytes written into file */
+};
+
+/* bitrate of one PID, for show_rate() and show_ratp() */
+struct evt_rate {
+        uint32_t lcnt;
+        uint16_t PID;
+};
+
+/* compact record of one reported packet, from parse thread to report thread
+ * the fields are copied from ts_obj with the same name, because ts_obj goes on
+ */
+struct evt {
+        int64_t cnt; /* count of this packet, for merge of -shard */
+        int has_err;
+        struct timeval tv; /* the arrive time of this packet */
+
+        int64_t ADDR;
+        uint16_t PID;
+        int64_t CTS;
+        int64_t CTS_base;
+        int64_t STC;
+        int64_t STC_base;
+
+        int has_pcr;
+        int64_t PCR;
+        int64_t PCR_base;
+        int16_t PCR_ext;
+        int64_t PCR_repetition;
+        int64_t PCR_continuity;
+        int64_t PCR_jitter;
+
+        int has_pts;
+        int64_t PTS;
+        int64_t PTS_repetition;
+        int64_t PTS_continuity;
+        int64_t PTS_minus_STC;
+        int64_t DTS;
+        int64_t DTS_continuity;
+        int64_t DTS_minus_STC;
+
+        uint8_t TS[188];
+        int AF_off; /* offset in TS[] */
+        int AF_len;
+        int PES_off;
+        int PES_len;
+        int ES_off;
+        int ES_len;
+
+        int has_sect;
+        struct ts_sect sect; /* sect.section point to the data after rate[] */
+        int64_t sect_interval;
+
+        struct ts_err err; /* before clear_error() */
+        int CC_wait;
+        int CC_find;
+        int CC_lost;
+        uint32_t RTP_lost;
+        int64_t RTP_jitter;
+        uint32_t CRC_32;
+        uint32_t CRC_32_calc;
+
+        int has_rate;
+        int64_t last_interval;
+        int64_t last_sys_cnt;
+        int64_t last_psi_cnt;
+        int64_t last_nul_cnt;
+        int rate_cnt; /* rate[0, rate_cnt): for show_rate() */
+        int ratp_cnt; /* rate[rate_cnt, rate_cnt + ratp_cnt): for show_ratp() */
+        struct evt_rate rate[]; /* then section data */
+};
+
 static void *mp; /* id of buddy memory pool, for list malloc and free */
 
+struct shard;
+struct chunk;
+struct group;
+struct worker;
+
 struct tsana_obj {
         int mode;
         int state;
@@ -185,7 +293,9 @@ struct tsana_obj {
 
         int is_impsi; /* import PSI/SI from psi.xml */
         int is_dump; /* output packet directly */
+        int is_bin; /* stdin is binary record, not text line */
         int is_mem; /* show memory info */
+        int is_thread; /* report in another thread */
         uint64_t aim_start; /* ignore some packets fisrt, default: 0(no ignore) */
         uint64_t aim_count; /* stop after analyse some packets, default: 0(no stop) */
         uint16_t aim_pid;
@@ -193,6 +303,8 @@ struct tsana_obj {
         uint16_t aim_prog;
         uint16_t aim_type; /* 0: any type; 1: video; 2: audio */
         int64_t aim_interval; /* for rate calc */
+        int is_rate_only; /* no report but rate, rats and ratp: CTS and count of most PIDs */
+        uint8_t role[0x2000]; /* TS_ROLE_xxx of each PID for is_rate_only, see rate_role() */
         char *color_off;
         char *color_gray;
         char *color_red;
@@ -208,8 +320,197 @@ struct tsana_obj {
         uint64_t cnt; /* packet analysed */
         char tbuf[PKT_TBUF];
         char tbak[PKT_TBUF];
+        struct rec rec; /* for binary record */
+
+        /* direct input, instead of stdin */
+        char *file_i; /* file or URL, NULL means stdin */
+        struct url *url;
+        int type; /* FILE_TS, FILE_MTS or FILE_TSRS */
+        int npline; /* packet size: 188, 192 or 204 */
+        int64_t addr; /* address of next packet */
+        const uint8_t *map; /* memory map of file, NULL means url_read() */
+        int64_t map_size;
+        uint64_t rtp_lost; /* url->rtp.lost, set into ipt */
+
+        /* -demux: PES or ES of each cared PID into its own file */
+        char *demux_dir; /* NULL means no demux */
+        int is_demux_pes; /* PES packet, not ES */
+        struct demux **demux; /* demux[0x2000], NULL means no file for the PID */
+
+        /* random-access index of file, in a sidecar file */
+        int mkidx; /* interval(ms) of index entries, -1 means no -mkidx */
+        char *idx_file; /* index file, NULL means "file.idx" */
+        char *seek_pos; /* -seek position, NULL means from the first packet */
+        int is_seek; /* parse from the address of -seek or -start, not the first packet */
+
+        /* report */
+        struct ring *ring; /* NULL means report in parse thread */
+        pthread_t report; /* report thread */
+        struct evt *evt; /* EVT_SIZE_MAX-byte, for report in parse thread */
+
+        /* -shard: parse in some threads, each reports the packets of its programs */
+        int shard_cnt; /* 0 or 1 means parse in one thread */
+        struct shard *shard; /* shard[shard_cnt], NULL means parse in main thread */
+        int is_merge; /* report thread is merge_thread() */
+        int is_stop; /* shared: some shard thread meets exit */
+        struct dispatch *dispatch; /* for read thread */
+        const struct blk_rate *blk_rate; /* rate of this packet from read thread, NULL: from ts */
+        size_t mp_order; /* memory pool size of each ts_obj */
+
+        /* -chunk: parse parts of file in some threads, stitch the reports in main thread */
+        int chunk_cnt; /* 0 or 1 means parse in one thread */
+        struct chunk *chunk; /* chunk[chunk_cnt], chunk[0] is parsed in main thread */
+        int chunk_idx; /* next chunk to stitch */
+        int chunk_redo; /* chunks parsed again in main thread */
+        int64_t chunk_end; /* stitch next chunk here */
+        int hash_mask; /* TS_HASH_xxx, the state reports depend on */
+        int is_warm; /* parse before the chunk without report */
+        FILE *spool; /* evt records of the chunk, NULL means report now */
+        int64_t addr0; /* address of the first packet in file */
+
+        /* more than one udp:// URL: each group has its own ts_obj, parsed by some workers */
+        int group_cnt; /* URL number, 0 or 1 means one stream */
+        char *group_url[GROUP_MAX];
+        struct group *group; /* group[group_cnt], NULL means one stream */
+        int worker_cnt;
+        struct worker *worker; /* worker[worker_cnt] */
+        intptr_t poll; /* upoll of all groups */
+        int group_live; /* shared: group number without exit */
+        int is_group; /* obj of one group: report with its URL */
 
         struct ts_obj *ts;
+        struct ts_obj *ts_own; /* ts of this obj, ts may be of a stitched chunk */
+};
+
+/* one record in a block, from read thread to shard thread: a TS packet with
+ * what obj->ts of read thread knows about it, or own[] of the shard from now on
+ */
+struct blk_pkt {
+        int64_t cnt; /* count of this packet in the stream */
+        struct timeval tv; /* the arrive time of this packet */
+        int64_t ADDR;
+        int64_t MTS;
+        int64_t CTS; /* after ts_parse_tsh() of obj->ts */
+        int64_t STC;
+        int64_t RTP_jitter;
+        uint32_t RTP_lost;
+        uint32_t size; /* size of this record */
+        int Sync_byte_error; /* err of obj->ts, counted with all the packets */
+        int TS_sync_loss;
+        int RTP_error;
+        int CAT_error; /* ERR_2_6_0 at the end of rate interval */
+        uint8_t has_mts;
+        uint8_t has_rtp;
+        uint8_t has_rate; /* struct blk_rate after TS[] */
+        uint8_t is_own; /* not a packet, own[0x2000] in TS[] */
+        uint8_t TS[];
+};
+#define BLK_PKT_ALL ((offsetof(struct blk_pkt, TS) + 188 + 7) & ~(size_t)7)
+#define BLK_OWN ((offsetof(struct blk_pkt, TS) + 0x2000 + 7) & ~(size_t)7)
+#define BLK_RATE_MAX (sizeof(struct blk_rate) + 2 * 0x2000 * sizeof(struct evt_rate))
+#define BLK_PKT_MAX (BLK_PKT_ALL + BLK_RATE_MAX + BLK_OWN) /* records of one packet */
+#define BLK_SIZE ((PKT_BLK - 1) * BLK_PKT_ALL + BLK_PKT_MAX)
+
+/* rate of all PIDs from obj->ts of read thread, for the shard reports the packet */
+struct blk_rate {
+        int64_t last_interval;
+        int64_t last_sys_cnt;
+        int64_t last_psi_cnt;
+        int64_t last_nul_cnt;
+        int rate_cnt; /* as struct evt */
+        int ratp_cnt;
+        struct evt_rate rate[];
+};
+
+/* read thread of -shard: obj->ts parses PSI, PCR and count of all packets */
+struct dispatch {
+        int has_role; /* role[] and owner[] are from PSI, else all packets to all shards */
+        uint8_t role[0x2000]; /* TS_ROLE_xxx of each PID, for obj->ts */
+        uint8_t owner[0x2000]; /* the shard reports this PID, and PSI is sent to all */
+        uint8_t ver[0x2000]; /* version_number of PAT and PMT met, 0xFF: none */
+};
+
+/* one part of file, parsed in its own thread:
+ * PSI from the head of file, then PCR and packet count only to warm for the
+ * statistic interval if rate is reported, then without report from warm, for
+ * the state of CC, PCR, PTS, etc, then reports from start into spool; its
+ * reports are used only if the state at start is the same as the one of the
+ * chunk before
+ */
+struct chunk {
+        struct tsana_obj obj; /* copy of main obj, with its own ts and spool */
+        struct tsana_obj *top; /* main obj */
+        void *mp; /* memory pool of obj.ts */
+        int64_t warm; /* parse from here without report */
+        int64_t start; /* report from here */
+        int64_t end; /* stop here */
+        int64_t addr; /* the address reached for start */
+        int64_t cnt; /* ts->cnt at start, maybe not right after lost sync */
+        uint64_t hash; /* ts_state_hash() at start */
+        uint8_t role[0x2000]; /* TS_ROLE_xxx of each PID before warm, for rate state */
+        pthread_t thread;
+        int is_run; /* thread is running */
+        int is_bad; /* its reports can not be used */
+        int is_exit; /* meet exit in its reports */
+};
+
+/* the end of evt records for one block of packets, or exit after packet cnt */
+struct mark {
+        int64_t cnt;
+        int is_exit;
+};
+
+/* one multicast group of more than one URL: its own url, ts_obj and state */
+struct group {
+        struct tsana_obj obj; /* copy of main obj, report in worker thread */
+        struct tsana_obj *top; /* main obj */
+        int idx; /* group i belongs to worker (i % worker_cnt) */
+        void *mp; /* memory pool of obj.ts */
+        uint64_t drop; /* datagram dropped by kernel, reported */
+        uint32_t rtp_lost; /* RTP packet lost before datagram without TS packet, for the next one */
+        int is_exit; /* shared: no more packet for it */
+};
+
+/* RTP packet lost before one datagram of grp_blk */
+struct grp_lost {
+        int pkt; /* index of the first TS packet of the datagram */
+        uint32_t rtp_lost;
+};
+
+/* packets of some datagrams of one group, from receive thread to worker thread */
+struct grp_blk {
+        struct timeval tv; /* the arrive time of these packets */
+        int idx; /* group */
+        int cnt; /* packet number */
+        int has_rtp; /* RTP header is stripped */
+        int lost_cnt; /* datagram with RTP packet lost, struct grp_lost after TS[] in pkt order */
+        int64_t rtp_jitter; /* unit: STC */
+        uint8_t TS[]; /* cnt x 188-byte */
+};
+#define GRP_LOST(blk) ((struct grp_lost *)((blk)->TS + (size_t)((blk)->cnt) * 188))
+
+/* one worker thread: parse the packets of its groups */
+struct worker {
+        struct tsana_obj *top; /* main obj */
+        struct ring *in; /* grp_blk from receive thread */
+        pthread_t thread;
+        int is_run; /* thread is running */
+};
+
+/* one shard thread: parse PSI and the packets of its own PIDs, report them */
+struct shard {
+        struct tsana_obj obj; /* copy of main obj, with its own state, ts and ring */
+        struct tsana_obj *top; /* main obj */
+        int idx; /* program i belongs to shard (i % shard_cnt) */
+        void *mp; /* memory pool of obj.ts */
+        struct ring *in; /* blocks of blk_pkt from read thread */
+        pthread_t thread;
+        int is_run; /* thread is running */
+        uint8_t own[0x2000]; /* 1: report the packets of this PID */
+
+        /* read thread */
+        uint8_t *blk; /* the block to fill, in ring */
+        size_t blk_len;
 };
 
 enum {
@@ -235,6 +536,7 @@ enum {
 static struct tsana_obj *obj = NULL;
 
 static void state_parse_psi(struct tsana_obj *obj);
+static void rate_role(struct tsana_obj *obj);
 static int state_parse_each(struct tsana_obj *obj);
 
 static struct tsana_obj *create(int argc, char *argv[]);
@@ -249,6 +551,8 @@ static void show_help();
 static void show_version();
 
 static int get_one_pkt(struct tsana_obj *obj);
+static int get_url_pkt(struct tsana_obj *obj);
+static int open_url(struct tsana_obj *obj);
 static const struct pid_type_table *ts_pid_type(int type);
 static const struct stream_type_table *elem_type(int stream_type);
 
@@ -262,25 +566,74 @@ static int export_psi(struct tsana_obj *obj);
 static int import_psi(struct tsana_obj *obj);
 
 static void show_pkt(struct tsana_obj *obj);
-static void show_time(struct tsana_obj *obj);
-static void show_addr(struct tsana_obj *obj);
-static void show_cts(struct tsana_obj *obj);
-static void show_stc(struct tsana_obj *obj);
-static void show_pcr(struct tsana_obj *obj);
-static void show_pts(struct tsana_obj *obj);
-static void show_tsh(struct tsana_obj *obj);
-static void show_ts(struct tsana_obj *obj);
-static void show_mts(struct tsana_obj *obj);
-static void show_af(struct tsana_obj *obj);
-static void show_pesh(struct tsana_obj *obj);
-static void show_pes(struct tsana_obj *obj);
-static void show_es(struct tsana_obj *obj);
-static void show_sec(struct tsana_obj *obj);
-static void show_si(struct tsana_obj *obj);
-static void show_rate(struct tsana_obj *obj);
-static void show_rats(struct tsana_obj *obj);
-static void show_ratp(struct tsana_obj *obj);
-static int show_error(struct tsana_obj *obj);
+static void show_time(struct tsana_obj *obj, const struct evt *evt);
+static void show_addr(struct tsana_obj *obj, const struct evt *evt);
+static void show_cts(struct tsana_obj *obj, const struct evt *evt);
+static void show_stc(struct tsana_obj *obj, const struct evt *evt);
+static void show_pcr(struct tsana_obj *obj, const struct evt *evt);
+static void show_pts(struct tsana_obj *obj, const struct evt *evt);
+static void show_tsh(struct tsana_obj *obj, const struct evt *evt);
+static void show_ts(struct tsana_obj *obj, const struct evt *evt);
+static void show_mts(struct tsana_obj *obj, const struct evt *evt);
+static void show_af(struct tsana_obj *obj, const struct evt *evt);
+static void show_pesh(struct tsana_obj *obj, const struct evt *evt);
+static void show_pes(struct tsana_obj *obj, const struct evt *evt);
+static void show_es(struct tsana_obj *obj, const struct evt *evt);
+static void show_sec(struct tsana_obj *obj, const struct evt *evt);
+static void show_si(struct tsana_obj *obj, const struct evt *evt);
+static void show_rate(struct tsana_obj *obj, const struct evt *evt);
+static void show_rats(struct tsana_obj *obj, const struct evt *evt);
+static void show_ratp(struct tsana_obj *obj, const struct evt *evt);
+static void show_error(struct tsana_obj *obj, const struct evt *evt);
+static int clear_error(struct tsana_obj *obj);
+
+static int start_report(struct tsana_obj *obj);
+static void stop_report(struct tsana_obj *obj);
+static size_t evt_size(struct tsana_obj *obj);
+static void evt_make(struct tsana_obj *obj, struct evt *evt, int has_err);
+static struct evt_rate *rate_make(struct tsana_obj *obj, struct evt_rate *rate, int *rate_cnt, int *ratp_cnt);
+static void show_evt(struct tsana_obj *obj, const struct evt *evt);
+static void *report_thread(void *arg);
+static int has_error(const struct ts_obj *ts);
+
+static int demux_pkt(struct tsana_obj *obj);
+static void demux_pes(void *arg, const struct ts_pes *pes);
+static int demux_data(struct tsana_obj *obj, uint16_t PID, const uint8_t *buf, size_t len);
+static struct demux *demux_open(struct tsana_obj *obj, uint16_t PID);
+static int demux_write(struct demux *dm);
+static void demux_close(struct tsana_obj *obj);
+
+static int make_idx(struct tsana_obj *obj);
+static int seek_idx(struct tsana_obj *obj);
+static const char *idx_name(struct tsana_obj *obj, char *buf, size_t size);
+static int skip_start(struct tsana_obj *obj);
+static int64_t feed_psi(struct tsana_obj *obj, int64_t to);
+static int goto_pkt(struct tsana_obj *obj, int64_t addr);
+
+static int start_shard(struct tsana_obj *obj);
+static void stop_shard(struct tsana_obj *obj);
+static void read_shard(struct tsana_obj *obj);
+static struct blk_pkt *add_rec(struct shard *sd, size_t size);
+static void send_blk(struct tsana_obj *obj);
+static void put_mark(struct ring *ring, int64_t cnt, int is_exit);
+static void shard_role(struct tsana_obj *obj);
+static void shard_claim(struct dispatch *dp, uint8_t *claim, uint16_t PID, int idx);
+static void *shard_thread(void *arg);
+static void *merge_thread(void *arg);
+
+static int start_chunk(struct tsana_obj *obj);
+static void stop_chunk(struct tsana_obj *obj);
+static int next_chunk(struct tsana_obj *obj);
+static int replay_chunk(struct tsana_obj *obj, struct chunk *ck, int64_t dcnt);
+static void spool_evt(struct tsana_obj *obj, const struct evt *evt);
+static void *chunk_thread(void *arg);
+
+static int run_group(struct tsana_obj *obj);
+static int start_group(struct tsana_obj *obj);
+static void stop_group(struct tsana_obj *obj);
+static void recv_group(struct tsana_obj *obj, struct group *gp);
+static int parse_group(struct group *gp, const uint8_t *pkt, const struct timeval *tv);
+static void *worker_thread(void *arg);
 
 static void table_info_PAT(struct ts_sect *sect, uint8_t *section);
 static void table_info_CAT(struct ts_sect *sect, uint8_t *section);
@@ -313,6 +666,20 @@ int main(int argc, char *argv[])
         if(!obj) {
                 return -1;
         }
+        if(obj->group_cnt > 1) {
+                get_rslt = run_group(obj);
+                destroy(obj);
+                return get_rslt;
+        }
+        if(obj->mkidx >= 0) {
+                get_rslt = make_idx(obj);
+                destroy(obj);
+                return get_rslt;
+        }
+        if(0 != start_report(obj)) {
+                destroy(obj);
+                return -1;
+        }
         ts = obj->ts;
         ts->aim_interval = obj->aim_interval;
 
@@ -320,8 +687,22 @@ int main(int argc, char *argv[])
                 import_psi(obj);
         }
 
-        while(STATE_EXIT != obj->state && GOT_EOF != (get_rslt = get_one_pkt(obj))) {
-                if(GOT_WRONG_PKT == get_rslt) {
+        if(obj->shard) {
+                read_shard(obj);
+                stop_report(obj); /* wait for all reports, before PSI check */
+                if(obj->is_stop) {
+                        goto main_return;
+                }
+                obj->state = STATE_EXIT; /* all packets parsed */
+        }
+
+        while(STATE_EXIT != obj->state) {
+                if(obj->addr >= obj->chunk_end && 0 != next_chunk(obj)) {
+                        goto main_return; /* meet exit in the reports of some chunk */
+                }
+                ts = obj->ts; /* maybe the ts_obj of a stitched chunk */
+                get_rslt = get_one_pkt(obj);
+                if(GOT_EOF == get_rslt || GOT_WRONG_PKT == get_rslt) {
                         break;
                 }
                 if(0 != ts_parse_tsh(obj->ts)) {
@@ -336,6 +717,9 @@ int main(int argc, char *argv[])
                 switch(obj->state) {
                         case STATE_PARSE_PSI:
                                 state_parse_psi(obj);
+                                if(STATE_PARSE_EACH == obj->state && obj->chunk_cnt > 1) {
+                                        start_chunk(obj); /* parse in one thread if failed */
+                                }
                                 break;
                         case STATE_PARSE_EACH:
                                 if(0 != state_parse_each(obj)) {
@@ -390,15 +774,44 @@ static void state_parse_psi(struct tsana_obj *obj)
 
         if(ts->is_pat_pmt_parsed) {
                 obj->state = ((MODE_EXIT != obj->mode) ? STATE_PARSE_EACH : STATE_EXIT);
+                if(obj->is_rate_only) {
+                        rate_role(obj);
+                }
+        }
+        return;
+}
+
+/* -rate only: PCR for CTS, PAT, CAT and PMT as usual, CTS and count of the
+ * others, without AF and STC of each packet
+ */
+static void rate_role(struct tsana_obj *obj)
+{
+        struct ts_obj *ts = obj->ts;
+        struct znode *znode;
+
+        memset(obj->role, TS_ROLE_RATE, sizeof(obj->role));
+        for(znode = (struct znode *)(ts->prog0); znode; znode = znode->next) {
+                struct ts_prog *prog = (struct ts_prog *)znode;
+
+                if(0x1FFF != prog->PCR_PID) {
+                        obj->role[prog->PCR_PID] = TS_ROLE_PCR;
+                }
+        }
+        for(znode = (struct znode *)(ts->prog0); znode; znode = znode->next) {
+                obj->role[((struct ts_prog *)znode)->PMT_PID] = TS_ROLE_ALL;
         }
+        obj->role[0x0000] = TS_ROLE_ALL; /* PAT */
+        obj->role[0x0001] = TS_ROLE_ALL; /* CAT */
+        ts_ioctl(ts, TS_SROLE, obj->role);
         return;
 }
 
 static int state_parse_each(struct tsana_obj *obj)
 {
-        int i;
         int has_err;
         int has_report;
+        int rslt;
+        struct evt *evt;
         struct ts_obj *ts = obj->ts;
         struct ts_pid *pid = ts->pid;
         struct ts_sect *sect = ts->sect;
@@ -412,7 +825,8 @@ static int state_parse_each(struct tsana_obj *obj)
            obj->aim.pesh        ||
            obj->aim.pes         ||
            obj->aim.es          ||
-           obj->aim.err) {
+           obj->aim.err         ||
+           obj->demux_dir) {
                 /* filter: PID */
                 if(ANY_PID != obj->aim_pid &&
                    ts->PID != obj->aim_pid) {
@@ -449,14 +863,14 @@ static int state_parse_each(struct tsana_obj *obj)
                 }
         }
 
-        /* error for this TS packet? */
-        has_err = 0;
-        for(i = 0; i < sizeof(struct ts_err); i++) {
-                if(*((uint8_t *)&(ts->err) + i)) {
-                        has_err = 1;
-                }
+        /* -demux: ES data into the file of its PID, no text; whole PES by demux_pes() */
+        if(obj->demux_dir && !(obj->is_demux_pes) && !(obj->is_warm) && 0 != demux_pkt(obj)) {
+                return -1;
         }
 
+        /* error for this TS packet? only -err reports it */
+        has_err = ((obj->aim.err) ? has_error(ts) : 0);
+
         /* report for this TS packet? */
         has_report = 0;
         if(obj->aim.pts && ts->has_pts) {
@@ -499,73 +913,1852 @@ static int state_parse_each(struct tsana_obj *obj)
                 has_report = 1;
         }
 
-        /* report */
-        if(obj->aim.time && has_report) {
-                show_time(obj);
+        if(!has_report) {
+                return 0;
         }
-        if(obj->aim.addr && has_report) {
-                show_addr(obj);
+        if(obj->is_warm) {
+                /* no report before the chunk, keep err the same as one thread */
+                return ((obj->aim.err && has_err) ? clear_error(obj) : 0);
         }
-        if(obj->aim.cts && has_report) {
-                show_cts(obj);
+
+        /* report: copy what show_xxx() need, then format in report thread */
+        if(obj->ring) {
+                evt = (struct evt *)ring_reserve(obj->ring, evt_size(obj));
+                if(NULL == evt) {
+                        return -1;
+                }
         }
-        if(obj->aim.stc && has_report) {
-                show_stc(obj);
+        else {
+                evt = obj->evt;
         }
-        if(obj->aim.pts && has_report) {
-                show_pts(obj);
+        evt_make(obj, evt, has_err);
+        rslt = ((obj->aim.err && has_err) ? clear_error(obj) : 0);
+        if(obj->ring) {
+                ring_commit(obj->ring);
         }
-        if(obj->aim.pcr && has_report) {
-                show_pcr(obj);
+        else if(obj->spool) {
+                spool_evt(obj, evt);
         }
-        if(obj->aim.tsh && has_report) {
-                show_tsh(obj);
+        else {
+                show_evt(obj, evt);
         }
-        if(obj->aim.ts && has_report) {
-                show_ts(obj);
+        return rslt;
+}
+
+/* ES fragment of this packet into the buffer of its PID */
+static int demux_pkt(struct tsana_obj *obj)
+{
+        struct ts_obj *ts = obj->ts;
+
+        if(0 == ts->ES_len) {
+                return 0;
         }
-        if(obj->aim.mts && has_report) {
-                show_mts(obj);
+
+        /* filter: type: video or audio */
+        if(TYPE_VIDEO == obj->aim_type && !IS_TYPE(TS_TYPE_VID, ts->pid->type)) {
+                return 0;
         }
-        if(obj->aim.af && ts->AF_len) {
-                show_af(obj);
+        if(TYPE_AUDIO == obj->aim_type && !IS_TYPE(TS_TYPE_AUD, ts->pid->type)) {
+                return 0;
         }
-        if(obj->aim.pesh && (ts->PES_len != ts->ES_len)) {
-                show_pesh(obj);
+        return demux_data(obj, ts->PID, ts->ES, (size_t)(ts->ES_len));
+}
+
+/* callback of ts_pes_callback(): whole PES packet into the buffer of its PID,
+ * called in ts_parse_tsb() of a packet of this PID, so ts->pid is its PID */
+static void demux_pes(void *arg, const struct ts_pes *pes)
+{
+        struct tsana_obj *obj = (struct tsana_obj *)arg;
+        struct ts_pid *pid = obj->ts->pid;
+
+        if(obj->is_warm || STATE_EXIT == obj->state) {
+                return;
         }
-        if(obj->aim.pes && ts->PES_len) {
-                show_pes(obj);
+
+        /* filter: PID, program_number, type: video or audio, as state_parse_each() */
+        if(ANY_PID != obj->aim_pid && pes->PID != obj->aim_pid) {
+                return;
+        }
+        if(ANY_PROG != obj->aim_prog &&
+           (!(pid->prog) || (pid->prog->program_number != obj->aim_prog))) {
+                return;
+        }
+        if(TYPE_VIDEO == obj->aim_type && !IS_TYPE(TS_TYPE_VID, pid->type)) {
+                return;
+        }
+        if(TYPE_AUDIO == obj->aim_type && !IS_TYPE(TS_TYPE_AUD, pid->type)) {
+                return;
+        }
+
+        if(0 != demux_data(obj, pes->PID, pes->buf, (size_t)(pes->len))) {
+                obj->state = STATE_EXIT; /* stop after this packet */
+        }
+        return;
+}
+
+static int demux_data(struct tsana_obj *obj, uint16_t PID, const uint8_t *buf, size_t len)
+{
+        struct demux *dm;
+
+        dm = obj->demux[PID];
+        if(NULL == dm) {
+                dm = demux_open(obj, PID);
+                if(NULL == dm) {
+                        return -1;
+                }
+                obj->demux[PID] = dm;
+        }
+
+        while(len > 0) {
+                size_t n = DEMUX_BUF - dm->len;
+
+                n = ((len < n) ? len : n);
+                memcpy(dm->buf + dm->len, buf, n);
+                dm->len += n;
+                buf += n;
+                len -= n;
+                if(DEMUX_BUF == dm->len && 0 != demux_write(dm)) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static struct demux *demux_open(struct tsana_obj *obj, uint16_t PID)
+{
+        struct demux *dm;
+        char name[1024];
+
+        snprintf(name, sizeof(name), "%s/0x%04X.%s", obj->demux_dir, (unsigned int)PID,
+                 (obj->is_demux_pes) ? "pes" : "es");
+        dm = (struct demux *)malloc(sizeof(struct demux));
+        if(NULL == dm) {
+                RPTERR("malloc demux failed");
+                return NULL;
+        }
+        if(0 != posix_memalign((void **)&(dm->buf), DEMUX_ALIGN, DEMUX_BUF)) {
+                RPTERR("malloc demux buffer failed");
+                free(dm);
+                return NULL;
+        }
+        dm->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(dm->fd < 0) {
+                fprintf(stderr, "can not open file \"%s\"!\n", name);
+                free(dm->buf);
+                free(dm);
+                return NULL;
+        }
+        dm->len = 0;
+        dm->total = 0;
+        RPTINF("demux 0x%04X into %s", (unsigned int)PID, name);
+        return dm;
+}
+
+/* all data in buf[], the size is DEMUX_BUF except the last one */
+static int demux_write(struct demux *dm)
+{
+        const uint8_t *p = dm->buf;
+        size_t left = dm->len;
+
+        while(left > 0) {
+                ssize_t n = write(dm->fd, p, left);
+
+                if(n < 0) {
+                        if(EINTR == errno) {
+                                continue;
+                        }
+                        RPTERR("write demux file failed");
+                        return -1;
+                }
+                p += n;
+                left -= (size_t)n;
+        }
+        dm->total += (int64_t)(dm->len);
+        dm->len = 0;
+        return 0;
+}
+
+static void demux_close(struct tsana_obj *obj)
+{
+        int i;
+
+        if(NULL == obj->demux) {
+                return;
+        }
+        for(i = 0; i < 0x2000; i++) {
+                struct demux *dm = obj->demux[i];
+
+                if(NULL == dm) {
+                        continue;
+                }
+                demux_write(dm);
+                close(dm->fd);
+                RPTINF("demux 0x%04X: %" PRId64 " bytes", (unsigned int)i, dm->total);
+                free(dm->buf);
+                free(dm);
+        }
+        free(obj->demux);
+        obj->demux = NULL;
+        return;
+}
+
+static const char *idx_name(struct tsana_obj *obj, char *buf, size_t size)
+{
+        if(obj->idx_file) {
+                return obj->idx_file;
+        }
+        snprintf(buf, size, "%s.idx", obj->file_i);
+        return buf;
+}
+
+/* -mkidx: index the whole file into the sidecar file, no report */
+static int make_idx(struct tsana_obj *obj)
+{
+        struct ts_idx *idx;
+        char name[FILENAME_MAX];
+        int rslt = 0;
+
+        idx = ts_idx_create(obj->npline, obj->mkidx);
+        if(NULL == idx) {
+                return -1;
+        }
+
+        if(obj->map) {
+                int64_t n = (obj->map_size - obj->addr) / obj->npline;
+
+                rslt = ts_idx_add(idx, obj->map + obj->addr, (size_t)n, obj->addr);
+        }
+        else {
+                uint8_t *buf = (uint8_t *)malloc(256 * obj->npline);
+                size_t n;
+
+                if(NULL == buf) {
+                        RPTERR("malloc index buffer failed");
+                        ts_idx_destroy(idx);
+                        return -1;
+                }
+                while(0 == rslt && 0 < (n = url_read(buf, obj->npline, 256, obj->url))) {
+                        rslt = ts_idx_add(idx, buf, n, obj->addr);
+                        obj->addr += (int64_t)n * obj->npline;
+                }
+                free(buf);
+        }
+
+        if(0 == rslt) {
+                rslt = ts_idx_save(idx, idx_name(obj, name, sizeof(name)));
+        }
+        if(0 == rslt) {
+                fprintf(stdout, "%s: %" PRId64 " packets, %" PRId64 " entries, %" PRId64 " PAT/PMT versions\n",
+                        idx_name(obj, name, sizeof(name)), idx->pkt_cnt, idx->ent_cnt, idx->ver_cnt);
+        }
+        ts_idx_destroy(idx);
+        return rslt;
+}
+
+/* -seek: PAT and PMT in force by index, then move obj->addr to the position and sync again */
+static int seek_idx(struct tsana_obj *obj)
+{
+        struct ts_obj *ts = obj->ts;
+        struct ts_idx *idx;
+        char name[FILENAME_MAX];
+        int64_t addr;
+        int64_t from;
+        int64_t to;
+
+        if(URL_IS_UDP(obj->url)) {
+                RPTERR("-seek is only for file");
+                return -1;
+        }
+        idx = ts_idx_open(idx_name(obj, name, sizeof(name)), obj->npline, obj->seek_pos, &addr);
+        if(NULL == idx) {
+                return -1;
+        }
+
+        /* from the last PAT or PMT change before addr, any PAT and PMT met is in force at addr */
+        if(0 == ts_idx_psi(idx, addr, &from, &to)) {
+                if(0 == goto_pkt(obj, from)) {
+                        feed_psi(obj, to);
+                }
+        }
+        ts_idx_destroy(idx);
+        if(ts->is_pat_pmt_parsed) {
+                state_parse_psi(obj);
+        }
+        else {
+                RPTWRN("no PAT or PMT in force at 0x%" PRIX64 ", parse them after it", addr);
+        }
+        ts_ioctl(ts, TS_SEEK, 0); /* the next packet does not follow the PSI above */
+
+        if(0 != goto_pkt(obj, addr)) {
+                RPTERR("no TS packet at 0x%" PRIX64 " of \"%s\", index is out of date?", addr, obj->file_i);
+                return -1;
+        }
+        RPTINF("seek \"%s\": 0x%" PRIX64, obj->seek_pos, obj->addr);
+        obj->addr0 = obj->addr;
+        obj->is_seek = 1;
+        return 0;
+}
+
+/* -start of file: PAT and PMT from the head, then seek to packet aim_start directly */
+static int skip_start(struct tsana_obj *obj)
+{
+        struct ts_obj *ts = obj->ts;
+        int64_t addr = obj->addr + (int64_t)(obj->aim_start) * obj->npline;
+        int64_t cnt;
+
+        if(obj->map && addr >= obj->map_size) {
+                RPTERR("packet %" PRIu64 " is beyond the end of \"%s\"", obj->aim_start, obj->file_i);
+                return -1;
+        }
+
+        /* other PIDs are parsed from aim_start as usual */
+        cnt = feed_psi(obj, addr);
+        if(ts->is_pat_pmt_parsed) {
+                state_parse_psi(obj);
+        }
+        else {
+                RPTWRN("no PAT or PMT in %" PRId64 " packets before packet %" PRIu64 ", parse them after it",
+                       cnt, obj->aim_start);
+        }
+        ts_ioctl(ts, TS_SEEK, 0); /* the next packet does not follow the PSI above */
+
+        if(0 != goto_pkt(obj, addr)) {
+                RPTERR("no TS packet after packet %" PRIu64 " of \"%s\"", obj->aim_start, obj->file_i);
+                return -1;
+        }
+        RPTINF("start from packet %" PRIu64 ": 0x%" PRIX64, obj->aim_start, obj->addr);
+        obj->addr0 = obj->addr;
+        obj->aim_start = 0; /* skipped already */
+        obj->is_seek = 1;
+        return 0;
+}
+
+/* feed PAT and PMT only from obj->addr to address to(< 0: the end), till they are parsed */
+static int64_t feed_psi(struct tsana_obj *obj, int64_t to)
+{
+        struct ts_obj *ts = obj->ts;
+        int64_t cnt;
+
+        for(cnt = 0; cnt < PSI_SCAN_MAX && (to < 0 || obj->addr < to) && !(ts->is_pat_pmt_parsed); cnt++) {
+                const uint8_t *p;
+                struct ts_pid *pid;
+                uint16_t PID;
+
+                if(GOT_RIGHT_PKT != get_url_pkt(obj)) {
+                        break;
+                }
+                p = ((ts->ipt.pTS) ? ts->ipt.pTS : ts->ipt.TS);
+                PID = (uint16_t)(((p[1] & 0x1F) << 8) | p[2]);
+                pid = ts->pid_tab[PID];
+                if(0x0000 == PID || (pid && IS_TYPE(TS_TYPE_PMT, pid->type))) {
+                        ts_parse_tsh(ts);
+                        ts_parse_tsb(ts);
+                }
+        }
+        return cnt;
+}
+
+/* move obj->addr to the packet at addr, sync again only if it is not there */
+static int goto_pkt(struct tsana_obj *obj, int64_t addr)
+{
+        obj->addr = addr;
+        obj->type = sync_goto(obj->url->fd, obj->map, obj->map_size, &(obj->addr), obj->type, &(obj->npline));
+        if(FILE_TS != obj->type && FILE_MTS != obj->type && FILE_TSRS != obj->type) {
+                return -1;
+        }
+        return 0;
+}
+
+/* per-packet report(MODE_ALL) is formatted in report thread, if possible */
+static int start_report(struct tsana_obj *obj)
+{
+        if(MODE_ALL == obj->mode && obj->is_thread && !(obj->is_dump) &&
+           obj->shard_cnt > 1 && !(obj->is_impsi) && !(obj->demux_dir)) {
+                if(obj->aim.err &&
+                   (ANY_PID != obj->aim_pid || ANY_TABLE != obj->aim_table || ANY_PROG != obj->aim_prog)) {
+                        /* error of other PID is kept for the cared PID, in one ts_obj */
+                        RPTWRN("-err with filter can not be parsed by shard, use one thread");
+                }
+                else if(0 == start_shard(obj)) {
+                        return 0;
+                }
+                else {
+                        RPTWRN("start shard threads failed, parse in one thread");
+                }
+        }
+
+        if(MODE_ALL == obj->mode && obj->is_thread && !(obj->is_dump)) {
+                obj->ring = ring_create(RING_SIZE);
+                if(obj->ring && 0 == pthread_create(&(obj->report), NULL, report_thread, obj)) {
+                        return 0;
+                }
+                RPTWRN("start report thread failed, report in parse thread");
+                ring_destroy(obj->ring);
+                obj->ring = NULL;
+        }
+
+        obj->evt = (struct evt *)malloc(EVT_SIZE_MAX);
+        if(NULL == obj->evt) {
+                RPTERR("malloc evt failed");
+                return -1;
+        }
+        return 0;
+}
+
+/* wait for report thread to format all the evt records */
+static void stop_report(struct tsana_obj *obj)
+{
+        if(obj->shard) {
+                stop_shard(obj);
+        }
+        if(obj->chunk) {
+                stop_chunk(obj);
+        }
+        if(obj->ring) {
+                ring_close(obj->ring);
+                pthread_join(obj->report, NULL);
+                if(obj->is_mem) {
+                        fprintf(stderr, "ring: parse thread waited %ld times for report thread\n",
+                                ring_full_cnt(obj->ring));
+                }
+                ring_destroy(obj->ring);
+                obj->ring = NULL;
+        }
+        free(obj->evt);
+        obj->evt = NULL;
+        return;
+}
+
+/* size of the evt record for this packet, maybe a little bigger */
+static size_t evt_size(struct tsana_obj *obj)
+{
+        struct ts_obj *ts = obj->ts;
+        size_t size = sizeof(struct evt);
+
+        if(obj->blk_rate) {
+                size += (size_t)(obj->blk_rate->rate_cnt + obj->blk_rate->ratp_cnt) * sizeof(struct evt_rate);
+        }
+        else if(ts->has_rate && (obj->aim.rate || obj->aim.ratp)) {
+                struct znode *znode;
+
+                for(znode = (struct znode *)(ts->pid0); znode; znode = znode->next) {
+                        size += 2 * sizeof(struct evt_rate);
+                }
+        }
+        if(ts->sect && (obj->aim.sec || obj->aim.si)) {
+                size += ts->sect->section_length + 3;
+        }
+        return size;
+}
+
+static void evt_make(struct tsana_obj *obj, struct evt *evt, int has_err)
+{
+        struct ts_obj *ts = obj->ts;
+        struct evt_rate *rate = evt->rate;
+
+        evt->cnt = ts->cnt;
+        evt->has_err = has_err;
+        evt->tv = obj->tv;
+
+        evt->ADDR = ts->ADDR;
+        evt->PID = ts->PID;
+        evt->CTS = ts->CTS;
+        evt->CTS_base = ts->CTS_base;
+        evt->STC = ts->STC;
+        evt->STC_base = ts->STC_base;
+
+        evt->has_pcr = ts->has_pcr;
+        evt->PCR = ts->PCR;
+        evt->PCR_base = ts->PCR_base;
+        evt->PCR_ext = ts->PCR_ext;
+        evt->PCR_repetition = ts->PCR_repetition;
+        evt->PCR_continuity = ts->PCR_continuity;
+        evt->PCR_jitter = ts->PCR_jitter;
+
+        evt->has_pts = ts->has_pts;
+        evt->PTS = ts->PTS;
+        evt->PTS_repetition = ts->PTS_repetition;
+        evt->PTS_continuity = ts->PTS_continuity;
+        evt->PTS_minus_STC = ts->PTS_minus_STC;
+        evt->DTS = ts->DTS;
+        evt->DTS_continuity = ts->DTS_continuity;
+        evt->DTS_minus_STC = ts->DTS_minus_STC;
+
+        /* AF, PES and ES point into this packet */
+        memcpy(evt->TS, ts->TS, 188);
+        evt->AF_len = ts->AF_len;
+        evt->AF_off = (ts->AF_len ? (int)(ts->AF - ts->TS) : 0);
+        evt->PES_len = ts->PES_len;
+        evt->PES_off = (ts->PES_len ? (int)(ts->PES - ts->TS) : 0);
+        evt->ES_len = ts->ES_len;
+        evt->ES_off = (ts->ES_len ? (int)(ts->ES - ts->TS) : 0);
+
+        memcpy(&(evt->err), &(ts->err), sizeof(struct ts_err));
+        evt->CC_wait = ts->CC_wait;
+        evt->CC_find = ts->CC_find;
+        evt->CC_lost = ts->CC_lost;
+        evt->RTP_lost = ts->RTP_lost;
+        evt->RTP_jitter = ts->RTP_jitter;
+        evt->CRC_32 = ts->CRC_32;
+        evt->CRC_32_calc = ts->CRC_32_calc;
+
+        /* rate: filter here, pid list goes on */
+        evt->has_rate = ts->has_rate;
+        evt->last_interval = ts->last_interval;
+        evt->last_sys_cnt = ts->last_sys_cnt;
+        evt->last_psi_cnt = ts->last_psi_cnt;
+        evt->last_nul_cnt = ts->last_nul_cnt;
+        if(obj->blk_rate) {
+                /* -shard: from read thread */
+                evt->rate_cnt = obj->blk_rate->rate_cnt;
+                evt->ratp_cnt = obj->blk_rate->ratp_cnt;
+                memcpy(rate, obj->blk_rate->rate, (size_t)(evt->rate_cnt + evt->ratp_cnt) * sizeof(struct evt_rate));
+                rate += evt->rate_cnt + evt->ratp_cnt;
+        }
+        else {
+                rate = rate_make(obj, rate, &(evt->rate_cnt), &(evt->ratp_cnt));
+        }
+
+        /* section: copy after rate[] */
+        evt->has_sect = (NULL != ts->sect);
+        evt->sect_interval = ts->sect_interval;
+        if(ts->sect && (obj->aim.sec || obj->aim.si)) {
+                memcpy(&(evt->sect), ts->sect, sizeof(struct ts_sect));
+                evt->sect.section = (uint8_t *)rate;
+                memcpy(evt->sect.section, ts->sect->section, ts->sect->section_length + 3);
+        }
+        return;
+}
+
+/* rate[] of the PIDs for show_rate() and show_ratp(), return the end of rate[] */
+static struct evt_rate *rate_make(struct tsana_obj *obj, struct evt_rate *rate, int *rate_cnt, int *ratp_cnt)
+{
+        struct ts_obj *ts = obj->ts;
+        struct znode *znode;
+
+        *rate_cnt = 0;
+        *ratp_cnt = 0;
+        if(ts->has_rate && obj->aim.rate) {
+                for(znode = (struct znode *)(ts->pid0); znode; znode = znode->next) {
+                        struct ts_pid *pid = (struct ts_pid *)znode;
+
+                        /* filter: user PID only */
+                        if(pid->PID < 0x0020 || 0x1FFF == pid->PID) {
+                                /* not program */
+                                continue;
+                        }
+
+                        /* filter: PID */
+                        if(ANY_PID != obj->aim_pid && pid->PID != obj->aim_pid) {
+                                /* not cared PID */
+                                continue;
+                        }
+
+                        /* filter: program_number */
+                        if(ANY_PROG != obj->aim_prog) {
+                                if(!(pid->prog)) {
+                                        /* not program */
+                                        continue;
+                                }
+                                else if(pid->prog->program_number != obj->aim_prog) {
+                                        /* not cared program */
+                                        continue;
+                                }
+                        }
+
+                        /* filter: type: video or audio */
+                        if(TYPE_ANY != obj->aim_type) {
+                                if(TYPE_VIDEO == obj->aim_type && !IS_TYPE(TS_TYPE_VID, pid->type)) {
+                                        /* not video PID */
+                                        continue;
+                                }
+                                if(TYPE_AUDIO == obj->aim_type && !IS_TYPE(TS_TYPE_AUD, pid->type)) {
+                                        /* not audio PID */
+                                        continue;
+                                }
+                        }
+
+                        rate->PID = pid->PID;
+                        rate->lcnt = pid->lcnt;
+                        rate++;
+                        (*rate_cnt)++;
+                }
+        }
+        if(ts->has_rate && obj->aim.ratp) {
+                for(znode = (struct znode *)(ts->pid0); znode; znode = znode->next) {
+                        struct ts_pid *pid_item = (struct ts_pid *)znode;
+
+                        if(pid_item->PID >= 0x0020 && pid_item->PID != pid_item->prog->PMT_PID) {
+                                /* not psi/si PID */
+                                continue;
+                        }
+
+                        rate->PID = pid_item->PID;
+                        rate->lcnt = pid_item->lcnt;
+                        rate++;
+                        (*ratp_cnt)++;
+                }
+        }
+        return rate;
+}
+
+static void show_evt(struct tsana_obj *obj, const struct evt *evt)
+{
+        if(obj->is_group) {
+                /* some workers share stdout, keep the line together */
+                flockfile(stdout);
+                fprintf(stdout, "*url, %s, ", obj->file_i);
+        }
+        if(obj->aim.time) {
+                show_time(obj, evt);
+        }
+        if(obj->aim.addr) {
+                show_addr(obj, evt);
+        }
+        if(obj->aim.cts) {
+                show_cts(obj, evt);
+        }
+        if(obj->aim.stc) {
+                show_stc(obj, evt);
+        }
+        if(obj->aim.pts) {
+                show_pts(obj, evt);
+        }
+        if(obj->aim.pcr) {
+                show_pcr(obj, evt);
+        }
+        if(obj->aim.tsh) {
+                show_tsh(obj, evt);
+        }
+        if(obj->aim.ts) {
+                show_ts(obj, evt);
+        }
+        if(obj->aim.mts) {
+                show_mts(obj, evt);
+        }
+        if(obj->aim.af && evt->AF_len) {
+                show_af(obj, evt);
+        }
+        if(obj->aim.pesh && (evt->PES_len != evt->ES_len)) {
+                show_pesh(obj, evt);
+        }
+        if(obj->aim.pes && evt->PES_len) {
+                show_pes(obj, evt);
+        }
+        if(obj->aim.es && evt->ES_len) {
+                show_es(obj, evt);
+        }
+        if(obj->aim.sec && evt->has_sect) {
+                show_sec(obj, evt);
+        }
+        if(obj->aim.si && evt->has_sect) {
+                show_si(obj, evt);
+        }
+        if(obj->aim.rate && evt->has_rate) {
+                show_rate(obj, evt);
+        }
+        if(obj->aim.rats && evt->has_rate) {
+                show_rats(obj, evt);
+        }
+        if(obj->aim.ratp && evt->has_rate) {
+                show_ratp(obj, evt);
+        }
+        if(obj->aim.err && evt->has_err) {
+                show_error(obj, evt);
+        }
+        fprintf(stdout, "\n");
+        if(obj->is_group) {
+                funlockfile(stdout);
+        }
+        return;
+}
+
+/* format the evt records from parse thread */
+static void *report_thread(void *arg)
+{
+        struct tsana_obj *obj = (struct tsana_obj *)arg;
+        const struct evt *evt;
+        size_t len;
+
+        while(NULL != (evt = (const struct evt *)ring_peek(obj->ring, &len))) {
+                show_evt(obj, evt);
+                ring_release(obj->ring);
+        }
+        fflush(stdout);
+        return NULL;
+}
+
+static int has_error(const struct ts_obj *ts)
+{
+        size_t i;
+
+        for(i = 0; i < sizeof(struct ts_err); i++) {
+                if(*((const uint8_t *)&(ts->err) + i)) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/* read thread(obj->ts) -> shard threads(ts_obj of each) -> merge thread
+ *
+ * obj->ts in read thread parses PSI, PCR and count of all packets once, for
+ * CTS, STC and rate; then each packet goes to the shard of its program, and
+ * PSI goes to all shards, so each shard runs the other stages(CC, PES, SI,
+ * etc) only for its own PIDs, with the same state of each PID as one ts_obj;
+ * then the merge thread formats the reports of the owners in the order of
+ * packets
+ */
+static int start_shard(struct tsana_obj *obj)
+{
+        int i;
+        struct shard *sd;
+        struct ts_cfg cfg;
+
+        obj->shard = (struct shard *)calloc(obj->shard_cnt, sizeof(struct shard));
+        obj->dispatch = (struct dispatch *)calloc(1, sizeof(struct dispatch));
+        if(NULL == obj->shard || NULL == obj->dispatch) {
+                RPTERR("malloc shard failed");
+                free(obj->shard);
+                free(obj->dispatch);
+                obj->shard = NULL;
+                obj->dispatch = NULL;
+                return -1;
+        }
+        memset(obj->dispatch->ver, 0xFF, sizeof(obj->dispatch->ver));
+
+        memcpy(&cfg, &(obj->ts->cfg), sizeof(struct ts_cfg));
+        if(obj->ts->is_pat_pmt_parsed) {
+                /* PSI of -start or -seek: the shards parse PSI after it, so does obj->ts */
+                ts_ioctl(obj->ts, TS_INIT, 0);
+                ts_ioctl(obj->ts, TS_SCFG, &cfg);
+        }
+        ts_ioctl(obj->ts, TS_QUIET, obj->ts); /* the shards report on stderr */
+        cfg.need_statistic = 0; /* rate is from obj->ts */
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                memcpy(&(sd->obj), obj, sizeof(struct tsana_obj));
+                sd->obj.shard_cnt = 0;
+                sd->obj.shard = NULL;
+                sd->obj.dispatch = NULL;
+                sd->obj.is_rate_only = 0; /* rate is from obj->ts */
+                sd->obj.ts = NULL;
+                sd->obj.ring = NULL;
+                sd->obj.state = STATE_PARSE_PSI;
+                sd->top = obj;
+                sd->idx = i;
+                memset(sd->own, ((0 == i) ? 1 : 0), sizeof(sd->own)); /* till PSI is parsed */
+
+                sd->mp = buddy_create(obj->mp_order, 6);
+                if(NULL == sd->mp) {
+                        RPTERR("malloc memory pool of shard %d failed", i);
+                        goto start_shard_failed;
+                }
+                buddy_init(sd->mp);
+                sd->obj.ts = ts_create(sd->mp);
+                if(NULL == sd->obj.ts) {
+                        RPTERR("malloc ts object of shard %d failed", i);
+                        goto start_shard_failed;
+                }
+                ts_ioctl(sd->obj.ts, TS_INIT, 0);
+                ts_ioctl(sd->obj.ts, TS_SCFG, &cfg);
+
+                sd->in = ring_create(RING_SIZE);
+                sd->obj.ring = ring_create(RING_SIZE);
+                if(NULL == sd->in || NULL == sd->obj.ring) {
+                        goto start_shard_failed;
+                }
+        }
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                if(0 != pthread_create(&(sd->thread), NULL, shard_thread, sd)) {
+                        goto start_shard_failed;
+                }
+                sd->is_run = 1;
+        }
+        if(0 != pthread_create(&(obj->report), NULL, merge_thread, obj)) {
+                goto start_shard_failed;
+        }
+        obj->is_merge = 1;
+        return 0;
+
+start_shard_failed:
+        stop_shard(obj);
+        return -1;
+}
+
+/* no more packet, wait for all the threads, then free the shards */
+static void stop_shard(struct tsana_obj *obj)
+{
+        int i;
+        struct shard *sd;
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                if(sd->in) {
+                        ring_close(sd->in);
+                }
+        }
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                if(sd->is_run) {
+                        pthread_join(sd->thread, NULL); /* it closes sd->obj.ring */
+                }
+                else if(sd->obj.ring) {
+                        ring_close(sd->obj.ring);
+                }
+        }
+        if(obj->is_merge) {
+                pthread_join(obj->report, NULL);
+                obj->is_merge = 0;
+        }
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                if(obj->is_mem && sd->is_run) {
+                        fprintf(stderr, "shard %d: read thread waited %ld times, shard thread waited %ld times\n",
+                                i, ring_full_cnt(sd->in), ring_full_cnt(sd->obj.ring));
+                }
+                ring_destroy(sd->in);
+                ring_destroy(sd->obj.ring);
+                ts_destroy(sd->obj.ts);
+                if(sd->mp) {
+                        buddy_destroy(sd->mp);
+                }
+        }
+        free(obj->shard);
+        obj->shard = NULL;
+
+        /* obj->ts as usual, e.g. parse in one thread if start_shard() failed */
+        ts_ioctl(obj->ts, TS_SROLE, NULL);
+        ts_ioctl(obj->ts, TS_QUIET, NULL);
+        free(obj->dispatch);
+        obj->dispatch = NULL;
+        return;
+}
+
+/* read thread: parse each packet in obj->ts, then send it to the shards use
+ * it, with the rate to its owner; before PSI is parsed, all packets go to all
+ * the shards; blocks of all the shards are for the same packets
+ */
+static void read_shard(struct tsana_obj *obj)
+{
+        struct dispatch *dp = obj->dispatch;
+        struct ts_obj *ts = obj->ts;
+        struct ts_ipt *ipt = &(ts->ipt);
+        struct ts_err *err = &(ts->err);
+        struct shard *sd;
+        struct blk_pkt head; /* the same in all the shards */
+        struct blk_pkt *pkt;
+        const uint8_t *p;
+        uint16_t PID;
+        int n = 0; /* packet in the block */
+        int i;
+        int get_rslt;
+
+        memset(&head, 0, sizeof(struct blk_pkt));
+        head.size = (uint32_t)BLK_PKT_ALL;
+        while(!__atomic_load_n(&(obj->is_stop), __ATOMIC_RELAXED) &&
+              GOT_EOF != (get_rslt = get_one_pkt(obj))) {
+                if(GOT_WRONG_PKT == get_rslt || !(ipt->has_ts)) {
+                        break;
+                }
+
+                gettimeofday(&(head.tv), NULL); /* record the arrive time */
+                if(0 != ts_parse_tsh(ts)) {
+                        break;
+                }
+                head.cnt = ts->cnt;
+                head.ADDR = ts->ADDR;
+                head.CTS = ts->CTS;
+                head.STC = ts->STC;
+                if(ts->cnt >= (int64_t)(obj->aim_start)) {
+                        ts_parse_tsb(ts);
+                }
+                head.MTS = ipt->MTS;
+                head.has_mts = (uint8_t)(ipt->has_mts);
+                head.has_rtp = (uint8_t)(ipt->has_rtp);
+                head.RTP_lost = ipt->RTP_lost;
+                head.RTP_jitter = ipt->RTP_jitter;
+                head.Sync_byte_error = err->Sync_byte_error;
+                head.TS_sync_loss = err->TS_sync_loss;
+                head.RTP_error = err->RTP_error;
+                head.CAT_error = ((ts->has_rate) ? (err->CAT_error & ERR_2_6_0) : 0);
+                head.has_rate = (uint8_t)(ts->has_rate);
+                err->CAT_error = 0; /* the other CAT_error is reported by the shard */
+
+                PID = ts->PID;
+                p = ts->TS;
+                for(i = 0; i < obj->shard_cnt; i++) {
+                        sd = obj->shard + i;
+                        if(0 == n) {
+                                sd->blk = (uint8_t *)ring_reserve(sd->in, BLK_SIZE);
+                                sd->blk_len = 0;
+                        }
+                        if(i != dp->owner[PID] &&
+                           dp->has_role && TS_ROLE_ALL != dp->role[PID]) {
+                                continue; /* PID of other shard */
+                        }
+
+                        pkt = add_rec(sd, BLK_PKT_ALL);
+                        memcpy(pkt, &head, offsetof(struct blk_pkt, TS));
+                        memcpy(pkt->TS, p, 188);
+                        if(head.has_rate && i == dp->owner[PID]) {
+                                struct blk_rate *br = (struct blk_rate *)((uint8_t *)pkt + BLK_PKT_ALL);
+                                struct evt_rate *end;
+
+                                br->last_interval = ts->last_interval;
+                                br->last_sys_cnt = ts->last_sys_cnt;
+                                br->last_psi_cnt = ts->last_psi_cnt;
+                                br->last_nul_cnt = ts->last_nul_cnt;
+                                end = rate_make(obj, br->rate, &(br->rate_cnt), &(br->ratp_cnt));
+                                pkt->size = (uint32_t)((uint8_t *)end - (uint8_t *)pkt);
+                                sd->blk_len = (size_t)((uint8_t *)end - sd->blk);
+                        }
+                        else {
+                                pkt->has_rate = 0;
+                        }
+                }
+
+                /* share the PIDs again after this packet, if PSI changes */
+                if(ts->sect && (0x0000 == PID || IS_TYPE(TS_TYPE_PMT, ts->pid->type)) &&
+                   dp->ver[PID] != ts->sect->version_number) {
+                        if(0xFF != dp->ver[PID]) {
+                                dp->has_role = 0;
+                        }
+                        dp->ver[PID] = ts->sect->version_number;
+                }
+                if(!(dp->has_role) && ts->is_pat_pmt_parsed) {
+                        shard_role(obj);
+                }
+
+                if(PKT_BLK == ++n) {
+                        send_blk(obj);
+                        n = 0;
+                }
+                else {
+                        for(i = 0; i < obj->shard_cnt; i++) {
+                                if(obj->shard[i].blk_len + BLK_PKT_MAX > BLK_SIZE) {
+                                        send_blk(obj); /* no room for the next packet */
+                                        n = 0;
+                                        break;
+                                }
+                        }
+                }
+
+                if((0 != obj->aim_count) && (ts->cnt + 1 >= (int64_t)(obj->aim_start + obj->aim_count))) {
+                        break;
+                }
+        }
+        if(n) {
+                send_blk(obj);
+        }
+        return;
+}
+
+/* a record of size-byte at the end of the block */
+static struct blk_pkt *add_rec(struct shard *sd, size_t size)
+{
+        struct blk_pkt *pkt = (struct blk_pkt *)(sd->blk + sd->blk_len);
+
+        pkt->size = (uint32_t)size;
+        sd->blk_len += size;
+        return pkt;
+}
+
+static void send_blk(struct tsana_obj *obj)
+{
+        int i;
+        struct shard *sd;
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                sd = obj->shard + i;
+                ring_shrink(sd->in, sd->blk_len);
+                ring_commit(sd->in);
+        }
+        return;
+}
+
+static void put_mark(struct ring *ring, int64_t cnt, int is_exit)
+{
+        struct mark *mark = (struct mark *)ring_reserve(ring, sizeof(struct mark));
+
+        if(NULL == mark) {
+                return;
+        }
+        mark->cnt = cnt;
+        mark->is_exit = is_exit;
+        ring_commit(ring);
+        return;
+}
+
+/* share the PIDs by program of obj->ts: program i belongs to shard (i % shard_cnt),
+ * then send own[] to each shard before the next packet
+ *
+ * obj->ts parses PAT, CAT and PMT(sent to all shards), PCR for CTS and STC,
+ * and counts the other packets
+ */
+static void shard_role(struct tsana_obj *obj)
+{
+        struct dispatch *dp = obj->dispatch;
+        struct ts_obj *ts = obj->ts;
+        struct znode *znode;
+        struct blk_pkt *pkt;
+        uint8_t claim[0x2000]; /* 1: PID belongs to some program already */
+        int i;
+        int k;
+
+        /* PID out of all programs: shard 0 */
+        memset(dp->owner, 0, sizeof(dp->owner));
+        memset(dp->role, ((obj->is_rate_only) ? TS_ROLE_RATE : TS_ROLE_CNT), sizeof(dp->role));
+        memset(claim, 0, sizeof(claim));
+        memset(claim, 1, 0x0020); /* PSI/SI PID */
+        claim[0x1FFF] = 1; /* empty packet */
+
+        for(i = 0, znode = (struct znode *)(ts->prog0); znode; znode = znode->next, i++) {
+                struct ts_prog *prog = (struct ts_prog *)znode;
+                int idx = i % obj->shard_cnt;
+                struct znode *zelem;
+
+                shard_claim(dp, claim, prog->PMT_PID, idx);
+                shard_claim(dp, claim, prog->PCR_PID, idx);
+                for(zelem = (struct znode *)(prog->elem0); zelem; zelem = zelem->next) {
+                        shard_claim(dp, claim, ((struct ts_elem *)zelem)->PID, idx);
+                }
+        }
+
+        for(znode = (struct znode *)(ts->prog0); znode; znode = znode->next) {
+                struct ts_prog *prog = (struct ts_prog *)znode;
+
+                if(0x1FFF != prog->PCR_PID) {
+                        dp->role[prog->PCR_PID] = TS_ROLE_PCR;
+                }
+        }
+        for(znode = (struct znode *)(ts->prog0); znode; znode = znode->next) {
+                dp->role[((struct ts_prog *)znode)->PMT_PID] = TS_ROLE_ALL;
+        }
+        dp->role[0x0000] = TS_ROLE_ALL; /* PAT */
+        dp->role[0x0001] = TS_ROLE_ALL; /* CAT */
+        ts_ioctl(ts, TS_SROLE, dp->role);
+        dp->has_role = 1;
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                pkt = add_rec(obj->shard + i, BLK_OWN);
+                pkt->is_own = 1;
+                pkt->has_rate = 0;
+                for(k = 0; k < 0x2000; k++) {
+                        pkt->TS[k] = (uint8_t)(i == dp->owner[k]);
+                }
+        }
+        return;
+}
+
+/* PID shared by some programs belongs to the first one */
+static void shard_claim(struct dispatch *dp, uint8_t *claim, uint16_t PID, int idx)
+{
+        if(claim[PID]) {
+                return;
+        }
+        claim[PID] = 1;
+        dp->owner[PID] = (uint8_t)idx;
+        return;
+}
+
+/* parse PSI and the packets of its own PIDs, report them */
+static void *shard_thread(void *arg)
+{
+        struct shard *sd = (struct shard *)arg;
+        struct tsana_obj *obj = &(sd->obj);
+        struct ts_obj *ts = obj->ts;
+        struct ts_ipt *ipt = &(ts->ipt);
+        struct ts_err *err = &(ts->err);
+        const uint8_t *blk;
+        const uint8_t *end;
+        const struct blk_pkt *pkt;
+        size_t len;
+        int is_own;
+        int rslt;
+        int is_exit = 0;
+
+        ipt->has_ts = 1;
+        ipt->has_rs = 0; /* RS is only for -dump */
+        ipt->has_addr = 1;
+        ipt->has_cts = 1;
+        ipt->has_stc = 1;
+        while(NULL != (blk = (const uint8_t *)ring_peek(sd->in, &len))) {
+                for(end = blk + len; blk < end && !is_exit; blk += pkt->size) {
+                        pkt = (const struct blk_pkt *)blk;
+                        if(pkt->is_own) {
+                                memcpy(sd->own, pkt->TS, sizeof(sd->own));
+                                continue;
+                        }
+                        is_own = sd->own[((pkt->TS[1] & 0x1F) << 8) | pkt->TS[2]];
+
+                        ipt->pTS = pkt->TS; /* kept until ring_release() */
+                        ipt->ADDR = pkt->ADDR;
+                        ipt->MTS = pkt->MTS;
+                        ipt->CTS = pkt->CTS;
+                        ipt->STC = pkt->STC;
+                        ipt->has_mts = pkt->has_mts;
+                        ipt->has_rtp = pkt->has_rtp;
+                        ipt->RTP_lost = pkt->RTP_lost;
+                        ipt->RTP_jitter = pkt->RTP_jitter;
+
+                        ts->cnt = pkt->cnt - 1; /* other packets are not here */
+                        ts_ioctl(ts, TS_QUIET, (is_own ? NULL : ts)); /* the owner reports on stderr */
+                        ts_parse_tsh(ts);
+                        err->Sync_byte_error = pkt->Sync_byte_error;
+                        err->TS_sync_loss = pkt->TS_sync_loss;
+                        err->RTP_error = pkt->RTP_error;
+                        if(ts->cnt < obj->aim_start) {
+                                continue;
+                        }
+
+                        obj->tv = pkt->tv;
+                        ts_parse_tsb(ts);
+                        obj->blk_rate = NULL;
+                        if(pkt->has_rate) {
+                                obj->blk_rate = (const struct blk_rate *)(blk + BLK_PKT_ALL);
+                                ts->has_rate = 1;
+                                ts->last_interval = obj->blk_rate->last_interval;
+                                ts->last_sys_cnt = obj->blk_rate->last_sys_cnt;
+                                ts->last_psi_cnt = obj->blk_rate->last_psi_cnt;
+                                ts->last_nul_cnt = obj->blk_rate->last_nul_cnt;
+                                err->CAT_error |= pkt->CAT_error;
+                        }
+                        if(STATE_PARSE_PSI == obj->state) {
+                                state_parse_psi(obj);
+                                continue;
+                        }
+
+                        if(is_own) {
+                                rslt = state_parse_each(obj);
+                        }
+                        else {
+                                /* the owner reports it, clear as it does */
+                                rslt = ((obj->aim.err && has_error(ts)) ? clear_error(obj) : 0);
+                        }
+                        if(0 != rslt) {
+                                /* no more evt, but go on reading till read thread stops */
+                                put_mark(obj->ring, ts->cnt, 1);
+                                ring_close(obj->ring);
+                                __atomic_store_n(&(sd->top->is_stop), 1, __ATOMIC_RELAXED);
+                                is_exit = 1;
+                        }
+                }
+                ipt->pTS = NULL;
+                ring_release(sd->in);
+                if(!is_exit) {
+                        put_mark(obj->ring, INT64_MAX, 0);
+                }
+        }
+        if(!is_exit) {
+                ring_close(obj->ring);
+        }
+        return NULL;
+}
+
+/* format the evt records from all the shard threads, in the order of packets */
+static void *merge_thread(void *arg)
+{
+        struct tsana_obj *obj = (struct tsana_obj *)arg;
+        const void *rec[SHARD_MAX]; /* head record of each shard, NULL means done */
+        int has_head[SHARD_MAX]; /* rec[] is OK */
+        int64_t cnt[SHARD_MAX];
+        int is_mark[SHARD_MAX];
+        size_t len;
+        int is_exit = 0;
+        int i;
+        int k;
+
+        for(i = 0; i < obj->shard_cnt; i++) {
+                has_head[i] = 0;
+        }
+        while(1) {
+                /* the first record: (cnt, is_mark) is min */
+                k = -1;
+                for(i = 0; i < obj->shard_cnt; i++) {
+                        if(!has_head[i]) {
+                                rec[i] = ring_peek(obj->shard[i].obj.ring, &len);
+                                has_head[i] = 1;
+                                if(rec[i]) {
+                                        is_mark[i] = (sizeof(struct mark) == len);
+                                        cnt[i] = (is_mark[i] ? ((const struct mark *)rec[i])->cnt :
+                                                               ((const struct evt *)rec[i])->cnt);
+                                }
+                        }
+                        if(NULL == rec[i]) {
+                                continue;
+                        }
+                        if(k < 0 || cnt[i] < cnt[k] || (cnt[i] == cnt[k] && is_mark[i] < is_mark[k])) {
+                                k = i;
+                        }
+                }
+                if(k < 0) {
+                        break; /* all done */
+                }
+
+                if(!is_mark[k]) {
+                        if(!is_exit) {
+                                show_evt(obj, (const struct evt *)rec[k]);
+                        }
+                }
+                else if(((const struct mark *)rec[k])->is_exit) {
+                        is_exit = 1;
+                }
+                else {
+                        /* end of a block in all the shards, go to next block together */
+                        for(i = 0; i < obj->shard_cnt; i++) {
+                                if(rec[i] && i != k) {
+                                        ring_release(obj->shard[i].obj.ring);
+                                        has_head[i] = 0;
+                                }
+                        }
+                }
+                ring_release(obj->shard[k].obj.ring);
+                has_head[k] = 0;
+        }
+        fflush(stdout);
+        return NULL;
+}
+
+/* main thread -> chunk threads(ts_obj of each) -> main thread
+ *
+ * PSI is parsed from the head of file in main thread, then the rest of file
+ * is split into chunks: main thread parses chunk[0] and reports as usual, the
+ * other chunks are parsed in their threads at the same time, and reported
+ * into spool files; when main thread meets the start of a chunk, the reports
+ * of the chunk are used if its state is the same as main thread there, else
+ * main thread parses the chunk again, so the report is the same as one thread
+ */
+static int start_chunk(struct tsana_obj *obj)
+{
+        int i;
+        int64_t step;
+        int64_t warm;
+        struct chunk *ck;
+
+        if(NULL == obj->map || FILE_MTS == obj->type || obj->is_dump || obj->is_impsi ||
+           0 != obj->aim_start || 0 != obj->aim_count || obj->demux_dir || obj->is_seek) {
+                /* STC of MTS file is accumulated from the first packet */
+                RPTWRN("-chunk needs TS or TSRS file without -dump, -impsi, -demux, -seek, -start or -count, parse in one thread");
+                return -1;
+        }
+
+        if(NULL != obj->shard) {
+                RPTWRN("-chunk can not be used with -shard, parse by shard");
+                return -1;
+        }
+
+        /* on packet border, from the address after PSI */
+        step = (obj->map_size - obj->addr) / obj->chunk_cnt / obj->npline * obj->npline;
+        if(step < CHUNK_PKT_MIN * obj->npline) {
+                RPTINF("file is too small for %d chunks, parse in one thread", obj->chunk_cnt);
+                return -1;
+        }
+        warm = (step >> 3) / obj->npline * obj->npline; /* enough for CC, PCR and PTS of most streams */
+
+        obj->chunk = (struct chunk *)calloc(obj->chunk_cnt, sizeof(struct chunk));
+        if(NULL == obj->chunk) {
+                RPTERR("malloc chunk failed");
+                return -1;
+        }
+        obj->hash_mask = 0;
+        if(obj->aim.err) {
+                obj->hash_mask |= TS_HASH_ERR;
+        }
+        if(obj->aim.sec || obj->aim.si) {
+                obj->hash_mask |= TS_HASH_SECT;
+        }
+        if(obj->aim.rate || obj->aim.rats || obj->aim.ratp) {
+                obj->hash_mask |= TS_HASH_RATE;
+        }
+
+        for(i = 0; i < obj->chunk_cnt; i++) {
+                ck = obj->chunk + i;
+                ck->top = obj;
+                ck->start = obj->addr + step * i;
+                ck->end = ((i + 1 < obj->chunk_cnt) ? (ck->start + step) : INT64_MAX);
+                ck->warm = ((ck->start - warm > obj->addr) ? (ck->start - warm) : obj->addr);
+                if(0 == i) {
+                        continue; /* main thread */
+                }
+
+                memcpy(&(ck->obj), obj, sizeof(struct tsana_obj));
+                ck->obj.chunk_cnt = 0;
+                ck->obj.chunk = NULL;
+                ck->obj.chunk_end = INT64_MAX;
+                ck->obj.ring = NULL;
+                ck->obj.ts = NULL;
+                ck->obj.ts_own = NULL;
+                ck->obj.evt = (struct evt *)malloc(EVT_SIZE_MAX);
+                ck->obj.spool = tmpfile();
+                if(NULL == ck->obj.evt || NULL == ck->obj.spool) {
+                        RPTERR("malloc evt or open spool of chunk %d failed", i);
+                        goto start_chunk_failed;
+                }
+                setvbuf(ck->obj.spool, NULL, _IOFBF, SPOOL_BUF);
+
+                ck->mp = buddy_create(obj->mp_order, 6);
+                if(NULL == ck->mp) {
+                        RPTERR("malloc memory pool of chunk %d failed", i);
+                        goto start_chunk_failed;
+                }
+                buddy_init(ck->mp);
+                ck->obj.ts = ts_create(ck->mp);
+                if(NULL == ck->obj.ts) {
+                        RPTERR("malloc ts object of chunk %d failed", i);
+                        goto start_chunk_failed;
+                }
+                ck->obj.ts_own = ck->obj.ts;
+                ts_ioctl(ck->obj.ts, TS_INIT, 0);
+                ts_ioctl(ck->obj.ts, TS_SCFG, &(obj->ts->cfg));
+                ck->obj.ts->aim_interval = obj->aim_interval;
+        }
+
+        for(i = 1; i < obj->chunk_cnt; i++) {
+                ck = obj->chunk + i;
+                if(0 != pthread_create(&(ck->thread), NULL, chunk_thread, ck)) {
+                        goto start_chunk_failed;
+                }
+                ck->is_run = 1;
+        }
+        obj->chunk_idx = 1;
+        obj->chunk_redo = 0;
+        obj->chunk_end = obj->chunk[1].start;
+        return 0;
+
+start_chunk_failed:
+        stop_chunk(obj);
+        return -1;
+}
+
+/* wait for all the chunk threads, then free the chunks */
+static void stop_chunk(struct tsana_obj *obj)
+{
+        int i;
+        struct chunk *ck;
+
+        __atomic_store_n(&(obj->is_stop), 1, __ATOMIC_RELAXED); /* for chunks not stitched */
+        for(i = 1; i < obj->chunk_cnt; i++) {
+                ck = obj->chunk + i;
+                if(ck->is_run) {
+                        pthread_join(ck->thread, NULL);
+                        ck->is_run = 0;
+                }
+        }
+        if(obj->is_mem) {
+                fprintf(stderr, "chunk: %d of %d chunks parsed again in main thread\n",
+                        obj->chunk_redo, obj->chunk_cnt - 1);
+        }
+
+        obj->ts = obj->ts_own;
+        for(i = 1; i < obj->chunk_cnt; i++) {
+                ck = obj->chunk + i;
+                if(ck->obj.spool) {
+                        fclose(ck->obj.spool);
+                }
+                free(ck->obj.evt);
+                if(ck->obj.ts) {
+                        ts_destroy(ck->obj.ts);
+                }
+                if(ck->mp) {
+                        buddy_destroy(ck->mp);
+                }
+        }
+        free(obj->chunk);
+        obj->chunk = NULL;
+        obj->chunk_end = INT64_MAX;
+        return;
+}
+
+/* main thread at the start of next chunk: use its reports and ts_obj if
+ * it starts with the same state, else parse it in main thread
+ */
+static int next_chunk(struct tsana_obj *obj)
+{
+        struct chunk *ck;
+        int64_t dcnt;
+
+        while(obj->chunk_idx < obj->chunk_cnt) {
+                ck = obj->chunk + obj->chunk_idx++;
+                pthread_join(ck->thread, NULL);
+                ck->is_run = 0;
+
+                if(ck->is_bad || ck->addr != obj->addr ||
+                   ck->hash != ts_state_hash(obj->ts, obj->hash_mask)) {
+                        RPTINF("chunk %d starts with other state, parse it again", obj->chunk_idx - 1);
+                        obj->chunk_redo++;
+                        obj->chunk_end = ck->end;
+                        return 0;
+                }
+                dcnt = obj->ts->cnt - ck->cnt; /* packets skipped to warm are counted by size */
+                if(0 != replay_chunk(obj, ck, dcnt)) {
+                        return -1;
+                }
+                if(ck->is_exit) {
+                        return -1;
+                }
+
+                /* go on from the end of the chunk */
+                ck->obj.ts->cnt += dcnt;
+                /* set after the first statistic interval from STC sync of prog0, as tsb_rate() */
+                ck->obj.ts->is_psi_si_parsed = (obj->ts->is_psi_si_parsed ||
+                                                (obj->ts->prog0 && obj->ts->prog0->is_STC_sync &&
+                                                 ts_timestamp_diff(ck->obj.ts->CTS, obj->ts->CTS0, STC_OVF) >= obj->aim_interval));
+                obj->ts = ck->obj.ts;
+                obj->addr = ck->obj.addr;
+                obj->type = ck->obj.type;
+                obj->npline = ck->obj.npline;
+        }
+        obj->chunk_end = INT64_MAX;
+        return 0;
+}
+
+/* report the evt records in the spool of chunk */
+static int replay_chunk(struct tsana_obj *obj, struct chunk *ck, int64_t dcnt)
+{
+        FILE *spool = ck->obj.spool;
+        struct evt *evt;
+        size_t size;
+
+        rewind(spool);
+        while(1 == fread(&size, sizeof(size_t), 1, spool)) {
+                evt = ((obj->ring) ? (struct evt *)ring_reserve(obj->ring, size) : obj->evt);
+                if(NULL == evt || size > EVT_SIZE_MAX || 1 != fread(evt, size, 1, spool)) {
+                        RPTERR("bad spool of chunk %d", (int)(ck - obj->chunk));
+                        return -1;
+                }
+                evt->cnt += dcnt;
+                if(evt->has_sect && (obj->aim.sec || obj->aim.si)) {
+                        /* section data is after rate[] in this record */
+                        evt->sect.section = (uint8_t *)(evt->rate + evt->rate_cnt + evt->ratp_cnt);
+                }
+                if(obj->ring) {
+                        ring_commit(obj->ring);
+                }
+                else {
+                        show_evt(obj, evt);
+                }
+        }
+        return 0;
+}
+
+static void spool_evt(struct tsana_obj *obj, const struct evt *evt)
+{
+        size_t size = evt_size(obj);
+
+        fwrite(&size, sizeof(size_t), 1, obj->spool);
+        fwrite(evt, size, 1, obj->spool);
+        return;
+}
+
+static void *chunk_thread(void *arg)
+{
+        struct chunk *ck = (struct chunk *)arg;
+        struct tsana_obj *obj = &(ck->obj);
+        struct ts_obj *ts = obj->ts;
+
+        /* PSI from the head of file, the same as main thread */
+        obj->addr = obj->addr0;
+        obj->state = STATE_PARSE_PSI;
+        while(STATE_PARSE_PSI == obj->state) {
+                if(GOT_RIGHT_PKT != get_one_pkt(obj)) {
+                        ck->is_bad = 1;
+                        return NULL;
+                }
+                ts_parse_tsh(ts);
+                ts_parse_tsb(ts);
+                state_parse_psi(obj);
+        }
+
+        if(obj->hash_mask & TS_HASH_RATE) {
+                /* the statistic interval goes on from the first PCR: PCR and count to warm */
+                struct znode *znode;
+
+                memset(ck->role, TS_ROLE_RATE, sizeof(ck->role));
+                for(znode = (struct znode *)(ts->prog0); znode; znode = znode->next) {
+                        ck->role[((struct ts_prog *)znode)->PCR_PID] = TS_ROLE_PCR;
+                }
+                ts_ioctl(ts, TS_SROLE, ck->role);
+                while(obj->addr < ck->warm) {
+                        if(GOT_RIGHT_PKT != get_one_pkt(obj)) {
+                                ck->is_bad = 1;
+                                return NULL;
+                        }
+                        ts_parse_tsh(ts);
+                        ts_parse_tsb(ts);
+                }
+                ts_ioctl(ts, TS_SROLE, ((obj->is_rate_only) ? obj->role : NULL));
+        }
+        else if(ck->warm > obj->addr) {
+                /* skip to warm, count the packets skipped */
+                ts->cnt += (ck->warm - obj->addr) / obj->npline;
+                obj->addr = ck->warm;
+        }
+
+        /* without report before start */
+        obj->is_warm = 1;
+        while(obj->addr < ck->start) {
+                if(GOT_RIGHT_PKT != get_one_pkt(obj)) {
+                        ck->is_bad = 1;
+                        return NULL;
+                }
+                ts_parse_tsh(ts);
+                ts_parse_tsb(ts);
+                state_parse_each(obj); /* no exit before start */
+        }
+        obj->is_warm = 0;
+        ck->addr = obj->addr;
+        ck->cnt = ts->cnt;
+        ck->hash = ts_state_hash(ts, obj->hash_mask);
+
+        /* reports into spool */
+        while(obj->addr < ck->end) {
+                if(__atomic_load_n(&(ck->top->is_stop), __ATOMIC_RELAXED)) {
+                        ck->is_bad = 1;
+                        break;
+                }
+                if(GOT_RIGHT_PKT != get_one_pkt(obj)) {
+                        break;
+                }
+                ts_parse_tsh(ts);
+                gettimeofday(&(obj->tv), NULL); /* record the arrive time */
+                ts_parse_tsb(ts);
+                if(0 != state_parse_each(obj)) {
+                        ck->is_exit = 1;
+                        break;
+                }
+        }
+        if(ferror(obj->spool)) {
+                RPTERR("write spool of chunk %d failed", (int)(ck - ck->top->chunk));
+                ck->is_bad = 1;
+        }
+        return NULL;
+}
+
+/* receive thread(main) -> worker threads(ts_obj of each group)
+ *
+ * main thread waits for the datagrams of all groups with upoll, then sends
+ * them to the worker of the group, group i belongs to worker (i % worker_cnt);
+ * each group is parsed as one stream, and reported by its worker at once
+ */
+static int run_group(struct tsana_obj *obj)
+{
+        void *arg[GROUP_MAX];
+        int cnt;
+        int i;
+
+        if(0 != start_group(obj)) {
+                return -1;
+        }
+
+        while(0 != __atomic_load_n(&(obj->group_live), __ATOMIC_RELAXED)) {
+                cnt = upoll_wait(obj->poll, arg, GROUP_MAX, GROUP_WAIT_MS);
+                if(cnt < 0) {
+                        break;
+                }
+                for(i = 0; i < cnt; i++) {
+                        recv_group(obj, (struct group *)arg[i]);
+                }
+        }
+
+        stop_group(obj);
+        return 0;
+}
+
+static int start_group(struct tsana_obj *obj)
+{
+        int i;
+        struct group *gp;
+        struct worker *wk;
+
+        obj->worker_cnt = ((obj->worker_cnt < obj->group_cnt) ? obj->worker_cnt : obj->group_cnt);
+        obj->group = (struct group *)calloc(obj->group_cnt, sizeof(struct group));
+        obj->worker = (struct worker *)calloc(obj->worker_cnt, sizeof(struct worker));
+        obj->poll = upoll_create();
+        if(NULL == obj->group || NULL == obj->worker || (intptr_t)NULL == obj->poll) {
+                RPTERR("malloc group failed");
+                goto start_group_failed;
+        }
+
+        for(i = 0; i < obj->group_cnt; i++) {
+                gp = obj->group + i;
+                memcpy(&(gp->obj), obj, sizeof(struct tsana_obj));
+                gp->obj.group_cnt = 0;
+                gp->obj.group = NULL;
+                gp->obj.worker = NULL;
+                gp->obj.is_group = 1;
+                gp->obj.file_i = obj->group_url[i];
+                gp->obj.url = NULL;
+                gp->obj.ts = NULL;
+                gp->obj.ring = NULL;
+                gp->obj.evt = NULL;
+                gp->obj.addr = 0;
+                gp->top = obj;
+                gp->idx = i;
+
+                gp->obj.url = url_open(gp->obj.file_i, "rb");
+                if(NULL == gp->obj.url) {
+                        RPTERR("open \"%s\" failed", gp->obj.file_i);
+                        goto start_group_failed;
+                }
+                if(0 != upoll_add(obj->poll, gp->obj.url->udp, gp)) {
+                        goto start_group_failed;
+                }
+
+                gp->mp = buddy_create(obj->mp_order, 6);
+                if(NULL == gp->mp) {
+                        RPTERR("malloc memory pool of group %d failed", i);
+                        goto start_group_failed;
+                }
+                buddy_init(gp->mp);
+                gp->obj.ts = ts_create(gp->mp);
+                if(NULL == gp->obj.ts) {
+                        RPTERR("malloc ts object of group %d failed", i);
+                        goto start_group_failed;
+                }
+                ts_ioctl(gp->obj.ts, TS_INIT, 0);
+                ts_ioctl(gp->obj.ts, TS_SCFG, &(obj->ts->cfg));
+                gp->obj.ts->aim_interval = obj->aim_interval;
+                gp->obj.ts->ipt.has_ts = 1;
+                gp->obj.ts->ipt.has_rs = 0;
+                gp->obj.ts->ipt.has_addr = 1;
+                gp->obj.ts->ipt.has_mts = 0;
+                gp->obj.ts->ipt.has_cts = 0;
+                gp->obj.ts->ipt.has_rtp = 0;
+
+                gp->obj.evt = (struct evt *)malloc(EVT_SIZE_MAX);
+                if(NULL == gp->obj.evt) {
+                        RPTERR("malloc evt of group %d failed", i);
+                        goto start_group_failed;
+                }
+        }
+
+        for(i = 0; i < obj->worker_cnt; i++) {
+                wk = obj->worker + i;
+                wk->top = obj;
+                wk->in = ring_create(RING_SIZE);
+                if(NULL == wk->in) {
+                        goto start_group_failed;
+                }
+        }
+        for(i = 0; i < obj->worker_cnt; i++) {
+                wk = obj->worker + i;
+                if(0 != pthread_create(&(wk->thread), NULL, worker_thread, wk)) {
+                        goto start_group_failed;
+                }
+                wk->is_run = 1;
+        }
+        obj->group_live = obj->group_cnt;
+        return 0;
+
+start_group_failed:
+        stop_group(obj);
+        return -1;
+}
+
+/* no more datagram, wait for all the workers, then free the groups */
+static void stop_group(struct tsana_obj *obj)
+{
+        int i;
+        struct group *gp;
+        struct worker *wk;
+
+        for(i = 0; obj->worker && i < obj->worker_cnt; i++) {
+                wk = obj->worker + i;
+                if(wk->in) {
+                        ring_close(wk->in);
+                }
+        }
+        for(i = 0; obj->worker && i < obj->worker_cnt; i++) {
+                wk = obj->worker + i;
+                if(wk->is_run) {
+                        pthread_join(wk->thread, NULL);
+                        if(obj->is_mem) {
+                                fprintf(stderr, "worker %d: receive thread waited %ld times\n",
+                                        i, ring_full_cnt(wk->in));
+                        }
+                }
+                ring_destroy(wk->in);
+        }
+        free(obj->worker);
+        obj->worker = NULL;
+
+        for(i = 0; obj->group && i < obj->group_cnt; i++) {
+                gp = obj->group + i;
+                free(gp->obj.evt);
+                if(gp->obj.ts) {
+                        ts_destroy(gp->obj.ts);
+                }
+                if(gp->mp) {
+                        buddy_destroy(gp->mp);
+                }
+                if(gp->obj.url) {
+                        url_close(gp->obj.url);
+                }
+        }
+        free(obj->group);
+        obj->group = NULL;
+
+        if((intptr_t)NULL != obj->poll) {
+                upoll_destroy(obj->poll);
+                obj->poll = (intptr_t)NULL;
+        }
+        return;
+}
+
+/* the datagrams of one readable group, without wait, to the ring of its worker */
+static void recv_group(struct tsana_obj *obj, struct group *gp)
+{
+        const struct udp_dgram *dgram;
+        struct grp_blk *blk;
+        struct grp_lost *lost;
+        struct ring *in = obj->worker[gp->idx % obj->worker_cnt].in;
+        struct url *url = gp->obj.url;
+        int is_rtp = (SCH_RTP == url->scheme);
+        uint64_t drop;
+        size_t off;
+        size_t len;
+        int cnt;
+        int n;
+        int i;
+
+        cnt = udp_recv(url->udp, &dgram, 0);
+        if(cnt <= 0) {
+                return;
+        }
+        drop = udp_drop(url->udp);
+        if(drop != gp->drop) {
+                RPTWRN("%s: %"PRIu64" datagram dropped by kernel, %"PRIu64" in all",
+                       gp->obj.file_i, drop - gp->drop, drop);
+                gp->drop = drop;
+        }
+        if(__atomic_load_n(&(gp->is_exit), __ATOMIC_RELAXED)) {
+                return; /* drop it */
+        }
+
+        /* whole TS packets only, without RTP header */
+        for(n = 0, i = 0; i < cnt; i++) {
+                off = rtp_payload(dgram[i].buf, dgram[i].len, &len, is_rtp);
+                n += (int)(((0 != off) ? len : dgram[i].len) / 188);
         }
-        if(obj->aim.es && ts->ES_len) {
-                show_es(obj);
+        if(0 == n) {
+                return;
         }
-        if(obj->aim.sec && ts->sect) {
-                show_sec(obj);
+        blk = (struct grp_blk *)ring_reserve(in, offsetof(struct grp_blk, TS) + (size_t)n * 188 +
+                                                 (size_t)cnt * sizeof(struct grp_lost));
+        if(NULL == blk) {
+                return;
         }
-        if(obj->aim.si && ts->sect) {
-                show_si(obj);
+        gettimeofday(&(blk->tv), NULL); /* record the arrive time */
+        blk->idx = gp->idx;
+        blk->cnt = n;
+        blk->lost_cnt = 0;
+        lost = GRP_LOST(blk);
+        for(n = 0, i = 0; i < cnt; i++) {
+                const uint8_t *buf = dgram[i].buf;
+
+                len = dgram[i].len;
+                off = rtp_payload(buf, len, &len, is_rtp);
+                if(0 != off) {
+                        gp->rtp_lost += rtp_count(&(url->rtp), buf, dgram[i].arrival);
+                        buf += off;
+                }
+                len = len / 188 * 188;
+                if(0 == len) {
+                        continue; /* its RTP lost goes with the next datagram */
+                }
+                if(0 != gp->rtp_lost) {
+                        /* with the first packet of this datagram */
+                        lost[blk->lost_cnt].pkt = n;
+                        lost[blk->lost_cnt].rtp_lost = gp->rtp_lost;
+                        blk->lost_cnt++;
+                        gp->rtp_lost = 0;
+                }
+                memcpy(blk->TS + (size_t)n * 188, buf, len);
+                n += (int)(len / 188);
         }
-        if(obj->aim.rate && ts->has_rate) {
-                show_rate(obj);
+        blk->has_rtp = (0 != url->rtp.cnt);
+        blk->rtp_jitter = RTP_JITTER_STC(&(url->rtp));
+        ring_commit(in);
+        return;
+}
+
+/* parse one packet of the group as main() does, return -1 for exit */
+static int parse_group(struct group *gp, const uint8_t *pkt, const struct timeval *tv)
+{
+        struct tsana_obj *obj = &(gp->obj);
+        struct ts_obj *ts = obj->ts;
+        struct ts_ipt *ipt = &(ts->ipt);
+
+        ipt->pTS = pkt;
+        ipt->ADDR = obj->addr;
+        obj->addr += 188;
+        if(0 != ts_parse_tsh(ts)) {
+                return -1;
         }
-        if(obj->aim.rats && ts->has_rate) {
-                show_rats(obj);
+        if(ts->cnt < obj->aim_start) {
+                return 0;
         }
-        if(obj->aim.ratp && ts->has_rate) {
-                show_ratp(obj);
+
+        obj->tv = *tv;
+        ts_parse_tsb(ts);
+        if(STATE_PARSE_PSI == obj->state) {
+                state_parse_psi(obj);
         }
-        if(obj->aim.err && has_err) {
-                if(0 != show_error(obj)) {
+        else if(STATE_PARSE_EACH == obj->state) {
+                if(0 != state_parse_each(obj)) {
                         return -1;
                 }
         }
+        if(STATE_EXIT == obj->state) {
+                return -1;
+        }
 
-        if(has_report) {
-                fprintf(stdout, "\n");
+        obj->cnt++;
+        if((0 != obj->aim_count) && (obj->cnt >= obj->aim_count)) {
+                return -1;
         }
         return 0;
 }
 
+/* parse the packets of its groups, report at once */
+static void *worker_thread(void *arg)
+{
+        struct worker *wk = (struct worker *)arg;
+        const struct grp_blk *blk;
+        const struct grp_lost *lost;
+        struct group *gp;
+        struct ts_ipt *ipt;
+        size_t len;
+        int i;
+        int j;
+
+        while(NULL != (blk = (const struct grp_blk *)ring_peek(wk->in, &len))) {
+                gp = wk->top->group + blk->idx;
+                ipt = &(gp->obj.ts->ipt);
+                ipt->has_rtp = blk->has_rtp;
+                ipt->RTP_jitter = blk->rtp_jitter;
+                lost = GRP_LOST(blk);
+                for(i = 0, j = 0; i < blk->cnt && !(gp->is_exit); i++) {
+                        ipt->RTP_lost = 0;
+                        if(j < blk->lost_cnt && i == lost[j].pkt) {
+                                ipt->RTP_lost = lost[j++].rtp_lost; /* the first packet of that datagram */
+                        }
+                        if(0 != parse_group(gp, blk->TS + (size_t)i * 188, &(blk->tv))) {
+                                __atomic_store_n(&(gp->is_exit), 1, __ATOMIC_RELAXED);
+                                __atomic_sub_fetch(&(wk->top->group_live), 1, __ATOMIC_RELAXED);
+                        }
+                }
+                ipt->pTS = NULL;
+                ring_release(wk->in);
+        }
+        fflush(stdout);
+        return NULL;
+}
+
 static struct tsana_obj *create(int argc, char *argv[])
 {
         int i;
@@ -586,9 +2779,43 @@ static struct tsana_obj *create(int argc, char *argv[])
         memset(&(obj->aim), 0, sizeof(struct aim));
 
         memset(&cfg, 1, sizeof(struct ts_cfg));
+        cfg.need_pes_pkt = 0; /* no PES reassembly */
         obj->is_impsi = 0;
         obj->is_dump = 0;
+        obj->is_bin = 0;
         obj->is_mem = 0;
+        obj->is_thread = 1;
+        obj->ring = NULL;
+        obj->evt = NULL;
+        obj->shard_cnt = 0;
+        obj->shard = NULL;
+        obj->dispatch = NULL;
+        obj->blk_rate = NULL;
+        obj->is_merge = 0;
+        obj->is_stop = 0;
+        obj->chunk_cnt = 0;
+        obj->chunk = NULL;
+        obj->chunk_end = INT64_MAX;
+        obj->is_warm = 0;
+        obj->spool = NULL;
+        obj->addr0 = 0;
+        obj->file_i = NULL;
+        obj->url = NULL;
+        obj->map = NULL;
+        obj->rtp_lost = 0;
+        obj->demux_dir = NULL;
+        obj->is_demux_pes = 0;
+        obj->demux = NULL;
+        obj->mkidx = -1;
+        obj->idx_file = NULL;
+        obj->seek_pos = NULL;
+        obj->is_seek = 0;
+        obj->group_cnt = 0;
+        obj->group = NULL;
+        obj->worker_cnt = WORKER_DEFAULT;
+        obj->worker = NULL;
+        obj->poll = (intptr_t)NULL;
+        obj->is_group = 0;
         obj->cnt = 0;
         obj->aim_start = 0;
         obj->aim_count = 0;
@@ -597,6 +2824,7 @@ static struct tsana_obj *create(int argc, char *argv[])
         obj->aim_prog = ANY_PROG;
         obj->aim_type = TYPE_ANY;
         obj->aim_interval = 1000 * STC_MS;
+        obj->is_rate_only = 0;
         obj->color_off = "";
         obj->color_gray = "";
         obj->color_red = "";
@@ -630,6 +2858,97 @@ static struct tsana_obj *create(int argc, char *argv[])
                         else if(0 == strcmp(argv[i], "-mem")) {
                                 obj->is_mem = 1;
                         }
+                        else if(0 == strcmp(argv[i], "-demux")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-demux'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                obj->demux_dir = argv[i];
+                                obj->mode = MODE_ALL;
+                        }
+                        else if(0 == strcmp(argv[i], "-mkidx")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-mkidx'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                sscanf(argv[i], "%i" , &dat);
+                                if(0 <= dat && dat <= 70000) {
+                                        obj->mkidx = dat;
+                                }
+                                else {
+                                        fprintf(stderr, "bad variable for '-mkidx': %d(0-70000), use 500 instead!\n", dat);
+                                        obj->mkidx = 500;
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-idx")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-idx'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                obj->idx_file = argv[i];
+                        }
+                        else if(0 == strcmp(argv[i], "-seek")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-seek'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                obj->seek_pos = argv[i];
+                        }
+                        else if(0 == strcmp(argv[i], "-nothread")) {
+                                obj->is_thread = 0;
+                        }
+                        else if(0 == strcmp(argv[i], "-shard")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-shard'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                sscanf(argv[i], "%i" , &dat);
+                                if(0 <= dat && dat <= SHARD_MAX) {
+                                        obj->shard_cnt = dat;
+                                }
+                                else {
+                                        fprintf(stderr,
+                                                "bad variable for '-shard': %d, ignore!\n",
+                                                dat);
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-chunk")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-chunk'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                sscanf(argv[i], "%i" , &dat);
+                                if(0 <= dat && dat <= CHUNK_MAX) {
+                                        obj->chunk_cnt = dat;
+                                }
+                                else {
+                                        fprintf(stderr,
+                                                "bad variable for '-chunk': %d, ignore!\n",
+                                                dat);
+                                }
+                        }
+                        else if(0 == strcmp(argv[i], "-worker")) {
+                                i++;
+                                if(i >= argc) {
+                                        fprintf(stderr, "no parameter for '-worker'!\n");
+                                        goto create_failed_with_obj;
+                                }
+                                sscanf(argv[i], "%i" , &dat);
+                                if(1 <= dat && dat <= WORKER_MAX) {
+                                        obj->worker_cnt = dat;
+                                }
+                                else {
+                                        fprintf(stderr,
+                                                "bad variable for '-worker': %d, ignore!\n",
+                                                dat);
+                                }
+                        }
                         else if(0 == strcmp(argv[i], "-time")) {
                                 obj->aim.time = 1;
                                 obj->mode = MODE_ALL;
@@ -862,12 +3181,55 @@ static struct tsana_obj *create(int argc, char *argv[])
                         }
                 }
                 else {
-                        fprintf(stderr, "Wrong parameter: %s\n", argv[i]);
+                        obj->file_i = argv[i];
+                        if(obj->group_cnt >= GROUP_MAX) {
+                                fprintf(stderr, "too many URL, at most %d!\n", GROUP_MAX);
+                                goto create_failed_with_obj;
+                        }
+                        obj->group_url[obj->group_cnt++] = argv[i];
+                }
+        }
+
+        /* -demux: -pes or -es(default) selects the data, not the text report */
+        if(obj->demux_dir) {
+                obj->is_demux_pes = obj->aim.pes;
+                obj->aim.pes = 0;
+                obj->aim.es = 0;
+                obj->demux = (struct demux **)calloc(0x2000, sizeof(struct demux *));
+                if(NULL == obj->demux) {
+                        RPTERR("malloc demux table failed");
+                        goto create_failed_with_obj;
+                }
+                if(0 != mkdir(obj->demux_dir, 0755) && EEXIST != errno) {
+                        fprintf(stderr, "can not make dir \"%s\"!\n", obj->demux_dir);
+                        goto create_failed_with_obj;
+                }
+        }
+
+        /* more than one URL: each is opened by its group */
+        if(obj->group_cnt > 1) {
+                if(MODE_ALL != obj->mode || obj->is_dump || obj->is_impsi || obj->demux_dir) {
+                        fprintf(stderr, "more than one URL is only for per-packet report, e.g. -err!\n");
                         goto create_failed_with_obj;
                 }
+                for(i = 0; i < obj->group_cnt; i++) {
+                        if(0 != strncmp(obj->group_url[i], "udp://", 6) &&
+                           0 != strncmp(obj->group_url[i], "rtp://", 6)) {
+                                fprintf(stderr, "more than one URL should be all udp:// or rtp://, not \"%s\"!\n",
+                                        obj->group_url[i]);
+                                goto create_failed_with_obj;
+                        }
+                }
+                if(obj->shard_cnt > 1 || obj->chunk_cnt > 1) {
+                        RPTWRN("-shard and -chunk can not be used for more than one URL, ignore");
+                        obj->shard_cnt = 0;
+                        obj->chunk_cnt = 0;
+                }
+                obj->file_i = NULL;
         }
 
         /* create & init buddy module */
+        obj->mp_order = mp_order;
         mp = buddy_create(mp_order, 6); /* borrow a big memory from OS */
         if(0 == mp) {
                 RPTERR("malloc memory pool failed");
@@ -888,17 +3250,74 @@ static struct tsana_obj *create(int argc, char *argv[])
 
         /* create & init ts module */
         obj->ts = ts_create(mp);
+        obj->ts_own = obj->ts;
         if(0 == obj->ts) {
                 RPTERR("malloc ts object failed");
                 goto create_failed_with_mp;
         }
         ts_ioctl(obj->ts, TS_INIT, 0);
+        if(MODE_ALL == obj->mode && !(obj->is_dump)) {
+                /* skip the parse stages no report needs */
+                if(!(obj->aim.pts || obj->aim.pesh || obj->aim.pes ||
+                     obj->aim.es || obj->aim.err || obj->demux_dir)) {
+                        cfg.need_pes = 0;
+                }
+                if(!(obj->aim.err || obj->is_demux_pes)) {
+                        cfg.need_cc = 0; /* -demux -pes drops PES with CC lost */
+                }
+                if(!(obj->aim.stc || obj->aim.pcr || obj->aim.pts || obj->aim.tsh ||
+                     obj->aim.ts || obj->aim.af || obj->aim.pesh || obj->aim.pes ||
+                     obj->aim.es || obj->aim.sec || obj->aim.si || obj->aim.err ||
+                     obj->demux_dir)) {
+                        obj->is_rate_only = 1; /* see rate_role() */
+                }
+        }
+        cfg.need_pes_pkt = obj->is_demux_pes; /* whole PES for -demux -pes */
         ts_ioctl(obj->ts, TS_SCFG, &cfg);
+        if(obj->is_demux_pes) {
+                ts_pes_callback(obj->ts, demux_pes, obj);
+        }
+
+        if((obj->mkidx >= 0 || obj->seek_pos) && (!(obj->file_i) || obj->group_cnt > 1)) {
+                fprintf(stderr, "-mkidx and -seek are only for one TS file!\n");
+                goto create_failed_with_ts;
+        }
+        if(obj->file_i) {
+                if(0 != open_url(obj)) {
+                        goto create_failed_with_ts;
+                }
+                if(obj->seek_pos && obj->mkidx < 0 && 0 != seek_idx(obj)) {
+                        url_close(obj->url);
+                        goto create_failed_with_ts;
+                }
+                if(0 != obj->aim_start && obj->mkidx < 0 && !URL_IS_UDP(obj->url) &&
+                   0 != skip_start(obj)) {
+                        url_close(obj->url);
+                        goto create_failed_with_ts;
+                }
+                return obj;
+        }
+        if(obj->group_cnt > 1) {
+                return obj;
+        }
+
+        /* binary record or text line, judged by the first byte */
+        rec_binmode(stdin); /* before the peek, text line parse ignores '\r' */
+        obj->is_bin = rec_is_bin(stdin);
+        if(obj->is_bin) {
+                rec_binmode(stdout); /* for -dump */
+                obj->rec.TS = obj->ts->ipt.TS;
+                obj->rec.RS = obj->ts->ipt.RS;
+                obj->rec.DATA = NULL;
+        }
         return obj;
 
+create_failed_with_ts:
+        ts_destroy(obj->ts);
 create_failed_with_mp:
         buddy_destroy(mp); /* return the memory to OS */
 create_failed_with_obj:
+        free(obj->demux);
         free(obj);
         return NULL;
 }
@@ -909,6 +3328,13 @@ static int destroy(struct tsana_obj *obj)
                 return 0;
         }
 
+        stop_report(obj);
+        demux_close(obj);
+
+        if(obj->url) {
+                url_close(obj->url);
+        }
+
         buddy_status(mp, obj->is_mem, "before ts destroy");
         ts_destroy(obj->ts);
         buddy_status(mp, obj->is_mem, "after ts destroy");
@@ -959,8 +3385,10 @@ static void show_help()
 {
         fprintf(stdout,
                 "'tsana' get TS packet from stdin, analyse, then send the result to stdout.\n"
+                "stdin can be text line or binary record(\"catts -b\"), judged automatically.\n"
+                "TS file or URL can be read directly without catts or catip.\n"
                 "\n"
-                "Usage: tsana [OPTION]...\n"
+                "Usage: tsana [OPTION]... [file|URL|udp://... rtp://...]\n"
                 "\n"
                 "Options:\n"
                 " -lst             show PID list information, default option\n"
@@ -970,8 +3398,21 @@ static void show_help()
                 " -expsi           export PSI information into psi.xml\n"
                 " -impsi           import PSI information from psi.xml before analyse\n"
 #endif
-                " -dump            dump cared packet\n"
+                " -dump            dump cared packet, in the same format as stdin\n"
                 " -mem             show memory status\n"
+                " -nothread        format report in parse thread, default: another thread\n"
+                " -demux <dir>     write ES(-es, default) or whole PES packet(-pes) of each cared PID\n"
+                "                  into dir/0xXXXX.es or dir/0xXXXX.pes, instead of text line;\n"
+                "                  PES broken by CC lost or unfinished at the end is dropped\n"
+                " -mkidx <ms>      make random-access index of file into file.idx(or -idx) then exit,\n"
+                "                  PCR and PTS entry every ms(0-70,000), each random access point\n"
+                " -idx <file>      index file of -mkidx and -seek, default: file.idx\n"
+                " -seek <pos>      analyse from pos by index: second from the first PCR(e.g. 12.5),\n"
+                "                  \"pcr:PCR\" or \"pkt:x\"; second and PCR seek back to random access point\n"
+                " -shard <n>       parse in n-thread(2-%d) by program, each reports its PIDs\n"
+                " -chunk <n>       parse file in n-thread(2-%d) by part, the same report as one thread\n"
+                " -worker <n>      parse more than one udp:// URL in n-thread(1-%d), default: %d,\n"
+                "                  each URL has its own report, begin with \"*url, URL, \"\n"
                 "\n"
                 " -time            \"*time, YYYY-mm-dd HH:MM:SS, second, usecond, delta_time(ms), \"\n"
                 " -addr            \"*addr, address(hex), address(dec), PID, \"\n"
@@ -994,22 +3435,35 @@ static void show_help()
                 " -err             \"*err, TR-101-290, datail, \"\n"
                 "\n"
                 " -c -color        enable colour effect to help read, default: mono\n"
-                " -start <x>       analyse from packet(x), default: 0, first packet\n"
+                " -start <x>       analyse from packet(x), default: 0, first packet; file is seeked\n"
+                "                  to it directly, with PAT and PMT read from the head\n"
                 " -count <n>       analyse n-packet then stop, default: 0, no stop\n"
                 " -pid <pid>       set cared PID, default: any PID(0x2000)\n"
                 " -table <id>      set cared table, default: any table(0xFF)\n"
                 " -prog <prog>     set cared prog, default: any program(0x0000)\n"
                 " -type <type>     set cared PID type, default: any type(0)\n"
                 " -iv <iv>         set cared interval(1ms-70,000ms), default: 1000ms\n"
-                " -mp <mp>         set memory pool size order(16-%zd), default: %zd, means 2^%zd bytes\n"
+                " -mp <mp>         set memory arena size order(16-%zd), default: %zd, means 2^%zd bytes,\n"
+                "                  the memory pool grows arena by arena\n"
                 "\n"
                 " -h, --help       display this information\n"
                 " -v, --version    display my version\n"
                 "\n"
                 "Examples:\n"
                 "  \"catts xxx.ts | tsana -c -time -addr -pcr -pts\" -- report all PCR/PTS/DTS information\n"
+                "  \"catts -b xxx.ts | tsana -rate\" -- binary record, much faster than text line\n"
+                "  \"tsana -err xxx.ts\" -- read TS, TSRS or MTS file directly\n"
+                "  \"tsana -err udp://224.165.54.31:1234\" -- receive TS over IP directly\n"
+                "  \"tsana -err rtp://224.165.54.31:1234\" -- TS over RTP, with RTP loss and jitter\n"
+                "  \"tsana -shard 4 -err xxx.ts\" -- many programs, parse in 4-thread\n"
+                "  \"tsana -chunk 4 -err xxx.ts\" -- big file, parse 4 parts at the same time\n"
+                "  \"tsana -err udp://239.1.1.1:1234 udp://239.1.1.2:1234\" -- monitor some groups\n"
+                "  \"tsana -demux out -prog 1 xxx.ts\" -- ES of each PID in program 1, in one pass\n"
+                "  \"tsana -mkidx 500 xxx.ts\" -- make index xxx.ts.idx, for -seek of tsana and catts\n"
+                "  \"tsana -seek 600 -count 10000 -pcr xxx.ts\" -- PCR from the 10th minute, by index\n"
                 "\n"
                 "Report bugs to <zhoucheng@tsinghua.org.cn>.\n",
+                SHARD_MAX, CHUNK_MAX, WORKER_MAX, WORKER_DEFAULT,
                 BUDDY_ORDER_MAX, MP_ORDER_DEFAULT, MP_ORDER_DEFAULT);
         return;
 }
@@ -1039,11 +3493,43 @@ static int get_one_pkt(struct tsana_obj *obj)
         struct ts_ipt *ipt = &(ts->ipt);
         long long int data;
 
+        if(obj->url) {
+                return get_url_pkt(obj);
+        }
+
+        if(obj->is_bin) {
+                struct rec *rec = &(obj->rec);
+
+                switch(rec_read(stdin, rec, 0)) {
+                        case REC_OK:
+                                break;
+                        case REC_EOF:
+                                return GOT_EOF;
+                        default:
+                                RPTERR("bad binary record");
+                                return GOT_WRONG_PKT;
+                }
+                ipt->has_ts = ((rec->flag & REC_TS) ? 1 : 0);
+                ipt->has_rs = ((rec->flag & REC_RS) ? 1 : 0);
+                ipt->has_addr = ((rec->flag & REC_ADDR) ? 1 : 0);
+                ipt->has_mts = ((rec->flag & REC_MTS) ? 1 : 0);
+                ipt->has_cts = ((rec->flag & REC_CTS) ? 1 : 0);
+                ipt->ADDR = rec->ADDR;
+                ipt->MTS = rec->MTS;
+                ipt->CTS = rec->CTS;
+                return GOT_RIGHT_PKT;
+        }
+
         if(NULL == fgets(obj->tbuf, PKT_TBUF, stdin)) {
                 return GOT_EOF;
         }
 
         strcpy(obj->tbak, obj->tbuf); /* for dump */
+        pt = strstr(obj->tbak, "\r\n"); /* stdin is in binary mode */
+        if(pt) {
+                strcpy(pt, "\n");
+        }
+        pt = (char *)(obj->tbuf);
 
         ipt->has_ts = 0;
         ipt->has_rs = 0;
@@ -1082,6 +3568,117 @@ static int get_one_pkt(struct tsana_obj *obj)
         return GOT_RIGHT_PKT;
 }
 
+static int open_url(struct tsana_obj *obj)
+{
+        obj->url = url_open(obj->file_i, "rb");
+        if(NULL == obj->url) {
+                RPTERR("open \"%s\" failed", obj->file_i);
+                return -1;
+        }
+
+        obj->addr = 0;
+        if(URL_IS_UDP(obj->url)) {
+                obj->type = FILE_TS; /* 7 x 188-byte in each UDP packet */
+                obj->npline = 188;
+                return 0;
+        }
+
+        obj->type = judge_type(obj->url->fd, &(obj->addr), &(obj->npline));
+        if(FILE_TS != obj->type && FILE_MTS != obj->type && FILE_TSRS != obj->type) {
+                RPTERR("\"%s\" is not TS file", obj->file_i);
+                url_close(obj->url);
+                obj->url = NULL;
+                return -1;
+        }
+
+        /* parse TS packet in the map, without copy */
+        obj->addr0 = obj->addr;
+        obj->map = url_map(obj->url, &(obj->map_size));
+        return 0;
+}
+
+/* read TS packet into ipt->TS, or point ipt->pTS to the map or UDP receive ring, without text line */
+static int get_url_pkt(struct tsana_obj *obj)
+{
+        struct ts_ipt *ipt = &(obj->ts->ipt);
+        struct url *url = obj->url;
+        const uint8_t *ts; /* TS data */
+        const uint8_t *mts; /* MTS of FILE_MTS */
+        uint8_t mbuf[4];
+
+        while(1) {
+                if(obj->map) {
+                        const uint8_t *p = obj->map + obj->addr;
+
+                        if(obj->addr + obj->npline > obj->map_size) {
+                                return GOT_EOF;
+                        }
+                        mts = p;
+                        p += ((FILE_MTS == obj->type) ? 4 : 0);
+                        ts = p;
+                        if(FILE_TSRS == obj->type) {
+                                memcpy(ipt->RS, p + 188, 16);
+                        }
+                        ipt->pTS = ts;
+                }
+                else if(URL_IS_UDP(url)) {
+                        /* datagrams are received in batch, kept until next get_url_pkt() */
+                        if(1 != url_pkts(url, &ts, 188, 1)) {
+                                return GOT_EOF;
+                        }
+                        mts = mbuf;
+                        ipt->pTS = ts;
+
+                        /* RTP loss of the new datagram goes with its first packet */
+                        ipt->RTP_lost = (uint32_t)(url->rtp.lost - obj->rtp_lost);
+                        ipt->RTP_jitter = RTP_JITTER_STC(&(url->rtp));
+                        obj->rtp_lost = url->rtp.lost;
+                }
+                else {
+                        if(FILE_MTS == obj->type && 1 != url_read(mbuf, 4, 1, url)) {
+                                return GOT_EOF;
+                        }
+                        if(1 != url_read(ipt->TS, 188, 1, url)) {
+                                return GOT_EOF;
+                        }
+                        if(FILE_TSRS == obj->type && 1 != url_read(ipt->RS, 16, 1, url)) {
+                                return GOT_EOF;
+                        }
+                        mts = mbuf;
+                        ts = ipt->TS;
+                        ipt->pTS = NULL;
+                }
+                if(0x47 == ts[0] || URL_IS_UDP(url)) {
+                        break;
+                }
+
+                /* lost sync, judge type again like catts */
+                obj->addr -= ((obj->addr >= (int64_t)obj->npline) ? obj->npline : 0);
+                if(obj->map) {
+                        obj->type = judge_type_mem(obj->map, obj->map_size, &(obj->addr), &(obj->npline));
+                }
+                else {
+                        obj->type = judge_type(url->fd, &(obj->addr), &(obj->npline));
+                }
+                if(FILE_TS != obj->type && FILE_MTS != obj->type && FILE_TSRS != obj->type) {
+                        return GOT_EOF;
+                }
+        }
+
+        ipt->has_ts = 1;
+        ipt->has_rs = ((FILE_TSRS == obj->type) ? 1 : 0);
+        ipt->has_addr = 1;
+        ipt->has_mts = ((FILE_MTS == obj->type) ? 1 : 0);
+        ipt->has_cts = 0;
+        ipt->has_rtp = (URL_IS_UDP(url) && 0 != url->rtp.cnt);
+        ipt->ADDR = obj->addr;
+        if(FILE_MTS == obj->type) {
+                ipt->MTS = ((int64_t)mts[0] << 24) | (mts[1] << 16) | (mts[2] << 8) | mts[3];
+        }
+        obj->addr += obj->npline;
+        return GOT_RIGHT_PKT;
+}
+
 static const struct pid_type_table *ts_pid_type(int type)
 {
         const struct pid_type_table *p;
@@ -1216,6 +3813,29 @@ static void show_pkt(struct tsana_obj *obj)
         if(ANY_PID != obj->aim_pid && ts->PID != obj->aim_pid) {
                 return;
         }
+        if(obj->is_bin) {
+                rec_write(stdout, &(obj->rec)); /* the same format as stdin */
+                return;
+        }
+        if(obj->url) {
+                struct ts_ipt *ipt = &(ts->ipt);
+                char tbuf[PKT_TBUF];
+
+                fprintf(stdout, "*ts, ");
+                b2t(tbuf, ts->TS, 188);
+                fprintf(stdout, "%s", tbuf);
+                if(ipt->has_rs) {
+                        fprintf(stdout, "*rs, ");
+                        b2t(tbuf, ipt->RS, 16);
+                        fprintf(stdout, "%s", tbuf);
+                }
+                fprintf(stdout, "*addr, %"PRIX64", ", ipt->ADDR);
+                if(ipt->has_mts) {
+                        fprintf(stdout, "*mts, %"PRIX64", ", ipt->MTS);
+                }
+                fprintf(stdout, "\n");
+                return;
+        }
         fprintf(stdout, "%s", obj->tbak);
 }
 
@@ -1353,7 +3973,7 @@ static void show_psi(struct tsana_obj *obj)
         return;
 }
 
-static void show_time(struct tsana_obj *obj)
+static void show_time(struct tsana_obj *obj, const struct evt *evt)
 {
         struct tm *lt; /* local time */
         char str_hms[32]; /* "2013-05-19 12:38:00" */
@@ -1361,67 +3981,59 @@ static void show_time(struct tsana_obj *obj)
 
         if(!timerisset(&(obj->ltv))) {
                 /* init last arrive time */
-                obj->ltv.tv_sec = obj->tv.tv_sec;
-                obj->ltv.tv_usec = obj->tv.tv_usec;
+                obj->ltv.tv_sec = evt->tv.tv_sec;
+                obj->ltv.tv_usec = evt->tv.tv_usec;
         }
-        timersub(&(obj->tv), &(obj->ltv), &dtv); /* calc delta arrive time */
-        obj->ltv.tv_sec = obj->tv.tv_sec;
-        obj->ltv.tv_usec = obj->tv.tv_usec;
+        timersub(&(evt->tv), &(obj->ltv), &dtv); /* calc delta arrive time */
+        obj->ltv.tv_sec = evt->tv.tv_sec;
+        obj->ltv.tv_usec = evt->tv.tv_usec;
 
-        lt = localtime(&(obj->tv.tv_sec));
+        lt = localtime(&(evt->tv.tv_sec));
         strftime(str_hms, 32, "%Y-%m-%d %H:%M:%S", lt);
 
         fprintf(stdout,
                 "%s*time%s, %s%s%s, %ld, %06ld, %.6f, ",
                 obj->color_green, obj->color_off,
-                obj->color_yellow, str_hms, obj->color_off, obj->tv.tv_sec, obj->tv.tv_usec,
+                obj->color_yellow, str_hms, obj->color_off, evt->tv.tv_sec, evt->tv.tv_usec,
                 dtv.tv_sec * 1000.0 + dtv.tv_usec / 1000.0);
         return;
 }
 
-static void show_addr(struct tsana_obj *obj)
+static void show_addr(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
         fprintf(stdout,
                 "%s*addr%s, %s0x%"PRIX64"%s, %"PRId64", %s0x%04X%s, ",
                 obj->color_green, obj->color_off,
-                obj->color_yellow, ts->ADDR, obj->color_off, ts->ADDR,
-                obj->color_yellow, ts->PID, obj->color_off);
+                obj->color_yellow, evt->ADDR, obj->color_off, evt->ADDR,
+                obj->color_yellow, evt->PID, obj->color_off);
         return;
 }
 
-static void show_cts(struct tsana_obj *obj)
+static void show_cts(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
         fprintf(stdout,
                 "%s*cts%s, %13"PRIu64", %10"PRIu64", ",
-                obj->color_green, obj->color_off, ts->CTS, ts->CTS_base);
+                obj->color_green, obj->color_off, evt->CTS, evt->CTS_base);
         return;
 }
 
-static void show_stc(struct tsana_obj *obj)
+static void show_stc(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
         fprintf(stdout,
                 "%s*stc%s, %13"PRIu64", %10"PRIu64", ",
-                obj->color_green, obj->color_off, ts->STC, ts->STC_base);
+                obj->color_green, obj->color_off, evt->STC, evt->STC_base);
         return;
 }
 
-static void show_pcr(struct tsana_obj *obj)
+static void show_pcr(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
-        if(ts->has_pcr) {
+        if(evt->has_pcr) {
                 fprintf(stdout, "%s*pcr%s, %13"PRIu64", %10"PRIu64", %3d, %+7.3f, %+7.3f, %+4.0f, ",
                         obj->color_green, obj->color_off,
-                        ts->PCR, ts->PCR_base, ts->PCR_ext,
-                        (double)(ts->PCR_repetition) / STC_MS,
-                        (double)(ts->PCR_continuity) / STC_MS,
-                        (double)(ts->PCR_jitter) * 1e3 / STC_US);
+                        evt->PCR, evt->PCR_base, evt->PCR_ext,
+                        (double)(evt->PCR_repetition) / STC_MS,
+                        (double)(evt->PCR_continuity) / STC_MS,
+                        (double)(evt->PCR_jitter) * 1e3 / STC_US);
         }
         else {
                 fprintf(stdout, "%s*pcr%s,              ,           ,    ,        ,        ,     , ",
@@ -1430,22 +4042,20 @@ static void show_pcr(struct tsana_obj *obj)
         return;
 }
 
-static void show_pts(struct tsana_obj *obj)
+static void show_pts(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
-        if(ts->has_pts) {
+        if(evt->has_pts) {
                 fprintf(stdout, "%s*pts%s, %10"PRIu64", %+8.3f, %+8.3f, ",
                         obj->color_green, obj->color_off,
-                        ts->PTS,
-                        (double)(ts->PTS_continuity) / (90), /* ms */
-                        (double)(ts->PTS_minus_STC) / (90)); /* ms */
+                        evt->PTS,
+                        (double)(evt->PTS_continuity) / (90), /* ms */
+                        (double)(evt->PTS_minus_STC) / (90)); /* ms */
 
                 fprintf(stdout, "%s*dts%s, %10"PRIu64", %+8.3f, %+8.3f, ",
                         obj->color_green, obj->color_off,
-                        ts->DTS,
-                        (double)(ts->DTS_continuity) / (90), /* ms */
-                        (double)(ts->DTS_minus_STC) / (90)); /* ms */
+                        evt->DTS,
+                        (double)(evt->DTS_continuity) / (90), /* ms */
+                        (double)(evt->DTS_minus_STC) / (90)); /* ms */
         }
         else {
                 fprintf(stdout, "%s*pts%s,           ,         ,         , ",
@@ -1456,98 +4066,89 @@ static void show_pts(struct tsana_obj *obj)
         return;
 }
 
-static void show_tsh(struct tsana_obj *obj)
+static void show_tsh(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 4 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*tsh%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->ipt.TS, 4);
+        b2t(str, evt->TS, 4);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_ts(struct tsana_obj *obj)
+static void show_ts(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 188 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*ts%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->ipt.TS, 188);
+        b2t(str, evt->TS, 188);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_mts(struct tsana_obj *obj)
+static void show_mts(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
         fprintf(stdout, "%s*mts%s, %" PRIX64 ", ",
                 obj->color_green, obj->color_off,
-                ts->CTS & 0x3FFFFFFF);
+                evt->CTS & 0x3FFFFFFF);
         return;
 }
 
-static void show_af(struct tsana_obj *obj)
+static void show_af(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 188 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*af%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->AF, ts->AF_len);
+        b2t(str, evt->TS + evt->AF_off, evt->AF_len);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_pesh(struct tsana_obj *obj)
+static void show_pesh(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 188 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*pesh%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->PES, ts->PES_len - ts->ES_len);
+        b2t(str, evt->TS + evt->PES_off, evt->PES_len - evt->ES_len);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_pes(struct tsana_obj *obj)
+static void show_pes(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 188 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*pes%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->PES, ts->PES_len);
+        b2t(str, evt->TS + evt->PES_off, evt->PES_len);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_es(struct tsana_obj *obj)
+static void show_es(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 188 + 3]; /* part of one TS packet */
 
         fprintf(stdout, "%s*es%s, ",
                 obj->color_green, obj->color_off);
-        b2t(str, ts->ES, ts->ES_len);
+        b2t(str, evt->TS + evt->ES_off, evt->ES_len);
         fprintf(stdout, "%s", str);
         return;
 }
 
-static void show_sec(struct tsana_obj *obj)
+static void show_sec(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 4096 + 3];
-        struct ts_sect *sect = ts->sect;
+        const struct ts_sect *sect = &(evt->sect);
 
         /* section_interval */
         fprintf(stdout, "%s*sec%s, %+9.3f, ",
                 obj->color_green, obj->color_off,
-                (double)(ts->sect_interval) / STC_MS);
+                (double)(evt->sect_interval) / STC_MS);
 
         /* section_head */
         b2t(str, sect->section, 8);
@@ -1560,17 +4161,16 @@ static void show_sec(struct tsana_obj *obj)
         return;
 }
 
-static void show_si(struct tsana_obj *obj)
+static void show_si(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
         char str[3 * 8 + 3];
         int is_unknown_table_id = 0;
-        struct ts_sect *sect = ts->sect;
+        struct ts_sect *sect = (struct ts_sect *)&(evt->sect); /* table_info_xxx() only read it */
 
         /* section_interval */
         fprintf(stdout, "%s*si%s, %+9.3f, ",
                 obj->color_green, obj->color_off,
-                (double)(ts->sect_interval) / STC_MS);
+                (double)(evt->sect_interval) / STC_MS);
 
         /* section_head */
         b2t(str, sect->section, 8);
@@ -1671,105 +4271,58 @@ static void show_si(struct tsana_obj *obj)
         return;
 }
 
-static void show_rate(struct tsana_obj *obj)
+static void show_rate(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-        struct znode *znode;
+        const struct evt_rate *rate = evt->rate;
+        int i;
 
         fprintf(stdout, "%s*rate%s, %.3f, ",
                 obj->color_green, obj->color_off,
-                ts->last_interval / 27000.0);
-        for(znode = (struct znode *)(ts->pid0); znode; znode = znode->next) {
-                struct ts_pid *pid = (struct ts_pid *)znode;
-
-                /* filter: user PID only */
-                if(pid->PID < 0x0020 || 0x1FFF == pid->PID) {
-                        /* not program */
-                        continue;
-                }
-
-                /* filter: PID */
-                if(ANY_PID != obj->aim_pid && pid->PID != obj->aim_pid) {
-                        /* not cared PID */
-                        continue;
-                }
-
-                /* filter: program_number */
-                if(ANY_PROG != obj->aim_prog) {
-                        if(!(pid->prog)) {
-                                /* not program */
-                                continue;
-                        }
-                        else if(pid->prog->program_number != obj->aim_prog) {
-                                /* not cared program */
-                                continue;
-                        }
-                }
-
-                /* filter: type: video or audio */
-                if(TYPE_ANY != obj->aim_type) {
-                        if(TYPE_VIDEO == obj->aim_type && !IS_TYPE(TS_TYPE_VID, pid->type)) {
-                                /* not video PID */
-                                continue;
-                        }
-                        if(TYPE_AUDIO == obj->aim_type && !IS_TYPE(TS_TYPE_AUD, pid->type)) {
-                                /* not audio PID */
-                                continue;
-                        }
-                }
-
+                evt->last_interval / 27000.0);
+        for(i = 0; i < evt->rate_cnt; i++, rate++) {
+                /* filtered in evt_make() */
                 fprintf(stdout, "%s0x%04X%s, %9.6f, ",
-                        obj->color_yellow, pid->PID, obj->color_off,
-                        pid->lcnt * 188.0 * 8 * 27 / (ts->last_interval));
+                        obj->color_yellow, rate->PID, obj->color_off,
+                        rate->lcnt * 188.0 * 8 * 27 / (evt->last_interval));
         }
         return;
 }
 
-static void show_rats(struct tsana_obj *obj)
+static void show_rats(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-
         fprintf(stdout, "%s*rats%s, %.3f, ",
                 obj->color_green, obj->color_off,
-                ts->last_interval / 27000.0);
+                evt->last_interval / 27000.0);
         fprintf(stdout, "%ssys%s, %9.6f, %spsi-si%s, %9.6f, %s0x1FFF%s, %9.6f, ",
-                obj->color_yellow, obj->color_off, ts->last_sys_cnt * 188.0 * 8 * 27 / (ts->last_interval),
-                obj->color_yellow, obj->color_off, ts->last_psi_cnt * 188.0 * 8 * 27 / (ts->last_interval),
-                obj->color_yellow, obj->color_off, ts->last_nul_cnt * 188.0 * 8 * 27 / (ts->last_interval));
+                obj->color_yellow, obj->color_off, evt->last_sys_cnt * 188.0 * 8 * 27 / (evt->last_interval),
+                obj->color_yellow, obj->color_off, evt->last_psi_cnt * 188.0 * 8 * 27 / (evt->last_interval),
+                obj->color_yellow, obj->color_off, evt->last_nul_cnt * 188.0 * 8 * 27 / (evt->last_interval));
         return;
 }
 
-static void show_ratp(struct tsana_obj *obj)
+static void show_ratp(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-        struct znode *znode;
+        const struct evt_rate *rate = evt->rate + evt->rate_cnt;
+        int i;
 
         fprintf(stdout, "%s*ratp%s, %.3f, ",
                 obj->color_green, obj->color_off,
-                ts->last_interval / 27000.0);
+                evt->last_interval / 27000.0);
         fprintf(stdout, "%spsi-si%s, %9.6f, ",
-                obj->color_yellow, obj->color_off, ts->last_psi_cnt * 188.0 * 8 * 27 / (ts->last_interval));
-
-        for(znode = (struct znode *)(ts->pid0); znode; znode = znode->next) {
-                struct ts_pid *pid_item = (struct ts_pid *)znode;
-
-                if(pid_item->PID >= 0x0020 && pid_item->PID != pid_item->prog->PMT_PID) {
-                        /* not psi/si PID */
-                        continue;
-                }
+                obj->color_yellow, obj->color_off, evt->last_psi_cnt * 188.0 * 8 * 27 / (evt->last_interval));
 
+        for(i = 0; i < evt->ratp_cnt; i++, rate++) {
                 /* without PMT */
                 fprintf(stdout, "%s0x%04X%s, %9.6f, ",
-                        obj->color_yellow, pid_item->PID, obj->color_off,
-                        pid_item->lcnt * 188.0 * 8 * 27 / (ts->last_interval));
+                        obj->color_yellow, rate->PID, obj->color_off,
+                        rate->lcnt * 188.0 * 8 * 27 / (evt->last_interval));
         }
         return;
 }
 
-static int show_error(struct tsana_obj *obj)
+static void show_error(struct tsana_obj *obj, const struct evt *evt)
 {
-        struct ts_obj *ts = obj->ts;
-        struct ts_err *err = &(ts->err);
+        const struct ts_err *err = &(evt->err);
 
         fprintf(stdout, "%s*err%s, ",
                 obj->color_green, obj->color_off);
@@ -1779,9 +4332,8 @@ static int show_error(struct tsana_obj *obj)
                 fprintf(stdout, "1.1, TS_sync_loss, ");
                 if(err->Sync_byte_error > 10) {
                         fprintf(stdout, "\nToo many continual Sync_byte_error packet, EXIT!\n");
-                        return -1;
                 }
-                return 0;
+                return;
         }
         if(err->Sync_byte_error == 1) {
                 fprintf(stdout, "1.2 , Sync_byte, ");
@@ -1796,56 +4348,58 @@ static int show_error(struct tsana_obj *obj)
                 if((1<<2) & err->PAT_error) {
                         fprintf(stdout, "1.3c, PAT(transport_scrambling_field != 0x00), ");
                 }
-                err->PAT_error = 0;
         }
         if(err->Continuity_count_error) {
                 fprintf(stdout, "1.4 , CC(%X-%X=%2u), ",
-                        ts->CC_find, ts->CC_wait, ts->CC_lost);
+                        evt->CC_find, evt->CC_wait, evt->CC_lost);
+        }
+        if(err->RTP_error) {
+                /* network loss, the CC error of the same packet comes from it, not from mux */
+                if(ERR_RTP_0 & err->RTP_error) {
+                        fprintf(stdout, "net , RTP_sequence(%u lost), ",
+                                (unsigned int)(evt->RTP_lost));
+                }
+                if(ERR_RTP_1 & err->RTP_error) {
+                        fprintf(stdout, "net , RTP_jitter(%7.3f ms > %d ms), ",
+                                (double)(evt->RTP_jitter) / STC_MS, (int)(TS_RTP_JITTER_MAX / STC_MS));
+                }
         }
         if(err->PMT_error) {
                 if((1<<0) & err->PMT_error) {
                         fprintf(stdout, "1.5a, PMT section_interval(%+7.3f ms): (0, 500)ms, ",
-                                (double)(ts->sect_interval) / STC_MS);
+                                (double)(evt->sect_interval) / STC_MS);
                 }
                 if((1<<1) & err->PMT_error) {
                         fprintf(stdout, "1.5b, PMT(transport_scrambling_field != 0x00), ");
                 }
-                err->PMT_error = 0;
         }
         if(err->PID_error) {
                 fprintf(stdout, "1.6 , PID, ");
-                err->PID_error = 0;
         }
 
         /* Second priority: recommended for continuous or periodic monitoring */
         if(err->Transport_error) {
                 fprintf(stdout, "2.1 , Transport, ");
-                err->Transport_error = 0;
         }
         if(err->CRC_error) {
                 fprintf(stdout, "2.2 , CRC(0x%08X! 0x%08X?), ",
-                        ts->CRC_32_calc, ts->CRC_32);
-                err->CRC_error = 0;
+                        evt->CRC_32_calc, evt->CRC_32);
         }
         if(err->PCR_repetition_error) {
                 fprintf(stdout, "2.3a, PCR_repetition(%+7.3f ms), ",
-                        (double)(ts->PCR_repetition) / STC_MS);
-                err->PCR_repetition_error = 0;
+                        (double)(evt->PCR_repetition) / STC_MS);
         }
         if(err->PCR_discontinuity_indicator_error) {
                 fprintf(stdout, "2.3b, PCR_discontinuity_indicator(%+7.3f ms), ",
-                        (double)(ts->PCR_continuity) / STC_MS);
-                err->PCR_discontinuity_indicator_error = 0;
+                        (double)(evt->PCR_continuity) / STC_MS);
         }
         if(err->PCR_accuracy_error) {
                 fprintf(stdout, "2.4 , PCR_accuracy(%+4.0f ns), ",
-                        (double)(ts->PCR_jitter) * 1e3 / STC_US);
-                err->PCR_accuracy_error = 0;
+                        (double)(evt->PCR_jitter) * 1e3 / STC_US);
         }
         if(err->PTS_error) {
                 fprintf(stdout, "2.5 , PTS_repetition(%+7.3f ms > 700ms), ",
-                        (double)(ts->PTS_repetition) / STC_MS);
-                err->PTS_error = 0;
+                        (double)(evt->PTS_repetition) / STC_MS);
         }
         if(err->CAT_error) {
                 if((1<<0) & err->CAT_error) {
@@ -1854,12 +4408,33 @@ static int show_error(struct tsana_obj *obj)
                 if((1<<1) & err->CAT_error) {
                         fprintf(stdout, "2.6 , CAT(table_id error in PID 0x0001), ");
                 }
-                err->CAT_error = 0;
         }
 
         /* Third priority: application dependant monitoring */
         /* ... */
 
+        return;
+}
+
+/* clear the error shown by show_error(), return -1 to exit */
+static int clear_error(struct tsana_obj *obj)
+{
+        struct ts_err *err = &(obj->ts->err);
+
+        if(err->TS_sync_loss) {
+                return (err->Sync_byte_error > 10) ? -1 : 0;
+        }
+
+        err->PAT_error = 0;
+        err->PMT_error = 0;
+        err->PID_error = 0;
+        err->Transport_error = 0;
+        err->CRC_error = 0;
+        err->PCR_repetition_error = 0;
+        err->PCR_discontinuity_indicator_error = 0;
+        err->PCR_accuracy_error = 0;
+        err->PTS_error = 0;
+        err->CAT_error = 0;
         return 0;
 }
 